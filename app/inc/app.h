@@ -30,6 +30,16 @@ extern "C" {
 
 #include "uni_channel.h"
 
+typedef struct {
+  int64_t user_us;
+  int64_t sys_us;
+  long    voluntary_cs;    //主动让出CPU次数（阻塞等待）
+  long    involuntary_cs;  //被抢占次数
+  long    max_rss_kb;
+  long    rss_kb;
+  long    threads;
+} SdkUsage;
+
 /**
  * @brief unisound app初始化函数
  * @param cmd_callback 蜂鸟控制命令回调IoT设备hook
@@ -37,6 +47,28 @@ extern "C" {
  */
 int unisound_app_start(hbm_command_cb cmd_callback);
 
+/**
+ * @brief unisound app协作模式初始化，SDK不创建任何线程，需配合UartConfig.poll_mode = 1
+ * Tips: 应用在自己的主循环中调用SdkRunOnce，所有SDK接口只能在该线程调用
+ * @param cmd_callback 蜂鸟控制命令回调IoT设备hook
+ * @return 0 成功，-1 失败
+ */
+int unisound_app_start_cooperative(hbm_command_cb cmd_callback);
+
+/**
+ * @brief 协作模式下驱动一次SDK：接收解析串口数据，执行排队的handler
+ * @param timeout_msec 无排队handler且无串口数据时最长等待时间
+ * @return 执行的handler个数，-1 失败
+ */
+int SdkRunOnce(uint32_t timeout_msec);
+
+/**
+ * @brief 获取进程CPU时间、上下文切换次数及内存占用，用于线程模式与协作模式对比
+ * @param usage
+ * @return 0 成功，-1 失败
+ */
+int SdkGetUsage(SdkUsage *usage);
+
 /**
  * @brief IoT设备向蜂鸟M发送控制命令
  * @param cmd 控制命令
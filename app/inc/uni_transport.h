@@ -0,0 +1,102 @@
+/**************************************************************************
+ * Copyright (C) 2020-2020 Junlon2006
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ **************************************************************************
+ *
+ * Description : uni_transport.h
+ * Author      : junlon2006@163.com
+ * Date        : 2020.09.02
+ *
+ **************************************************************************/
+#ifndef APP_INC_UNI_TRANSPORT_H_
+#define APP_INC_UNI_TRANSPORT_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <termios.h>
+
+/*
+ * byte links below uni_uart.c. a transport only opens the link and answers
+ * the few questions which differ by link type, reading, writing, the tx ring,
+ * rx stage and io backends stay common to all. UartConfig.device selects it:
+ *   /dev/ttyUSB0         uart
+ *   tcp:127.0.0.1:9000   tcp connect
+ *   unix:/tmp/hbm.sock   unix stream socket connect
+ */
+
+typedef enum {
+  TRANSPORT_UART = 0,
+  TRANSPORT_TCP,
+  TRANSPORT_UNIX,
+} TransportType;
+
+typedef struct {
+  TransportType type;
+  const char    *name;
+  int           stream;  /* read returning 0 means peer closed, sockets */
+
+  /**
+   * @brief open link in non blocking mode
+   * @param address device without scheme
+   * @param speed uart speed, ignored by sockets
+   * @param baud any bps, 0 keep speed, ignored by sockets
+   * @return fd, -1 failed
+   */
+  int (*open)(const char *address, speed_t speed, uint32_t baud);
+
+  /**
+   * @brief switch link rate, sockets have none and accept any
+   * @return 0 success, -1 failed
+   */
+  int (*set_baud)(int fd, uint32_t baud);
+
+  /**
+   * @brief current link rate
+   * @return bps, 0 link has no rate
+   */
+  uint32_t (*get_baud)(int fd);
+
+  /**
+   * @brief wait until driver has sent out its own buffer
+   * @return 0 success, -1 failed
+   */
+  int (*drain)(int fd);
+
+  /**
+   * @brief bytes lost by driver since open
+   * @return count, 0 if link cannot lose bytes or has no counter
+   */
+  uint64_t (*overruns)(int fd);
+} Transport;
+
+/**
+ * @brief pick transport by scheme of device
+ * @param device e.g. /dev/ttyUSB0, tcp:host:port, unix:path
+ * @param address device without scheme
+ * @return transport, never NULL, uart when no scheme matches
+ */
+const Transport* TransportLookup(const char *device, const char **address);
+
+/* uart transport, uni_transport_uart.c */
+extern const Transport g_transport_uart;
+
+#ifdef __cplusplus
+}
+#endif
+#endif  // APP_INC_UNI_TRANSPORT_H_
@@ -28,19 +28,107 @@
 extern "C" {
 #endif
 
+#include <stdint.h>
 #include <termios.h>
 
 #define UNI_UART_DEVICE_NAME_MAX  (64)
 
+typedef enum {
+  UART_BACKEND_EPOLL = 0,
+  UART_BACKEND_IO_URING,  /* falls back to epoll when kernel or build lacks io_uring */
+} UartBackend;
+
 typedef struct {
-  char    device[UNI_UART_DEVICE_NAME_MAX];
-  speed_t speed;
+  char        device[UNI_UART_DEVICE_NAME_MAX];
+  speed_t     speed;
+  uint32_t    baud;      /* any bps by termios2, overrides speed when not 0 */
+  int         poll_mode; /* 1 no rx/parse thread, data is received and parsed by UartPoll */
+  UartBackend backend;
+  uint32_t    rx_stall_ms; /* worst parser stall rx keeps reading through, 0 default 1000 */
 } UartConfig;
 
+typedef struct {
+  UartBackend backend;           /* backend in use */
+  uint64_t syscalls;             /* all uart io syscalls, rx and tx */
+  uint64_t wakeups;              /* rx thread or UartPoll woke up */
+  uint64_t idle_wakeups;         /* woke up without any byte, timeout or spurious */
+  uint64_t reads;
+  uint64_t bytes;
+  uint32_t max_read;             /* largest single read */
+  uint64_t frames;
+  uint32_t frame_latency_us;     /* read of last byte to frame delivered, EWMA */
+  uint32_t frame_latency_max_us;
+  uint64_t tx_frames;            /* UartWrite calls accepted */
+  uint64_t tx_bytes;
+  uint64_t tx_direct_frames;     /* frames written by one syscall without queuing */
+  uint64_t tx_syscalls;          /* syscalls issued by writers, write() or io_uring_enter */
+  uint64_t tx_stalls;            /* short writes or EAGAIN */
+  uint64_t tx_overflow;          /* frames dropped, tx ring stayed full */
+  uint32_t tx_queued;            /* bytes waiting in tx ring */
+  uint32_t tx_queued_max;
+  uint32_t rx_parse_max_us;      /* longest single parse of one read, i.e. rx stall */
+  uint64_t rx_staged;            /* bytes read ahead into rx stage while parser stalled */
+  uint32_t rx_stage_max;         /* most bytes waiting in rx stage */
+  uint32_t rx_stage_cap;         /* rx stage limit, baud x rx_stall_ms */
+  uint64_t rx_overflow;          /* rx stage hit limit, reading stopped until parser caught up */
+  uint64_t rx_kernel_overruns;   /* driver overrun counters, 0 if tty has none (TIOCGICOUNT) */
+  uint64_t capture_bytes;        /* raw rx and tx bytes recorded by UartCapture */
+  uint64_t capture_dropped;      /* chunks not recorded, capture file fell behind */
+} UartStats;
+
 int UartInitialize(UartConfig *config);
 int UartFinalize();
 int UartWrite(char *buf, unsigned int len);
 
+/**
+ * @brief write out tx ring, then wait until driver has transmitted all bytes (tcdrain)
+ * @param timeout_msec max time waiting for tx ring to drain
+ * @return 0 success, -1 timeout or failed
+ */
+int UartFlush(uint32_t timeout_msec);
+
+/**
+ * @brief flush tx, then switch uart to any baud rate by termios2
+ * @param baud bps
+ * @return 0 success, -1 failed or driver cannot get within 2% of baud
+ */
+int UartSetBaud(uint32_t baud);
+
+/**
+ * @brief current baud rate
+ * @param void
+ * @return bps, 0 if unknown
+ */
+uint32_t UartGetBaud(void);
+
+/**
+ * @brief poll mode only, read all pending uart data and parse it on caller thread
+ * @param timeout_msec wait at most this long when no data pending, 0 never wait
+ * @return bytes parsed, -1 if failed
+ */
+int UartPoll(uint32_t timeout_msec);
+
+/**
+ * @brief called by frame receive handler on rx path, accounts per frame latency
+ * @param void
+ * @return void
+ */
+void UartFrameReceived(void);
+
+/**
+ * @brief get rx wakeup, latency and tx queue statistics
+ * @param stats
+ * @return 0 success, -1 failed
+ */
+int UartGetStats(UartStats *stats);
+
+/**
+ * @brief record raw rx and tx byte streams with timestamps, for replay by UART_REPLAY
+ * @param path capture file, truncated. NULL stops capture and closes the file
+ * @return 0 success, -1 failed
+ */
+int UartCapture(const char *path);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,56 @@
+/**************************************************************************
+ * Copyright (C) 2020-2020 Junlon2006
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ **************************************************************************
+ *
+ * Description : uni_uart_baud.h
+ * Author      : junlon2006@163.com
+ * Date        : 2020.08.31
+ *
+ **************************************************************************/
+#ifndef APP_INC_UNI_UART_BAUD_H_
+#define APP_INC_UNI_UART_BAUD_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+/*
+ * termios2 helpers of uni_uart.c. <asm/termbits.h> conflicts with
+ * <termios.h>, so they live in their own translation unit
+ */
+
+/**
+ * @brief set any input/output baud rate on fd by termios2 BOTHER
+ * @param fd
+ * @param baud bps
+ * @return 0 success, -1 failed
+ */
+int UartBaudApply(int fd, uint32_t baud);
+
+/**
+ * @brief get output baud rate of fd
+ * @param fd
+ * @return bps, 0 if failed
+ */
+uint32_t UartBaudCurrent(int fd);
+
+#ifdef __cplusplus
+}
+#endif
+#endif  // APP_INC_UNI_UART_BAUD_H_
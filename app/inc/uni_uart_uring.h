@@ -0,0 +1,100 @@
+/**************************************************************************
+ * Copyright (C) 2020-2020 Junlon2006
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ **************************************************************************
+ *
+ * Description : uni_uart_uring.h
+ * Author      : junlon2006@163.com
+ * Date        : 2020.08.30
+ *
+ **************************************************************************/
+#ifndef APP_INC_UNI_UART_URING_H_
+#define APP_INC_UNI_UART_URING_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "uni_uart.h"
+
+/*
+ * io_uring backend of uni_uart.c, used by it only. uart bytes are received
+ * by one multishot read into a ring of provided buffers, frames are copied
+ * into a registered tx buffer and written by WRITE_FIXED, a wrapped region
+ * goes out as two linked writes. completions are reaped by one thread at a
+ * time (rx thread, or UartPoll caller in poll mode), the uart handler runs
+ * there. writes issued while reaping are submitted together with next wait
+ */
+
+typedef void (*UartUringRxHandler)(unsigned char *buf, int len);
+
+/**
+ * @brief setup ring on uart fd and arm multishot read
+ * @param fd uart fd, O_NONBLOCK is cleared
+ * @param rx_handler called by reaping thread for every received buffer
+ * @param rx_cap bytes of provided buffers, received data waiting for a stalled parser
+ * @return 0 success, -1 io_uring or needed opcode unavailable
+ */
+int UartUringCreate(int fd, UartUringRxHandler rx_handler, uint32_t rx_cap);
+
+/**
+ * @brief release ring and buffers, no thread may be reaping
+ * @param void
+ * @return void
+ */
+void UartUringDestroy(void);
+
+/**
+ * @brief submit pending writes, wait for completions and handle them
+ * @param timeout_msec -1 wait forever, 0 never wait
+ * @return completions handled, -1 woken by UartUringWake or failed
+ */
+int UartUringRun(int timeout_msec);
+
+/**
+ * @brief make current or next UartUringRun return -1
+ * @param void
+ * @return void
+ */
+void UartUringWake(void);
+
+/**
+ * @brief copy frame into tx buffer and submit, waits for space at most timeout_msec
+ * @param buf
+ * @param len
+ * @param timeout_msec
+ * @return len success, -1 failed or tx buffer stayed full
+ */
+int UartUringWrite(char *buf, unsigned int len, uint32_t timeout_msec);
+
+/**
+ * @brief wait until all queued bytes are written
+ * @param timeout_msec
+ * @return 0 success, -1 timeout
+ */
+int UartUringFlush(uint32_t timeout_msec);
+
+/**
+ * @brief fill tx_*, rx_stage*, rx_overflow and syscalls fields of stats
+ * @param stats
+ * @return void
+ */
+void UartUringStatsFill(UartStats *stats);
+
+#ifdef __cplusplus
+}
+#endif
+#endif  // APP_INC_UNI_UART_URING_H_
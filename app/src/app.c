@@ -21,12 +21,17 @@
  * Date        : 2020.07.21
  *
  **************************************************************************/
+#include "app.h"
 #include "uni_log.h"
 #include "uni_uart.h"
 #include "uni_channel.h"
 #include "uni_communication.h"
 #include "porting.h"
 
+#include <stdio.h>
+#include <string.h>
+#include <sys/resource.h>
+
 #define TAG "app"
 
 /* 串口通信协议栈跨平台APIs hook注册函数集合 */
@@ -60,27 +65,107 @@ static int _comm_protocol_sem_timedwait_fn(void *sem, unsigned int timeout_mseco
   return uni_sem_wait(s, timeout_msecond);
 }
 
+/* 帧接收回调运行在UART接收路径上，顺带统计单帧接收延时 */
+static void _comm_protocol_recv_frame(CommPacket *packet) {
+  UartFrameReceived();
+  ChnlReceiveCommProtocolPacket(packet);
+}
+
+static int _comm_protocol_poll_fn(unsigned int timeout_msecond) {
+  return UartPoll(timeout_msecond);
+}
+
+static int _chnl_poll_fn(uint32_t timeout_msec) {
+  return UartPoll(timeout_msec);
+}
+
+static void _comm_protocol_hooks_fill(CommProtocolHooks *hooks) {
+  hooks->free_fn    = uni_free;
+  hooks->malloc_fn  = uni_malloc;
+  hooks->msleep_fn  = uni_msleep;
+  hooks->realloc_fn = uni_realloc;
+
+  hooks->sem_alloc_fn     = _comm_protocol_sem_alloc_fn;
+  hooks->sem_destroy_fn   = _comm_protocol_sem_destroy_fn;
+  hooks->sem_init_fn      = _comm_protocol_sem_init;
+  hooks->sem_post_fn      = _comm_protocol_sem_post_fn;
+  hooks->sem_wait_fn      = _comm_protocol_sem_wait_fn;
+  hooks->sem_timedwait_fn = _comm_protocol_sem_timedwait_fn;
+}
+
 int unisound_app_start(hbm_command_cb cmd_callback) {
   CommProtocolHooks hooks = {0};
-  hooks.free_fn    = uni_free;
-  hooks.malloc_fn  = uni_malloc;
-  hooks.msleep_fn  = uni_msleep;
-  hooks.realloc_fn = uni_realloc;
-
-  hooks.sem_alloc_fn     = _comm_protocol_sem_alloc_fn;
-  hooks.sem_destroy_fn   = _comm_protocol_sem_destroy_fn;
-  hooks.sem_init_fn      = _comm_protocol_sem_init;
-  hooks.sem_post_fn      = _comm_protocol_sem_post_fn;
-  hooks.sem_wait_fn      = _comm_protocol_sem_wait_fn;
-  hooks.sem_timedwait_fn = _comm_protocol_sem_timedwait_fn;
+  _comm_protocol_hooks_fill(&hooks);
 
   CommProtocolRegisterHooks(&hooks);
-  CommProtocolInit(UartWrite, ChnlReceiveCommProtocolPacket);
+  CommProtocolInit(UartWrite, _comm_protocol_recv_frame);
   ChnlInit(cmd_callback);
 
   return 0;
 }
 
+int unisound_app_start_cooperative(hbm_command_cb cmd_callback) {
+  CommProtocolHooks hooks = {0};
+  _comm_protocol_hooks_fill(&hooks);
+  hooks.poll_fn     = _comm_protocol_poll_fn;
+  hooks.clock_ms_fn = uni_get_clock_time_ms;
+
+  CommProtocolRegisterHooks(&hooks);
+  if (0 != CommProtocolInit(UartWrite, _comm_protocol_recv_frame)) {
+    LOGE(TAG, "comm protocol init failed");
+    return -1;
+  }
+
+  return ChnlInitCooperative(cmd_callback, _chnl_poll_fn);
+}
+
+int SdkRunOnce(uint32_t timeout_msec) {
+  /* 有排队handler时只收取已到达的数据，不等待 */
+  if (UartPoll(ChnlPendingTasks() ? 0 : timeout_msec) < 0) {
+    return -1;
+  }
+
+  return ChnlRunOnce(0);
+}
+
+static long _proc_status_value(const char *key) {
+  char line[128];
+  long value = -1;
+  size_t key_len = strlen(key);
+  FILE *fp = fopen("/proc/self/status", "r");
+
+  if (NULL == fp) {
+    return -1;
+  }
+
+  while (NULL != fgets(line, sizeof(line), fp)) {
+    if (0 == strncmp(line, key, key_len) && ':' == line[key_len]) {
+      value = atol(line + key_len + 1);
+      break;
+    }
+  }
+
+  fclose(fp);
+  return value;
+}
+
+int SdkGetUsage(SdkUsage *usage) {
+  struct rusage ru;
+
+  if (NULL == usage || 0 != getrusage(RUSAGE_SELF, &ru)) {
+    return -1;
+  }
+
+  usage->user_us       = (int64_t)ru.ru_utime.tv_sec * 1000000 + ru.ru_utime.tv_usec;
+  usage->sys_us        = (int64_t)ru.ru_stime.tv_sec * 1000000 + ru.ru_stime.tv_usec;
+  usage->voluntary_cs  = ru.ru_nvcsw;
+  usage->involuntary_cs = ru.ru_nivcsw;
+  usage->max_rss_kb    = ru.ru_maxrss;
+  usage->rss_kb        = _proc_status_value("VmRSS");
+  usage->threads       = _proc_status_value("Threads");
+  return 0;
+}
+
 int iot_device_send_command_to_hbm(uint32_t cmd, char *payload, uint32_t payload_len) {
   CommAttribute attr = {1};
   return CommProtocolPacketAssembleAndSend(cmd, payload, payload_len, &attr);
@@ -23,11 +23,15 @@
  **************************************************************************/
 #include "app.h"
 #include "uni_uart.h"
+#include "uni_hbmd.h"
 #include "uni_log.h"
+#include "asr_command_table.h"
 #include "stdio.h"
 
 #include <unistd.h>
 #include <fcntl.h>
+#include <string.h>
+#include <stdbool.h>
 
 #define TAG "main"
 
@@ -67,49 +71,198 @@ static void _response_broadcast_demo(const char *file_name) {
   close(fd);
 }
 
-#define MAX_PAYLOAD_LEN (16)
+/* asr_command.tbl中声明的handler，由生成的完美哈希路由表调用 */
+void asr_on_wakeup(const char *cmd, uint32_t len, void *ctx) {
+  _response_broadcast_demo("wozai.pcm");
+}
+
+void asr_on_exit(const char *cmd, uint32_t len, void *ctx) {
+  _response_broadcast_demo("youxuyaozaijiaowo.pcm");
+}
+
+void asr_on_ac_power_on(const char *cmd, uint32_t len, void *ctx) {
+  _response_broadcast_demo("yiweinidakaifengshan.pcm");
+}
+
 static void _hbm_command_callback(char *payload, uint32_t len) {
-  /* payload 不带'\0', 追加字符串结尾符号 */
-  char tmp[MAX_PAYLOAD_LEN] = {0};
-  strncpy(tmp, payload, ((len < MAX_PAYLOAD_LEN) ? len : (MAX_PAYLOAD_LEN - 1)));
-  LOGT(TAG, "param=%s", tmp);
+  /* payload 不带'\0', 直接按长度路由，无需拷贝 */
+  LOGT(TAG, "param=%.*s", (int)len, payload);
 
   /* 根据离线识别结果，进行播报应答 */
-  if (0 == strcmp(tmp, "wakeup_uni")) {
-    _response_broadcast_demo("wozai.pcm");
-  } else if (0 == strcmp(tmp, "exitUni")) {
-    _response_broadcast_demo("youxuyaozaijiaowo.pcm");
-  } else if (0 == strcmp(tmp, "ac_power_on")) {
-    _response_broadcast_demo("yiweinidakaifengshan.pcm");
-  } else {
+  if (0 != CmdRouterDispatch(&asr_command_table, payload, len, NULL)) {
     _response_broadcast_demo("ceshidefault.pcm");
   }
 }
 
 /* 离线识别结果回调函数 */
+static void _hbm_asr_result_handler(uint32_t cmd, char *payload, uint32_t len, void *ctx) {
+  _hbm_command_callback(payload, len);
+}
+
+/* 其余未单独注册handler的IoT消息回调 */
 static void _hbm_command_cb(uint32_t cmd, char *payload, uint32_t len) {
-  switch (cmd) {
-    case CHNL_MSG_HBM_IOT_ASR_RESULT:
-      _hbm_command_callback(payload, len);
-      break;
-    default:
-      break;
+  LOGT(TAG, "recv hbm command. cmd=%u", cmd);
+}
+
+#define USAGE_LOG_INTERVAL_MS  (10 * 1000)
+
+static void _usage_log(const char *mode) {
+  HbmdStats hbmd;
+  SdkUsage usage;
+  UartStats uart;
+  if (0 != SdkGetUsage(&usage) || 0 != UartGetStats(&uart)) {
+    return;
   }
+
+  LOGT(TAG, "[%s] uart %s backend, io syscalls=%llu (%.2f/frame rx+tx)", mode,
+       UART_BACKEND_IO_URING == uart.backend ? "io_uring" : "epoll",
+       (unsigned long long)uart.syscalls, (uart.frames + uart.tx_frames) ?
+       (double)uart.syscalls / (uart.frames + uart.tx_frames) : 0.0);
+
+  LOGT(TAG, "[%s] uart wakeups=%llu idle=%llu, reads=%llu bytes=%llu max_read=%u, "
+       "frames=%llu latency=%uus max=%uus", mode, (unsigned long long)uart.wakeups,
+       (unsigned long long)uart.idle_wakeups, (unsigned long long)uart.reads,
+       (unsigned long long)uart.bytes, uart.max_read, (unsigned long long)uart.frames,
+       uart.frame_latency_us, uart.frame_latency_max_us);
+
+  LOGT(TAG, "[%s] uart tx frames=%llu bytes=%llu direct=%llu, syscalls=%llu (%.2f/frame) "
+       "stalls=%llu overflow=%llu, queued=%u max=%u", mode, (unsigned long long)uart.tx_frames,
+       (unsigned long long)uart.tx_bytes, (unsigned long long)uart.tx_direct_frames,
+       (unsigned long long)uart.tx_syscalls,
+       uart.tx_frames ? (double)uart.tx_syscalls / uart.tx_frames : 0.0,
+       (unsigned long long)uart.tx_stalls, (unsigned long long)uart.tx_overflow,
+       uart.tx_queued, uart.tx_queued_max);
+
+  LOGT(TAG, "[%s] uart rx parse max=%uus, staged=%llu max=%u cap=%u, overflow=%llu "
+       "kernel overruns=%llu", mode, uart.rx_parse_max_us,
+       (unsigned long long)uart.rx_staged, uart.rx_stage_max, uart.rx_stage_cap,
+       (unsigned long long)uart.rx_overflow, (unsigned long long)uart.rx_kernel_overruns);
+
+  if (uart.capture_bytes || uart.capture_dropped) {
+    LOGT(TAG, "[%s] uart capture bytes=%llu dropped=%llu", mode,
+         (unsigned long long)uart.capture_bytes, (unsigned long long)uart.capture_dropped);
+  }
+
+  if (0 == HbmdGetStats(&hbmd)) {
+    LOGT(TAG, "[%s] hbmd clients=%u accepted=%u rejected=%u, packets=%llu drops=%llu, "
+         "sends=%u failed=%u, plays=%u streams=%u bytes=%llu failed=%u", mode, hbmd.clients,
+         hbmd.accepted, hbmd.rejected, (unsigned long long)hbmd.packets,
+         (unsigned long long)hbmd.packet_drops, hbmd.sends, hbmd.send_failed, hbmd.plays,
+         hbmd.streams, (unsigned long long)hbmd.play_bytes, hbmd.play_failed);
+  }
+
+  LOGT(TAG, "[%s] cpu user=%lldus sys=%lldus, cs voluntary=%ld involuntary=%ld, "
+       "rss=%ldKB max=%ldKB, threads=%ld", mode, (long long)usage.user_us,
+       (long long)usage.sys_us, usage.voluntary_cs, usage.involuntary_cs,
+       usage.rss_kb, usage.max_rss_kb, usage.threads);
+}
+
+static bool _has_option(int argc, char *argv[], const char *option) {
+  int i;
+  for (i = 2; i < argc; i++) {
+    if (0 == strcmp(argv[i], option)) {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+/* option in form name=value, e.g. capture=/tmp/uart.ucap */
+static const char* _option_value(int argc, char *argv[], const char *name) {
+  size_t len = strlen(name);
+  int i;
+  for (i = 2; i < argc; i++) {
+    if (0 == strncmp(argv[i], name, len) && '=' == argv[i][len]) {
+      return argv[i] + len + 1;
+    }
+  }
+
+  return NULL;
+}
+
+static bool _is_cooperative(int argc, char *argv[]) {
+  return _has_option(argc, argv, "coop");
 }
 
 static void _uart_init(int argc, char *argv[]) {
   UartConfig uart_config;
   snprintf(uart_config.device, sizeof(uart_config.device), "%s", argv[1]);
   uart_config.speed = B921600;
+  uart_config.baud = 0;
+  uart_config.rx_stall_ms = 0;
+  uart_config.poll_mode = _is_cooperative(argc, argv);
+  uart_config.backend = _has_option(argc, argv, "uring") ? UART_BACKEND_IO_URING :
+                                                           UART_BACKEND_EPOLL;
   if (0 != UartInitialize(&uart_config)) {
     LOGE(TAG, "uart init failed.");
   }
 }
 
+/* 921600为蜂鸟M固件默认波特率，协商从该波特率开始，只会向上切换 */
+static void _baud_negotiate() {
+  static const uint32_t rates[] = {921600, 1000000, 1500000, 2000000, 3000000};
+  ChnlBaudResult result;
+  int ret = ChnlNegotiateBaud(rates, sizeof(rates) / sizeof(rates[0]), UartSetBaud, &result);
+  if (ret < 0) {
+    LOGW(TAG, "baud negotiation failed, stay at %u", UartGetBaud());
+    return;
+  }
+
+  LOGT(TAG, "uart baud=%u, module max=%u, attempts=%u, fallbacks=%u, cost=%ums",
+       UartGetBaud(), result.module_max, result.attempts, result.fallbacks, result.elapsed_ms);
+}
+
+/* 协作模式：SDK不创建线程，全部工作在主循环中完成 */
+static void _cooperative_loop() {
+  long last_log = uni_get_clock_time_ms();
+  while (1) {
+    SdkRunOnce(1000);
+    if (uni_get_clock_time_ms() - last_log >= USAGE_LOG_INTERVAL_MS) {
+      _usage_log("coop");
+      last_log = uni_get_clock_time_ms();
+    }
+  }
+}
+
+/* usage: ./demo /dev/ttyUSB0 [coop] [uring] [negotiate] [capture=file] [daemon=socket] */
 int main(int argc, char *argv[]) {
+  bool cooperative = _is_cooperative(argc, argv);
+  const char *capture = _option_value(argc, argv, "capture");
+  const char *daemon = _option_value(argc, argv, "daemon");
   LogLevelSet(N_LOG_TRACK);
   _uart_init(argc, argv);
-  unisound_app_start(_hbm_command_cb);
-  while (1) usleep(1000 * 1000);
+  if (NULL != capture && 0 != UartCapture(capture)) {
+    LOGE(TAG, "uart capture to %s failed", capture);
+  }
+
+  if (cooperative) {
+    unisound_app_start_cooperative(_hbm_command_cb);
+  } else {
+    unisound_app_start(_hbm_command_cb);
+  }
+
+  /* 守护进程模式：识别结果等IoT消息由订阅的客户端处理 */
+  if (NULL != daemon) {
+    if (0 != HbmdStart(daemon)) {
+      LOGE(TAG, "hbmd start on %s failed", daemon);
+    }
+  } else {
+    ChnlRegisterHandler(CHNL_MSG_HBM_IOT_ASR_RESULT, _hbm_asr_result_handler, NULL,
+                        CHNL_EXECUTOR_IOT);
+  }
+
+  if (_has_option(argc, argv, "negotiate")) {
+    _baud_negotiate();
+  }
+
+  if (cooperative) {
+    _cooperative_loop();
+  }
+
+  while (1) {
+    usleep(USAGE_LOG_INTERVAL_MS * 1000);
+    _usage_log("threaded");
+  }
   return 0;
 }
@@ -0,0 +1,189 @@
+/**************************************************************************
+ * Copyright (C) 2020-2020 Junlon2006
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ **************************************************************************
+ *
+ * Description : uni_transport.c
+ * Author      : junlon2006@163.com
+ * Date        : 2020.09.02
+ *
+ **************************************************************************/
+#include "uni_transport.h"
+#include "uni_log.h"
+#include "porting.h"
+
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+
+#define TAG "transport"
+
+#define TRANSPORT_HOST_MAX  (64)
+
+/*
+ * connect blocking, then io is non blocking like the uart fd. a write after
+ * peer closed must fail with EPIPE, not kill the process
+ */
+static int _socket_setup(int fd) {
+  int flags = fcntl(fd, F_GETFL);
+  if (flags < 0 || 0 != fcntl(fd, F_SETFL, flags | O_NONBLOCK)) {
+    LOGE(TAG, "set non block failed[%s]", strerror(errno));
+    return -1;
+  }
+
+  signal(SIGPIPE, SIG_IGN);
+  return 0;
+}
+
+static int _tcp_open(const char *address, speed_t speed, uint32_t baud) {
+  char host[TRANSPORT_HOST_MAX];
+  struct addrinfo hints, *res, *ai;
+  const char *port = strrchr(address, ':');
+  int one = 1;
+  int fd = -1;
+  int ret;
+
+  if (NULL == port || port - address >= (int)sizeof(host)) {
+    LOGE(TAG, "invalid tcp address %s, expect host:port", address);
+    return -1;
+  }
+
+  snprintf(host, sizeof(host), "%.*s", (int)(port - address), address);
+  MZERO(&hints);
+  hints.ai_family   = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  if (0 != (ret = getaddrinfo(host, port + 1, &hints, &res))) {
+    LOGE(TAG, "resolve %s failed[%s]", address, gai_strerror(ret));
+    return -1;
+  }
+
+  for (ai = res; NULL != ai; ai = ai->ai_next) {
+    fd = socket(ai->ai_family, ai->ai_socktype | SOCK_CLOEXEC, ai->ai_protocol);
+    if (fd >= 0 && 0 == connect(fd, ai->ai_addr, ai->ai_addrlen)) {
+      break;
+    }
+
+    if (fd >= 0) {
+      close(fd);
+      fd = -1;
+    }
+  }
+
+  freeaddrinfo(res);
+  if (fd < 0) {
+    LOGE(TAG, "connect %s failed[%s]", address, strerror(errno));
+    return -1;
+  }
+
+  /* frames are small and latency bound, never wait to coalesce them */
+  setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+  if (0 != _socket_setup(fd)) {
+    close(fd);
+    return -1;
+  }
+
+  return fd;
+}
+
+static int _unix_open(const char *address, speed_t speed, uint32_t baud) {
+  struct sockaddr_un addr;
+  int fd;
+
+  if (strlen(address) >= sizeof(addr.sun_path)) {
+    LOGE(TAG, "unix socket path too long %s", address);
+    return -1;
+  }
+
+  MZERO(&addr);
+  addr.sun_family = AF_UNIX;
+  snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", address);
+  fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (fd < 0 || 0 != connect(fd, (struct sockaddr *)&addr, sizeof(addr))) {
+    LOGE(TAG, "connect %s failed[%s]", address, strerror(errno));
+    goto L_ERROR;
+  }
+
+  if (0 != _socket_setup(fd)) {
+    goto L_ERROR;
+  }
+
+  return fd;
+
+L_ERROR:
+  if (fd >= 0) {
+    close(fd);
+  }
+  return -1;
+}
+
+/* a socket has no line rate, baud negotiation passes without effect */
+static int _socket_set_baud(int fd, uint32_t baud) {
+  return 0;
+}
+
+static uint32_t _socket_get_baud(int fd) {
+  return 0;
+}
+
+static int _socket_drain(int fd) {
+  return 0;
+}
+
+/* stream sockets are flow controlled, a stalled reader slows the peer down */
+static uint64_t _socket_overruns(int fd) {
+  return 0;
+}
+
+static const Transport g_transport_tcp = {
+  TRANSPORT_TCP, "tcp", 1,
+  _tcp_open, _socket_set_baud, _socket_get_baud, _socket_drain, _socket_overruns,
+};
+
+static const Transport g_transport_unix = {
+  TRANSPORT_UNIX, "unix", 1,
+  _unix_open, _socket_set_baud, _socket_get_baud, _socket_drain, _socket_overruns,
+};
+
+static const struct {
+  const char      *scheme;
+  const Transport *transport;
+} g_schemes[] = {
+  {"tcp:",  &g_transport_tcp},
+  {"unix:", &g_transport_unix},
+};
+
+const Transport* TransportLookup(const char *device, const char **address) {
+  size_t i, len;
+
+  for (i = 0; i < sizeof(g_schemes) / sizeof(g_schemes[0]); i++) {
+    len = strlen(g_schemes[i].scheme);
+    if (0 == strncmp(device, g_schemes[i].scheme, len)) {
+      *address = device + len;
+      return g_schemes[i].transport;
+    }
+  }
+
+  *address = device;
+  return &g_transport_uart;
+}
@@ -0,0 +1,134 @@
+/**************************************************************************
+ * Copyright (C) 2020-2020 Junlon2006
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ **************************************************************************
+ *
+ * Description : uni_transport_uart.c
+ * Author      : junlon2006@163.com
+ * Date        : 2020.09.02
+ *
+ **************************************************************************/
+#include "uni_transport.h"
+#include "uni_uart_baud.h"
+#include "uni_log.h"
+#include "porting.h"
+
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <linux/serial.h>
+#include <termios.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+
+#define TAG "transport_uart"
+
+static int _set_speed(int fd, speed_t speed) {
+  int status;
+  struct termios options;
+
+  tcgetattr(fd, &options);
+  tcflush(fd, TCIOFLUSH);
+  cfsetispeed(&options, speed);
+  cfsetospeed(&options, speed);
+
+  status = tcsetattr(fd, TCSANOW, &options);
+  if (0 != status) {
+    return -1;
+  }
+
+  tcflush(fd, TCIOFLUSH);
+
+  return 0;
+}
+
+static void _set_option(struct termios *options) {
+  cfmakeraw(options);            /* 配置为原始模式 */
+  options->c_cflag    &= ~CSIZE;
+  options->c_cflag    |= CS8;       /* 8位数据位 */
+  options->c_iflag    |= INPCK;     /* disable parity checking */
+  options->c_cflag    &= ~CSTOPB;   /* 一个停止位 */
+  options->c_cc[VTIME] = 0;      /*设置等待时间*/
+  options->c_cc[VMIN]  = 0;       /*最小接收字符*/
+}
+
+static int _set_parity(int fd) {
+  struct termios options;
+  if (tcgetattr(fd, &options) != 0) {
+    return -1;
+  }
+
+  _set_option(&options);
+  if (tcsetattr(fd, TCSANOW, &options) != 0) {
+    return -1;
+  }
+
+  tcflush(fd, TCIOFLUSH);
+  return 0;
+}
+
+static int _uart_open(const char *address, speed_t speed, uint32_t baud) {
+  int fd = open(address, O_RDWR | O_NOCTTY | O_NDELAY);
+  if (-1 == fd) {
+    LOGE(TAG, "open %s failed[%s]", address, strerror(errno));
+    return -1;
+  }
+
+  if (0 != _set_speed(fd, speed)) {
+    LOGE(TAG, "set speed failed");
+    goto L_ERROR;
+  }
+
+  if (0 != _set_parity(fd)) {
+    LOGE(TAG, "set parity failed");
+    goto L_ERROR;
+  }
+
+  if (0 != baud && 0 != UartBaudApply(fd, baud)) {
+    LOGE(TAG, "set baud %u failed", baud);
+    goto L_ERROR;
+  }
+
+  return fd;
+
+L_ERROR:
+  close(fd);
+  return -1;
+}
+
+static int _uart_drain(int fd) {
+  if (0 != tcdrain(fd) && ENOTTY != errno) {
+    return -1;
+  }
+
+  return 0;
+}
+
+/* overrun and buffer overrun of serial driver, ptys and usb adapters may have none */
+static uint64_t _uart_overruns(int fd) {
+  struct serial_icounter_struct icount;
+  MZERO(&icount);
+  if (fd < 0 || 0 != ioctl(fd, TIOCGICOUNT, &icount)) {
+    return 0;
+  }
+
+  return (uint64_t)icount.overrun + icount.buf_overrun;
+}
+
+const Transport g_transport_uart = {
+  TRANSPORT_UART, "uart", 0,
+  _uart_open, UartBaudApply, UartBaudCurrent, _uart_drain, _uart_overruns,
+};
@@ -23,162 +23,752 @@
  **************************************************************************/
 #include "uni_uart.h"
 #include "uni_communication.h"
-#include "uni_log.h"
 #include "uni_ringbuf.h"
+#include "uni_transport.h"
+#include "uni_capture.h"
+#include "uni_log.h"
+#include "porting.h"
+#ifdef UNI_UART_IO_URING
+#include "uni_uart_uring.h"
+#endif
 
-#include <fcntl.h>
 #include <stdio.h>
-#include <sys/time.h>
-#include <termios.h>
+#include <poll.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
 #include <unistd.h>
 #include <pthread.h>
 #include <errno.h>
 #include <string.h>
 
 #define TAG                       "uart"
+/* one read drains up to this many bytes, 921600bps delivers ~4.5KB in 50ms */
+#define UART_READ_BUF_SIZE        (4096)
+/* tx ring holds frames the driver did not take yet, a few max size frames */
+#define UART_TX_RING_SIZE         (16 * 1024)
+#define UART_TX_CHUNK_SIZE        (4096)
+/* writer blocks at most this long for ring space before dropping a frame */
+#define UART_TX_BLOCK_MS          (1000)
+/* longest parser stall rx reads through by default, a writer blocked on full tx ring */
+#define UART_RX_STALL_MS          (UART_TX_BLOCK_MS)
+#define UART_RX_STAGE_MAX         (16 * 1024 * 1024)
 
 static int              uart_fd = -1;
+static const Transport  *transport = &g_transport_uart;
+static int              epoll_fd = -1;
+static int              exit_fd = -1;  /* eventfd, wakes rx thread on finalize */
 static int              is_running = 0;
-static RingBufferHandle ringbuf = NULL;
+static int              poll_mode = 0;
+static UartBackend      backend = UART_BACKEND_EPOLL;
+static int64_t          rx_batch_us = 0;
+static RingBufferHandle tx_ring = NULL;
+static uni_mutex_t      tx_mutex;
+static int              tx_armed = 0;  /* EPOLLOUT registered */
+static RingBufferHandle rx_stage = NULL;  /* bytes read while parser stalled, elastic */
+static int              rx_stage_size = 0;
+static int              rx_stage_cap = UART_READ_BUF_SIZE;
+static uint32_t         rx_stall_ms = UART_RX_STALL_MS;
+static int              rx_stage_full = 0;  /* reading stopped on cap until stage drained */
+static int              rx_parsing = 0;
+static pthread_t        rx_thread;
+static uint64_t         rx_overruns_base = 0;
+static CaptureHandle    capture = NULL;  /* raw rx and tx tee, see UartCapture */
+static UartStats        g_stats;
+static uni_mutex_t      g_stats_mutex;
+
+static void _free_all() {
+#ifdef UNI_UART_IO_URING
+  if (UART_BACKEND_IO_URING == backend) {
+    UartUringDestroy();
+  }
+#endif
+
+  if (uart_fd >= 0) {
+    close(uart_fd);
+    uart_fd = -1;
+  }
+
+  if (epoll_fd >= 0) {
+    close(epoll_fd);
+    epoll_fd = -1;
+  }
+
+  if (exit_fd >= 0) {
+    close(exit_fd);
+    exit_fd = -1;
+  }
+
+  if (NULL != tx_ring) {
+    RingBufferDestroy(tx_ring);
+    tx_ring = NULL;
+  }
 
-static int _set_speed(speed_t *speed) {
-  int status;
-  struct termios options;
+  if (NULL != rx_stage) {
+    RingBufferDestroy(rx_stage);
+    rx_stage = NULL;
+    rx_stage_size = 0;
+  }
+
+  if (NULL != capture) {
+    CaptureDestroy(capture);
+    capture = NULL;
+  }
+}
+
+/* bytes arriving during worst parser stall, the most rx stage ever holds */
+static int _rx_stage_cap(uint32_t baud) {
+  uint64_t cap = (uint64_t)baud / 10 * rx_stall_ms / 1000;
+  cap = uni_min(cap, (uint64_t)UART_RX_STAGE_MAX);
+  return (int)uni_max(cap, (uint64_t)UART_READ_BUF_SIZE);
+}
+
+static int _epoll_create() {
+  struct epoll_event ev;
 
-  tcgetattr(uart_fd, &options);
-  tcflush(uart_fd, TCIOFLUSH);
-  cfsetispeed(&options, *speed);
-  cfsetospeed(&options, *speed);
+  epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+  exit_fd  = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+  if (epoll_fd < 0 || exit_fd < 0) {
+    LOGE(TAG, "create epoll failed[%s]", strerror(errno));
+    return -1;
+  }
 
-  status = tcsetattr(uart_fd, TCSANOW, &options);
-  if (0 != status) {
+  ev.events  = EPOLLIN;
+  ev.data.fd = uart_fd;
+  if (0 != epoll_ctl(epoll_fd, EPOLL_CTL_ADD, uart_fd, &ev)) {
+    LOGE(TAG, "epoll add uart failed[%s]", strerror(errno));
     return -1;
   }
 
-  tcflush(uart_fd, TCIOFLUSH);
+  ev.events  = EPOLLIN;
+  ev.data.fd = exit_fd;
+  if (0 != epoll_ctl(epoll_fd, EPOLL_CTL_ADD, exit_fd, &ev)) {
+    LOGE(TAG, "epoll add eventfd failed[%s]", strerror(errno));
+    return -1;
+  }
 
   return 0;
 }
 
-static void _set_option(struct termios *options) {
-  cfmakeraw(options);            /* 配置为原始模式 */
-  options->c_cflag    &= ~CSIZE;
-  options->c_cflag    |= CS8;       /* 8位数据位 */
-  options->c_iflag    |= INPCK;     /* disable parity checking */
-  options->c_cflag    &= ~CSTOPB;   /* 一个停止位 */
-  options->c_cc[VTIME] = 0;      /*设置等待时间*/
-  options->c_cc[VMIN]  = 0;       /*最小接收字符*/
+static void _tx_arm_locked(int arm) {
+  struct epoll_event ev;
+  if (tx_armed == arm) {
+    return;
+  }
+
+  ev.events  = arm ? (EPOLLIN | EPOLLOUT) : EPOLLIN;
+  ev.data.fd = uart_fd;
+  uni_mutex_lock(&g_stats_mutex);
+  g_stats.syscalls++;
+  uni_mutex_unlock(&g_stats_mutex);
+  if (0 != epoll_ctl(epoll_fd, EPOLL_CTL_MOD, uart_fd, &ev)) {
+    LOGW(TAG, "epoll mod uart failed[%s]", strerror(errno));
+    return;
+  }
+
+  tx_armed = arm;
+}
+
+/* write queued bytes until ring empty or driver full, tx_mutex held */
+static int _tx_drain_locked() {
+  static char chunk[UART_TX_CHUNK_SIZE];
+  int total = 0;
+  int len, ret;
+
+  while ((len = RingBufferGetDataSize(tx_ring)) > 0) {
+    len = RingBufferPeek(chunk, uni_min(len, (int)sizeof(chunk)), tx_ring);
+    ret = write(uart_fd, chunk, len);
+
+    uni_mutex_lock(&g_stats_mutex);
+    g_stats.syscalls++;
+    g_stats.tx_syscalls++;
+    if (ret < len) {
+      g_stats.tx_stalls++;
+    }
+    uni_mutex_unlock(&g_stats_mutex);
+
+    if (ret <= 0) {
+      if (ret < 0 && EAGAIN != errno && EINTR != errno) {
+        LOGE(TAG, "uart write failed[%s]", strerror(errno));
+        return -1;
+      }
+      break;
+    }
+
+    RingBufferSkip(ret, tx_ring);
+    total += ret;
+    if (ret < len) {
+      break;
+    }
+  }
+
+  _tx_arm_locked(RingBufferGetDataSize(tx_ring) > 0);
+
+  uni_mutex_lock(&g_stats_mutex);
+  g_stats.tx_queued = RingBufferGetDataSize(tx_ring);
+  uni_mutex_unlock(&g_stats_mutex);
+  return total;
+}
+
+/* caller is rx thread inside parser, e.g. sending an ack into a full tx ring */
+static int _rx_stalled() {
+  return pthread_equal(pthread_self(), rx_thread) && rx_parsing;
 }
 
-static int _set_parity() {
-  struct termios options;
-  if (tcgetattr(uart_fd, &options) != 0) {
+/* double rx stage up to cap, staged bytes move over in order */
+static int _rx_stage_grow() {
+  static char chunk[UART_READ_BUF_SIZE];
+  RingBufferHandle ring;
+  int size = rx_stage_size ? uni_min(rx_stage_size * 2, rx_stage_cap) :
+                             uni_min(UART_READ_BUF_SIZE, rx_stage_cap);
+  int len;
+
+  if (size <= rx_stage_size || NULL == (ring = RingBufferCreate(size))) {
     return -1;
   }
 
-  _set_option(&options);
-  if (tcsetattr(uart_fd, TCSANOW, &options) != 0) {
-    return -1;
+  if (NULL != rx_stage) {
+    while ((len = RingBufferGetDataSize(rx_stage)) > 0) {
+      len = RingBufferRead(chunk, uni_min(len, (int)sizeof(chunk)), rx_stage);
+      RingBufferWrite(ring, chunk, len);
+    }
+    RingBufferDestroy(rx_stage);
   }
 
-  tcflush(uart_fd, TCIOFLUSH);
+  rx_stage = ring;
+  rx_stage_size = size;
   return 0;
 }
 
-static void _free_all() {
-  if (uart_fd) {
-    close(uart_fd);
-    uart_fd = 0;
+/*
+ * parser is stalled on rx thread, keep reading ahead into rx stage so the
+ * tty buffer does not overrun meanwhile. at cap reading stops and the kernel
+ * buffer absorbs the rest, an overflow is counted once per stall
+ */
+static void _rx_stage_fill() {
+  static char buffer[UART_READ_BUF_SIZE];
+  int room, ret;
+
+  while (!rx_stage_full) {
+    room = (NULL == rx_stage) ? 0 : RingBufferGetFreeSize(rx_stage);
+    if (0 == room && 0 != _rx_stage_grow()) {
+      rx_stage_full = 1;
+      uni_mutex_lock(&g_stats_mutex);
+      g_stats.rx_overflow++;
+      uni_mutex_unlock(&g_stats_mutex);
+      LOGW(TAG, "rx stage full, %d bytes staged, parser stalled", rx_stage_size);
+      return;
+    }
+
+    room = RingBufferGetFreeSize(rx_stage);
+    ret = read(uart_fd, buffer, uni_min(room, (int)sizeof(buffer)));
+    uni_mutex_lock(&g_stats_mutex);
+    g_stats.syscalls++;
+    uni_mutex_unlock(&g_stats_mutex);
+    if (ret <= 0) {
+      /* peer closed, stop polling for input until parser returns */
+      rx_stage_full |= (0 == ret && transport->stream);
+      return;
+    }
+
+    RingBufferWrite(rx_stage, buffer, ret);
+    uni_mutex_lock(&g_stats_mutex);
+    g_stats.rx_staged += ret;
+    g_stats.rx_stage_max = uni_max(g_stats.rx_stage_max,
+                                   (uint32_t)RingBufferGetDataSize(rx_stage));
+    uni_mutex_unlock(&g_stats_mutex);
   }
 }
 
-static void *_recv_task(void *arg) {
-  static unsigned char buffer[256] = {0};
-  fd_set rfds;
-  struct timeval tv;
+/* wait for tx room, a stalled rx thread stages incoming bytes meanwhile */
+static int _tx_wait_writable(int timeout_msec) {
+  long deadline = uni_get_clock_time_ms() + timeout_msec;
+  int stalled = _rx_stalled();
+  struct pollfd pfd;
   int ret;
-  int read_len;
 
-  while (is_running) {
-    FD_ZERO(&rfds);
-    FD_SET(uart_fd, &rfds);
-
-    tv.tv_sec  = 0;
-    tv.tv_usec = 100 * 1000;
-
-    ret = select(uart_fd + 1, &rfds, NULL, NULL, &tv);
-    if (0 < ret && FD_ISSET(uart_fd, &rfds)) {
-      read_len = read(uart_fd, buffer, sizeof(buffer));
-      if (read_len > 0) {
-        if (RingBufferGetFreeSize(ringbuf) > read_len) {
-          RingBufferWrite(ringbuf, buffer, read_len);
-        } else {
-          LOGW(TAG, "uart ringbuf full");
-        }
-      }
+  while (1) {
+    pfd.fd      = uart_fd;
+    pfd.events  = (stalled && !rx_stage_full) ? (POLLOUT | POLLIN) : POLLOUT;
+    pfd.revents = 0;
+    ret = poll(&pfd, 1, timeout_msec);
+    if (ret > 0 && (pfd.revents & POLLIN)) {
+      _rx_stage_fill();
+    }
+
+    if (ret <= 0 || (pfd.revents & ~POLLIN)) {
+      return ret;
+    }
+
+    timeout_msec = (int)(deadline - uni_get_clock_time_ms());
+    if (timeout_msec <= 0) {
+      return 0;
     }
   }
+}
 
-  _free_all();
-  return NULL;
+/*
+ * wait for uart readable or, while tx ring not empty, writable. readable
+ * drains fd until EAGAIN and feeds protocol stack directly, no parser thread.
+ * parsing may still stall, e.g. an ack waiting for tx ring room, reads go on
+ * into rx stage then and are parsed first once the parser returns
+ */
+static void _rx_feed(unsigned char *buf, int len) {
+  uint32_t cost;
+
+  CaptureAppend(capture, CAPTURE_DIR_RX, buf, (uint32_t)len);
+  rx_batch_us = uni_get_clock_time_us();
+  rx_parsing = 1;
+  CommProtocolReceiveUartData(buf, len);
+  rx_parsing = 0;
+  cost = (uint32_t)(uni_get_clock_time_us() - rx_batch_us);
+
+  uni_mutex_lock(&g_stats_mutex);
+  g_stats.reads++;
+  g_stats.bytes += len;
+  g_stats.max_read = uni_max(g_stats.max_read, (uint32_t)len);
+  g_stats.rx_parse_max_us = uni_max(g_stats.rx_parse_max_us, cost);
+  uni_mutex_unlock(&g_stats_mutex);
 }
 
-static void *_protocol_stack_parse_task(void *args) {
+/* parse bytes staged during a stall, then give memory of a grown stage back */
+static int _rx_stage_drain() {
+  static unsigned char chunk[UART_READ_BUF_SIZE];
+  int total = 0;
   int len;
-  static char buf[128];
-  while (is_running) {
-    len = RingBufferGetDataSize(ringbuf);
-    if (len == 0) {
-      usleep(1000 * 2);
-      continue;
+
+  if (NULL == rx_stage) {
+    return 0;
+  }
+
+  /* parsing may stall again and stage more, even into a regrown ring */
+  while ((len = RingBufferGetDataSize(rx_stage)) > 0) {
+    len = RingBufferRead((char *)chunk, uni_min(len, (int)sizeof(chunk)), rx_stage);
+    _rx_feed(chunk, len);
+    total += len;
+  }
+
+  rx_stage_full = 0;
+  if (rx_stage_size > UART_READ_BUF_SIZE) {
+    RingBufferDestroy(rx_stage);
+    rx_stage = NULL;
+    rx_stage_size = 0;
+  }
+
+  return total;
+}
+
+static void _wakeup_account(int idle) {
+  uni_mutex_lock(&g_stats_mutex);
+  g_stats.wakeups++;
+  if (idle) {
+    g_stats.idle_wakeups++;
+  }
+  uni_mutex_unlock(&g_stats_mutex);
+}
+
+static int _io_once(int timeout_msec) {
+  static unsigned char buffer[UART_READ_BUF_SIZE];
+  struct epoll_event events[2];
+  uint32_t ready = 0;
+  int total = 0;
+  int written = 0;
+  int n, i, ret;
+
+  rx_thread = pthread_self();
+  n = epoll_wait(epoll_fd, events, sizeof(events) / sizeof(events[0]), timeout_msec);
+  uni_mutex_lock(&g_stats_mutex);
+  g_stats.syscalls++;
+  uni_mutex_unlock(&g_stats_mutex);
+  if (n < 0) {
+    return (EINTR == errno) ? 0 : -1;
+  }
+
+  for (i = 0; i < n; i++) {
+    if (events[i].data.fd == exit_fd) {
+      return -1;
     }
+    ready |= events[i].events;
+  }
 
-    len = len > sizeof(buf) ? sizeof(buf) : len;
-    RingBufferRead(buf, len, ringbuf);
-    CommProtocolReceiveUartData((unsigned char *)buf, len);
+  if (ready & EPOLLOUT) {
+    uni_mutex_lock(&tx_mutex);
+    written = _tx_drain_locked();
+    uni_mutex_unlock(&tx_mutex);
   }
+
+  while (1) {
+    ret = read(uart_fd, buffer, sizeof(buffer));
+    uni_mutex_lock(&g_stats_mutex);
+    g_stats.syscalls++;
+    uni_mutex_unlock(&g_stats_mutex);
+    if (0 == ret && transport->stream) {
+      LOGW(TAG, "%s peer closed", transport->name);
+      is_running = 0;
+      return -1;
+    }
+
+    if (ret <= 0) {
+      break;
+    }
+
+    _rx_feed(buffer, ret);
+    total += ret + _rx_stage_drain();
+  }
+
+  _wakeup_account(0 == total && written <= 0);
+  return total;
+}
+
+static int _run_once(int timeout_msec) {
+#ifdef UNI_UART_IO_URING
+  int ret;
+  if (UART_BACKEND_IO_URING == backend) {
+    ret = UartUringRun(timeout_msec);
+    if (ret >= 0) {
+      _wakeup_account(0 == ret);
+    }
+    return ret;
+  }
+#endif
+
+  return _io_once(timeout_msec);
+}
+
+static void *_recv_task(void *arg) {
+  while (is_running) {
+    if (_run_once(-1) < 0 && is_running) {
+      LOGE(TAG, "uart io failed[%s]", strerror(errno));
+      break;
+    }
+  }
+
+  _free_all();
+  return NULL;
 }
 
 static int _create_worker_thread() {
   pthread_t pid;
-  pthread_create(&pid, NULL, _recv_task, NULL);
-  pthread_detach(pid);
+  if (0 != pthread_create(&pid, NULL, _recv_task, NULL)) {
+    return -1;
+  }
 
-  pthread_create(&pid, NULL, _protocol_stack_parse_task, NULL);
   pthread_detach(pid);
   return 0;
 }
 
-int UartInitialize(UartConfig *config) {
-  uart_fd = open(config->device, O_RDWR | O_NOCTTY | O_NDELAY);
-  if (-1 == uart_fd) {
-    LOGE(TAG, "open %s failed[%s]", config->device, strerror(errno));
+static int _epoll_backend_create() {
+  if (0 != _epoll_create()) {
     return -1;
   }
 
-  if (0 != _set_speed(&config->speed)) {
-    LOGE(TAG, "set speed failed");
+  tx_ring = RingBufferCreate(UART_TX_RING_SIZE);
+  if (NULL == tx_ring) {
+    LOGE(TAG, "create tx ring failed");
     return -1;
   }
 
-  if (0 != _set_parity()) {
-    LOGE(TAG, "set parity failed");
+  tx_armed = 0;
+  uni_mutex_new(&tx_mutex);
+  return 0;
+}
+
+static int _backend_create(UartBackend wanted) {
+  backend = UART_BACKEND_EPOLL;
+  if (UART_BACKEND_IO_URING == wanted) {
+#ifdef UNI_UART_IO_URING
+    if (0 == UartUringCreate(uart_fd, _rx_feed, rx_stage_cap)) {
+      backend = UART_BACKEND_IO_URING;
+      return 0;
+    }
+    LOGW(TAG, "io_uring unavailable, fall back to epoll");
+#else
+    LOGW(TAG, "built without io_uring, fall back to epoll");
+#endif
+  }
+
+  return _epoll_backend_create();
+}
+
+int UartInitialize(UartConfig *config) {
+  const char *address;
+
+  transport = TransportLookup(config->device, &address);
+  uart_fd = transport->open(address, config->speed, config->baud);
+  if (-1 == uart_fd) {
+    LOGE(TAG, "open %s link %s failed", transport->name, address);
+    return -1;
+  }
+
+  rx_stall_ms = config->rx_stall_ms ? config->rx_stall_ms : UART_RX_STALL_MS;
+  rx_stage_cap = _rx_stage_cap(transport->get_baud(uart_fd));
+  rx_stage_full = 0;
+  rx_overruns_base = transport->overruns(uart_fd);
+
+  uni_mutex_new(&g_stats_mutex);
+  MZERO(&g_stats);
+  g_stats.rx_stage_cap = rx_stage_cap;
+  if (0 != _backend_create(config->backend)) {
+    _free_all();
     return -1;
   }
 
-  ringbuf = RingBufferCreate(1024);
+  g_stats.backend = backend;
   is_running = 1;
-  _create_worker_thread();
+  poll_mode = config->poll_mode;
+  if (poll_mode) {
+    LOGD(TAG, "uart init success, poll mode");
+    return 0;
+  }
+
+  if (0 != _create_worker_thread()) {
+    LOGE(TAG, "create rx thread failed");
+    _free_all();
+    return -1;
+  }
 
   LOGD(TAG, "uart init success");
   return 0;
 }
 
 int UartFinalize() {
+  uint64_t one = 1;
+  if (0 != UartFlush(UART_TX_BLOCK_MS)) {
+    LOGW(TAG, "tx flush timeout, queued bytes dropped");
+  }
+
   is_running = 0;
+  if (poll_mode) {
+    _free_all();
+    return 0;
+  }
+
+#ifdef UNI_UART_IO_URING
+  if (UART_BACKEND_IO_URING == backend) {
+    UartUringWake();
+    return 0;
+  }
+#endif
+
+  /* rx thread closes fds on exit */
+  if (sizeof(one) != write(exit_fd, &one, sizeof(one))) {
+    LOGW(TAG, "wake rx thread failed[%s]", strerror(errno));
+  }
+  return 0;
+}
+
+/* queue whole remainder of a frame or nothing, tx_mutex held */
+static int _tx_queue_locked(char *buf, int len) {
+  if (RingBufferGetFreeSize(tx_ring) < len) {
+    return -1;
+  }
+
+  RingBufferWrite(tx_ring, buf, len);
+  _tx_arm_locked(1);
+
+  uni_mutex_lock(&g_stats_mutex);
+  g_stats.tx_queued = RingBufferGetDataSize(tx_ring);
+  g_stats.tx_queued_max = uni_max(g_stats.tx_queued_max, g_stats.tx_queued);
+  uni_mutex_unlock(&g_stats_mutex);
   return 0;
 }
 
+/*
+ * a frame is never truncated on the wire: whatever the driver does not take
+ * right now is queued whole and written by the io thread on EPOLLOUT (or by
+ * UartPoll in poll mode). only when the ring cannot hold the frame the caller
+ * waits for the driver, draining inline without touching the rx path
+ */
 int UartWrite(char *buf, unsigned int len) {
-  return write(uart_fd, buf, len);
+  long deadline = uni_get_clock_time_ms() + UART_TX_BLOCK_MS;
+  int direct = 1;
+  int ret = 0;
+
+  /* frames as handed over, before queuing, a frame later dropped is still recorded */
+  CaptureAppend(capture, CAPTURE_DIR_TX, buf, len);
+
+#ifdef UNI_UART_IO_URING
+  if (UART_BACKEND_IO_URING == backend) {
+    return UartUringWrite(buf, len, UART_TX_BLOCK_MS);
+  }
+#endif
+
+  if (NULL == tx_ring || len > UART_TX_RING_SIZE) {
+    return -1;
+  }
+
+  uni_mutex_lock(&tx_mutex);
+  if (0 == RingBufferGetDataSize(tx_ring)) {
+    ret = write(uart_fd, buf, len);
+    uni_mutex_lock(&g_stats_mutex);
+    g_stats.syscalls++;
+    g_stats.tx_syscalls++;
+    if (ret < (int)len) {
+      g_stats.tx_stalls++;
+    }
+    uni_mutex_unlock(&g_stats_mutex);
+
+    if (ret < 0 && EAGAIN != errno && EINTR != errno) {
+      uni_mutex_unlock(&tx_mutex);
+      LOGE(TAG, "uart write failed[%s]", strerror(errno));
+      return -1;
+    }
+
+    ret = uni_max(ret, 0);
+  }
+
+  while (ret < (int)len && 0 != _tx_queue_locked(buf + ret, len - ret)) {
+    direct = 0;
+    uni_mutex_unlock(&tx_mutex);
+    if (uni_get_clock_time_ms() >= deadline) {
+      uni_mutex_lock(&g_stats_mutex);
+      g_stats.tx_overflow++;
+      uni_mutex_unlock(&g_stats_mutex);
+      LOGW(TAG, "tx ring full, drop frame len=%u", len);
+      return -1;
+    }
+
+    _tx_wait_writable((int)(deadline - uni_get_clock_time_ms()));
+    uni_mutex_lock(&tx_mutex);
+    _tx_drain_locked();
+  }
+
+  uni_mutex_unlock(&tx_mutex);
+
+  uni_mutex_lock(&g_stats_mutex);
+  g_stats.tx_frames++;
+  g_stats.tx_bytes += len;
+  if (direct && ret == (int)len) {
+    g_stats.tx_direct_frames++;
+  }
+  uni_mutex_unlock(&g_stats_mutex);
+  return (int)len;
+}
+
+static int _tx_flush(uint32_t timeout_msec) {
+  long deadline = uni_get_clock_time_ms() + timeout_msec;
+  int remain;
+
+#ifdef UNI_UART_IO_URING
+  if (UART_BACKEND_IO_URING == backend) {
+    return UartUringFlush(timeout_msec);
+  }
+#endif
+
+  if (NULL == tx_ring) {
+    return -1;
+  }
+
+  while (1) {
+    uni_mutex_lock(&tx_mutex);
+    _tx_drain_locked();
+    remain = RingBufferGetDataSize(tx_ring);
+    uni_mutex_unlock(&tx_mutex);
+    if (0 == remain) {
+      return 0;
+    }
+
+    if (uni_get_clock_time_ms() >= deadline) {
+      return -1;
+    }
+
+    _tx_wait_writable((int)(deadline - uni_get_clock_time_ms()));
+  }
+}
+
+int UartFlush(uint32_t timeout_msec) {
+  if (0 != _tx_flush(timeout_msec)) {
+    return -1;
+  }
+
+  /* queue empty, now wait for driver to shift out its own buffer */
+  if (0 != transport->drain(uart_fd)) {
+    LOGW(TAG, "%s drain failed[%s]", transport->name, strerror(errno));
+  }
+
+  return 0;
+}
+
+int UartSetBaud(uint32_t baud) {
+  /* bytes still queued would go out at new rate and turn into garbage */
+  if (0 != UartFlush(UART_TX_BLOCK_MS)) {
+    LOGW(TAG, "tx flush timeout before baud switch");
+  }
+
+  if (0 != transport->set_baud(uart_fd, baud)) {
+    LOGE(TAG, "set baud %u failed[%s]", baud, strerror(errno));
+    return -1;
+  }
+
+  /* io_uring keeps buffers sized at create, epoll stage follows new rate */
+  if (UART_BACKEND_EPOLL == backend) {
+    rx_stage_cap = _rx_stage_cap(baud);
+    uni_mutex_lock(&g_stats_mutex);
+    g_stats.rx_stage_cap = rx_stage_cap;
+    uni_mutex_unlock(&g_stats_mutex);
+  }
+
+  LOGT(TAG, "baud switched to %u", baud);
+  return 0;
+}
+
+uint32_t UartGetBaud(void) {
+  return transport->get_baud(uart_fd);
+}
+
+int UartPoll(uint32_t timeout_msec) {
+  if (!poll_mode || !is_running) {
+    return -1;
+  }
+
+  return _run_once((int)timeout_msec);
+}
+
+void UartFrameReceived(void) {
+  uint32_t cost = (uint32_t)(uni_get_clock_time_us() - rx_batch_us);
+
+  uni_mutex_lock(&g_stats_mutex);
+  g_stats.frames++;
+  g_stats.frame_latency_us = (g_stats.frame_latency_us * 7 + cost) >> 3;
+  g_stats.frame_latency_max_us = uni_max(g_stats.frame_latency_max_us, cost);
+  uni_mutex_unlock(&g_stats_mutex);
+}
+
+int UartGetStats(UartStats *stats) {
+  uint64_t overruns;
+
+  if (NULL == stats) {
+    return -1;
+  }
+
+  uni_mutex_lock(&g_stats_mutex);
+  *stats = g_stats;
+  uni_mutex_unlock(&g_stats_mutex);
+  overruns = transport->overruns(uart_fd);
+  stats->rx_kernel_overruns = overruns > rx_overruns_base ? overruns - rx_overruns_base : 0;
+
+  if (NULL != capture) {
+    CaptureStats capture_stats;
+    CaptureGetStats(capture, &capture_stats);
+    stats->capture_bytes = capture_stats.bytes;
+    stats->capture_dropped = capture_stats.dropped;
+  }
+
+#ifdef UNI_UART_IO_URING
+  if (UART_BACKEND_IO_URING == backend) {
+    UartUringStatsFill(stats);
+  }
+#endif
+  return 0;
+}
+
+int UartCapture(const char *path) {
+  if (NULL == path) {
+    return NULL == capture ? -1 : CaptureStop(capture);
+  }
+
+  if (NULL == capture && NULL == (capture = CaptureCreate(0))) {
+    return -1;
+  }
+
+  return CaptureStart(capture, path);
 }
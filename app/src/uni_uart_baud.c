@@ -0,0 +1,64 @@
+/**************************************************************************
+ * Copyright (C) 2020-2020 Junlon2006
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ **************************************************************************
+ *
+ * Description : uni_uart_baud.c
+ * Author      : junlon2006@163.com
+ * Date        : 2020.08.31
+ *
+ **************************************************************************/
+#include "uni_uart_baud.h"
+
+#include <asm/termbits.h>
+#include <sys/ioctl.h>
+
+#define UART_BAUD_TOLERANCE_DIV  (50)
+
+int UartBaudApply(int fd, uint32_t baud) {
+  struct termios2 options;
+  uint32_t diff;
+  if (0 != ioctl(fd, TCGETS2, &options)) {
+    return -1;
+  }
+
+  options.c_cflag &= ~CBAUD;
+  options.c_cflag |= BOTHER;
+  options.c_cflag &= ~(CBAUD << IBSHIFT);
+  options.c_cflag |= BOTHER << IBSHIFT;
+  options.c_ispeed = baud;
+  options.c_ospeed = baud;
+  if (0 != ioctl(fd, TCSETS2, &options)) {
+    return -1;
+  }
+
+  /* driver rounds to what its divider can do, more than 2% off breaks framing */
+  if (0 != ioctl(fd, TCGETS2, &options)) {
+    return -1;
+  }
+
+  diff = (options.c_ospeed > baud) ? options.c_ospeed - baud : baud - options.c_ospeed;
+  return (diff * UART_BAUD_TOLERANCE_DIV > baud) ? -1 : 0;
+}
+
+uint32_t UartBaudCurrent(int fd) {
+  struct termios2 options;
+  if (0 != ioctl(fd, TCGETS2, &options)) {
+    return 0;
+  }
+
+  return options.c_ospeed;
+}
@@ -0,0 +1,761 @@
+/**************************************************************************
+ * Copyright (C) 2020-2020 Junlon2006
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ **************************************************************************
+ *
+ * Description : uni_uart_uring.c
+ * Author      : junlon2006@163.com
+ * Date        : 2020.08.30
+ *
+ **************************************************************************/
+#include "uni_uart_uring.h"
+#include "uni_log.h"
+#include "porting.h"
+
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <errno.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define TAG                       "uart_uring"
+#define URING_ENTRIES             (32)
+#define URING_RX_BUF_CNT_MIN      (16)  /* entries of provided buffer ring, power of 2 */
+#define URING_RX_BUF_CNT_MAX      (4096)
+#define URING_RX_BUF_SIZE         (4096)
+#define URING_RX_BGID             (0)
+#define URING_TX_BUF_SIZE         (16 * 1024)
+#define URING_PROBE_OPS           (256)
+
+/* linux 6.7, missing in older uapi headers */
+#define URING_OP_READ_MULTISHOT   (49)
+
+#define UD_RX                     (1)
+#define UD_TX                     (2)
+#define UD_WAKE                   (3)
+#define UD_MAKE(type, len)        ((__u64)(type) | ((__u64)(len) << 8))
+#define UD_TYPE(ud)               ((uint32_t)((ud) & 0xFF))
+#define UD_LEN(ud)                ((uint32_t)((ud) >> 8))
+
+typedef struct {
+  int                      ring_fd;
+  int                      uart_fd;
+  UartUringRxHandler       rx_handler;
+  void                     *ring_ptr;
+  size_t                   ring_len;
+  struct io_uring_sqe      *sqes;
+  size_t                   sqes_len;
+  unsigned                 *sq_head;
+  unsigned                 *sq_tail;
+  unsigned                 sq_mask;
+  unsigned                 sq_entries;
+  unsigned                 sq_pending;   /* queued in sq, not passed to kernel yet */
+  unsigned                 *cq_head;
+  unsigned                 *cq_tail;
+  unsigned                 cq_mask;
+  struct io_uring_cqe      *cqes;
+  struct io_uring_buf_ring *br;
+  size_t                   br_len;
+  unsigned char            *rx_bufs;
+  uint16_t                 br_tail;
+  int                      rx_armed;
+  uint32_t                 rx_buf_cnt;
+  uint16_t                 *stash_bid;   /* rx held back while writer reaps, fifo of rx_buf_cnt */
+  int                      *stash_len;
+  uint32_t                 stash_head;   /* free running */
+  uint32_t                 stash_tail;
+  uint32_t                 stash_bytes;
+  char                     *tx_buf;
+  uint32_t                 tx_head;      /* free running, written out */
+  uint32_t                 tx_tail;      /* free running, queued */
+  uint32_t                 tx_sqes;      /* writes in flight */
+  uint32_t                 tx_waiters;
+  uni_sem_t                tx_sem;
+  int                      reap_depth;
+  pthread_t                reaper;
+  int                      woken;
+  int                      closed;       /* peer of a socket closed, reaping fails with ECONNRESET */
+  uni_mutex_t              mutex;
+  UartStats                stats;        /* tx_*, rx_stage*, rx_overflow and syscalls only */
+} UartUring;
+
+static UartUring g_uring = {.ring_fd = -1, .uart_fd = -1};
+
+static int _enter(unsigned to_submit, unsigned min_complete, unsigned flags, int timeout_msec) {
+  struct io_uring_getevents_arg arg;
+  struct __kernel_timespec ts;
+
+  MZERO(&arg);
+  if (timeout_msec >= 0 && (flags & IORING_ENTER_GETEVENTS)) {
+    ts.tv_sec  = timeout_msec / 1000;
+    ts.tv_nsec = (timeout_msec % 1000) * 1000000LL;
+    arg.ts     = (__u64)(uintptr_t)&ts;
+  }
+
+  __atomic_add_fetch(&g_uring.stats.syscalls, 1, __ATOMIC_RELAXED);
+  return (int)syscall(__NR_io_uring_enter, g_uring.ring_fd, to_submit, min_complete,
+                      flags | IORING_ENTER_EXT_ARG, &arg, sizeof(arg));
+}
+
+static int _register(unsigned opcode, void *arg, unsigned nr_args) {
+  return (int)syscall(__NR_io_uring_register, g_uring.ring_fd, opcode, arg, nr_args);
+}
+
+static struct io_uring_sqe *_sqe_get_locked() {
+  struct io_uring_sqe *sqe;
+  unsigned tail = *g_uring.sq_tail;
+  if (tail - __atomic_load_n(g_uring.sq_head, __ATOMIC_ACQUIRE) >= g_uring.sq_entries) {
+    return NULL;
+  }
+
+  sqe = &g_uring.sqes[tail & g_uring.sq_mask];
+  memset(sqe, 0, sizeof(*sqe));
+  __atomic_store_n(g_uring.sq_tail, tail + 1, __ATOMIC_RELEASE);
+  g_uring.sq_pending++;
+  return sqe;
+}
+
+static void _submit_locked() {
+  int ret;
+  if (0 == g_uring.sq_pending) {
+    return;
+  }
+
+  ret = _enter(g_uring.sq_pending, 0, 0, -1);
+  if (ret > 0) {
+    g_uring.sq_pending -= uni_min((unsigned)ret, g_uring.sq_pending);
+  }
+}
+
+static int _is_reaper_locked() {
+  return g_uring.reap_depth > 0 && pthread_equal(g_uring.reaper, pthread_self());
+}
+
+static void _rx_arm_locked() {
+  struct io_uring_sqe *sqe = _sqe_get_locked();
+  if (NULL == sqe) {
+    return;
+  }
+
+  sqe->opcode    = URING_OP_READ_MULTISHOT;
+  sqe->fd        = g_uring.uart_fd;
+  sqe->flags     = IOSQE_BUFFER_SELECT;
+  sqe->buf_group = URING_RX_BGID;
+  sqe->off       = (__u64)-1;
+  sqe->user_data = UD_MAKE(UD_RX, 0);
+  g_uring.rx_armed = 1;
+}
+
+static void _rx_recycle(uint16_t bid) {
+  struct io_uring_buf *buf;
+  uni_mutex_lock(&g_uring.mutex);
+  buf = &g_uring.br->bufs[g_uring.br_tail & (g_uring.rx_buf_cnt - 1)];
+  buf->addr = (__u64)(uintptr_t)(g_uring.rx_bufs + (size_t)bid * URING_RX_BUF_SIZE);
+  buf->len  = URING_RX_BUF_SIZE;
+  buf->bid  = bid;
+  g_uring.br_tail++;
+  __atomic_store_n(&g_uring.br->tail, g_uring.br_tail, __ATOMIC_RELEASE);
+  uni_mutex_unlock(&g_uring.mutex);
+}
+
+static void _rx_deliver(uint16_t bid, int len) {
+  g_uring.rx_handler(g_uring.rx_bufs + (size_t)bid * URING_RX_BUF_SIZE, len);
+  _rx_recycle(bid);
+}
+
+static void _rx_stash(uint16_t bid, int len) {
+  uint32_t i = g_uring.stash_tail++ & (g_uring.rx_buf_cnt - 1);
+  g_uring.stash_bid[i] = bid;
+  g_uring.stash_len[i] = len;
+  g_uring.stash_bytes += len;
+
+  uni_mutex_lock(&g_uring.mutex);
+  g_uring.stats.rx_staged += len;
+  g_uring.stats.rx_stage_max = uni_max(g_uring.stats.rx_stage_max, g_uring.stash_bytes);
+  uni_mutex_unlock(&g_uring.mutex);
+}
+
+/* oldest first, parsing may stall again and stash more behind */
+static int _rx_stash_flush() {
+  int cnt = 0;
+  uint32_t i;
+
+  while (g_uring.stash_head != g_uring.stash_tail) {
+    i = g_uring.stash_head++ & (g_uring.rx_buf_cnt - 1);
+    g_uring.stash_bytes -= g_uring.stash_len[i];
+    _rx_deliver(g_uring.stash_bid[i], g_uring.stash_len[i]);
+    cnt++;
+  }
+
+  return cnt;
+}
+
+/* one whole pending region, a region wrapping buffer end is two linked writes */
+static void _tx_kick_locked() {
+  struct io_uring_sqe *sqe;
+  uint32_t pending = g_uring.tx_tail - g_uring.tx_head;
+  uint32_t offset  = g_uring.tx_head % URING_TX_BUF_SIZE;
+  uint32_t len;
+
+  while (0 == g_uring.tx_sqes && pending > 0) {
+    len = uni_min(pending, URING_TX_BUF_SIZE - offset);
+    if (NULL == (sqe = _sqe_get_locked())) {
+      return;
+    }
+
+    sqe->opcode    = IORING_OP_WRITE_FIXED;
+    sqe->fd        = g_uring.uart_fd;
+    sqe->addr      = (__u64)(uintptr_t)(g_uring.tx_buf + offset);
+    sqe->len       = len;
+    sqe->off       = (__u64)-1;
+    sqe->buf_index = 0;
+    sqe->user_data = UD_MAKE(UD_TX, len);
+    g_uring.tx_sqes++;
+    if (len == pending) {
+      break;
+    }
+
+    sqe->flags = IOSQE_IO_LINK;
+    if (NULL == (sqe = _sqe_get_locked())) {
+      return;
+    }
+
+    sqe->opcode    = IORING_OP_WRITE_FIXED;
+    sqe->fd        = g_uring.uart_fd;
+    sqe->addr      = (__u64)(uintptr_t)g_uring.tx_buf;
+    sqe->len       = pending - len;
+    sqe->off       = (__u64)-1;
+    sqe->buf_index = 0;
+    sqe->user_data = UD_MAKE(UD_TX, pending - len);
+    g_uring.tx_sqes++;
+    break;
+  }
+}
+
+static void _tx_complete(int res, uint32_t len) {
+  uni_mutex_lock(&g_uring.mutex);
+  g_uring.tx_sqes--;
+  if (res > 0) {
+    g_uring.tx_head += res;
+  }
+
+  /* short write, or rest of link canceled by it */
+  if (res != (int)len) {
+    g_uring.stats.tx_stalls++;
+  }
+
+  if (res < 0 && -ECANCELED != res && -EAGAIN != res && -EINTR != res) {
+    LOGE(TAG, "uart write failed[%s], drop %u bytes", strerror(-res),
+         g_uring.tx_tail - g_uring.tx_head);
+    g_uring.tx_head = g_uring.tx_tail;
+  }
+
+  _tx_kick_locked();
+  g_uring.stats.tx_queued = g_uring.tx_tail - g_uring.tx_head;
+  for (; g_uring.tx_waiters > 0; g_uring.tx_waiters--) {
+    uni_sem_signal(&g_uring.tx_sem);
+  }
+  uni_mutex_unlock(&g_uring.mutex);
+}
+
+static int _cq_drain(int defer_rx) {
+  struct io_uring_cqe *cqe;
+  unsigned head = *g_uring.cq_head;
+  int handled = 0;
+  __u64 user_data;
+  uint32_t flags;
+  int res;
+
+  while (head != __atomic_load_n(g_uring.cq_tail, __ATOMIC_ACQUIRE)) {
+    cqe       = &g_uring.cqes[head & g_uring.cq_mask];
+    user_data = cqe->user_data;
+    res       = cqe->res;
+    flags     = cqe->flags;
+    /* release slot before handling, handler may reap again through UartUringWrite */
+    __atomic_store_n(g_uring.cq_head, ++head, __ATOMIC_RELEASE);
+    handled++;
+
+    switch (UD_TYPE(user_data)) {
+    case UD_RX:
+      if (flags & IORING_CQE_F_BUFFER) {
+        uint16_t bid = (uint16_t)(flags >> IORING_CQE_BUFFER_SHIFT);
+        if (res <= 0) {
+          _rx_recycle(bid);
+        } else if (defer_rx) {
+          _rx_stash(bid, res);
+        } else {
+          /* rx stashed by a nested reap is older, keep arrival order */
+          handled += _rx_stash_flush();
+          _rx_deliver(bid, res);
+        }
+      }
+
+      if (!(flags & IORING_CQE_F_MORE)) {
+        if (res < 0 && -ENOBUFS != res) {
+          LOGW(TAG, "multishot read stopped[%s]", strerror(-res));
+        }
+        uni_mutex_lock(&g_uring.mutex);
+        /* end of file, only a socket peer closing gets here, rx stops for good */
+        if (0 == res) {
+          LOGW(TAG, "peer closed");
+          g_uring.closed = 1;
+          g_uring.woken = 1;
+        }
+        /* every buffer waits for parser, kernel tty buffer takes over */
+        if (-ENOBUFS == res) {
+          g_uring.stats.rx_overflow++;
+        }
+        g_uring.rx_armed = 0;
+        uni_mutex_unlock(&g_uring.mutex);
+      }
+      break;
+    case UD_TX:
+      _tx_complete(res, UD_LEN(user_data));
+      break;
+    case UD_WAKE:
+      g_uring.woken = 1;
+      break;
+    default:
+      break;
+    }
+
+    head = *g_uring.cq_head;
+  }
+
+  return handled;
+}
+
+static int _cq_ready() {
+  return *g_uring.cq_head != __atomic_load_n(g_uring.cq_tail, __ATOMIC_ACQUIRE);
+}
+
+/*
+ * reaping thread only. ready completions are taken without any syscall,
+ * otherwise pending submissions and the wait share one io_uring_enter
+ */
+static int _reap(int timeout_msec, int defer_rx) {
+  unsigned to_submit;
+  int handled = 0;
+  int ret;
+
+  if (!defer_rx) {
+    handled += _rx_stash_flush();
+  }
+
+  uni_mutex_lock(&g_uring.mutex);
+  if (!g_uring.rx_armed && g_uring.stash_head == g_uring.stash_tail) {
+    _rx_arm_locked();
+  }
+  to_submit = g_uring.sq_pending;
+  g_uring.sq_pending = 0;
+  uni_mutex_unlock(&g_uring.mutex);
+
+  if (_cq_ready()) {
+    ret = to_submit ? _enter(to_submit, 0, 0, -1) : 0;
+  } else if (0 == timeout_msec) {
+    ret = to_submit ? _enter(to_submit, 0, 0, -1) : 0;
+  } else {
+    ret = _enter(to_submit, 1, IORING_ENTER_GETEVENTS, timeout_msec);
+  }
+
+  if (ret < 0 && ETIME != errno && EINTR != errno) {
+    LOGE(TAG, "io_uring_enter failed[%s]", strerror(errno));
+    return -1;
+  }
+
+  if (ret >= 0 && (unsigned)ret < to_submit) {
+    uni_mutex_lock(&g_uring.mutex);
+    g_uring.sq_pending += to_submit - ret;
+    uni_mutex_unlock(&g_uring.mutex);
+  }
+
+  handled += _cq_drain(defer_rx);
+  if (g_uring.closed) {
+    errno = ECONNRESET;
+  }
+  return g_uring.woken ? -1 : handled;
+}
+
+static int _reaper_acquire() {
+  int ok = 0;
+  uni_mutex_lock(&g_uring.mutex);
+  if (0 == g_uring.reap_depth || pthread_equal(g_uring.reaper, pthread_self())) {
+    g_uring.reaper = pthread_self();
+    g_uring.reap_depth++;
+    ok = 1;
+  }
+  uni_mutex_unlock(&g_uring.mutex);
+  return ok;
+}
+
+static void _reaper_release() {
+  uni_mutex_lock(&g_uring.mutex);
+  g_uring.reap_depth--;
+  uni_mutex_unlock(&g_uring.mutex);
+}
+
+/*
+ * wait until tx buffer holds at most limit bytes, mutex held. the reaping
+ * thread (or anyone while no thread reaps) reaps itself with rx held back,
+ * parsing must not nest into a write, other threads sleep on tx_sem
+ */
+static int _tx_wait_locked(uint32_t limit, long deadline) {
+  long now;
+  while (g_uring.tx_tail - g_uring.tx_head > limit) {
+    now = uni_get_clock_time_ms();
+    if (now >= deadline || g_uring.woken) {
+      return -1;
+    }
+
+    if (g_uring.reap_depth > 0 && !_is_reaper_locked()) {
+      _submit_locked();
+      g_uring.tx_waiters++;
+      uni_mutex_unlock(&g_uring.mutex);
+      uni_sem_wait(&g_uring.tx_sem, (unsigned int)(deadline - now));
+      uni_mutex_lock(&g_uring.mutex);
+      continue;
+    }
+
+    uni_mutex_unlock(&g_uring.mutex);
+    if (_reaper_acquire()) {
+      _reap((int)(deadline - now), 1);
+      _reaper_release();
+    }
+    uni_mutex_lock(&g_uring.mutex);
+  }
+
+  return 0;
+}
+
+int UartUringWrite(char *buf, unsigned int len, uint32_t timeout_msec) {
+  long deadline = uni_get_clock_time_ms() + timeout_msec;
+  uint32_t offset, first;
+
+  if (g_uring.ring_fd < 0 || len > URING_TX_BUF_SIZE) {
+    return -1;
+  }
+
+  uni_mutex_lock(&g_uring.mutex);
+  if (0 != _tx_wait_locked(URING_TX_BUF_SIZE - len, deadline)) {
+    g_uring.stats.tx_overflow++;
+    uni_mutex_unlock(&g_uring.mutex);
+    LOGW(TAG, "tx buffer full, drop frame len=%u", len);
+    return -1;
+  }
+
+  offset = g_uring.tx_tail % URING_TX_BUF_SIZE;
+  first  = uni_min(len, URING_TX_BUF_SIZE - offset);
+  memcpy(g_uring.tx_buf + offset, buf, first);
+  memcpy(g_uring.tx_buf, buf + first, len - first);
+
+  if (0 == g_uring.tx_sqes) {
+    g_uring.stats.tx_direct_frames++;
+  }
+
+  g_uring.tx_tail += len;
+  g_uring.stats.tx_frames++;
+  g_uring.stats.tx_bytes += len;
+  g_uring.stats.tx_queued = g_uring.tx_tail - g_uring.tx_head;
+  g_uring.stats.tx_queued_max = uni_max(g_uring.stats.tx_queued_max, g_uring.stats.tx_queued);
+  _tx_kick_locked();
+
+  /* reaping thread is blocked in io_uring_enter, submit by ourselves */
+  if (g_uring.reap_depth > 0 && !_is_reaper_locked() && g_uring.sq_pending > 0) {
+    g_uring.stats.tx_syscalls++;
+    _submit_locked();
+  }
+  uni_mutex_unlock(&g_uring.mutex);
+  return (int)len;
+}
+
+int UartUringFlush(uint32_t timeout_msec) {
+  int ret;
+  uni_mutex_lock(&g_uring.mutex);
+  ret = _tx_wait_locked(0, uni_get_clock_time_ms() + timeout_msec);
+  uni_mutex_unlock(&g_uring.mutex);
+  return ret;
+}
+
+int UartUringRun(int timeout_msec) {
+  int ret;
+  if (!_reaper_acquire()) {
+    return -1;
+  }
+
+  ret = _reap(timeout_msec, 0);
+  _reaper_release();
+  return ret;
+}
+
+void UartUringWake(void) {
+  struct io_uring_sqe *sqe;
+  uni_mutex_lock(&g_uring.mutex);
+  g_uring.woken = 1;
+  if (NULL != (sqe = _sqe_get_locked())) {
+    sqe->opcode    = IORING_OP_NOP;
+    sqe->user_data = UD_MAKE(UD_WAKE, 0);
+    _submit_locked();
+  }
+
+  for (; g_uring.tx_waiters > 0; g_uring.tx_waiters--) {
+    uni_sem_signal(&g_uring.tx_sem);
+  }
+  uni_mutex_unlock(&g_uring.mutex);
+}
+
+void UartUringStatsFill(UartStats *stats) {
+  uni_mutex_lock(&g_uring.mutex);
+  stats->tx_frames        = g_uring.stats.tx_frames;
+  stats->tx_bytes         = g_uring.stats.tx_bytes;
+  stats->tx_direct_frames = g_uring.stats.tx_direct_frames;
+  stats->tx_syscalls      = g_uring.stats.tx_syscalls;
+  stats->tx_stalls        = g_uring.stats.tx_stalls;
+  stats->tx_overflow      = g_uring.stats.tx_overflow;
+  stats->tx_queued        = g_uring.stats.tx_queued;
+  stats->tx_queued_max    = g_uring.stats.tx_queued_max;
+  stats->rx_staged        = g_uring.stats.rx_staged;
+  stats->rx_stage_max     = g_uring.stats.rx_stage_max;
+  stats->rx_stage_cap     = g_uring.rx_buf_cnt * URING_RX_BUF_SIZE;
+  stats->rx_overflow      = g_uring.stats.rx_overflow;
+  stats->syscalls        += __atomic_load_n(&g_uring.stats.syscalls, __ATOMIC_RELAXED);
+  uni_mutex_unlock(&g_uring.mutex);
+}
+
+static int _probe() {
+  struct io_uring_probe *probe;
+  size_t size = sizeof(*probe) + URING_PROBE_OPS * sizeof(struct io_uring_probe_op);
+  int ok;
+
+  if (NULL == (probe = uni_malloc(size))) {
+    return -1;
+  }
+
+  memset(probe, 0, size);
+  ok = (0 == _register(IORING_REGISTER_PROBE, probe, URING_PROBE_OPS) &&
+        probe->ops_len > URING_OP_READ_MULTISHOT &&
+        (probe->ops[URING_OP_READ_MULTISHOT].flags & IO_URING_OP_SUPPORTED) &&
+        (probe->ops[IORING_OP_WRITE_FIXED].flags & IO_URING_OP_SUPPORTED));
+  uni_free(probe);
+  return ok ? 0 : -1;
+}
+
+static int _ring_map(struct io_uring_params *p) {
+  size_t sq_len = p->sq_off.array + p->sq_entries * sizeof(unsigned);
+  size_t cq_len = p->cq_off.cqes + p->cq_entries * sizeof(struct io_uring_cqe);
+  unsigned *sq_array;
+  unsigned i;
+  char *ring;
+
+  g_uring.ring_len = uni_max(sq_len, cq_len);
+  g_uring.ring_ptr = mmap(NULL, g_uring.ring_len, PROT_READ | PROT_WRITE,
+                          MAP_SHARED | MAP_POPULATE, g_uring.ring_fd, IORING_OFF_SQ_RING);
+  if (MAP_FAILED == g_uring.ring_ptr) {
+    g_uring.ring_ptr = NULL;
+    return -1;
+  }
+
+  g_uring.sqes_len = p->sq_entries * sizeof(struct io_uring_sqe);
+  g_uring.sqes = mmap(NULL, g_uring.sqes_len, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, g_uring.ring_fd, IORING_OFF_SQES);
+  if (MAP_FAILED == g_uring.sqes) {
+    g_uring.sqes = NULL;
+    return -1;
+  }
+
+  ring = (char *)g_uring.ring_ptr;
+  g_uring.sq_head    = (unsigned *)(ring + p->sq_off.head);
+  g_uring.sq_tail    = (unsigned *)(ring + p->sq_off.tail);
+  g_uring.sq_mask    = *(unsigned *)(ring + p->sq_off.ring_mask);
+  g_uring.sq_entries = p->sq_entries;
+  g_uring.cq_head    = (unsigned *)(ring + p->cq_off.head);
+  g_uring.cq_tail    = (unsigned *)(ring + p->cq_off.tail);
+  g_uring.cq_mask    = *(unsigned *)(ring + p->cq_off.ring_mask);
+  g_uring.cqes       = (struct io_uring_cqe *)(ring + p->cq_off.cqes);
+
+  /* sqe index i always sits in slot i */
+  sq_array = (unsigned *)(ring + p->sq_off.array);
+  for (i = 0; i < p->sq_entries; i++) {
+    sq_array[i] = i;
+  }
+
+  return 0;
+}
+
+static int _buffers_register() {
+  struct io_uring_buf_reg reg;
+  struct iovec iov;
+  uint16_t i;
+
+  g_uring.tx_buf = uni_malloc(URING_TX_BUF_SIZE);
+  g_uring.rx_bufs = uni_malloc((size_t)g_uring.rx_buf_cnt * URING_RX_BUF_SIZE);
+  g_uring.stash_bid = uni_malloc(g_uring.rx_buf_cnt * sizeof(uint16_t));
+  g_uring.stash_len = uni_malloc(g_uring.rx_buf_cnt * sizeof(int));
+  if (NULL == g_uring.tx_buf || NULL == g_uring.rx_bufs ||
+      NULL == g_uring.stash_bid || NULL == g_uring.stash_len) {
+    return -1;
+  }
+
+  iov.iov_base = g_uring.tx_buf;
+  iov.iov_len  = URING_TX_BUF_SIZE;
+  if (0 != _register(IORING_REGISTER_BUFFERS, &iov, 1)) {
+    LOGW(TAG, "register tx buffer failed[%s]", strerror(errno));
+    return -1;
+  }
+
+  g_uring.br_len = g_uring.rx_buf_cnt * sizeof(struct io_uring_buf);
+  g_uring.br = mmap(NULL, g_uring.br_len, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (MAP_FAILED == g_uring.br) {
+    g_uring.br = NULL;
+    return -1;
+  }
+
+  MZERO(&reg);
+  reg.ring_addr    = (__u64)(uintptr_t)g_uring.br;
+  reg.ring_entries = g_uring.rx_buf_cnt;
+  reg.bgid         = URING_RX_BGID;
+  if (0 != _register(IORING_REGISTER_PBUF_RING, &reg, 1)) {
+    LOGW(TAG, "register rx buffer ring failed[%s]", strerror(errno));
+    return -1;
+  }
+
+  for (i = 0; i < g_uring.rx_buf_cnt; i++) {
+    _rx_recycle(i);
+  }
+
+  return 0;
+}
+
+void UartUringDestroy(void) {
+  if (NULL != g_uring.sqes) {
+    munmap(g_uring.sqes, g_uring.sqes_len);
+  }
+
+  if (NULL != g_uring.ring_ptr) {
+    munmap(g_uring.ring_ptr, g_uring.ring_len);
+  }
+
+  /* closing ring drops registered buffers and buffer ring */
+  if (g_uring.ring_fd >= 0) {
+    close(g_uring.ring_fd);
+    uni_sem_free(&g_uring.tx_sem);
+    uni_mutex_free(&g_uring.mutex);
+  }
+
+  if (NULL != g_uring.br) {
+    munmap(g_uring.br, g_uring.br_len);
+  }
+
+  if (NULL != g_uring.tx_buf) {
+    uni_free(g_uring.tx_buf);
+  }
+
+  if (NULL != g_uring.rx_bufs) {
+    uni_free(g_uring.rx_bufs);
+  }
+
+  if (NULL != g_uring.stash_bid) {
+    uni_free(g_uring.stash_bid);
+  }
+
+  if (NULL != g_uring.stash_len) {
+    uni_free(g_uring.stash_len);
+  }
+
+  MZERO(&g_uring);
+  g_uring.ring_fd = -1;
+  g_uring.uart_fd = -1;
+}
+
+/* a multishot read the kernel refuses on this fd fails at once, inline with submit */
+static int _rx_arm_check() {
+  struct io_uring_cqe *cqe;
+  if (!_cq_ready()) {
+    return 0;
+  }
+
+  cqe = &g_uring.cqes[*g_uring.cq_head & g_uring.cq_mask];
+  if (UD_RX == UD_TYPE(cqe->user_data) && cqe->res < 0 &&
+      !(cqe->flags & IORING_CQE_F_MORE)) {
+    LOGW(TAG, "multishot read unsupported on uart fd[%s]", strerror(-cqe->res));
+    return -1;
+  }
+
+  return 0;
+}
+
+/* enough buffers to hold rx_cap bytes, power of 2 as buffer ring requires */
+static uint32_t _rx_buf_cnt(uint32_t rx_cap) {
+  uint32_t cnt = URING_RX_BUF_CNT_MIN;
+  while (cnt < URING_RX_BUF_CNT_MAX && (uint64_t)cnt * URING_RX_BUF_SIZE < rx_cap) {
+    cnt <<= 1;
+  }
+
+  return cnt;
+}
+
+int UartUringCreate(int fd, UartUringRxHandler rx_handler, uint32_t rx_cap) {
+  struct io_uring_params params;
+  int flags;
+
+  MZERO(&g_uring);
+  g_uring.uart_fd    = fd;
+  g_uring.rx_handler = rx_handler;
+  g_uring.rx_buf_cnt = _rx_buf_cnt(rx_cap);
+  MZERO(&params);
+  g_uring.ring_fd = (int)syscall(__NR_io_uring_setup, URING_ENTRIES, &params);
+  if (g_uring.ring_fd < 0) {
+    LOGW(TAG, "io_uring_setup failed[%s]", strerror(errno));
+    return -1;
+  }
+
+  uni_mutex_new(&g_uring.mutex);
+  uni_sem_new(&g_uring.tx_sem, 0);
+  if (!(params.features & IORING_FEAT_SINGLE_MMAP) ||
+      !(params.features & IORING_FEAT_EXT_ARG) || 0 != _probe()) {
+    LOGW(TAG, "io_uring lacks multishot read or ext arg");
+    goto L_ERROR;
+  }
+
+  if (0 != _ring_map(&params) || 0 != _buffers_register()) {
+    goto L_ERROR;
+  }
+
+  /* blocking fd, io_uring polls instead of returning EAGAIN */
+  flags = fcntl(fd, F_GETFL);
+  fcntl(fd, F_SETFL, flags & ~O_NONBLOCK);
+
+  uni_mutex_lock(&g_uring.mutex);
+  _rx_arm_locked();
+  _submit_locked();
+  uni_mutex_unlock(&g_uring.mutex);
+  if (0 != _rx_arm_check()) {
+    fcntl(fd, F_SETFL, flags);
+    goto L_ERROR;
+  }
+
+  LOGD(TAG, "io_uring backend ready, sq=%u cq=%u", params.sq_entries, params.cq_entries);
+  return 0;
+
+L_ERROR:
+  UartUringDestroy();
+  return -1;
+}
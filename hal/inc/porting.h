@@ -175,6 +175,15 @@ int uni_msleep(unsigned int msec);
  */
 long uni_get_clock_time_ms(void);
 
+/**
+ * Get monotonic clock time in usecond, used for latency statistics.
+ *
+ * @param[in] void
+ *
+ * @return usecond
+ */
+int64_t uni_get_clock_time_us(void);
+
 /**
  * Get UTC second.
  *
@@ -169,6 +169,12 @@ long uni_get_clock_time_ms(void) {
     return tv.tv_sec * 1000 + tv.tv_usec / 1000;
 }
 
+int64_t uni_get_clock_time_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
 long uni_get_utc_time_sec(void) {
     return time(NULL);
 }
@@ -30,10 +30,80 @@ extern "C" {
 
 #include "uni_channel_common.h"
 #include "uni_communication.h"
+#include "uni_packet_pool.h"
+#include "uni_dispatcher.h"
 #include "porting.h"
 
 typedef void (* hbm_command_cb)(uint32_t cmd, char *payload, uint32_t len);
 
+typedef void (* ChnlCmdHandler)(uint32_t cmd, char *payload, uint32_t len, void *ctx);
+
+/* 协作模式接收驱动：读取并解析串口数据，无数据时最多等待timeout_msec */
+typedef int (* ChnlPollHandler)(uint32_t timeout_msec);
+
+/* 本端串口切换到baud，需先发完已排队数据，返回0成功 */
+typedef int (* ChnlBaudHandler)(uint32_t baud);
+
+typedef enum {
+  CHNL_EXECUTOR_INLINE = 0, //协议栈解析线程直接执行，不拷贝不排队，handler不可阻塞，不可发送可靠传输消息
+  CHNL_EXECUTOR_NORMAL,     //普通事件队列，由共享worker池执行，下同
+  CHNL_EXECUTOR_NON_BLOCK,  //非阻塞事件队列，challenge pack等需要及时应答的消息
+  CHNL_EXECUTOR_IOT,        //IoT事件队列，用户回调，不同cmd可并发执行，同一cmd串行
+} ChnlExecutor;
+
+typedef struct {
+  uint32_t net_connected;
+  uint32_t state_pushes;          //主动推送网络状态次数
+  uint32_t state_push_failed;
+  uint32_t offline_ms;            //累计离线时长
+  uint32_t offline_rasr_ms;       //离线期间RASR会话累计时长
+  uint32_t offline_feed_packets;  //离线期间仍收到的ADPCM包，接收线程直接丢弃
+  uint32_t offline_feed_bytes;    //以上包的UART字节数（含帧头）
+  uint32_t est_uart_saved_bytes;  //离线RASR会话期间按ADPCM码率估算未传输的UART字节数
+  uint32_t est_cpu_saved_us;      //以上省去的包及直接丢弃的包，按在线时每包平均处理耗时估算
+  uint32_t short_feed_packets;    //长度不足一个ADPCM包的数据，直接丢弃
+} ChnlNetStats;
+
+#define CHNL_AUDIO_CHUNK_HISTORY  (16)
+
+typedef struct {
+  uint32_t time_ms;     //相对首次播报推送的时间
+  uint32_t chunk_size;  //调整后的分片大小
+  uint32_t throughput;  //调整时刻链路吞吐 Byte/s
+} ChnlAudioChunkSample;
+
+typedef struct {
+  uint32_t chunk_size;          //当前分片大小，PCM字节
+  uint32_t chunk_min;
+  uint32_t chunk_max;
+  uint32_t pushes;
+  uint32_t push_bytes;          //PCM字节
+  uint32_t push_errors;         //重传耗尽仍未ACK
+  uint32_t push_slow;           //ACK耗时达到重传超时，推断链路发生重传
+  uint32_t credit_queries;      //查询蜂鸟M音频buffer剩余空间次数
+  uint32_t ack_latency_us;      //单包发送至ACK耗时，EWMA
+  uint32_t ack_latency_max_us;
+  uint32_t throughput;          //链路吞吐 Byte/s，EWMA，不含等待credit的时间
+  uint32_t fast_start;          //快速起播投机首发字节数，0表示关闭
+  uint32_t burst_bytes;         //投机首发累计字节
+  uint32_t burst_overcommit;    //credit应答小于已投机发送量的次数
+  uint32_t starts[2];           //起播次数，下同[0]常规起播 [1]快速起播
+  uint32_t start_us[2];         //调用至首包ACK平均耗时
+  uint32_t result_starts[2];    //距识别结果10s内的起播次数
+  uint32_t result_to_audio_ms[2]; //识别结果到达至首包音频ACK平均耗时
+  uint32_t result_to_audio_last_ms;
+  uint32_t history_cnt;         //分片大小累计调整次数，history为最近CHNL_AUDIO_CHUNK_HISTORY次的环形缓冲
+  ChnlAudioChunkSample history[CHNL_AUDIO_CHUNK_HISTORY];
+} ChnlAudioFeedStats;
+
+typedef struct {
+  uint32_t baud;           //协商后的波特率，未切换时为协商前的波特率
+  uint32_t module_max;     //蜂鸟M支持的最高波特率
+  uint32_t attempts;       //尝试切换的波特率个数
+  uint32_t fallbacks;      //校验失败退回原波特率次数
+  uint32_t elapsed_ms;
+} ChnlBaudResult;
+
 /**
  * @brief channel全局初始化
  * @param cmd_callback
@@ -41,6 +111,96 @@ typedef void (* hbm_command_cb)(uint32_t cmd, char *payload, uint32_t len);
  */
 int ChnlInit(hbm_command_cb cmd_callback);
 
+/**
+ * @brief channel协作模式初始化，不创建任何线程，接收、解析、分发及重传均在调用方线程中执行
+ * Tips: 应用循环调用ChnlRunOnce执行排队的handler；发送等待ACK、播报等待credit期间由poll驱动接收，
+ *       此时收到的消息只排队，待当前handler返回后由下一次ChnlRunOnce执行；
+ *       所有channel及通信协议接口只能在同一线程调用，准入策略不支持BLOCK
+ * @param cmd_callback
+ * @param poll 接收驱动，如UartPoll
+ * @return 0 成功, -1 失败
+ */
+int ChnlInitCooperative(hbm_command_cb cmd_callback, ChnlPollHandler poll);
+
+/**
+ * @brief 协作模式下执行排队的handler，handler内嵌套调用时直接返回0
+ * @param max_tasks 最多执行个数，0表示执行到队列中没有可执行的handler
+ * @return 执行的handler个数，-1 非协作模式
+ */
+int ChnlRunOnce(uint32_t max_tasks);
+
+/**
+ * @brief 排队等待执行的handler个数，协作模式下据此决定poll是否需要等待
+ * @return 排队个数
+ */
+uint32_t ChnlPendingTasks(void);
+
+/**
+ * @brief 注册消息处理函数，O(1)直接索引分发；未注册的IoT消息(>CHNL_MSG_HBM_IOT_DEVICE_BASE)仍回调cmd_callback
+ * Tips: 建议在ChnlInit之后、收到对应消息之前完成注册；重复注册覆盖旧handler，handler为NULL表示注销
+ *       运行中可随时重新注册或注销，每次回调使用同一次注册的handler、ctx及executor；
+ *       已排队的消息按执行时的注册处理，替换或注销时已开始的回调仍以旧ctx执行
+ * @param cmd 消息类型
+ * @param handler 处理函数
+ * @param ctx handler私有参数，替换或注销后须保持有效直到旧handler正在执行的回调返回，
+ *            通常为静态生命周期对象；释放前可先注销，再确认旧回调不在执行中
+ * @param executor 执行handler的事件队列/线程
+ * @return 0 成功，-1 失败
+ */
+int ChnlRegisterHandler(CommCmd cmd, ChnlCmdHandler handler, void *ctx,
+                        ChnlExecutor executor);
+
+/**
+ * @brief 设置接收packet准入策略，默认PACKET_POOL_POLICY_DROP
+ * @param policy 预算不足时的处理策略，BLOCK会阻塞协议栈解析线程，超时后丢弃
+ * @param byte_budget 所有在途packet payload字节总预算，0表示不修改
+ * @param block_timeout_msec BLOCK策略最长等待时间
+ * @return 0 成功，-1 失败
+ */
+int ChnlSetAdmissionPolicy(PacketPoolPolicy policy, uint32_t byte_budget,
+                           uint32_t block_timeout_msec);
+
+/**
+ * @brief 获取接收packet占用及丢包统计
+ * @param stats
+ * @return 0 成功，-1 失败
+ */
+int ChnlGetPacketStats(PacketPoolStats *stats);
+
+/**
+ * @brief 设置IoT设备网络状态，状态变化时主动通知蜂鸟M，离线时蜂鸟M暂停推送RASR ADPCM数据，
+ *        challenge pack应答同样携带该状态；离线期间收到的ADPCM包在接收线程直接丢弃
+ * Tips: 默认在线，网络监测模块在连接建立/断开时调用；ChnlInit之前调用仅记录状态
+ * @param connected 1 在线，0 离线
+ * @return 0 成功，-1 通知蜂鸟M失败（状态已记录，下次challenge pack时同步）
+ */
+int ChnlSetNetworkState(int connected);
+
+/**
+ * @brief 获取网络状态及离线节省统计
+ * @param stats
+ * @return 0 成功，-1 失败
+ */
+int ChnlGetNetStats(ChnlNetStats *stats);
+
+/**
+ * @brief 设置执行器handler耗时预算，超时由watchdog告警并计入统计overrun
+ * Tips: 默认NORMAL 200ms，NON_BLOCK 1000ms，IOT 5000ms
+ * @param executor 排队执行器，INLINE不支持
+ * @param budget_msec 0表示关闭
+ * @return 0 成功，-1 失败
+ */
+int ChnlSetHandlerLatencyBudget(ChnlExecutor executor, uint32_t budget_msec);
+
+/**
+ * @brief 获取事件分发统计，class下标0~2依次对应NORMAL、NON_BLOCK、IOT执行器
+ * Tips: worker线程数编译期通过CHNL_DISPATCH_WORKER_CNT配置，默认4；
+ *       IoT回调并发数通过CHNL_IOT_CALLBACK_CONCURRENCY配置，默认2
+ * @param stats
+ * @return 0 成功，-1 失败
+ */
+int ChnlGetDispatchStats(DispatcherStats *stats);
+
 /**
  * @brief channel packet解析函数
  * @param packet
@@ -75,11 +235,75 @@ int ChnlIotDevicePushCmd(unsigned int cmd, char *payload, unsigned int payload_l
  * @brief IoT设备向蜂鸟M发送音频播报raw PCM数据
  * @param pcm pcm数据buffer首指针
  * @param len pcm数据长度字节数 [注意：len必须是512的倍数，除了最后一次可以不是512倍数]
+ * 发送分片大小按ACK耗时、重传及蜂鸟M音频buffer剩余空间自适应调整（AIMD），与len无关
  * Tips: 流式推送，务必满足len的条件，比如音频1026字节数据，推送长度可以是[512，512，2]
  * 如果不采用流式推送，也可以一次推送完，比如音频200K字节，可以一次推送完，len = 200K
+ * 多个IoT回调并发调用时单次调用整体串行，分片推送的调用方需自行保证同一时刻只有一路播报
  */
 int ChnlIotDeviceFeedAudioData(char *pcm, int len);
 
+/**
+ * @brief IoT设备向蜂鸟M发送音频播报raw PCM数据，零拷贝：每个分片的帧头直接组装在分片前
+ *        COMM_PROTOCOL_HEADROOM字节内，不再分配帧并拷贝PCM，适合共享内存环形缓冲（uni_shm_ring.h）
+ * Tips: pcm之前COMM_PROTOCOL_HEADROOM字节须可写，调用期间[pcm - COMM_PROTOCOL_HEADROOM, pcm + len)被改写，
+ *       返回后内容不再是原PCM；分片前的帧头空间为已发送的数据，调用方不可同时写入
+ * @param pcm pcm数据buffer首指针
+ * @param len pcm数据长度字节数 [约束同ChnlIotDeviceFeedAudioData]
+ * @return 0 成功，-1 失败
+ */
+int ChnlIotDeviceFeedAudioDataInPlace(char *pcm, int len);
+
+/**
+ * @brief IoT设备向蜂鸟M发送音频播报数据，raw PCM在发送路径上实时编码为IMA-ADPCM，UART带宽占用为PCM的1/4
+ * @param pcm pcm数据buffer首指针
+ * @param len pcm数据长度字节数 [约束同ChnlIotDeviceFeedAudioData]
+ * @return 0 成功，-1 失败
+ */
+int ChnlIotDeviceFeedAudioDataAdpcm(char *pcm, int len);
+
+/**
+ * @brief 设置播报音频分片大小范围，PCM字节，按128字节对齐
+ * Tips: 默认128~2048，起始512；ACK耗时不超过目标时每个满分片加一个对齐单位，
+ *       超过目标时减一个对齐单位，重传或发送失败时减半
+ * @param chunk_min
+ * @param chunk_max 不超过2048
+ * @return 0 成功，-1 失败
+ */
+int ChnlSetAudioChunkRange(uint32_t chunk_min, uint32_t chunk_max);
+
+/**
+ * @brief 设置快速起播，起播时credit查询与首发数据同时发出，不再等待查询应答后才推送首包
+ * Tips: 距上次推送超过300ms视为起播；首发字节数取burst_bytes与本地剩余空间估计的较大值，
+ *       应答到达后扣除首发量对账，应答不足首发量时计入burst_overcommit
+ *       统计中起播耗时按常规/快速分别累计，可用于开启前后对比
+ * @param enable 1 开启，0 关闭（默认）
+ * @param burst_bytes 投机首发字节数，需不大于蜂鸟M空闲时音频buffer，0使用默认1024
+ * @return 0 成功，-1 失败
+ */
+int ChnlSetAudioFastStart(int enable, uint32_t burst_bytes);
+
+/**
+ * @brief 与蜂鸟M协商波特率，在当前（安全）波特率下查询蜂鸟M支持的波特率，
+ *        从双方共同支持且高于当前的波特率中由高到低逐个尝试：切换、发送测试图样、校验回显，
+ *        校验失败双方退回当前波特率后尝试下一个
+ * Tips: 需在RASR会话及播报开始前调用，协商期间其他可靠传输消息可能因重传而延迟；
+ *       蜂鸟M切换后未收到校验包自行退回，固件默认波特率不变，蜂鸟M重启后需重新协商
+ * @param rates 本端支持的波特率，顺序任意，超过CHNL_BAUD_RATE_MAX个只取前CHNL_BAUD_RATE_MAX个
+ * @param rate_cnt
+ * @param set_local 切换本端串口波特率
+ * @param result 协商过程统计，可为NULL
+ * @return 0 已切换到更高波特率，1 未切换，-1 失败（蜂鸟M无应答或不支持协商）
+ */
+int ChnlNegotiateBaud(const uint32_t *rates, uint32_t rate_cnt, ChnlBaudHandler set_local,
+                      ChnlBaudResult *result);
+
+/**
+ * @brief 获取播报音频吞吐及分片大小变化统计
+ * @param stats
+ * @return 0 成功，-1 失败
+ */
+int ChnlGetAudioFeedStats(ChnlAudioFeedStats *stats);
+
 #ifdef __cplusplus
 }
 #endif
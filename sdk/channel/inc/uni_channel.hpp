@@ -0,0 +1,304 @@
+/**************************************************************************
+ * Copyright (C) 2020-2020  Unisound
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ **************************************************************************
+ *
+ * Description : uni_channel.hpp
+ * Author      : junlon2006@163.com
+ * Date        : 2020.08.16
+ *
+ **************************************************************************/
+#ifndef SDK_CHANNEL_INC_UNI_CHANNEL_HPP_
+#define SDK_CHANNEL_INC_UNI_CHANNEL_HPP_
+
+/*
+ * 可选的C++类型化消息层，header only，需C++11
+ * 1. Message<CHNL_MSG_xxx>在编译期将消息id映射到payload类型，未映射的id无法收发（编译失败）
+ * 2. 定长payload长度为编译期常量，变长payload在栈上编译期定长的Frame中原地构造，不再strlen、不再手工计算长度
+ * 3. Register<cmd, fn>生成类型化trampoline，长度校验后回调强类型handler，不再手工强转
+ * 4. Frame在payload前预留COMM_PROTOCOL_HEADROOM字节，帧头原地组装后直接发送，通信协议层不再拷贝payload
+ */
+
+#include "uni_channel.h"
+#include "uni_log.h"
+
+#include <stdint.h>
+#include <string.h>
+
+namespace uni {
+namespace chnl {
+
+/* 帧长上限，与通信协议PROTOCOL_BUF_SUPPORT_MAX_SIZE及帧头一致 */
+static const uint32_t kFrameMax      = 8192;
+static const uint32_t kFrameHeadSize = COMM_PROTOCOL_HEADROOM;
+
+/* 线上布局编译期校验，修改uni_channel_common.h的结构体需同步两端 */
+static_assert(sizeof(ChIoTInitParam) == 84, "ChIoTInitParam layout changed");
+static_assert(sizeof(ChnIoTRasrStartParam) == 4, "ChnIoTRasrStartParam layout changed");
+static_assert(sizeof(ChnIoTRasrFeedDataParam) == 128, "ChnIoTRasrFeedDataParam layout changed");
+static_assert(sizeof(ChnIoTRasrResult) == 8, "ChnIoTRasrResult layout changed");
+static_assert(sizeof(ChnIoTChallengePackAck) == 36, "ChnIoTChallengePackAck layout changed");
+static_assert(sizeof(ChnIoTNetConfigureStatus) == 4, "ChnIoTNetConfigureStatus layout changed");
+static_assert(sizeof(ChnIoTNetState) == 4, "ChnIoTNetState layout changed");
+static_assert(sizeof(ChnIoTAudioLenAck) == 4, "ChnIoTAudioLenAck layout changed");
+static_assert(sizeof(ChnIoTAudioSourceEncoded) == 6, "ChnIoTAudioSourceEncoded layout changed");
+static_assert(sizeof(ChnIoTBaudCaps) == 40, "ChnIoTBaudCaps layout changed");
+static_assert(sizeof(ChnIoTBaudSwitch) == 8, "ChnIoTBaudSwitch layout changed");
+static_assert(sizeof(ChnIoTBaudVerify) == 68, "ChnIoTBaudVerify layout changed");
+
+/* 无payload消息 */
+struct NoPayload {};
+
+/* 定长消息，payload即结构体本身 */
+template <CommCmd Cmd, typename T>
+struct FixedMessage {
+  typedef T Payload;
+  typedef void (*Handler)(const T &payload, void *ctx);
+  static const CommCmd  kCmd      = Cmd;
+  static const uint32_t kHeadSize = sizeof(T);
+  static const bool     kHasTail  = false;
+
+  template <Handler Fn>
+  static void Invoke(char *payload, uint32_t len, void *ctx) {
+    if (len < kHeadSize) {
+      LOGW("channel++", "malformed payload. cmd=%d, len=%u", Cmd, len);
+      return;
+    }
+    Fn(*reinterpret_cast<const T *>(payload), ctx);
+  }
+};
+
+template <CommCmd Cmd>
+struct EmptyMessage {
+  typedef NoPayload Payload;
+  typedef void (*Handler)(void *ctx);
+  static const CommCmd  kCmd      = Cmd;
+  static const uint32_t kHeadSize = 0;
+  static const bool     kHasTail  = false;
+
+  template <Handler Fn>
+  static void Invoke(char * /* payload */, uint32_t /* len */, void *ctx) {
+    Fn(ctx);
+  }
+};
+
+/* 定长头 + 变长尾，如ChnIoTRasrResult.cmd_hash_string；头为NoPayload时整个payload均为尾 */
+template <CommCmd Cmd, typename T>
+struct TailMessage {
+  typedef T Payload;
+  typedef void (*Handler)(const T &head, const char *tail, uint32_t tail_len, void *ctx);
+  static const CommCmd  kCmd      = Cmd;
+  static const uint32_t kHeadSize = sizeof(T);
+  static const bool     kHasTail  = true;
+
+  template <Handler Fn>
+  static void Invoke(char *payload, uint32_t len, void *ctx) {
+    if (len < kHeadSize) {
+      LOGW("channel++", "malformed payload. cmd=%d, len=%u", Cmd, len);
+      return;
+    }
+    Fn(*reinterpret_cast<const T *>(payload), payload + kHeadSize, len - kHeadSize, ctx);
+  }
+};
+
+template <CommCmd Cmd>
+struct TailMessage<Cmd, NoPayload> {
+  typedef NoPayload Payload;
+  typedef void (*Handler)(const char *tail, uint32_t tail_len, void *ctx);
+  static const CommCmd  kCmd      = Cmd;
+  static const uint32_t kHeadSize = 0;
+  static const bool     kHasTail  = true;
+
+  template <Handler Fn>
+  static void Invoke(char *payload, uint32_t len, void *ctx) {
+    Fn(payload, len, ctx);
+  }
+};
+
+/* 消息id到payload类型的编译期映射，未特化的id为不完整类型 */
+template <CommCmd Cmd>
+struct Message;
+
+#define UNI_CHNL_MESSAGE(cmd, kind, ...) \
+  template <> struct Message<cmd> : kind<cmd, ##__VA_ARGS__> {}
+
+UNI_CHNL_MESSAGE(CHNL_MSG_IOT_INIT,                                FixedMessage, ChIoTInitParam);
+UNI_CHNL_MESSAGE(CHNL_MSG_IOT_RASR_START,                          FixedMessage, ChnIoTRasrStartParam);
+UNI_CHNL_MESSAGE(CHNL_MSG_IOT_RASR_STOP,                           EmptyMessage);
+UNI_CHNL_MESSAGE(CHNL_MSG_IOT_RASR_DATA_FEED,                      FixedMessage, ChnIoTRasrFeedDataParam);
+UNI_CHNL_MESSAGE(CHNL_MSG_IOT_RASR_RESULT,                         TailMessage,  ChnIoTRasrResult);
+UNI_CHNL_MESSAGE(CHNL_MSG_IOT_NET_CONFIGURE_STATUS,                FixedMessage, ChnIoTNetConfigureStatus);
+UNI_CHNL_MESSAGE(CHNL_MSG_ASR_CHALLENGE_PACK,                      FixedMessage, ChnIoTChallengePackParam);
+UNI_CHNL_MESSAGE(CHNL_MSG_ASR_CHALLENGE_PACK_ACK,                  FixedMessage, ChnIoTChallengePackAck);
+UNI_CHNL_MESSAGE(CHNL_MSG_IOT_HBM_AUDIO_SOURCE_BUF_REMAIN_LEN,     EmptyMessage);
+UNI_CHNL_MESSAGE(CHNL_MSG_IOT_HBM_AUDIO_SOURCE_BUF_REMAIN_LEN_ACK, FixedMessage, ChnIoTAudioLenAck);
+UNI_CHNL_MESSAGE(CHNL_MSG_IOT_HBM_AUDIO_SOURCE,                    TailMessage,  NoPayload);
+UNI_CHNL_MESSAGE(CHNL_MSG_IOT_HBM_AUDIO_SOURCE_ENCODED,            TailMessage,  ChnIoTAudioSourceEncoded);
+UNI_CHNL_MESSAGE(CHNL_MSG_IOT_NET_STATE,                           FixedMessage, ChnIoTNetState);
+UNI_CHNL_MESSAGE(CHNL_MSG_IOT_HBM_BAUD_QUERY,                      EmptyMessage);
+UNI_CHNL_MESSAGE(CHNL_MSG_IOT_HBM_BAUD_QUERY_ACK,                  FixedMessage, ChnIoTBaudCaps);
+UNI_CHNL_MESSAGE(CHNL_MSG_IOT_HBM_BAUD_SWITCH,                     FixedMessage, ChnIoTBaudSwitch);
+UNI_CHNL_MESSAGE(CHNL_MSG_IOT_HBM_BAUD_VERIFY,                     FixedMessage, ChnIoTBaudVerify);
+UNI_CHNL_MESSAGE(CHNL_MSG_IOT_HBM_BAUD_VERIFY_ACK,                 FixedMessage, ChnIoTBaudVerify);
+
+#undef UNI_CHNL_MESSAGE
+
+inline int SendRaw(CommCmd cmd, const void *payload, uint32_t len, bool reliable) {
+  CommAttribute attr = {reliable ? 1 : 0};
+  return CommProtocolPacketAssembleAndSend(cmd, const_cast<char *>(static_cast<const char *>(payload)),
+                                           static_cast<CommPayloadLen>(len), &attr);
+}
+
+/**
+ * @brief 发送定长消息，长度为编译期常量sizeof(Payload)
+ * @param payload
+ * @param reliable
+ * @return 0 成功，其他为CommProtocolErrorCode
+ */
+template <CommCmd Cmd>
+inline int Send(const typename Message<Cmd>::Payload &payload, bool reliable = true) {
+  static_assert(!Message<Cmd>::kHasTail, "message has variable tail, use Frame");
+  static_assert(Message<Cmd>::kHeadSize > 0, "message has no payload, use Send<cmd>()");
+  return SendRaw(Cmd, &payload, Message<Cmd>::kHeadSize, reliable);
+}
+
+/**
+ * @brief 发送无payload消息
+ * @param reliable
+ * @return 0 成功，其他为CommProtocolErrorCode
+ */
+template <CommCmd Cmd>
+inline int Send(bool reliable = true) {
+  static_assert(Message<Cmd>::kHeadSize == 0 && !Message<Cmd>::kHasTail,
+                "message has payload");
+  return SendRaw(Cmd, NULL, 0, reliable);
+}
+
+/*
+ * 变长消息帧，容量为编译期常量，头与尾在同一块栈内存中原地构造后一次发送，
+ * payload前预留帧头空间，Send时帧头原地组装（CommProtocolPacketSendInPlace），不再拷贝
+ * Frame<CHNL_MSG_IOT_RASR_RESULT, 32> frame;
+ * frame.Head().vui_session_id = id;
+ * frame.Append(str, len);
+ * frame.Send();
+ */
+template <CommCmd Cmd, uint32_t TailCapacity>
+class Frame {
+ public:
+  typedef typename Message<Cmd>::Payload Payload;
+  static const uint32_t kHeadSize = Message<Cmd>::kHeadSize;
+  static const uint32_t kCapacity = kHeadSize + TailCapacity;
+
+  static_assert(Message<Cmd>::kHasTail, "message has no tail, use Send<cmd>(payload)");
+  static_assert(kCapacity + kFrameHeadSize < kFrameMax, "frame exceeds protocol limit");
+
+  Frame() : tail_len_(0) {
+    memset(Body(), 0, kHeadSize);
+  }
+
+  Payload& Head() {
+    static_assert(kHeadSize > 0, "message has no head");
+    return *reinterpret_cast<Payload *>(Body());
+  }
+
+  char* Tail() {
+    return Body() + kHeadSize;
+  }
+
+  uint32_t TailLen() const {
+    return tail_len_;
+  }
+
+  /* 直接写Tail()后设置长度，超出容量时截断到容量 */
+  void SetTailLen(uint32_t len) {
+    tail_len_ = (len > TailCapacity) ? TailCapacity : len;
+  }
+
+  /* 追加尾部数据，容量不足返回-1且不写入 */
+  int Append(const void *data, uint32_t len) {
+    if (len > TailCapacity - tail_len_) {
+      return -1;
+    }
+    memcpy(Tail() + tail_len_, data, len);
+    tail_len_ += len;
+    return 0;
+  }
+
+  uint32_t Size() const {
+    return kHeadSize + tail_len_;
+  }
+
+  /* 帧头写入预留空间，payload不变，可重复发送 */
+  int Send(bool reliable = true) {
+    CommAttribute attr = {reliable ? 1 : 0};
+    return CommProtocolPacketSendInPlace(Cmd, Body(), static_cast<CommPayloadLen>(Size()), &attr);
+  }
+
+ private:
+  char* Body() {
+    return buf_ + kFrameHeadSize;
+  }
+
+  char     buf_[kFrameHeadSize + kCapacity];
+  uint32_t tail_len_;
+};
+
+/**
+ * @brief 上报RASR结果，命令字为字符串字面量时帧长编译期确定，含结尾'\0'
+ * @param vui_session_id
+ * @param cmd_hash_code
+ * @param cmd_hash_string 字符串字面量或定长字符数组
+ * @return 0 成功，其他为CommProtocolErrorCode
+ */
+template <size_t N>
+inline int SendRasrResult(uint32_t vui_session_id, uint32_t cmd_hash_code,
+                          const char (&cmd_hash_string)[N]) {
+  Frame<CHNL_MSG_IOT_RASR_RESULT, N> frame;
+  frame.Head().vui_session_id = vui_session_id;
+  frame.Head().cmd_hash_code  = cmd_hash_code;
+  frame.Append(cmd_hash_string, N);
+  return frame.Send();
+}
+
+template <CommCmd Cmd, typename Message<Cmd>::Handler Fn>
+void Trampoline(uint32_t /* cmd */, char *payload, uint32_t len, void *ctx) {
+  Message<Cmd>::template Invoke<Fn>(payload, len, ctx);
+}
+
+/**
+ * @brief 注册强类型handler，handler签名由消息类型决定：
+ *        定长 void(const Payload &, void *ctx)
+ *        无payload void(void *ctx)
+ *        变长 void(const Payload &, const char *tail, uint32_t tail_len, void *ctx)
+ *        payload短于定长头时丢弃并告警，不回调
+ * @param ctx
+ * @param executor
+ * @return 0 成功，-1 失败
+ */
+template <CommCmd Cmd, typename Message<Cmd>::Handler Fn>
+inline int Register(void *ctx = NULL, ChnlExecutor executor = CHNL_EXECUTOR_NORMAL) {
+  return ChnlRegisterHandler(Cmd, &Trampoline<Cmd, Fn>, ctx, executor);
+}
+
+template <CommCmd Cmd>
+inline int Unregister() {
+  return ChnlRegisterHandler(Cmd, NULL, NULL, CHNL_EXECUTOR_NORMAL);
+}
+
+}  // namespace chnl
+}  // namespace uni
+
+#endif  // SDK_CHANNEL_INC_UNI_CHANNEL_HPP_
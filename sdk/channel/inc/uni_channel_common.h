@@ -52,6 +52,13 @@ enum {
   CHNL_MSG_IOT_HBM_AUDIO_SOURCE_BUF_REMAIN_LEN,
   CHNL_MSG_IOT_HBM_AUDIO_SOURCE_BUF_REMAIN_LEN_ACK,
   CHNL_MSG_IOT_HBM_AUDIO_SOURCE,
+  CHNL_MSG_IOT_HBM_AUDIO_SOURCE_ENCODED, //压缩音频播报，payload携带编码格式
+  CHNL_MSG_IOT_NET_STATE,                //网络状态变化主动通知，离线时蜂鸟M暂停推送ADPCM
+  CHNL_MSG_IOT_HBM_BAUD_QUERY,           //查询蜂鸟M当前及支持的波特率
+  CHNL_MSG_IOT_HBM_BAUD_QUERY_ACK,
+  CHNL_MSG_IOT_HBM_BAUD_SWITCH,          //蜂鸟M ACK后切换，超时未收到校验包自行退回原波特率
+  CHNL_MSG_IOT_HBM_BAUD_VERIFY,          //新波特率下的测试图样，蜂鸟M原样回复后切换生效
+  CHNL_MSG_IOT_HBM_BAUD_VERIFY_ACK,
 
   CHNL_MSG_HBM_IOT_DEVICE_BASE = 1000, //1001开始的所有msg为IoT端需要感知处理的消息
   CHNL_MSG_HBM_IOT_ASR_RESULT,
@@ -91,6 +98,10 @@ typedef struct {
   unsigned int status; //0成功，1失败
 } UNI_PACKED ChnIoTNetConfigureStatus;
 
+typedef struct {
+  unsigned int net_connected; //语义同ChnIoTChallengePackAck.net_connected
+} UNI_PACKED ChnIoTNetState;
+
 typedef struct {
   ChIoTInitParam init;
 } UNI_PACKED ChnIoTChallengePackParam;
@@ -99,6 +110,39 @@ typedef struct {
   unsigned int remain_bytes;
 } UNI_PACKED ChnIoTAudioLenAck;
 
+enum {
+  CHNL_AUDIO_CODEC_PCM = 0,
+  CHNL_AUDIO_CODEC_IMA_ADPCM,
+};
+
+#define CHNL_BAUD_RATE_MAX      (8)
+#define CHNL_BAUD_PATTERN_LEN   (64)
+
+typedef struct {
+  unsigned int current;                    //当前波特率
+  unsigned int count;                      //rates有效个数
+  unsigned int rates[CHNL_BAUD_RATE_MAX];  //支持的波特率，含current
+} UNI_PACKED ChnIoTBaudCaps;
+
+typedef struct {
+  unsigned int baud;
+  unsigned int verify_timeout_ms;          //切换后超过该时长未收到校验包，蜂鸟M退回原波特率
+} UNI_PACKED ChnIoTBaudSwitch;
+
+typedef struct {
+  unsigned int  baud;                      //发送端认为的当前波特率
+  unsigned char pattern[CHNL_BAUD_PATTERN_LEN];
+} UNI_PACKED ChnIoTBaudVerify;
+
+/* 每包独立可解，predictor、step_index为本包首个采样编码前的codec状态 */
+typedef struct {
+  unsigned char  codec;
+  unsigned char  step_index;
+  short          predictor;
+  unsigned short samples;
+  char           data[0];
+} UNI_PACKED ChnIoTAudioSourceEncoded;
+
 #ifdef __cplusplus
 }
 #endif
@@ -32,6 +32,9 @@ extern "C" {
 
 #define UNI_PACKED          __attribute__ ((packed))
 
+/* frame header size, CommProtocolPacketSendInPlace assembles it in front of payload */
+#define COMM_PROTOCOL_HEADROOM  (16)
+
 typedef unsigned short      CommCmd;
 typedef unsigned short      CommPayloadLen;
 typedef int                 (*CommWriteHandler)(char *buf, unsigned int len);
@@ -69,6 +72,11 @@ typedef struct {
 
   /* sleep */
   int (*msleep_fn)(unsigned int msecond); /* sleep hook */
+
+  /* cooperative mode, optional. when both set, waiting for ack drives receive path
+   * by poll_fn on the sending thread instead of sleeping, no receive thread needed */
+  int  (*poll_fn)(unsigned int timeout_msecond); /* read and parse uart data, wait up to timeout */
+  long (*clock_ms_fn)(void);                     /* monotonic clock in millisecond */
 } CommProtocolHooks;
 
 typedef void (*CommRecvPacketHandler)(CommPacket *packet);
@@ -109,6 +117,19 @@ int CommProtocolPacketAssembleAndSend(CommCmd cmd, char *payload,
                                       CommPayloadLen payload_len,
                                       CommAttribute *attr);
 
+/**
+ * @brief send one packet without copying payload, frame header is assembled in the
+          COMM_PROTOCOL_HEADROOM bytes right before payload, which are overwritten
+ * @param cmd command type
+ * @param payload the payload of cmd, payload - COMM_PROTOCOL_HEADROOM must be writable
+ * @param payload_len the payload length
+ * @param attr same as CommProtocolPacketAssembleAndSend
+ * @return 0 means success, other means failed
+ */
+int CommProtocolPacketSendInPlace(CommCmd cmd, char *payload,
+                                  CommPayloadLen payload_len,
+                                  CommAttribute *attr);
+
 /**
  * @brief receive orignial uart data
  * @param buf the uart data buffer pointer
@@ -0,0 +1,132 @@
+/**************************************************************************
+ * Copyright (C) 2020-2020  Unisound
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ **************************************************************************
+ *
+ * Description : uni_packet_pool.h
+ * Author      : junlon2006@163.com
+ * Date        : 2020.08.10
+ *
+ **************************************************************************/
+#ifndef SDK_CHANNEL_INC_UNI_PACKET_POOL_H_
+#define SDK_CHANNEL_INC_UNI_PACKET_POOL_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "uni_communication.h"
+#include <stdint.h>
+
+#define PACKET_POOL_CLASS_MAX  (4)
+
+typedef void* PacketPoolHandle;
+
+typedef enum {
+  PACKET_POOL_POLICY_DROP = 0,     /* 预算或slot不足直接丢弃新包 */
+  PACKET_POOL_POLICY_BLOCK,        /* 阻塞等待预算及slot释放，超时丢弃 */
+  PACKET_POOL_POLICY_EVICT_OLDEST, /* 淘汰最老的可淘汰包（尚未被处理）腾出预算及slot */
+} PacketPoolPolicy;
+
+typedef struct {
+  uint32_t payload_size; /* slot可容纳的最大payload */
+  uint32_t count;        /* slot个数 */
+} PacketPoolClass;
+
+typedef struct {
+  uint32_t class_cnt;
+  uint32_t payload_size[PACKET_POOL_CLASS_MAX];
+  uint32_t slot_cnt[PACKET_POOL_CLASS_MAX];
+  uint32_t in_use[PACKET_POOL_CLASS_MAX];
+  uint32_t in_use_max[PACKET_POOL_CLASS_MAX];
+  uint32_t byte_budget;
+  uint32_t bytes_in_use;
+  uint32_t bytes_in_use_max;
+  uint32_t admitted;
+  uint32_t drop_budget;    /* 预算不足丢弃 */
+  uint32_t drop_no_slot;   /* slot耗尽丢弃 */
+  uint32_t drop_too_large; /* payload超出最大slot */
+  uint32_t evicted;
+  uint32_t blocked;
+  uint32_t block_timeout;
+} PacketPoolStats;
+
+/**
+ * @brief 创建预分配packet池，classes按payload_size升序。
+ *        可淘汰包只使用恰好容纳它的最小一级slot，不向更大级别溢出
+ * @param classes
+ * @param class_cnt 不超过PACKET_POOL_CLASS_MAX
+ * @param byte_budget 所有在途packet payload字节总预算
+ * @return handle，失败返回NULL
+ */
+PacketPoolHandle PacketPoolCreate(const PacketPoolClass *classes, int class_cnt,
+                                  uint32_t byte_budget);
+
+/**
+ * @brief 销毁packet池，调用前所有packet必须已归还
+ * @param handle
+ * @return void
+ */
+void PacketPoolDestroy(PacketPoolHandle handle);
+
+/**
+ * @brief 设置准入策略
+ * @param handle
+ * @param policy
+ * @param byte_budget 0表示不修改
+ * @param block_timeout_msec PACKET_POOL_POLICY_BLOCK时最长等待时间
+ * @return void
+ */
+void PacketPoolSetPolicy(PacketPoolHandle handle, PacketPoolPolicy policy,
+                         uint32_t byte_budget, uint32_t block_timeout_msec);
+
+/**
+ * @brief 准入并拷贝一个packet，字节预算与slot同时预留
+ * @param handle
+ * @param packet 源packet
+ * @param evictable 1表示EVICT_OLDEST策略下可被淘汰
+ * @return 池内packet，未准入返回NULL
+ */
+CommPacket* PacketPoolAlloc(PacketPoolHandle handle, CommPacket *packet, int evictable);
+
+/**
+ * @brief 消费者开始处理前调用，此后packet不再可被淘汰
+ * @param handle
+ * @param packet
+ * @return 0 有效，处理完PacketPoolFree；-1 已被淘汰，slot已回收，不可再PacketPoolFree
+ */
+int PacketPoolAcquire(PacketPoolHandle handle, CommPacket *packet);
+
+/**
+ * @brief 归还packet
+ * @param handle
+ * @param packet
+ * @return void
+ */
+void PacketPoolFree(PacketPoolHandle handle, CommPacket *packet);
+
+/**
+ * @brief 获取占用及丢包统计
+ * @param handle
+ * @param stats
+ * @return void
+ */
+void PacketPoolGetStats(PacketPoolHandle handle, PacketPoolStats *stats);
+
+#ifdef __cplusplus
+}
+#endif
+#endif  // SDK_CHANNEL_INC_UNI_PACKET_POOL_H_
@@ -23,7 +23,9 @@
  **************************************************************************/
 #include "uni_channel.h"
 #include "uni_log.h"
-#include "uni_event_list.h"
+#include "uni_dispatcher.h"
+#include "uni_adpcm.h"
+#include "uni_rasr.h"
 #include "porting.h"
 
 #include <stdlib.h>
@@ -33,124 +35,318 @@
 
 #define TAG                 "channel"
 
+/* 播报音频分片自适应，PCM字节，对齐保证ADPCM偶数采样 */
+#define AUDIO_CHUNK_SIZE    (512)
+#define AUDIO_CHUNK_ALIGN   (128)
+#define AUDIO_CHUNK_LIMIT   (2048)
+
+/* 单包ACK耗时目标，超过则缩小分片；达到协议栈ACK超时即视为发生重传 */
+#ifndef CHNL_AUDIO_ACK_TARGET_MS
+#define CHNL_AUDIO_ACK_TARGET_MS  (40)
+#endif
+#define AUDIO_ACK_RESEND_MS       (200)
+
+/* 快速起播投机首发字节数，蜂鸟M空闲时音频buffer至少可容纳该长度 */
+#ifndef CHNL_AUDIO_FAST_START_BYTES
+#define CHNL_AUDIO_FAST_START_BYTES  (1024)
+#endif
+/* 距上次推送超过该间隔视为一次新的起播 */
+#define AUDIO_START_IDLE_MS       (300)
+/* 识别结果到首包音频超过该时长不计入统计，认为播报与该结果无关 */
+#define AUDIO_RESULT_WINDOW_MS    (10 * 1000)
+
+/* 波特率协商：应答等待、蜂鸟M切换后等待校验包的时长、切换后双方串口稳定时间 */
+#define BAUD_REPLY_TIMEOUT_MS     (1000)
+#define BAUD_VERIFY_TIMEOUT_MS    (500)
+#define BAUD_SETTLE_MS            (20)
+
+/* 所有在途packet payload字节预算，ADPCM 128Byte每包 */
+#define PACKET_BYTE_BUDGET  (1024 * 16)
+
+/* 所有排队执行器共享的worker线程数，每类执行器的并发上限见g_dispatch_config */
+#ifndef CHNL_DISPATCH_WORKER_CNT
+#define CHNL_DISPATCH_WORKER_CNT  (4)
+#endif
+
+/* IoT用户回调最大并发数，同一cmd的回调始终串行 */
+#ifndef CHNL_IOT_CALLBACK_CONCURRENCY
+#define CHNL_IOT_CALLBACK_CONCURRENCY  (2)
+#endif
+
+/* uArTcP帧头字节数，用于估算UART流量 */
+#define COMM_FRAME_HEADER_BYTES   (16)
+/* 蜂鸟M上行RASR音频16KHz 16bit单声道，ADPCM 4bit每采样 */
+#define RASR_ADPCM_BYTES_PER_SEC  (8000)
+#define RASR_FEED_WIRE_BYTES      (sizeof(ChnIoTRasrFeedDataParam) + COMM_FRAME_HEADER_BYTES)
+
+typedef int (*AudioPushHandler)(char *pcm, int len);
+
+/* 二级直接索引表，cmd高8位选页，低8位选项，页按需分配 */
+#define HANDLER_PAGE_BITS   (8)
+#define HANDLER_PAGE_SIZE   (1 << HANDLER_PAGE_BITS)
+#define HANDLER_PAGE_CNT    ((1 << (sizeof(CommCmd) * 8)) >> HANDLER_PAGE_BITS)
+
+/* 三个字段以seq保护整体替换：写者置seq为奇数后改写，读者读到前后一致的偶数seq才采用 */
 typedef struct {
-  EventListHandle event_handle;
-  EventListHandle event_non_block_handle;
-  EventListHandle event_iot_events_handle;
-  hbm_command_cb  cmd_callback;
-  uint32_t        inited;
-  uint8_t         adpcm_packet_cnt;
-  uint8_t         rasr_start_cnt;
-  uint8_t         rasr_stop_cnt;
-  uni_sem_t       sem_audio_len;
-  uint32_t        audio_remain_len;
+  uint32_t       seq;
+  ChnlCmdHandler handler;
+  void           *ctx;
+  ChnlExecutor   executor;
+} HandlerEntry;
+
+typedef struct {
+  DispatcherHandle dispatcher;
+  HandlerEntry     *handler_pages[HANDLER_PAGE_CNT];
+  hbm_command_cb   cmd_callback;
+  PacketPoolHandle packet_pool;
+  uint32_t         inited;
+  uint32_t         rasr_session_id;      //当前上行会话，仅在NORMAL执行器中访问
+  bool             rasr_session_open;
+  bool             rx_rasr_open;         //接收线程视角的会话状态，STOP之后的迟到数据直接丢弃
+  uni_sem_t        sem_audio_len;
+  uint32_t         audio_len_acked;      //协作模式下credit应答到达标志
+  ChnlPollHandler  poll;                 //协作模式接收驱动，NULL为线程模式
+  uni_mutex_t      mutex_audio_feed;
+  uint32_t         audio_remain_len;
+  uint32_t         net_offline;          //0在线（默认），接收线程无锁读取
+  long             offline_since_ms;
+  long             rasr_offline_start_ms;
+  ChnlNetStats     net_stats;
+  uint64_t         online_feed_us;       //在线时ADPCM包处理耗时，用于估算离线节省的CPU，worker写，原子访问
+  uint64_t         online_feed_packets;
+  uni_mutex_t      mutex_audio_stats;    //播报推送期间mutex_audio_feed长时间持有，统计单独加锁
+  ChnlAudioFeedStats audio_feed;
+  long             audio_feed_epoch_ms;
+  uint32_t         audio_credit_max;     //蜂鸟M报告过的最大剩余空间，分片不超过该值
+  uint32_t         fast_start_bytes;     //0关闭快速起播
+  long             audio_feed_last_ms;   //上次推送结束时间
+  long             asr_result_ms;        //最近一次识别结果到达时间，接收线程写入
+  uni_sem_t        sem_baud;
+  uint32_t         baud_expect;          //等待中的波特率协商应答cmd，0不等待
+  uint32_t         baud_replied;
+  union {
+    ChnIoTBaudCaps   caps;
+    ChnIoTBaudVerify verify;
+  } baud_reply;                          //接收线程写入，baud_replied置位后读取
 } Channel;
 
 static Channel g_channel = {0};
 
-static bool _is_non_block_cmd(int cmd) {
-  return (cmd == CHNL_MSG_IOT_INIT ||
-          cmd == CHNL_MSG_ASR_CHALLENGE_PACK ||
-          cmd == CHNL_MSG_DAEMON_REBOOT_REQUEST);
-}
-
 static bool _is_iot_cmd(int cmd) {
   return (cmd > CHNL_MSG_HBM_IOT_DEVICE_BASE);
 }
 
 /**
- * 保护内存使用，对于大内存块，限制个数，目前监控ADPCM数据包128Byte每包，最大不得缓存超过2KB即16个
+ * 按消息长度分级的预分配slot，ADPCM数据包只落在第二级。
+ * 第二级slot数 * 128Byte 大于PACKET_BYTE_BUDGET，保证先触发预算限制
  */
-static bool _is_memory_cost_packet_limited(int cmd) {
-  if (cmd != CHNL_MSG_IOT_RASR_DATA_FEED) return false;
-  if (g_channel.adpcm_packet_cnt >= 16) return true;
-  g_channel.adpcm_packet_cnt++;
+static const PacketPoolClass g_packet_classes[] = {
+  {32,   32},
+  {160,  144},
+  {1024, 8},
+  {8192, 1},
+};
+
+/* 只有音频数据可被EVICT_OLDEST策略淘汰，控制类消息不可淘汰 */
+static bool _is_evictable_cmd(int cmd) {
+  return (cmd == CHNL_MSG_IOT_RASR_DATA_FEED);
+}
+
+/* ADPCM数据包不携带会话id，会话结束后到达的数据在分配、排队之前丢弃 */
+static bool _rasr_late_drop(CommPacket *packet) {
+  if (packet->cmd == CHNL_MSG_IOT_RASR_START) {
+    g_channel.rx_rasr_open = true;
+  } else if (packet->cmd == CHNL_MSG_IOT_RASR_STOP) {
+    g_channel.rx_rasr_open = false;
+  } else if (packet->cmd == CHNL_MSG_IOT_RASR_DATA_FEED && !g_channel.rx_rasr_open) {
+    LOGD(TAG, "drop adpcm out of session");
+    return true;
+  }
+
   return false;
 }
 
-static bool _need_skiped_rasr_event(int cmd) {
-  if (cmd == CHNL_MSG_IOT_RASR_START) {
-    if (g_channel.rasr_start_cnt != 0) return true;
-    g_channel.rasr_start_cnt = 1;
+/* 取handler、ctx、executor的一致快照，与ChnlRegisterHandler并发时不会混用新旧字段 */
+static bool _handler_lookup(CommCmd cmd, HandlerEntry *snapshot) {
+  HandlerEntry *entry = __atomic_load_n(&g_channel.handler_pages[cmd >> HANDLER_PAGE_BITS],
+                                        __ATOMIC_ACQUIRE);
+  uint32_t seq;
+
+  if (NULL == entry) {
     return false;
   }
 
-  if (cmd == CHNL_MSG_IOT_RASR_STOP) {
-    if (g_channel.rasr_stop_cnt != 0) return true;
-    g_channel.rasr_stop_cnt = 1;
+  entry += cmd & (HANDLER_PAGE_SIZE - 1);
+  do {
+    seq = __atomic_load_n(&entry->seq, __ATOMIC_ACQUIRE);
+    snapshot->handler  = __atomic_load_n(&entry->handler, __ATOMIC_RELAXED);
+    snapshot->ctx      = __atomic_load_n(&entry->ctx, __ATOMIC_RELAXED);
+    snapshot->executor = __atomic_load_n(&entry->executor, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+  } while ((seq & 1) || seq != __atomic_load_n(&entry->seq, __ATOMIC_RELAXED));
+
+  return NULL != snapshot->handler;
+}
+
+static ChnlExecutor _default_executor(int cmd) {
+  return _is_iot_cmd(cmd) ? CHNL_EXECUTOR_IOT : CHNL_EXECUTOR_NORMAL;
+}
+
+/* 排队执行器到dispatcher class的映射，INLINE不排队 */
+static uint32_t _executor_class(ChnlExecutor executor) {
+  return (uint32_t)executor - CHNL_EXECUTOR_NORMAL;
+}
+
+/* 顺序key：NORMAL队列RASR start/feed/stop同属一条音频流，必须整体串行；其余按cmd串行 */
+static uint32_t _executor_key(ChnlExecutor executor, int cmd) {
+  return (CHNL_EXECUTOR_NORMAL == executor) ? 0 : (uint32_t)cmd;
+}
+
+/* 未注册handler的消息，IoT消息回调给cmd_callback */
+static void _default_handle(CommPacket *packet) {
+  //回调给IoT设备，filter事件，根据消息范围收敛在HBM master中，slave不感知
+  if (_is_iot_cmd(packet->cmd)) {
+    if (g_channel.cmd_callback) {
+      g_channel.cmd_callback(packet->cmd, packet->payload, packet->payload_len);
+    }
+    return;
+  }
+
+  LOGT(TAG, "unhandled event. cmd=%d", packet->cmd);
+}
+
+static bool _is_net_offline() {
+  return 0 != __atomic_load_n(&g_channel.net_offline, __ATOMIC_RELAXED);
+}
+
+/* 离线时蜂鸟M停止推送前仍在路上的ADPCM包，不分配、不排队、不解码 */
+static bool _offline_drop(CommPacket *packet) {
+  if (packet->cmd != CHNL_MSG_IOT_RASR_DATA_FEED || !_is_net_offline()) {
     return false;
   }
 
-  return false;
+  __atomic_add_fetch(&g_channel.net_stats.offline_feed_packets, 1, __ATOMIC_RELAXED);
+  __atomic_add_fetch(&g_channel.net_stats.offline_feed_bytes,
+                     packet->payload_len + COMM_FRAME_HEADER_BYTES, __ATOMIC_RELAXED);
+  return true;
 }
 
 /* interrupt callback, cannot block */
 void ChnlReceiveCommProtocolPacket(CommPacket *packet) {
-  if (_is_memory_cost_packet_limited(packet->cmd)) {
+  if (_offline_drop(packet) || _rasr_late_drop(packet)) {
     return;
   }
 
-  if (_need_skiped_rasr_event(packet->cmd)) {
+  if (packet->cmd == CHNL_MSG_HBM_IOT_ASR_RESULT) {
+    __atomic_store_n(&g_channel.asr_result_ms, uni_get_clock_time_ms(), __ATOMIC_RELAXED);
+  }
+
+  HandlerEntry entry;
+  ChnlExecutor executor = _handler_lookup(packet->cmd, &entry) ? entry.executor :
+                                                                 _default_executor(packet->cmd);
+
+  if (CHNL_EXECUTOR_INLINE == executor) {
+    entry.handler(packet->cmd, packet->payload, packet->payload_len, entry.ctx);
     return;
   }
 
-  CommPacket *event = (CommPacket *)uni_malloc(packet->payload_len + sizeof(CommPacket));
+  CommPacket *event = PacketPoolAlloc(g_channel.packet_pool, packet,
+                                      _is_evictable_cmd(packet->cmd));
   if (NULL == event) {
-    LOGT(TAG, "alloc memory failed.");
+    LOGD(TAG, "packet dropped. cmd=%d, len=%d", packet->cmd, packet->payload_len);
     return;
   }
 
-  event->cmd         = packet->cmd;
-  event->payload     = (char *)event + sizeof(CommPacket);
-  event->payload_len = packet->payload_len;
-  if (event->payload_len > 0) {
-    memcpy(event->payload, packet->payload, packet->payload_len);
-  }
-
-  if (_is_iot_cmd(event->cmd)) {
-    EventListAdd(g_channel.event_iot_events_handle, event, EVENT_LIST_PRIORITY_HIGHEST);
-  } else if (_is_non_block_cmd(event->cmd)) {
-    EventListAdd(g_channel.event_non_block_handle, event, EVENT_LIST_PRIORITY_HIGHEST);
-  } else {
-    EventListAdd(g_channel.event_handle, event, EVENT_LIST_PRIORITY_HIGHEST);
+  if (0 != DispatcherSubmitKeyed(g_channel.dispatcher, _executor_class(executor),
+                                 _executor_key(executor, packet->cmd), event)) {
+    PacketPoolFree(g_channel.packet_pool, event);
   }
 }
 
-void _do_iot_device_init(char *packet, int len) {
+static void _do_iot_device_init(uint32_t cmd, char *packet, uint32_t len, void *ctx) {
   ChIoTInitParam *param = (ChIoTInitParam *)packet;
   LOGT(TAG, "recv iot init event");
 }
 
-static void _do_iot_device_rasr_start(char *packet, int len) {
+static void _do_iot_device_rasr_start(uint32_t cmd, char *packet, uint32_t len, void *ctx) {
   ChnIoTRasrStartParam *param = (ChnIoTRasrStartParam *)packet;
-  g_channel.rasr_start_cnt = 0;
+  if (len < sizeof(ChnIoTRasrStartParam)) {
+    LOGW(TAG, "invalid rasr start. len=%u", len);
+    return;
+  }
+
   LOGT(TAG, "recv iot rasr start. vui_session_id=%u", param->vui_session_id);
+
+  /* 重复的start（如重传）直接忽略 */
+  if (g_channel.rasr_session_open && g_channel.rasr_session_id == param->vui_session_id) {
+    return;
+  }
+
+  /* 蜂鸟M同一时刻只推送一路音频，新会话开始意味着上一会话的stop已丢失 */
+  if (g_channel.rasr_session_open) {
+    LOGW(TAG, "session[%u] superseded by session[%u]",
+         g_channel.rasr_session_id, param->vui_session_id);
+    RasrSessionStop(g_channel.rasr_session_id);
+  }
+
+  if (_is_net_offline()) {
+    __atomic_store_n(&g_channel.rasr_offline_start_ms, uni_get_clock_time_ms(), __ATOMIC_RELAXED);
+  }
+
+  g_channel.rasr_session_id   = param->vui_session_id;
+  g_channel.rasr_session_open = true;
+  RasrSessionStart(param->vui_session_id);
+}
+
+/* 离线期间的RASR会话时长，会话结束或网络恢复时结算 */
+static void _offline_rasr_settle() {
+  long start = __atomic_exchange_n(&g_channel.rasr_offline_start_ms, 0, __ATOMIC_RELAXED);
+  if (0 != start) {
+    __atomic_add_fetch(&g_channel.net_stats.offline_rasr_ms,
+                       (uint32_t)(uni_get_clock_time_ms() - start), __ATOMIC_RELAXED);
+  }
 }
 
-static void _do_iot_device_rasr_stop(char *packet, int len) {
-  g_channel.rasr_stop_cnt = 0;
+static void _do_iot_device_rasr_stop(uint32_t cmd, char *packet, uint32_t len, void *ctx) {
   LOGT(TAG, "recv iot rasr stop");
+  if (!g_channel.rasr_session_open) {
+    return;
+  }
+
+  _offline_rasr_settle();
+  g_channel.rasr_session_open = false;
+  RasrSessionStop(g_channel.rasr_session_id);
 }
 
-static void _do_iot_rasr_adpcm_data(char *packet, int len) {
+static void _do_iot_rasr_adpcm_data(uint32_t cmd, char *packet, uint32_t len, void *ctx) {
   ChnIoTRasrFeedDataParam *param = (ChnIoTRasrFeedDataParam *)packet;
-  g_channel.adpcm_packet_cnt--;
-  //param->adpcm数组中即为ADPCM数据
-  LOGD(TAG, "recv adpcm data. cache[%d]", g_channel.adpcm_packet_cnt);
+  int64_t begin;
+  LOGD(TAG, "recv adpcm data");
+  if (len < sizeof(ChnIoTRasrFeedDataParam)) {
+    LOGW(TAG, "short adpcm packet. len=%u", len);
+    __atomic_add_fetch(&g_channel.net_stats.short_feed_packets, 1, __ATOMIC_RELAXED);
+    return;
+  }
+
+  begin = uni_get_clock_time_us();
+  RasrSessionFeed(g_channel.rasr_session_id, param->adpcm, sizeof(param->adpcm));
+  __atomic_add_fetch(&g_channel.online_feed_us, (uint64_t)(uni_get_clock_time_us() - begin),
+                     __ATOMIC_RELAXED);
+  __atomic_add_fetch(&g_channel.online_feed_packets, 1, __ATOMIC_RELAXED);
 }
 
-static void _do_reboot_request(char *packet, int len) {
+static void _do_reboot_request(uint32_t cmd, char *packet, uint32_t len, void *ctx) {
   LOGE(TAG, "recv daemon reboot cmd");
   uni_reboot();
 }
 
-static int _do_challenge_pack(char *packet, int len) {
+static void _do_challenge_pack(uint32_t cmd, char *packet, uint32_t len, void *ctx) {
   static uint32_t current_sequence = 1;
   ChnIoTChallengePackParam *param = (ChnIoTChallengePackParam *)packet;
 
   ChnIoTChallengePackAck ack;
   ack.sequence      = current_sequence;
-  ack.net_connected = 1; //TODO, 网络状态，如果设置为0蜂鸟M将停止推送ADPCM数据
+  ack.net_connected = !_is_net_offline(); //如果为0蜂鸟M将停止推送ADPCM数据
   snprintf(ack.version, sizeof(ack.version), "%s", IOT_DEVICE_VERSION);
 
   LOGT(TAG, "receive challenge pack, cur_seq=%u, net=%d", current_sequence, ack.net_connected);
@@ -162,91 +358,111 @@ static int _do_challenge_pack(char *packet, int len) {
                                               &attr);
   if (ret != 0) {
     LOGW(TAG, "transmit failed");
-    return -1;
+    return;
   }
 
   current_sequence++;
-  return 0;
 }
 
-static void _do_netconfigure(char *packet, int len) {
-  LOGT(TAG, "recv netconfig");
-  //TODO 开始配网
-}
-
-static void _do_netconfigure_stop(char *packet, int len) {
-  LOGT(TAG, "netconfig stop");
-  //TODO 停止配网
-}
-
-static void _do_audio_len_ack(char *packet, int len) {
+static void _do_audio_len_ack(uint32_t cmd, char *packet, uint32_t len, void *ctx) {
   ChnIoTAudioLenAck *ack = (ChnIoTAudioLenAck *)packet;
+  if (len < sizeof(ChnIoTAudioLenAck)) {
+    LOGW(TAG, "short audio len ack. len=%u", len);
+    return;
+  }
+
   LOGD(TAG, "audio len=%d", ack->remain_bytes);
   g_channel.audio_remain_len = ack->remain_bytes;
+  if (NULL != g_channel.poll) {
+    __atomic_store_n(&g_channel.audio_len_acked, 1, __ATOMIC_RELEASE);
+    return;
+  }
+
   uni_sem_signal(&g_channel.sem_audio_len);
 }
 
-static int _cmd_to_iot_device_filter(CommPacket *packet) {
-  //回调给IoT设备，filter事件，根据消息范围收敛在HBM master中，slave不感知
-  if (_is_iot_cmd(packet->cmd)) {
-    if (g_channel.cmd_callback) {
-      g_channel.cmd_callback(packet->cmd, packet->payload, packet->payload_len);
-    }
+static void _do_baud_reply(uint32_t cmd, char *packet, uint32_t len, void *ctx) {
+  uint32_t expect_len = (CHNL_MSG_IOT_HBM_BAUD_QUERY_ACK == cmd) ?
+                        sizeof(ChnIoTBaudCaps) : sizeof(ChnIoTBaudVerify);
+  if (__atomic_load_n(&g_channel.baud_expect, __ATOMIC_ACQUIRE) != cmd) {
+    LOGW(TAG, "unexpected baud reply cmd=%u", cmd);
+    return;
+  }
 
-    return 0;
+  /* 截断的应答不置位，等待方超时后按无应答处理 */
+  if (len != expect_len) {
+    LOGW(TAG, "invalid baud reply cmd=%u, len=%u", cmd, len);
+    return;
   }
 
-  return -1;
+  memcpy(&g_channel.baud_reply, packet, len);
+  __atomic_store_n(&g_channel.baud_replied, 1, __ATOMIC_RELEASE);
+  if (NULL == g_channel.poll) {
+    uni_sem_signal(&g_channel.sem_baud);
+  }
 }
 
 static void _event_handle(void *event) {
   CommPacket *packet = (CommPacket *)event;
+  HandlerEntry entry;
 
-  if (0 == _cmd_to_iot_device_filter(packet)) {
-    goto L_END;
+  /* 已被EVICT_OLDEST策略淘汰，slot已由池回收 */
+  if (0 != PacketPoolAcquire(g_channel.packet_pool, packet)) {
+    return;
   }
 
-  switch (packet->cmd) {
-    case CHNL_MSG_IOT_INIT:
-      _do_iot_device_init(packet->payload, packet->payload_len);
-      break;
-    case CHNL_MSG_IOT_RASR_START:
-      _do_iot_device_rasr_start(packet->payload, packet->payload_len);
-      break;
-    case CHNL_MSG_IOT_RASR_STOP:
-      _do_iot_device_rasr_stop(packet->payload, packet->payload_len);
-      break;
-    case CHNL_MSG_IOT_RASR_DATA_FEED:
-      _do_iot_rasr_adpcm_data(packet->payload, packet->payload_len);
-      break;
-    case CHNL_MSG_IOT_NET_CONFIGURE:
-      _do_netconfigure(packet->payload, packet->payload_len);
-      break;
-    case CHNL_MSG_IOT_NET_CONFIGURE_STOP:
-      _do_netconfigure_stop(packet->payload, packet->payload_len);
-      break;
-    case CHNL_MSG_DAEMON_REBOOT_REQUEST:
-      _do_reboot_request(packet->payload, packet->payload_len);
-      break;
-    case CHNL_MSG_ASR_CHALLENGE_PACK:
-      _do_challenge_pack(packet->payload, packet->payload_len);
-      break;
-    case CHNL_MSG_IOT_HBM_AUDIO_SOURCE_BUF_REMAIN_LEN_ACK:
-      _do_audio_len_ack(packet->payload, packet->payload_len);
-      break;
-    default:
-      LOGT(TAG, "unhandled event. cmd=%d", packet->cmd);
-      break;
+  /* 排队期间可能被重新注册，执行时再查，按当前注册的handler处理 */
+  if (_handler_lookup(packet->cmd, &entry)) {
+    entry.handler(packet->cmd, packet->payload, packet->payload_len, entry.ctx);
+  } else {
+    _default_handle(packet);
+  }
+
+  PacketPoolFree(g_channel.packet_pool, packet);
+}
+
+/*
+ * 各类执行器并发上限之和不超过worker数时，任何一类处理慢都不会饿死其他类；
+ * IoT用户回调（如播报整段PCM）可能阻塞数秒，按cmd分key并发执行，不同消息互不阻塞；
+ * 超过latency budget的handler由dispatcher watchdog告警
+ */
+static const DispatcherConfig g_dispatch_config = {
+  CHNL_DISPATCH_WORKER_CNT, 2048, 3,
+  {
+    {"normal",    1,                             200},
+    {"non_block", 1,                             1000},
+    {"iot",       CHNL_IOT_CALLBACK_CONCURRENCY, 5000},
+  },
+};
+
+static int _create_dispatcher() {
+  DispatcherConfig config = g_dispatch_config;
+  if (NULL != g_channel.poll) {
+    config.worker_cnt = 0;
   }
 
-L_END:
-  uni_free(event);
+  g_channel.dispatcher = DispatcherCreate(&config, _event_handle);
+  return (NULL == g_channel.dispatcher) ? -1 : 0;
+}
+
+/* 协作模式下等待期间由当前线程驱动接收解析，flag为NULL时等满timeout */
+static void _poll_wait(uint32_t *flag, uint32_t timeout_msec) {
+  long deadline = uni_get_clock_time_ms() + timeout_msec;
+  long now;
+
+  while ((NULL == flag || !__atomic_load_n(flag, __ATOMIC_ACQUIRE)) &&
+         (now = uni_get_clock_time_ms()) < deadline) {
+    g_channel.poll((uint32_t)(deadline - now));
+  }
 }
 
-static void _create_event_list() {
-  g_channel.event_handle            = EventListCreate(_event_handle, 2048);
-  g_channel.event_non_block_handle  = EventListCreate(_event_handle, 2048);
-  g_channel.event_iot_events_handle = EventListCreate(_event_handle, 2048);
+static void _chnl_sleep(uint32_t msec) {
+  if (NULL != g_channel.poll) {
+    _poll_wait(NULL, msec);
+    return;
+  }
+
+  uni_msleep(msec);
 }
 
 static void _register_cmd_callback(hbm_command_cb cmd_callback) {
@@ -263,17 +479,267 @@ static int _is_channel_inited() {
 
 static void _sem_init() {
   uni_sem_new(&g_channel.sem_audio_len, 0);
+  uni_sem_new(&g_channel.sem_baud, 0);
+  uni_mutex_new(&g_channel.mutex_audio_feed);
+  uni_mutex_new(&g_channel.mutex_audio_stats);
+}
+
+static void _audio_feed_init() {
+  MZERO(&g_channel.audio_feed);
+  g_channel.audio_feed.chunk_size = AUDIO_CHUNK_SIZE;
+  g_channel.audio_feed.chunk_min  = AUDIO_CHUNK_ALIGN;
+  g_channel.audio_feed.chunk_max  = AUDIO_CHUNK_LIMIT;
+  g_channel.audio_credit_max      = 0;
+  g_channel.fast_start_bytes      = 0;
+}
+
+static int _packet_pool_create() {
+  g_channel.packet_pool = PacketPoolCreate(g_packet_classes,
+                                           sizeof(g_packet_classes) / sizeof(g_packet_classes[0]),
+                                           PACKET_BYTE_BUDGET);
+  return (NULL == g_channel.packet_pool) ? -1 : 0;
+}
+
+static HandlerEntry* _handler_entry_get(CommCmd cmd) {
+  HandlerEntry **page = &g_channel.handler_pages[cmd >> HANDLER_PAGE_BITS];
+  HandlerEntry *entries = __atomic_load_n(page, __ATOMIC_ACQUIRE);
+  HandlerEntry *expected = NULL;
+
+  if (NULL == entries) {
+    entries = (HandlerEntry *)uni_calloc(HANDLER_PAGE_SIZE, sizeof(HandlerEntry));
+    if (NULL == entries) {
+      LOGE(TAG, OUT_MEM_STRING);
+      return NULL;
+    }
+
+    /* 并发注册同一页时只保留先装入的一页 */
+    if (!__atomic_compare_exchange_n(page, &expected, entries, false,
+                                     __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+      uni_free(entries);
+      entries = expected;
+    }
+  }
+
+  return entries + (cmd & (HANDLER_PAGE_SIZE - 1));
+}
+
+int ChnlRegisterHandler(CommCmd cmd, ChnlCmdHandler handler, void *ctx,
+                        ChnlExecutor executor) {
+  HandlerEntry *entry;
+  uint32_t seq;
+
+  if (executor < CHNL_EXECUTOR_INLINE || executor > CHNL_EXECUTOR_IOT) {
+    LOGE(TAG, "invalid executor=%d", executor);
+    return -1;
+  }
+
+  if (NULL == (entry = _handler_entry_get(cmd))) {
+    return -1;
+  }
+
+  /* seq置奇数即占有该项，并发注册者等待；读者遇奇数或seq变化时重读 */
+  do {
+    seq = __atomic_load_n(&entry->seq, __ATOMIC_RELAXED);
+  } while ((seq & 1) || !__atomic_compare_exchange_n(&entry->seq, &seq, seq + 1, false,
+                                                     __ATOMIC_ACQUIRE, __ATOMIC_RELAXED));
+
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+  __atomic_store_n(&entry->handler, handler, __ATOMIC_RELAXED);
+  __atomic_store_n(&entry->ctx, ctx, __ATOMIC_RELAXED);
+  __atomic_store_n(&entry->executor, executor, __ATOMIC_RELAXED);
+  __atomic_store_n(&entry->seq, seq + 2, __ATOMIC_RELEASE);
+  return 0;
+}
+
+static void _register_builtin_handlers() {
+  ChnlRegisterHandler(CHNL_MSG_IOT_INIT, _do_iot_device_init, NULL, CHNL_EXECUTOR_NON_BLOCK);
+  ChnlRegisterHandler(CHNL_MSG_ASR_CHALLENGE_PACK, _do_challenge_pack, NULL, CHNL_EXECUTOR_NON_BLOCK);
+  ChnlRegisterHandler(CHNL_MSG_DAEMON_REBOOT_REQUEST, _do_reboot_request, NULL, CHNL_EXECUTOR_NON_BLOCK);
+  ChnlRegisterHandler(CHNL_MSG_IOT_RASR_START, _do_iot_device_rasr_start, NULL, CHNL_EXECUTOR_NORMAL);
+  ChnlRegisterHandler(CHNL_MSG_IOT_RASR_STOP, _do_iot_device_rasr_stop, NULL, CHNL_EXECUTOR_NORMAL);
+  ChnlRegisterHandler(CHNL_MSG_IOT_RASR_DATA_FEED, _do_iot_rasr_adpcm_data, NULL, CHNL_EXECUTOR_NORMAL);
+  /* 仅signal信号量，播报线程等待该应答，不经过队列直接在接收线程处理 */
+  ChnlRegisterHandler(CHNL_MSG_IOT_HBM_AUDIO_SOURCE_BUF_REMAIN_LEN_ACK, _do_audio_len_ack, NULL,
+                      CHNL_EXECUTOR_INLINE);
+  ChnlRegisterHandler(CHNL_MSG_IOT_HBM_BAUD_QUERY_ACK, _do_baud_reply, NULL, CHNL_EXECUTOR_INLINE);
+  ChnlRegisterHandler(CHNL_MSG_IOT_HBM_BAUD_VERIFY_ACK, _do_baud_reply, NULL, CHNL_EXECUTOR_INLINE);
 }
 
 int ChnlInit(hbm_command_cb cmd_callback) {
+  if (0 != _packet_pool_create()) {
+    LOGE(TAG, "create packet pool failed");
+    return -1;
+  }
+
   _sem_init();
-  _create_event_list();
+  _audio_feed_init();
+  RasrInit(NULL);
+  if (0 != _create_dispatcher()) {
+    LOGE(TAG, "create dispatcher failed");
+    return -1;
+  }
+
+  _register_builtin_handlers();
   _register_cmd_callback(cmd_callback);
   _set_channel_inited();
   LOGT(TAG, "channel init success");
   return 0;
 }
 
+int ChnlInitCooperative(hbm_command_cb cmd_callback, ChnlPollHandler poll) {
+  if (NULL == poll) {
+    LOGE(TAG, "poll handler required");
+    return -1;
+  }
+
+  g_channel.poll = poll;
+  return ChnlInit(cmd_callback);
+}
+
+int ChnlRunOnce(uint32_t max_tasks) {
+  if (!_is_channel_inited() || NULL == g_channel.poll) {
+    return -1;
+  }
+
+  return DispatcherRunOnce(g_channel.dispatcher, max_tasks);
+}
+
+uint32_t ChnlPendingTasks(void) {
+  if (!_is_channel_inited()) {
+    return 0;
+  }
+
+  return DispatcherQueued(g_channel.dispatcher);
+}
+
+int ChnlSetAdmissionPolicy(PacketPoolPolicy policy, uint32_t byte_budget,
+                           uint32_t block_timeout_msec) {
+  if (!_is_channel_inited()) {
+    LOGE(TAG, "module not init");
+    return -1;
+  }
+
+  /* 单线程下接收阻塞时无人释放packet，BLOCK只会等满超时 */
+  if (NULL != g_channel.poll && PACKET_POOL_POLICY_BLOCK == policy) {
+    LOGE(TAG, "block policy not supported in cooperative mode");
+    return -1;
+  }
+
+  PacketPoolSetPolicy(g_channel.packet_pool, policy, byte_budget, block_timeout_msec);
+  return 0;
+}
+
+int ChnlGetPacketStats(PacketPoolStats *stats) {
+  if (!_is_channel_inited() || NULL == stats) {
+    return -1;
+  }
+
+  PacketPoolGetStats(g_channel.packet_pool, stats);
+  return 0;
+}
+
+static int _push_net_state(int connected) {
+  ChnIoTNetState state;
+  CommAttribute attr = {1};
+  int ret;
+
+  state.net_connected = connected;
+  ret = CommProtocolPacketAssembleAndSend(CHNL_MSG_IOT_NET_STATE, (char *)&state,
+                                          sizeof(state), &attr);
+  if (ret != 0) {
+    LOGW(TAG, "push net state failed. err=%d", ret);
+    __atomic_add_fetch(&g_channel.net_stats.state_push_failed, 1, __ATOMIC_RELAXED);
+    return -1;
+  }
+
+  __atomic_add_fetch(&g_channel.net_stats.state_pushes, 1, __ATOMIC_RELAXED);
+  return 0;
+}
+
+int ChnlSetNetworkState(int connected) {
+  uint32_t offline = connected ? 0 : 1;
+  long since;
+
+  if (offline == __atomic_exchange_n(&g_channel.net_offline, offline, __ATOMIC_RELAXED)) {
+    return 0;
+  }
+
+  LOGT(TAG, "net state changed. connected=%d", !offline);
+  if (offline) {
+    __atomic_store_n(&g_channel.offline_since_ms, uni_get_clock_time_ms(), __ATOMIC_RELAXED);
+    /* 会话中途断网，从断网时刻开始计入离线会话时长 */
+    if (__atomic_load_n(&g_channel.rasr_session_open, __ATOMIC_RELAXED)) {
+      __atomic_store_n(&g_channel.rasr_offline_start_ms, uni_get_clock_time_ms(), __ATOMIC_RELAXED);
+    }
+  } else {
+    since = __atomic_exchange_n(&g_channel.offline_since_ms, 0, __ATOMIC_RELAXED);
+    if (0 != since) {
+      __atomic_add_fetch(&g_channel.net_stats.offline_ms,
+                         (uint32_t)(uni_get_clock_time_ms() - since), __ATOMIC_RELAXED);
+    }
+    _offline_rasr_settle();
+  }
+
+  if (!_is_channel_inited()) {
+    return 0;
+  }
+
+  return _push_net_state(!offline);
+}
+
+int ChnlGetNetStats(ChnlNetStats *stats) {
+  uint32_t expected, saved_packets, avg_us;
+  uint64_t feed_us, feed_packets;
+  long since;
+
+  if (NULL == stats) {
+    return -1;
+  }
+
+  *stats = g_channel.net_stats;
+  stats->net_connected = !_is_net_offline();
+  since = __atomic_load_n(&g_channel.offline_since_ms, __ATOMIC_RELAXED);
+  if (0 != since) {
+    stats->offline_ms += (uint32_t)(uni_get_clock_time_ms() - since);
+  }
+
+  /* 离线RASR会话期间本应上行的字节数，扣除仍然收到的部分 */
+  expected = (uint32_t)((uint64_t)stats->offline_rasr_ms * RASR_ADPCM_BYTES_PER_SEC / 1000 *
+                        RASR_FEED_WIRE_BYTES / sizeof(ChnIoTRasrFeedDataParam));
+  stats->est_uart_saved_bytes = (expected > stats->offline_feed_bytes) ?
+                                (expected - stats->offline_feed_bytes) : 0;
+
+  saved_packets = stats->est_uart_saved_bytes / RASR_FEED_WIRE_BYTES + stats->offline_feed_packets;
+  feed_packets = __atomic_load_n(&g_channel.online_feed_packets, __ATOMIC_RELAXED);
+  feed_us      = __atomic_load_n(&g_channel.online_feed_us, __ATOMIC_RELAXED);
+  avg_us = feed_packets ? (uint32_t)(feed_us / feed_packets) : 0;
+  stats->est_cpu_saved_us = saved_packets * avg_us;
+  return 0;
+}
+
+int ChnlSetHandlerLatencyBudget(ChnlExecutor executor, uint32_t budget_msec) {
+  if (!_is_channel_inited()) {
+    LOGE(TAG, "module not init");
+    return -1;
+  }
+
+  if (executor < CHNL_EXECUTOR_NORMAL || executor > CHNL_EXECUTOR_IOT) {
+    LOGE(TAG, "invalid executor=%d", executor);
+    return -1;
+  }
+
+  return DispatcherSetLatencyBudget(g_channel.dispatcher, _executor_class(executor), budget_msec);
+}
+
+int ChnlGetDispatchStats(DispatcherStats *stats) {
+  if (!_is_channel_inited() || NULL == stats) {
+    return -1;
+  }
+
+  DispatcherGetStats(g_channel.dispatcher, stats);
+  return 0;
+}
+
 int ChnlIotDeviceRasrResult(ChnIoTRasrResult *result) {
   CommAttribute attr = {1};
   int ret = CommProtocolPacketAssembleAndSend(CHNL_MSG_IOT_RASR_RESULT,
@@ -318,22 +784,41 @@ int ChnlIotDevicePushCmd(uint32_t cmd, char *payload, uint32_t payload_len) {
   return 0;
 }
 
-static int _get_audio_buf_remain_len() {
+static int _query_audio_buf_remain_len() {
   CommAttribute attr = {1};
+  __atomic_store_n(&g_channel.audio_len_acked, 0, __ATOMIC_RELAXED);
+  __atomic_add_fetch(&g_channel.audio_feed.credit_queries, 1, __ATOMIC_RELAXED);
   int ret = CommProtocolPacketAssembleAndSend(CHNL_MSG_IOT_HBM_AUDIO_SOURCE_BUF_REMAIN_LEN,
                                               NULL,
                                               0,
                                               &attr);
   if (ret != 0) {
     LOGT(TAG, "transmit failed. err=%d", ret);
-    return 0;
+    return -1;
   }
 
-  uni_sem_wait(&g_channel.sem_audio_len, 1000 * 5);
+  return 0;
+}
+
+static int _wait_audio_buf_remain_len() {
+  if (NULL != g_channel.poll) {
+    _poll_wait(&g_channel.audio_len_acked, 1000 * 5);
+  } else {
+    uni_sem_wait(&g_channel.sem_audio_len, 1000 * 5);
+  }
+  g_channel.audio_credit_max = uni_max(g_channel.audio_credit_max, g_channel.audio_remain_len);
   return g_channel.audio_remain_len;
 }
 
-static void _push_audio_data(char *pcm, int len) {
+static int _get_audio_buf_remain_len() {
+  if (0 != _query_audio_buf_remain_len()) {
+    return 0;
+  }
+
+  return _wait_audio_buf_remain_len();
+}
+
+static int _push_audio_data(char *pcm, int len) {
   CommAttribute attr = {1};
   int ret = CommProtocolPacketAssembleAndSend(CHNL_MSG_IOT_HBM_AUDIO_SOURCE,
                                               pcm,
@@ -342,20 +827,204 @@ static void _push_audio_data(char *pcm, int len) {
   if (ret != 0) {
     LOGT(TAG, "transmit failed. err=%d", ret);
   }
+  return ret;
 }
 
-int ChnlIotDeviceFeedAudioData(char *pcm, int len) {
+/* pcm has COMM_PROTOCOL_HEADROOM writable bytes in front, frame is built there */
+static int _push_audio_data_in_place(char *pcm, int len) {
+  CommAttribute attr = {1};
+  int ret = CommProtocolPacketSendInPlace(CHNL_MSG_IOT_HBM_AUDIO_SOURCE,
+                                          pcm,
+                                          len,
+                                          &attr);
+  if (ret != 0) {
+    LOGT(TAG, "transmit failed. err=%d", ret);
+  }
+  return ret;
+}
+
+static int _push_audio_data_adpcm(char *pcm, int len) {
+  static AdpcmState state = {0};
+  static char buf[sizeof(ChnIoTAudioSourceEncoded) + ADPCM_BYTES_PER_PCM_BYTES(AUDIO_CHUNK_LIMIT)];
+  ChnIoTAudioSourceEncoded *frame = (ChnIoTAudioSourceEncoded *)buf;
+  CommAttribute attr = {1};
+  int samples = (len / sizeof(short)) & ~1; //ADPCM一字节两个采样，奇数尾采样丢弃
+  int bytes;
+
+  frame->codec      = CHNL_AUDIO_CODEC_IMA_ADPCM;
+  frame->step_index = state.step_index;
+  frame->predictor  = state.predictor;
+  frame->samples    = samples;
+  bytes = AdpcmEncode(&state, (const short *)pcm, samples, (unsigned char *)frame->data);
+
+  int ret = CommProtocolPacketAssembleAndSend(CHNL_MSG_IOT_HBM_AUDIO_SOURCE_ENCODED,
+                                              buf,
+                                              sizeof(ChnIoTAudioSourceEncoded) + bytes,
+                                              &attr);
+  if (ret != 0) {
+    LOGT(TAG, "transmit failed. err=%d", ret);
+  }
+  return ret;
+}
+
+static void _chunk_record(uint32_t chunk) {
+  ChnlAudioFeedStats *feed = &g_channel.audio_feed;
+  ChnlAudioChunkSample *sample;
+
+  if (chunk == feed->chunk_size) {
+    return;
+  }
+
+  /* 推送路径不加锁读取chunk_size */
+  __atomic_store_n(&feed->chunk_size, chunk, __ATOMIC_RELAXED);
+  sample = &feed->history[feed->history_cnt++ % CHNL_AUDIO_CHUNK_HISTORY];
+  sample->time_ms    = (uint32_t)(uni_get_clock_time_ms() - g_channel.audio_feed_epoch_ms);
+  sample->chunk_size = chunk;
+  sample->throughput = feed->throughput;
+}
+
+/*
+ * AIMD：满分片且ACK耗时在目标内则加一个对齐单位，超过目标减一个对齐单位，
+ * 重传或失败减半；上限同时受蜂鸟M报告过的buffer空间约束，分片大于buffer只会多等credit
+ */
+static void _chunk_adapt(int push_len, int ret, int64_t cost_us) {
+  ChnlAudioFeedStats *feed = &g_channel.audio_feed;
+  uint32_t chunk, limit, sample;
+
+  /* chunk_size读改写整体在锁内，避免与其他推送线程或ChnlSetAudioChunkRange交错丢失更新 */
+  uni_mutex_lock(&g_channel.mutex_audio_stats);
+  chunk = feed->chunk_size;
+  limit = feed->chunk_max;
+  feed->pushes++;
+  feed->push_bytes += push_len;
+  feed->ack_latency_us = (feed->ack_latency_us * 7 + (uint32_t)cost_us) >> 3;
+  feed->ack_latency_max_us = uni_max(feed->ack_latency_max_us, (uint32_t)cost_us);
+
+  if (0 != ret) {
+    feed->push_errors++;
+    chunk >>= 1;
+  } else if (cost_us >= AUDIO_ACK_RESEND_MS * 1000) {
+    feed->push_slow++;
+    chunk >>= 1;
+  } else {
+    sample = (uint32_t)((int64_t)push_len * 1000000 / uni_max(cost_us, 1));
+    feed->throughput = feed->throughput ? (feed->throughput * 7 + sample) >> 3 : sample;
+    if (cost_us > CHNL_AUDIO_ACK_TARGET_MS * 1000) {
+      chunk -= AUDIO_CHUNK_ALIGN;
+    } else if ((uint32_t)push_len == chunk) {
+      chunk += AUDIO_CHUNK_ALIGN;
+    }
+  }
+
+  if (0 != g_channel.audio_credit_max) {
+    limit = uni_min(limit, uni_max(g_channel.audio_credit_max & ~(AUDIO_CHUNK_ALIGN - 1),
+                                   feed->chunk_min));
+  }
+
+  chunk &= ~(AUDIO_CHUNK_ALIGN - 1);
+  chunk = uni_max(uni_min(chunk, limit), feed->chunk_min);
+  _chunk_record(chunk);
+  uni_mutex_unlock(&g_channel.mutex_audio_stats);
+}
+
+static void _running_avg(uint32_t *avg, uint32_t cnt, uint32_t sample) {
+  *avg = (uint32_t)((int64_t)*avg + ((int64_t)sample - *avg) / cnt);
+}
+
+/* 起播首包ACK时记录调用至首包、识别结果至首包耗时，[0]常规起播 [1]快速起播 */
+static void _start_record(int64_t call_us, bool fast) {
+  ChnlAudioFeedStats *feed = &g_channel.audio_feed;
+  long result_ms = __atomic_exchange_n(&g_channel.asr_result_ms, 0, __ATOMIC_RELAXED);
+  long now_ms = uni_get_clock_time_ms();
+  uint32_t cost;
+
+  uni_mutex_lock(&g_channel.mutex_audio_stats);
+  feed->starts[fast]++;
+  _running_avg(&feed->start_us[fast], feed->starts[fast],
+               (uint32_t)(uni_get_clock_time_us() - call_us));
+
+  if (0 != result_ms && now_ms - result_ms < AUDIO_RESULT_WINDOW_MS) {
+    cost = (uint32_t)(now_ms - result_ms);
+    feed->result_starts[fast]++;
+    _running_avg(&feed->result_to_audio_ms[fast], feed->result_starts[fast], cost);
+    feed->result_to_audio_last_ms = cost;
+  }
+  uni_mutex_unlock(&g_channel.mutex_audio_stats);
+}
+
+static int _push_chunk(char *p, int push_len, AudioPushHandler push) {
+  int64_t begin;
+  int ret;
+
+  if (0 == g_channel.audio_feed_epoch_ms) {
+    g_channel.audio_feed_epoch_ms = uni_get_clock_time_ms();
+  }
+
+  begin = uni_get_clock_time_us();
+  ret = push(p, push_len);
+  _chunk_adapt(push_len, ret, uni_get_clock_time_us() - begin);
+  return ret;
+}
+
+/*
+ * 快速起播：credit查询请求发出后不等应答，先按投机额度推送首发数据，再等待应答对账。
+ * 查询先于首发数据到达蜂鸟M，应答为首发数据到达前的剩余空间，扣除首发量即为当前剩余
+ */
+static int _fast_start(char *pcm, int len, AudioPushHandler push, int *credit, int64_t call_us) {
+  int burst = uni_min(len, uni_max((int)g_channel.fast_start_bytes, *credit));
+  int chunk, pushed = 0, reply;
+
+  if (0 != _query_audio_buf_remain_len()) {
+    return 0;
+  }
+
+  while (pushed < burst) {
+    chunk = uni_min((int)__atomic_load_n(&g_channel.audio_feed.chunk_size, __ATOMIC_RELAXED),
+                    burst - pushed);
+    _push_chunk(pcm + pushed, chunk, push);
+    if (0 == pushed) {
+      _start_record(call_us, true);
+    }
+    pushed += chunk;
+  }
+
+  reply = _wait_audio_buf_remain_len();
+  __atomic_add_fetch(&g_channel.audio_feed.burst_bytes, pushed, __ATOMIC_RELAXED);
+  if (reply < pushed) {
+    LOGW(TAG, "fast start overcommit. credit=%d, burst=%d", reply, pushed);
+    __atomic_add_fetch(&g_channel.audio_feed.burst_overcommit, 1, __ATOMIC_RELAXED);
+    *credit = 0;
+  } else {
+    *credit = reply - pushed;
+  }
+
+  return pushed;
+}
+
+/* HBM音频buffer剩余空间以PCM字节数计，编码后发送不改变流控统计口径 */
+static int _feed_audio_data(char *pcm, int len, AudioPushHandler push) {
   static int audio_buf_remain_len = 0;
+  int64_t call_us = uni_get_clock_time_us();
+  long now_ms = uni_get_clock_time_ms();
   int remain = len;
   int push_len;
   char *p;
   bool first_query = true;
+  bool start;
 
   if (NULL == pcm || 0 == len) {
     LOGE(TAG, "param invalid. pcm=%p, len=%d", pcm, len);
     return -1;
   }
 
+  start = (0 == g_channel.audio_feed_last_ms ||
+           now_ms - g_channel.audio_feed_last_ms >= AUDIO_START_IDLE_MS);
+  if (start && 0 != g_channel.fast_start_bytes) {
+    remain -= _fast_start(pcm, len, push, &audio_buf_remain_len, call_us);
+    first_query = false;
+    start = false;
+  }
+
   while (remain > 0) {
     /*
      * 尝试读取HBM音频buffer remain空间，降低query频率，
@@ -368,7 +1037,7 @@ int ChnlIotDeviceFeedAudioData(char *pcm, int len) {
 
       if (!first_query) {
         LOGD(TAG, "wait 50ms");
-        uni_msleep(50);
+        _chnl_sleep(50);
       }
 
       first_query = false;
@@ -376,12 +1045,294 @@ int ChnlIotDeviceFeedAudioData(char *pcm, int len) {
 
     p = pcm + (len - remain);
     push_len = uni_min(audio_buf_remain_len, remain);
-    push_len = uni_min(512, push_len);//传输中途均采取512字节的包，最后一包采用可能存在的小包策略
+    push_len = uni_min((int)__atomic_load_n(&g_channel.audio_feed.chunk_size, __ATOMIC_RELAXED),
+                       push_len);//中途采用自适应分片，最后一包采用可能存在的小包策略
     remain -= push_len;
     audio_buf_remain_len -= push_len;
 
-    _push_audio_data(p, push_len);
+    _push_chunk(p, push_len, push);
+    if (start) {
+      _start_record(call_us, false);
+      start = false;
+    }
+  }
+
+  g_channel.audio_feed_last_ms = uni_get_clock_time_ms();
+  return 0;
+}
+
+/* IoT回调可并发执行，播报流控状态为全局共享，单次调用整体串行 */
+static int _feed_audio_data_locked(char *pcm, int len, AudioPushHandler push) {
+  int ret;
+  uni_mutex_lock(&g_channel.mutex_audio_feed);
+  ret = _feed_audio_data(pcm, len, push);
+  uni_mutex_unlock(&g_channel.mutex_audio_feed);
+  return ret;
+}
+
+int ChnlIotDeviceFeedAudioData(char *pcm, int len) {
+  return _feed_audio_data_locked(pcm, len, _push_audio_data);
+}
+
+int ChnlIotDeviceFeedAudioDataInPlace(char *pcm, int len) {
+  return _feed_audio_data_locked(pcm, len, _push_audio_data_in_place);
+}
+
+int ChnlIotDeviceFeedAudioDataAdpcm(char *pcm, int len) {
+  return _feed_audio_data_locked(pcm, len, _push_audio_data_adpcm);
+}
+
+int ChnlSetAudioChunkRange(uint32_t chunk_min, uint32_t chunk_max) {
+  ChnlAudioFeedStats *feed = &g_channel.audio_feed;
+
+  if (!_is_channel_inited()) {
+    LOGE(TAG, "module not init");
+    return -1;
+  }
+
+  chunk_min &= ~(AUDIO_CHUNK_ALIGN - 1);
+  chunk_max &= ~(AUDIO_CHUNK_ALIGN - 1);
+  if (0 == chunk_min || chunk_min > chunk_max || chunk_max > AUDIO_CHUNK_LIMIT) {
+    LOGE(TAG, "invalid chunk range. min=%u, max=%u", chunk_min, chunk_max);
+    return -1;
+  }
+
+  uni_mutex_lock(&g_channel.mutex_audio_stats);
+  feed->chunk_min = chunk_min;
+  feed->chunk_max = chunk_max;
+  _chunk_record(uni_max(uni_min(feed->chunk_size, chunk_max), chunk_min));
+  uni_mutex_unlock(&g_channel.mutex_audio_stats);
+  return 0;
+}
+
+int ChnlSetAudioFastStart(int enable, uint32_t burst_bytes) {
+  if (!_is_channel_inited()) {
+    LOGE(TAG, "module not init");
+    return -1;
+  }
+
+  if (0 == burst_bytes) {
+    burst_bytes = CHNL_AUDIO_FAST_START_BYTES;
+  }
+
+  uni_mutex_lock(&g_channel.mutex_audio_feed);
+  g_channel.fast_start_bytes = enable ? burst_bytes : 0;
+  uni_mutex_unlock(&g_channel.mutex_audio_feed);
+
+  uni_mutex_lock(&g_channel.mutex_audio_stats);
+  g_channel.audio_feed.fast_start = g_channel.fast_start_bytes;
+  uni_mutex_unlock(&g_channel.mutex_audio_stats);
+  LOGT(TAG, "audio fast start=%u", g_channel.fast_start_bytes);
+  return 0;
+}
+
+int ChnlGetAudioFeedStats(ChnlAudioFeedStats *stats) {
+  if (!_is_channel_inited() || NULL == stats) {
+    return -1;
+  }
+
+  uni_mutex_lock(&g_channel.mutex_audio_stats);
+  *stats = g_channel.audio_feed;
+  uni_mutex_unlock(&g_channel.mutex_audio_stats);
+  return 0;
+}
+
+/* 可靠发送cmd，reply_cmd非0时等待其应答到达g_channel.baud_reply */
+static int _baud_request(CommCmd cmd, void *payload, uint32_t len, CommCmd reply_cmd) {
+  CommAttribute attr = {1};
+  long deadline;
+  long now;
+  int ret;
+
+  memset(&g_channel.baud_reply, 0, sizeof(g_channel.baud_reply));
+  __atomic_store_n(&g_channel.baud_replied, 0, __ATOMIC_RELAXED);
+  __atomic_store_n(&g_channel.baud_expect, reply_cmd, __ATOMIC_RELEASE);
+  ret = CommProtocolPacketAssembleAndSend(cmd, (char *)payload, len, &attr);
+  if (0 != ret || 0 == reply_cmd) {
+    __atomic_store_n(&g_channel.baud_expect, 0, __ATOMIC_RELEASE);
+    return (0 == ret) ? 0 : -1;
+  }
+
+  deadline = uni_get_clock_time_ms() + BAUD_REPLY_TIMEOUT_MS;
+  while (!__atomic_load_n(&g_channel.baud_replied, __ATOMIC_ACQUIRE) &&
+         (now = uni_get_clock_time_ms()) < deadline) {
+    if (NULL != g_channel.poll) {
+      _poll_wait(&g_channel.baud_replied, (uint32_t)(deadline - now));
+    } else {
+      uni_sem_wait(&g_channel.sem_baud, (uint32_t)(deadline - now));
+    }
+  }
+
+  __atomic_store_n(&g_channel.baud_expect, 0, __ATOMIC_RELEASE);
+  return __atomic_load_n(&g_channel.baud_replied, __ATOMIC_ACQUIRE) ? 0 : -1;
+}
+
+/* 固定字节覆盖全0、全1及交替位，其余伪随机，seed区分每次校验 */
+static void _baud_pattern_fill(unsigned char *pattern, uint32_t seed) {
+  static const unsigned char fixed[] = {0x00, 0xFF, 0x55, 0xAA, 0x0F, 0xF0, 0x33, 0xCC};
+  uint32_t i;
+
+  memcpy(pattern, fixed, sizeof(fixed));
+  for (i = sizeof(fixed); i < CHNL_BAUD_PATTERN_LEN; i++) {
+    seed = seed * 1103515245 + 12345;
+    pattern[i] = (unsigned char)(seed >> 16);
+  }
+}
+
+static bool _baud_supported(const ChnIoTBaudCaps *caps, uint32_t baud) {
+  uint32_t i;
+  for (i = 0; i < uni_min(caps->count, CHNL_BAUD_RATE_MAX); i++) {
+    if (caps->rates[i] == baud) {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+/* 双方共同支持且高于当前的波特率，降序 */
+static uint32_t _baud_candidates(const ChnIoTBaudCaps *caps, const uint32_t *rates,
+                                 uint32_t rate_cnt, uint32_t *candidates) {
+  uint32_t cnt = 0;
+  uint32_t i, j, tmp;
+
+  for (i = 0; i < uni_min(rate_cnt, CHNL_BAUD_RATE_MAX); i++) {
+    if (rates[i] > caps->current && _baud_supported(caps, rates[i])) {
+      candidates[cnt++] = rates[i];
+    }
+  }
+
+  for (i = 1; i < cnt; i++) {
+    for (j = i; j > 0 && candidates[j - 1] < candidates[j]; j--) {
+      tmp = candidates[j];
+      candidates[j] = candidates[j - 1];
+      candidates[j - 1] = tmp;
+    }
+  }
+
+  return cnt;
+}
+
+static int _baud_verify(uint32_t baud) {
+  ChnIoTBaudVerify verify;
+  verify.baud = baud;
+  _baud_pattern_fill(verify.pattern, (uint32_t)uni_get_clock_time_us());
+  if (0 != _baud_request(CHNL_MSG_IOT_HBM_BAUD_VERIFY, &verify, sizeof(verify),
+                         CHNL_MSG_IOT_HBM_BAUD_VERIFY_ACK)) {
+    return -1;
+  }
+
+  if (g_channel.baud_reply.verify.baud != baud ||
+      0 != memcmp(g_channel.baud_reply.verify.pattern, verify.pattern, sizeof(verify.pattern))) {
+    LOGW(TAG, "baud %u verify pattern mismatch", baud);
+    return -1;
   }
 
   return 0;
 }
+
+static int _baud_query(ChnIoTBaudCaps *caps) {
+  if (0 != _baud_request(CHNL_MSG_IOT_HBM_BAUD_QUERY, NULL, 0, CHNL_MSG_IOT_HBM_BAUD_QUERY_ACK)) {
+    return -1;
+  }
+
+  if (NULL != caps) {
+    *caps = g_channel.baud_reply.caps;
+  }
+  return 0;
+}
+
+/*
+ * 校验失败后确认蜂鸟M所处波特率：蜂鸟M未收到校验包时已自行退回safe，
+ * 收到校验包但回显丢失时已在baud生效，哪边能应答查询就停在哪边
+ * 返回最终波特率，0表示两边均无应答
+ */
+static uint32_t _baud_resync(uint32_t safe, uint32_t baud, ChnlBaudHandler set_local) {
+  _chnl_sleep(BAUD_VERIFY_TIMEOUT_MS);
+  if (0 == set_local(safe) && 0 == _baud_query(NULL)) {
+    return safe;
+  }
+
+  if (0 == set_local(baud) && 0 == _baud_query(NULL)) {
+    LOGW(TAG, "verify reply lost, module already at %u", baud);
+    return baud;
+  }
+
+  set_local(safe);
+  return 0;
+}
+
+/* 返回最终波特率，0表示链路丢失 */
+static uint32_t _baud_try(uint32_t safe, uint32_t baud, ChnlBaudHandler set_local) {
+  ChnIoTBaudSwitch req = {baud, BAUD_VERIFY_TIMEOUT_MS};
+
+  if (0 != _baud_request(CHNL_MSG_IOT_HBM_BAUD_SWITCH, &req, sizeof(req), 0)) {
+    LOGW(TAG, "baud %u switch request not acked", baud);
+    return _baud_resync(safe, baud, set_local);
+  }
+
+  if (0 != set_local(baud)) {
+    LOGW(TAG, "local uart cannot run at %u", baud);
+    return _baud_resync(safe, baud, set_local);
+  }
+
+  _chnl_sleep(BAUD_SETTLE_MS);
+  if (0 == _baud_verify(baud)) {
+    return baud;
+  }
+
+  LOGW(TAG, "baud %u verify failed, fall back to %u", baud, safe);
+  return _baud_resync(safe, baud, set_local);
+}
+
+int ChnlNegotiateBaud(const uint32_t *rates, uint32_t rate_cnt, ChnlBaudHandler set_local,
+                      ChnlBaudResult *result) {
+  uint32_t candidates[CHNL_BAUD_RATE_MAX];
+  ChnIoTBaudCaps caps;
+  ChnlBaudResult r;
+  long start = uni_get_clock_time_ms();
+  uint32_t cnt, i, baud;
+  int ret = 1;
+
+  if (!_is_channel_inited() || NULL == rates || 0 == rate_cnt || NULL == set_local) {
+    return -1;
+  }
+
+  MZERO(&r);
+  if (0 != _baud_query(&caps)) {
+    LOGW(TAG, "module does not answer baud query");
+    return -1;
+  }
+
+  r.baud = caps.current;
+  for (i = 0; i < uni_min(caps.count, CHNL_BAUD_RATE_MAX); i++) {
+    r.module_max = uni_max(r.module_max, caps.rates[i]);
+  }
+
+  cnt = _baud_candidates(&caps, rates, rate_cnt, candidates);
+  for (i = 0; i < cnt; i++) {
+    r.attempts++;
+    baud = _baud_try(caps.current, candidates[i], set_local);
+    if (0 == baud) {
+      LOGE(TAG, "link lost during baud negotiation");
+      ret = -1;
+      break;
+    }
+
+    if (baud != caps.current) {
+      r.baud = baud;
+      ret = 0;
+      break;
+    }
+
+    r.fallbacks++;
+  }
+
+  r.elapsed_ms = (uint32_t)(uni_get_clock_time_ms() - start);
+  LOGT(TAG, "baud negotiated %u -> %u, module max=%u, attempts=%u, fallbacks=%u, cost=%ums",
+       caps.current, r.baud, r.module_max, r.attempts, r.fallbacks, r.elapsed_ms);
+  if (NULL != result) {
+    *result = r;
+  }
+  return ret;
+}
@@ -95,6 +95,9 @@ typedef struct {
   int                   inited;
 } CommProtocolBusiness;
 
+/* COMM_PROTOCOL_HEADROOM must match header layout */
+typedef char CommHeadroomCheck[sizeof(CommProtocolPacket) == COMM_PROTOCOL_HEADROOM ? 1 : -1];
+
 static unsigned char        g_sync[6] = {'u', 'A', 'r', 'T', 'c', 'P'};
 static CommProtocolHooks    g_hooks   = {NULL};
 static CommProtocolBusiness g_comm_protocol_business;
@@ -137,6 +140,10 @@ void CommProtocolRegisterHooks(CommProtocolHooks *hooks) {
   /* sleep hook */
   g_hooks.msleep_fn = hooks->msleep_fn;
 
+  /* cooperative mode hooks */
+  g_hooks.poll_fn     = hooks->poll_fn;
+  g_hooks.clock_ms_fn = hooks->clock_ms_fn;
+
   /* semaphore hooks */
   g_hooks.sem_alloc_fn     = hooks->sem_alloc_fn;
   g_hooks.sem_destroy_fn   = hooks->sem_destroy_fn;
@@ -195,15 +202,21 @@ static unsigned short _crc16(const char *buf, int len) {
 
 //----------------UTILS interruptable sleep--------------------
 typedef struct {
-  void *v;
+  void         *v;
+  volatile int broken; /* cooperative mode */
 } Interruptable;
 
 static int _is_sem_hook_registered() {
   return (1 == g_comm_protocol_business.sem_hooks_registered);
 }
 
+static int _is_poll_mode() {
+  return CHECK_NOT_NULL(g_hooks.poll_fn) && CHECK_NOT_NULL(g_hooks.clock_ms_fn);
+}
+
 static InterruptHandle InterruptCreate() {
   Interruptable *interrupter = (Interruptable *)g_hooks.malloc_fn(sizeof(Interruptable));
+  interrupter->broken = 0;
   if (_is_sem_hook_registered()) {
     interrupter->v = g_hooks.sem_alloc_fn();
     g_hooks.sem_init_fn(interrupter->v, 0);
@@ -224,6 +237,18 @@ static int InterruptDestroy(InterruptHandle handle) {
 
 static int InterruptableSleep(InterruptHandle handle, int sleep_msec) {
   Interruptable *interrupter = (Interruptable *)handle;
+  long deadline, now;
+
+  /* single thread, break can only happen inside poll_fn, reset before polling is safe */
+  if (_is_poll_mode()) {
+    interrupter->broken = 0;
+    deadline = g_hooks.clock_ms_fn() + sleep_msec;
+    while (!interrupter->broken && (now = g_hooks.clock_ms_fn()) < deadline) {
+      g_hooks.poll_fn((unsigned int)(deadline - now));
+    }
+    return 0;
+  }
+
   if (_is_sem_hook_registered()) {
     return g_hooks.sem_timedwait_fn(interrupter->v, sleep_msec);
   }
@@ -239,6 +264,11 @@ static int InterruptableSleep(InterruptHandle handle, int sleep_msec) {
 
 static int InterruptableBreak(InterruptHandle handle) {
   Interruptable *interrupter = (Interruptable *)handle;
+  if (_is_poll_mode()) {
+    interrupter->broken = 1;
+    return 0;
+  }
+
   if (_is_sem_hook_registered()) {
     return g_hooks.sem_post_fn(interrupter->v);
   }
@@ -354,7 +384,8 @@ static CommPayloadLen _payload_len_get(CommProtocolPacket *packet) {
 
 static void _payload_set(CommProtocolPacket *packet,
                          char *buf, CommPayloadLen len) {
-  if (NULL != buf && 0 < len) {
+  /* payload already in place, see CommProtocolPacketSendInPlace */
+  if (NULL != buf && 0 < len && buf != packet->payload) {
     _memcpy(packet->payload, buf, len);
   }
 }
@@ -542,6 +573,47 @@ int CommProtocolPacketAssembleAndSend(CommCmd cmd, char *payload,
   return ret;
 }
 
+/* header goes into headroom of caller's buffer, no alloc, no payload copy */
+static int _assemble_in_place_and_send_frame(CommCmd cmd,
+                                             char *payload,
+                                             CommPayloadLen payload_len,
+                                             CommAttribute *attribute) {
+  CommProtocolPacket *packet;
+  if (NULL == payload) {
+    return E_UNI_COMM_BUFFER_PTR_NULL;
+  }
+
+  if (_is_protocol_buffer_overflow(sizeof(CommProtocolPacket) +
+                                   payload_len)) {
+    return E_UNI_COMM_PAYLOAD_TOO_LONG;
+  }
+
+  packet = (CommProtocolPacket *)(payload - sizeof(CommProtocolPacket));
+  _memset(packet, 0, sizeof(CommProtocolPacket));
+  _assmeble_packet(packet, cmd, payload, payload_len,
+                   attribute && attribute->reliable, 0, 0, 0);
+
+  return _write_uart(packet, attribute);
+}
+
+int CommProtocolPacketSendInPlace(CommCmd cmd, char *payload,
+                                  CommPayloadLen payload_len,
+                                  CommAttribute *attr) {
+  int ret;
+
+  if (g_comm_protocol_business.app_send_sync_lock) {
+    g_hooks.sem_wait_fn(g_comm_protocol_business.app_send_sync_lock);
+  }
+
+  ret = _assemble_in_place_and_send_frame(cmd, payload, payload_len, attr);
+
+  if (g_comm_protocol_business.app_send_sync_lock) {
+    g_hooks.sem_post_fn(g_comm_protocol_business.app_send_sync_lock);
+  }
+
+  return ret;
+}
+
 static int _packet_disassemble(CommProtocolPacket *protocol_packet,
                                CommPacket *packet) {
   if (!_checksum_valid(protocol_packet)) {
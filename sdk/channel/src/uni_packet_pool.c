@@ -0,0 +1,388 @@
+/**************************************************************************
+ * Copyright (C) 2020-2020  Unisound
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ **************************************************************************
+ *
+ * Description : uni_packet_pool.c
+ * Author      : junlon2006@163.com
+ * Date        : 2020.08.10
+ *
+ **************************************************************************/
+#include "uni_packet_pool.h"
+#include "list_head.h"
+#include "uni_log.h"
+#include "porting.h"
+
+#define TAG                   "packet_pool"
+#define SLOT_ALIGN(size)      (((size) + 7) & ~7)
+
+#define atomic_inc(p)         __atomic_add_fetch(p, 1, __ATOMIC_ACQ_REL)
+
+typedef enum {
+  ADMIT_OK = 0,
+  ADMIT_NO_BUDGET,
+  ADMIT_NO_SLOT,
+} AdmitResult;
+
+typedef struct {
+  list_head  link;      /* free list when idle, evictable fifo when queued */
+  uint8_t    cls;
+  uint8_t    evictable;
+  uint8_t    queued;
+  uint32_t   stale;     /* dispatcher entries left behind by evictions, dropped by acquire */
+  uint32_t   charge;    /* bytes charged to budget */
+  CommPacket packet;
+} PacketSlot;
+
+typedef struct {
+  uint32_t  payload_size;
+  uint32_t  slot_size;
+  uint32_t  count;
+  list_head free_list;
+} SlotClass;
+
+/* budget, slots and fifo are all guarded by mutex, admission reserves both together */
+typedef struct {
+  SlotClass        classes[PACKET_POOL_CLASS_MAX];
+  int              class_cnt;
+  char             *memory;
+  list_head        evictable_fifo;
+  uni_mutex_t      mutex;
+  uni_sem_t        sem_release;
+  uint32_t         waiters;
+  PacketPoolPolicy policy;
+  uint32_t         block_timeout_msec;
+  PacketPoolStats  stats;
+} PacketPool;
+
+static PacketSlot* _slot_of(CommPacket *packet) {
+  return list_entry(packet, PacketSlot, packet);
+}
+
+/* wake BLOCK waiters whenever budget or a slot comes back, mutex held */
+static void _notify_release(PacketPool *pool) {
+  if (0 < pool->waiters) {
+    uni_sem_signal(&pool->sem_release);
+  }
+}
+
+/**
+ * smallest class which fits and still has a free slot. evictable packets
+ * never spill into bigger classes, so an audio burst cannot starve large
+ * control frames. mutex held
+ */
+static int _class_pick(PacketPool *pool, uint32_t payload_len, int evictable) {
+  int i;
+  for (i = 0; i < pool->class_cnt; i++) {
+    if (pool->classes[i].payload_size < payload_len) continue;
+    if (!list_empty(&pool->classes[i].free_list)) return i;
+    if (evictable) break;
+  }
+  return -1;
+}
+
+/* reserve budget and slot together, or neither. mutex held */
+static AdmitResult _try_reserve(PacketPool *pool, uint32_t bytes, int evictable,
+                                PacketSlot **out) {
+  PacketSlot *slot;
+  int cls;
+
+  if (pool->stats.bytes_in_use + bytes > pool->stats.byte_budget) {
+    return ADMIT_NO_BUDGET;
+  }
+
+  if (-1 == (cls = _class_pick(pool, bytes, evictable))) {
+    return ADMIT_NO_SLOT;
+  }
+
+  slot = list_get_head_entry(&pool->classes[cls].free_list, PacketSlot, link);
+  list_del(&slot->link);
+  slot->queued = 0;
+  slot->charge = bytes;
+  pool->stats.in_use[cls]++;
+  pool->stats.in_use_max[cls] = uni_max(pool->stats.in_use_max[cls], pool->stats.in_use[cls]);
+  pool->stats.bytes_in_use += bytes;
+  pool->stats.bytes_in_use_max = uni_max(pool->stats.bytes_in_use_max, pool->stats.bytes_in_use);
+  *out = slot;
+  return ADMIT_OK;
+}
+
+/* give back budget and slot, mutex held */
+static void _slot_release(PacketPool *pool, PacketSlot *slot) {
+  if (slot->queued) {
+    list_del(&slot->link);
+    slot->queued = 0;
+  }
+
+  pool->stats.bytes_in_use -= slot->charge;
+  slot->charge = 0;
+  list_add_tail(&slot->link, &pool->classes[slot->cls].free_list);
+  pool->stats.in_use[slot->cls]--;
+  _notify_release(pool);
+}
+
+/* whether freeing victim can satisfy what the failed reservation lacked */
+static int _evict_helps(PacketPool *pool, PacketSlot *victim, uint32_t bytes,
+                        int evictable, AdmitResult lack) {
+  uint32_t size = pool->classes[victim->cls].payload_size;
+
+  if (ADMIT_NO_BUDGET == lack) {
+    return 1;
+  }
+
+  if (size < bytes) {
+    return 0;
+  }
+
+  /* evictable packets only live in the smallest fitting class */
+  return !evictable || 0 == victim->cls || pool->classes[victim->cls - 1].payload_size < bytes;
+}
+
+/**
+ * reclaim the oldest queued evictable packet which helps this admission.
+ * its slot goes back to the free list immediately, the dispatcher entry
+ * still pointing at it is dropped by PacketPoolAcquire through stale.
+ * mutex held
+ */
+static int _evict_oldest(PacketPool *pool, uint32_t bytes, int evictable, AdmitResult lack) {
+  PacketSlot *slot;
+  list_head *p;
+
+  list_for_each(p, &pool->evictable_fifo) {
+    slot = list_entry(p, PacketSlot, link);
+    if (!_evict_helps(pool, slot, bytes, evictable, lack)) continue;
+
+    slot->stale++;
+    _slot_release(pool, slot);
+    pool->stats.evicted++;
+    return 0;
+  }
+
+  return -1;
+}
+
+/* wait for any release until deadline, mutex held and released while waiting */
+static int _block_wait(PacketPool *pool, int64_t deadline) {
+  int64_t remain = deadline - uni_get_clock_time_us();
+  if (remain <= 0) {
+    return -1;
+  }
+
+  pool->waiters++;
+  uni_mutex_unlock(&pool->mutex);
+  uni_sem_wait(&pool->sem_release, (unsigned int)((remain + 999) / 1000));
+  uni_mutex_lock(&pool->mutex);
+  pool->waiters--;
+  return 0;
+}
+
+static PacketSlot* _admit(PacketPool *pool, uint32_t bytes, int evictable) {
+  PacketSlot *slot = NULL;
+  AdmitResult ret;
+  int64_t deadline = 0;
+
+  uni_mutex_lock(&pool->mutex);
+  while (ADMIT_OK != (ret = _try_reserve(pool, bytes, evictable, &slot))) {
+    if (PACKET_POOL_POLICY_EVICT_OLDEST == pool->policy &&
+        0 == _evict_oldest(pool, bytes, evictable, ret)) {
+      continue;
+    }
+
+    if (PACKET_POOL_POLICY_BLOCK == pool->policy) {
+      if (0 == deadline) {
+        pool->stats.blocked++;
+        deadline = uni_get_clock_time_us() + (int64_t)pool->block_timeout_msec * 1000;
+      }
+
+      if (0 == _block_wait(pool, deadline)) {
+        continue;
+      }
+
+      pool->stats.block_timeout++;
+    }
+
+    if (ADMIT_NO_BUDGET == ret) {
+      pool->stats.drop_budget++;
+    } else {
+      pool->stats.drop_no_slot++;
+    }
+
+    slot = NULL;
+    break;
+  }
+  uni_mutex_unlock(&pool->mutex);
+  return slot;
+}
+
+CommPacket* PacketPoolAlloc(PacketPoolHandle handle, CommPacket *packet, int evictable) {
+  PacketPool *pool = (PacketPool *)handle;
+  PacketSlot *slot;
+
+  if (packet->payload_len > pool->classes[pool->class_cnt - 1].payload_size) {
+    atomic_inc(&pool->stats.drop_too_large);
+    return NULL;
+  }
+
+  if (NULL == (slot = _admit(pool, packet->payload_len, evictable))) {
+    return NULL;
+  }
+
+  slot->evictable           = (uint8_t)evictable;
+  slot->packet.cmd          = packet->cmd;
+  slot->packet.payload_len  = packet->payload_len;
+  if (packet->payload_len > 0) {
+    memcpy(slot->packet.payload, packet->payload, packet->payload_len);
+  }
+
+  uni_mutex_lock(&pool->mutex);
+  if (evictable) {
+    list_add_tail(&slot->link, &pool->evictable_fifo);
+    slot->queued = 1;
+  }
+  pool->stats.admitted++;
+  uni_mutex_unlock(&pool->mutex);
+  return &slot->packet;
+}
+
+int PacketPoolAcquire(PacketPoolHandle handle, CommPacket *packet) {
+  PacketPool *pool = (PacketPool *)handle;
+  PacketSlot *slot = _slot_of(packet);
+  int ret = 0;
+
+  /**
+   * an evicted slot may already serve a newer packet, which has its own
+   * dispatcher entry. whichever entry comes first while stale is pending
+   * is dropped, the other one processes the current occupant
+   */
+  uni_mutex_lock(&pool->mutex);
+  if (0 < slot->stale) {
+    slot->stale--;
+    ret = -1;
+  } else if (slot->queued) {
+    list_del(&slot->link);
+    slot->queued = 0;
+  }
+  uni_mutex_unlock(&pool->mutex);
+  return ret;
+}
+
+void PacketPoolFree(PacketPoolHandle handle, CommPacket *packet) {
+  PacketPool *pool = (PacketPool *)handle;
+  PacketSlot *slot = _slot_of(packet);
+
+  uni_mutex_lock(&pool->mutex);
+  _slot_release(pool, slot);
+  uni_mutex_unlock(&pool->mutex);
+}
+
+static uint32_t _slot_size(uint32_t payload_size) {
+  return SLOT_ALIGN(sizeof(PacketSlot) + payload_size);
+}
+
+static void _classes_init(PacketPool *pool) {
+  char *p = pool->memory;
+  PacketSlot *slot;
+  uint32_t j;
+  int i;
+
+  for (i = 0; i < pool->class_cnt; i++) {
+    for (j = 0; j < pool->classes[i].count; j++) {
+      slot = (PacketSlot *)p;
+      slot->cls            = (uint8_t)i;
+      slot->queued         = 0;
+      slot->stale          = 0;
+      slot->charge         = 0;
+      slot->packet.payload = (char *)slot + sizeof(PacketSlot);
+      list_add_tail(&slot->link, &pool->classes[i].free_list);
+      p += pool->classes[i].slot_size;
+    }
+  }
+}
+
+PacketPoolHandle PacketPoolCreate(const PacketPoolClass *classes, int class_cnt,
+                                  uint32_t byte_budget) {
+  PacketPool *pool;
+  uint32_t total = 0;
+  int i;
+
+  if (NULL == classes || class_cnt <= 0 || class_cnt > PACKET_POOL_CLASS_MAX) {
+    return NULL;
+  }
+
+  if (NULL == (pool = (PacketPool *)uni_calloc(1, sizeof(PacketPool)))) {
+    LOGE(TAG, OUT_MEM_STRING);
+    return NULL;
+  }
+
+  pool->class_cnt       = class_cnt;
+  pool->stats.class_cnt = class_cnt;
+  for (i = 0; i < class_cnt; i++) {
+    pool->classes[i].payload_size = classes[i].payload_size;
+    pool->classes[i].slot_size    = _slot_size(classes[i].payload_size);
+    pool->classes[i].count        = classes[i].count;
+    pool->stats.payload_size[i]   = classes[i].payload_size;
+    pool->stats.slot_cnt[i]       = classes[i].count;
+    list_init(&pool->classes[i].free_list);
+    total += pool->classes[i].slot_size * classes[i].count;
+  }
+
+  if (NULL == (pool->memory = (char *)uni_malloc(total))) {
+    LOGE(TAG, OUT_MEM_STRING);
+    uni_free(pool);
+    return NULL;
+  }
+
+  list_init(&pool->evictable_fifo);
+  pool->policy            = PACKET_POOL_POLICY_DROP;
+  pool->stats.byte_budget = byte_budget;
+  uni_mutex_new(&pool->mutex);
+  uni_sem_new(&pool->sem_release, 0);
+  _classes_init(pool);
+  LOGT(TAG, "packet pool created. memory=%u, budget=%u", total, byte_budget);
+  return pool;
+}
+
+void PacketPoolDestroy(PacketPoolHandle handle) {
+  PacketPool *pool = (PacketPool *)handle;
+  if (NULL == pool) {
+    return;
+  }
+
+  uni_mutex_free(&pool->mutex);
+  uni_sem_free(&pool->sem_release);
+  uni_free(pool->memory);
+  uni_free(pool);
+}
+
+void PacketPoolSetPolicy(PacketPoolHandle handle, PacketPoolPolicy policy,
+                         uint32_t byte_budget, uint32_t block_timeout_msec) {
+  PacketPool *pool = (PacketPool *)handle;
+  uni_mutex_lock(&pool->mutex);
+  pool->policy             = policy;
+  pool->block_timeout_msec = block_timeout_msec;
+  if (0 != byte_budget) {
+    pool->stats.byte_budget = byte_budget;
+  }
+  _notify_release(pool);
+  uni_mutex_unlock(&pool->mutex);
+}
+
+void PacketPoolGetStats(PacketPoolHandle handle, PacketPoolStats *stats) {
+  PacketPool *pool = (PacketPool *)handle;
+  uni_mutex_lock(&pool->mutex);
+  *stats = pool->stats;
+  uni_mutex_unlock(&pool->mutex);
+}
@@ -0,0 +1,233 @@
+/**************************************************************************
+ * Copyright (C) 2020-2020  Unisound
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ **************************************************************************
+ *
+ * Description : adpcm_bench.c
+ * Author      : junlon2006@163.com
+ * Date        : 2020.09.08
+ *
+ **************************************************************************/
+/*
+ * usage: ADPCM_BENCH [options] [pcm_file]
+ *
+ * encoder throughput and round-trip quality of the ADPCM playback path.
+ * pcm is cut into chunks and encoded with state carried between chunks, the
+ * way ChnlIotDeviceFeedAudioDataAdpcm does; every chunk is then decoded on
+ * its own from the encoder state at chunk start, the way the module does.
+ * without pcm_file a 16KHz 16bit mono speech-like test signal is generated
+ *   -c chunk   pcm bytes per chunk, default 512
+ *   -n loops   encode whole pcm this many times, default 50
+ *   -s snr     minimum round-trip SNR in dB, exit 1 below it
+ */
+#include "uni_adpcm.h"
+#include "porting.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include <unistd.h>
+
+#define BENCH_SAMPLE_RATE     (16000)
+#define BENCH_CHUNK_MAX       (4096)
+#define BENCH_SYNTH_SEC       (10)
+
+typedef struct {
+  const char *file;
+  uint32_t   chunk;
+  uint32_t   loops;
+  double     min_snr;
+} BenchConfig;
+
+static BenchConfig g_config;
+
+static int _pcm_load(short **pcm, int *samples) {
+  FILE *fp;
+  long size;
+
+  if (NULL == (fp = fopen(g_config.file, "rb"))) {
+    return -1;
+  }
+
+  fseek(fp, 0, SEEK_END);
+  size = ftell(fp) & ~3L;
+  fseek(fp, 0, SEEK_SET);
+  if (size <= 0 || NULL == (*pcm = (short *)malloc(size))) {
+    fclose(fp);
+    return -1;
+  }
+
+  *samples = (int)(size / sizeof(short));
+  if (fread(*pcm, 1, size, fp) != (size_t)size) {
+    free(*pcm);
+    fclose(fp);
+    return -1;
+  }
+
+  fclose(fp);
+  return 0;
+}
+
+/* voiced harmonics under a syllable envelope plus low noise, roughly speech dynamics */
+static int _pcm_synth(short **pcm, int *samples) {
+  double t, env, v;
+  int i, h;
+
+  *samples = BENCH_SAMPLE_RATE * BENCH_SYNTH_SEC;
+  if (NULL == (*pcm = (short *)malloc(*samples * sizeof(short)))) {
+    return -1;
+  }
+
+  srand(1);
+  for (i = 0; i < *samples; i++) {
+    t   = (double)i / BENCH_SAMPLE_RATE;
+    env = 0.5 + 0.5 * sin(2 * M_PI * 3 * t);
+    v   = 0;
+    for (h = 1; h <= 8; h++) {
+      v += sin(2 * M_PI * 140 * h * t) / h;
+    }
+    v = 9000 * env * v + (rand() % 601 - 300);
+    (*pcm)[i] = (short)uni_max(-32768, uni_min(32767, (int)v));
+  }
+
+  return 0;
+}
+
+static double _snr_db(const short *ref, const short *out, int samples) {
+  double signal = 0, noise = 0, d;
+  int i;
+
+  for (i = 0; i < samples; i++) {
+    d       = (double)ref[i] - out[i];
+    signal += (double)ref[i] * ref[i];
+    noise  += d * d;
+  }
+
+  return noise > 0 ? 10 * log10(signal / noise) : 999.0;
+}
+
+static int _bench(const short *pcm, int samples) {
+  int chunk_samples = (int)(g_config.chunk / sizeof(short)) & ~1;
+  int chunks = samples / chunk_samples;
+  unsigned char *adpcm = (unsigned char *)malloc(samples / ADPCM_SAMPLES_PER_BYTE);
+  AdpcmState *starts = (AdpcmState *)malloc(chunks * sizeof(AdpcmState));
+  short *decoded = (short *)malloc(samples * sizeof(short));
+  int64_t encode_us, decode_us, start;
+  double audio_sec, snr;
+  AdpcmState state;
+  uint32_t loop;
+  int i, bytes;
+
+  if (NULL == adpcm || NULL == starts || NULL == decoded || 0 == chunks) {
+    free(adpcm);
+    free(starts);
+    free(decoded);
+    return -1;
+  }
+
+  bytes = chunk_samples / ADPCM_SAMPLES_PER_BYTE;
+  start = uni_get_clock_time_us();
+  for (loop = 0; loop < g_config.loops; loop++) {
+    AdpcmStateReset(&state);
+    for (i = 0; i < chunks; i++) {
+      starts[i] = state;
+      AdpcmEncode(&state, pcm + i * chunk_samples, chunk_samples, adpcm + i * bytes);
+    }
+  }
+  encode_us = uni_get_clock_time_us() - start;
+
+  start = uni_get_clock_time_us();
+  for (loop = 0; loop < g_config.loops; loop++) {
+    for (i = 0; i < chunks; i++) {
+      state = starts[i];
+      AdpcmDecode(&state, adpcm + i * bytes, bytes, decoded + i * chunk_samples);
+    }
+  }
+  decode_us = uni_get_clock_time_us() - start;
+
+  samples   = chunks * chunk_samples;
+  audio_sec = (double)samples / BENCH_SAMPLE_RATE * g_config.loops;
+  snr       = _snr_db(pcm, decoded, samples);
+  printf("[bench] audio=%.1fs chunk=%u, encode %.1fMB/s pcm (%.0fx realtime, %.1fus per audio second), "
+         "decode %.1fMB/s pcm (%.0fx realtime)\n", audio_sec, g_config.chunk,
+         encode_us ? (double)samples * sizeof(short) * g_config.loops / encode_us : 0.0,
+         encode_us ? audio_sec * 1000000 / encode_us : 0.0,
+         encode_us / audio_sec,
+         decode_us ? (double)samples * sizeof(short) * g_config.loops / decode_us : 0.0,
+         decode_us ? audio_sec * 1000000 / decode_us : 0.0);
+  printf("[bench] round trip snr=%.2fdB over %d samples, link bytes %d -> %d\n",
+         snr, samples, (int)(samples * sizeof(short)), samples / ADPCM_SAMPLES_PER_BYTE);
+
+  free(adpcm);
+  free(starts);
+  free(decoded);
+  return snr >= g_config.min_snr ? 0 : 1;
+}
+
+static int _options_parse(int argc, char *argv[]) {
+  int opt;
+
+  g_config.chunk   = 512;
+  g_config.loops   = 50;
+  g_config.min_snr = -1000;
+  while (-1 != (opt = getopt(argc, argv, "c:n:s:"))) {
+    switch (opt) {
+    case 'c': g_config.chunk = (uint32_t)atoi(optarg); break;
+    case 'n': g_config.loops = (uint32_t)atoi(optarg); break;
+    case 's': g_config.min_snr = atof(optarg); break;
+    default:
+      goto L_USAGE;
+    }
+  }
+
+  if (optind < argc - 1 || 0 == g_config.loops || g_config.chunk < 4 ||
+      g_config.chunk > BENCH_CHUNK_MAX) {
+    goto L_USAGE;
+  }
+
+  g_config.file = optind < argc ? argv[optind] : NULL;
+  return 0;
+
+L_USAGE:
+  fprintf(stderr, "usage: %s [-c chunk] [-n loops] [-s min_snr_db] [pcm_file]\n", argv[0]);
+  return -1;
+}
+
+int main(int argc, char *argv[]) {
+  short *pcm = NULL;
+  int samples = 0, ret;
+
+  if (0 != _options_parse(argc, argv)) {
+    return 2;
+  }
+
+  if (0 != (NULL == g_config.file ? _pcm_synth(&pcm, &samples) : _pcm_load(&pcm, &samples))) {
+    fprintf(stderr, "load pcm %s failed\n", NULL == g_config.file ? "synth" : g_config.file);
+    return 2;
+  }
+
+  if (-1 == (ret = _bench(pcm, samples))) {
+    fprintf(stderr, "pcm shorter than one chunk\n");
+    ret = 2;
+  } else if (1 == ret) {
+    fprintf(stderr, "snr below %.2fdB\n", g_config.min_snr);
+  }
+
+  free(pcm);
+  return ret;
+}
@@ -0,0 +1,293 @@
+/**************************************************************************
+ * Copyright (C) 2020-2020  Unisound
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ **************************************************************************
+ *
+ * Description : audio_shm_bench.c
+ * Author      : junlon2006@163.com
+ * Date        : 2020.09.05
+ *
+ **************************************************************************/
+/*
+ * usage: AUDIO_SHM_BENCH [options] pcm_file
+ *
+ * cost of getting playback pcm from a producer onto the uart, per second of
+ * 16KHz 16bit audio. frames are written to /dev/null, unreliable, so only the
+ * host side of the path is measured, no module or flow control involved
+ *   copy: producer reads file into a static buffer, CommProtocolPacketAssembleAndSend
+ *         allocates a frame and copies pcm into it, the path of ChnlIotDeviceFeedAudioData
+ *   ring: forked producer process reads file straight into a ShmRing, consumer
+ *         sends each chunk by CommProtocolPacketSendInPlace, the path of
+ *         ChnlIotDeviceFeedAudioDataInPlace, cpu of both processes counted
+ *   -m mode    copy, ring or both (default)
+ *   -c chunk   pcm bytes per frame, default 512
+ *   -n loops   send file this many times, default 200
+ *   -R kb      ring size, default 64
+ */
+#include "uni_shm_ring.h"
+#include "uni_communication.h"
+#include "uni_channel_common.h"
+#include "porting.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+#define BENCH_BYTES_PER_SEC   (16000 * 2)
+#define BENCH_CHUNK_MAX       (4096)
+#define BENCH_RING_TIMEOUT_MS (5 * 1000)
+
+typedef struct {
+  const char *file;
+  int        copy;
+  int        ring;
+  uint32_t   chunk;
+  uint32_t   loops;
+  uint32_t   ring_kb;
+} BenchConfig;
+
+typedef struct {
+  uint64_t bytes;
+  uint64_t frames;
+  uint64_t allocs;        /* frame allocations by protocol layer */
+  uint64_t copied;        /* pcm bytes copied in user space once the producer has read them */
+  int64_t  cpu_us;        /* user + sys, producer included */
+  int64_t  elapsed_us;
+} BenchResult;
+
+static BenchConfig g_config;
+static int         g_null_fd = -1;
+static uint64_t    g_allocs = 0;
+
+static void* _count_malloc(size_t size) {
+  g_allocs++;
+  return malloc(size);
+}
+
+static int _null_write(char *buf, unsigned int len) {
+  return (int)write(g_null_fd, buf, len);
+}
+
+static void _on_frame(CommPacket *packet) {
+}
+
+static int64_t _cpu_us(int who) {
+  struct rusage usage;
+  getrusage(who, &usage);
+  return (int64_t)(usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000000 +
+         usage.ru_utime.tv_usec + usage.ru_stime.tv_usec;
+}
+
+/* demo path of app/src/main.c, file into static buffer, frame allocated and filled */
+static int _bench_copy(BenchResult *result) {
+  static char raw_pcm[BENCH_CHUNK_MAX];
+  CommAttribute attr = {0};
+  int64_t cpu = _cpu_us(RUSAGE_SELF), start = uni_get_clock_time_us();
+  uint64_t allocs = g_allocs;
+  uint32_t i;
+  int fd, len;
+
+  if ((fd = open(g_config.file, O_RDONLY)) < 0) {
+    return -1;
+  }
+
+  for (i = 0; i < g_config.loops; i++) {
+    lseek(fd, 0, SEEK_SET);
+    while ((len = (int)read(fd, raw_pcm, g_config.chunk)) > 0) {
+      CommProtocolPacketAssembleAndSend(CHNL_MSG_IOT_HBM_AUDIO_SOURCE, raw_pcm, len, &attr);
+      result->bytes += len;
+      result->frames++;
+    }
+  }
+
+  close(fd);
+  result->elapsed_us = uni_get_clock_time_us() - start;
+  result->cpu_us     = _cpu_us(RUSAGE_SELF) - cpu;
+  result->allocs     = g_allocs - allocs;
+  /* file read is a kernel copy on both paths, the frame payload copy is not */
+  result->copied     = result->bytes;
+  return 0;
+}
+
+static void _producer(ShmRingHandle ring) {
+  uint32_t room, i;
+  int fd, len = 0;
+  char *p;
+
+  if ((fd = open(g_config.file, O_RDONLY)) < 0) {
+    _exit(1);
+  }
+
+  for (i = 0; i < g_config.loops && len >= 0; i++) {
+    lseek(fd, 0, SEEK_SET);
+    do {
+      if (NULL == (p = ShmRingWriteBegin(ring, &room, BENCH_RING_TIMEOUT_MS))) {
+        len = -1;
+        break;
+      }
+
+      if ((len = (int)read(fd, p, room)) > 0) {
+        ShmRingWriteEnd(ring, (uint32_t)len);
+      }
+    } while (len > 0);
+  }
+
+  ShmRingFinish(ring);
+  _exit(0 == ShmRingDrain(ring, BENCH_RING_TIMEOUT_MS) ? 0 : 1);
+}
+
+/* producer writes the ring in place, frames are built in front of each chunk */
+static int _bench_ring(BenchResult *result) {
+  CommAttribute attr = {0};
+  int64_t cpu = _cpu_us(RUSAGE_SELF) + _cpu_us(RUSAGE_CHILDREN);
+  int64_t start = uni_get_clock_time_us();
+  uint64_t allocs = g_allocs;
+  uint32_t len, sent, frame;
+  ShmRingHandle ring;
+  int status, finished;
+  pid_t pid;
+  char *pcm;
+
+  if (NULL == (ring = ShmRingCreate(g_config.ring_kb * 1024, COMM_PROTOCOL_HEADROOM))) {
+    return -1;
+  }
+
+  if (0 == (pid = fork())) {
+    _producer(ring);
+  }
+
+  while (NULL != (pcm = ShmRingReadBegin(ring, &len, g_config.chunk, BENCH_RING_TIMEOUT_MS))) {
+    if ((finished = ShmRingIsFinished(ring))) {
+      pcm = ShmRingReadBegin(ring, &len, 0, 0);
+    }
+
+    if (!finished) {
+      len -= len % g_config.chunk;
+    }
+
+    for (sent = 0; sent < len; sent += frame) {
+      frame = uni_min(g_config.chunk, len - sent);
+      CommProtocolPacketSendInPlace(CHNL_MSG_IOT_HBM_AUDIO_SOURCE, pcm + sent, frame, &attr);
+      result->frames++;
+    }
+
+    ShmRingReadEnd(ring, len);
+    result->bytes += len;
+  }
+
+  ShmRingDone(ring, 0);
+  waitpid(pid, &status, 0);
+  result->elapsed_us = uni_get_clock_time_us() - start;
+  result->cpu_us     = _cpu_us(RUSAGE_SELF) + _cpu_us(RUSAGE_CHILDREN) - cpu;
+  result->allocs     = g_allocs - allocs;
+  result->copied     = 0;
+  ShmRingClose(ring);
+  return WIFEXITED(status) && 0 == WEXITSTATUS(status) ? 0 : -1;
+}
+
+static void _report(const char *mode, BenchResult *result) {
+  double audio_sec = (double)result->bytes / BENCH_BYTES_PER_SEC;
+
+  printf("[bench] %-4s audio=%.1fs frames=%llu, %.2f copies/byte, %llu frame allocs, "
+         "cpu=%lldus (%.1fus per audio second), %.1fMB/s\n", mode, audio_sec,
+         (unsigned long long)result->frames,
+         result->bytes ? (double)result->copied / result->bytes : 0.0,
+         (unsigned long long)result->allocs, (long long)result->cpu_us,
+         audio_sec > 0 ? result->cpu_us / audio_sec : 0.0,
+         result->elapsed_us ? (double)result->bytes / result->elapsed_us : 0.0);
+}
+
+static int _options_parse(int argc, char *argv[]) {
+  int opt;
+
+  g_config.copy    = 1;
+  g_config.ring    = 1;
+  g_config.chunk   = 512;
+  g_config.loops   = 200;
+  g_config.ring_kb = 64;
+  while (-1 != (opt = getopt(argc, argv, "m:c:n:R:"))) {
+    switch (opt) {
+    case 'm':
+      g_config.copy = (0 != strcmp(optarg, "ring"));
+      g_config.ring = (0 != strcmp(optarg, "copy"));
+      break;
+    case 'c': g_config.chunk = (uint32_t)atoi(optarg); break;
+    case 'n': g_config.loops = (uint32_t)atoi(optarg); break;
+    case 'R': g_config.ring_kb = (uint32_t)atoi(optarg); break;
+    default:
+      goto L_USAGE;
+    }
+  }
+
+  if (optind != argc - 1 || 0 == g_config.loops || 0 == g_config.chunk ||
+      g_config.chunk > BENCH_CHUNK_MAX || g_config.ring_kb * 1024 <= g_config.chunk) {
+    goto L_USAGE;
+  }
+
+  g_config.file = argv[optind];
+  return 0;
+
+L_USAGE:
+  fprintf(stderr, "usage: %s [-m copy|ring|both] [-c chunk] [-n loops] [-R kb] pcm_file\n",
+          argv[0]);
+  return -1;
+}
+
+int main(int argc, char *argv[]) {
+  static CommProtocolHooks hooks;
+  BenchResult result;
+
+  if (0 != _options_parse(argc, argv)) {
+    return 2;
+  }
+
+  /* unreliable sends never wait, no semaphores needed */
+  hooks.malloc_fn  = _count_malloc;
+  hooks.free_fn    = free;
+  hooks.realloc_fn = realloc;
+  hooks.msleep_fn  = uni_msleep;
+  CommProtocolRegisterHooks(&hooks);
+  if ((g_null_fd = open("/dev/null", O_WRONLY)) < 0 ||
+      0 != CommProtocolInit(_null_write, _on_frame)) {
+    fprintf(stderr, "comm protocol init failed\n");
+    return 2;
+  }
+
+  if (g_config.copy) {
+    memset(&result, 0, sizeof(result));
+    if (0 != _bench_copy(&result)) {
+      fprintf(stderr, "copy bench on %s failed\n", g_config.file);
+      return 1;
+    }
+    _report("copy", &result);
+  }
+
+  if (g_config.ring) {
+    memset(&result, 0, sizeof(result));
+    if (0 != _bench_ring(&result)) {
+      fprintf(stderr, "ring bench on %s failed\n", g_config.file);
+      return 1;
+    }
+    _report("ring", &result);
+  }
+
+  return 0;
+}
@@ -0,0 +1,112 @@
+/**************************************************************************
+ * Copyright (C) 2020-2020  Unisound
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ **************************************************************************
+ *
+ * Description : channel_hpp_check.cpp
+ * Author      : junlon2006@163.com
+ * Date        : 2020.09.11
+ *
+ **************************************************************************/
+/*
+ * usage: CHANNEL_HPP_CHECK
+ *
+ * builds uni_channel.hpp with the tree, so a layout or template error fails
+ * the build instead of the first C++ user. every message kind is registered
+ * through Register<cmd, fn> and the send templates are instantiated; at run
+ * time the Frame bookkeeping is checked without a uart: headroom in front of
+ * the payload, head and tail contiguous, Append refusing to overflow.
+ * exit 1 when a check fails
+ */
+#include "uni_channel.hpp"
+
+#include <stdio.h>
+#include <string.h>
+
+using namespace uni::chnl;
+
+typedef Frame<CHNL_MSG_IOT_RASR_RESULT, 32>          ResultFrame;
+typedef Frame<CHNL_MSG_IOT_HBM_AUDIO_SOURCE, 64>     AudioFrame;
+
+static void _on_init(const ChIoTInitParam & /* param */, void * /* ctx */) {}
+static void _on_rasr_stop(void * /* ctx */) {}
+static void _on_rasr_result(const ChnIoTRasrResult & /* head */, const char * /* tail */,
+                            uint32_t /* tail_len */, void * /* ctx */) {}
+static void _on_audio(const char * /* tail */, uint32_t /* tail_len */, void * /* ctx */) {}
+
+/* taking the address instantiates the send path, nothing is sent */
+static int (* const g_sends[])(bool) = {
+  &Send<CHNL_MSG_IOT_RASR_STOP>,
+  &Send<CHNL_MSG_IOT_HBM_BAUD_QUERY>,
+};
+static int (* const g_send_net_state)(const ChnIoTNetState &, bool) = &Send<CHNL_MSG_IOT_NET_STATE>;
+static int (ResultFrame::* const g_frame_send)(bool) = &ResultFrame::Send;
+static int (AudioFrame::* const g_audio_send)(bool)  = &AudioFrame::Send;
+
+static int _expect(bool ok, const char *what) {
+  if (!ok) {
+    fprintf(stderr, "[check] unexpected: %s\n", what);
+  }
+  return ok ? 0 : 1;
+}
+
+static int _frame_check(void) {
+  static const char kCmd[] = "turn_on_light";
+  ResultFrame frame;
+  AudioFrame audio;
+  char pcm[64] = {0};
+  int fails = 0;
+
+  frame.Head().vui_session_id = 1;
+  frame.Head().cmd_hash_code  = 2;
+  fails += _expect(0 == frame.Append(kCmd, sizeof(kCmd)), "append within capacity");
+  fails += _expect(frame.Size() == sizeof(ChnIoTRasrResult) + sizeof(kCmd), "size is head + tail");
+  fails += _expect(frame.Tail() == reinterpret_cast<char *>(&frame.Head()) + sizeof(ChnIoTRasrResult),
+                   "tail right after head");
+  fails += _expect(reinterpret_cast<char *>(&frame.Head()) - reinterpret_cast<char *>(&frame) >=
+                   static_cast<long>(COMM_PROTOCOL_HEADROOM), "headroom before payload");
+  fails += _expect(-1 == frame.Append(pcm, sizeof(pcm)), "append over capacity refused");
+  fails += _expect(0 == memcmp(frame.Tail(), kCmd, sizeof(kCmd)), "tail kept after refused append");
+
+  audio.SetTailLen(sizeof(pcm) + 1);
+  fails += _expect(audio.Size() == sizeof(pcm), "tail len clamped to capacity");
+  return fails;
+}
+
+static int _register_check(void) {
+  int fails = 0;
+
+  fails += _expect(0 == Register<CHNL_MSG_IOT_INIT, _on_init>(), "register fixed");
+  fails += _expect(0 == Register<CHNL_MSG_IOT_RASR_STOP, _on_rasr_stop>(), "register empty");
+  fails += _expect(0 == Register<CHNL_MSG_IOT_RASR_RESULT, _on_rasr_result>(), "register tail");
+  fails += _expect(0 == Register<CHNL_MSG_IOT_HBM_AUDIO_SOURCE, _on_audio>(NULL, CHNL_EXECUTOR_INLINE),
+                   "register raw tail");
+  Unregister<CHNL_MSG_IOT_INIT>();
+  Unregister<CHNL_MSG_IOT_RASR_STOP>();
+  Unregister<CHNL_MSG_IOT_RASR_RESULT>();
+  Unregister<CHNL_MSG_IOT_HBM_AUDIO_SOURCE>();
+  return fails;
+}
+
+int main(void) {
+  int fails;
+
+  fails = _frame_check() + _register_check();
+  fails += _expect(NULL != g_sends[0] && NULL != g_sends[1] && NULL != g_send_net_state &&
+                   NULL != g_frame_send && NULL != g_audio_send, "send paths instantiated");
+  printf("[check] uni_channel.hpp %s\n", fails ? "failed" : "ok");
+  return fails ? 1 : 0;
+}
@@ -0,0 +1,1074 @@
+/**************************************************************************
+ * Copyright (C) 2020-2020  Unisound
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ **************************************************************************
+ *
+ * Description : hbm_sim.c
+ * Author      : junlon2006@163.com
+ * Date        : 2020.08.28
+ *
+ **************************************************************************/
+
+/*
+ * usage: HBM_SIM [options], then run APP on the printed pty (or -l link)
+ *
+ * virtual HBM module on the master side of a pty pair, speaks the module
+ * side of the channel protocol:
+ *   challenge pack every -c ms, round trip to CHALLENGE_PACK_ACK measured
+ *   offline asr result every -a ms, words of -w in turn, time to first audio measured
+ *   rasr session every -r ms lasting -d ms, ADPCM stream at -x times real time,
+ *   paused while host reports network offline
+ *   audio source buffer of -B bytes played out at 16KHz 16bit, answers
+ *   REMAIN_LEN queries, counts overflow and underrun
+ *   baud query answered with -b as only rate, verify echoed
+ *
+ * link impairments, module -> host frames and host -> module reads:
+ *   -b baud    module -> host paced at wire rate, 0 unpaced
+ *   -L ms      one way latency, -J ms jitter on top, order kept like a wire
+ *   -e ber     bit error rate, both directions
+ *   -p prob    loss probability, whole frame to host, whole read from host
+ *
+ *   -l path    symlink slave pty to path
+ *   -u addr    serve one host at a time on a socket instead of a pty, tcp:[host:]port
+ *              or unix:path, then run APP tcp:127.0.0.1:port or unix:path
+ *   -i file    16KHz 16bit mono pcm streamed by rasr, looped, default tone bursts
+ *   -t sec     run time then print summary and exit, 0 forever
+ *   -s ms      report interval
+ *   -S seed    random seed of impairments
+ */
+#define _GNU_SOURCE  /* posix_openpt, ptsname */
+#include "uni_communication.h"
+#include "uni_channel_common.h"
+#include "uni_adpcm.h"
+#include "uni_event_list.h"
+#include "uni_log.h"
+#include "porting.h"
+
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <math.h>
+#include <signal.h>
+#include <termios.h>
+#include <time.h>
+
+#define SIM_STACK_SIZE          (64 * 1024)
+#define SIM_READ_BUF_SIZE       (4096)
+#define SIM_WORDS_MAX           (16)
+
+/* 蜂鸟M上行RASR 16KHz 16bit，每包128字节ADPCM即256个采样16ms */
+#define RASR_PACKET_SAMPLES     (ADPCM_SAMPLES_PER_BYTE * sizeof(((ChnIoTRasrFeedDataParam *)0)->adpcm))
+#define RASR_PACKET_US          (RASR_PACKET_SAMPLES * 1000000LL / 16000)
+
+/* 播报音频16KHz 16bit，与主机推送起播判定一致，间隔内再次推送视为同一次播报 */
+#define AUDIO_PCM_BYTES_PER_SEC (32000)
+#define AUDIO_STREAM_GAP_MS     (300)
+
+typedef struct Chunk {
+  struct Chunk  *next;
+  int64_t       due_us;
+  int           len;
+  unsigned char data[0];
+} Chunk;
+
+/* one direction of the link, FIFO like a wire: latency, jitter and pacing */
+typedef struct {
+  const char   *name;
+  void         (*deliver)(unsigned char *buf, int len);
+  uint32_t     baud;
+  Chunk        *head;
+  Chunk        *tail;
+  int64_t      wire_free_us;
+  uni_mutex_t  mutex;
+  uni_sem_t    sem;
+  double       ber;
+  double       loss;
+  uint64_t     bits_to_error;  /* geometric skip to next flipped bit */
+  unsigned int seed;
+} Link;
+
+typedef struct {
+  uint32_t cnt;
+  uint64_t sum_us;
+  uint32_t max_us;
+} Latency;
+
+typedef struct {
+  uint32_t capacity;
+  uint32_t fill;
+  int64_t  played_us;     /* fill valid at this time */
+  int64_t  last_push_us;
+  uint32_t peak;
+  uint64_t bytes;
+  uint32_t pushes;
+  uint32_t queries;
+  uint32_t streams;
+  uint32_t underruns;     /* ran empty inside one stream */
+  uint64_t overflow_bytes;
+} AudioBuffer;
+
+typedef struct {
+  uint64_t tx_frames;
+  uint64_t tx_bytes;
+  uint64_t tx_lost;
+  uint64_t rx_reads;
+  uint64_t rx_bytes;
+  uint64_t rx_lost;
+  uint64_t rx_frames;
+  uint64_t bit_errors;
+  uint32_t send_failed;   /* reliable send without ack after resends */
+  Latency  send;          /* reliable send until ack */
+  uint32_t challenge_sent;
+  uint32_t challenge_acked;
+  Latency  challenge;     /* challenge pack until CHALLENGE_PACK_ACK */
+  uint32_t net_connected;
+  uint32_t asr_sent;
+  Latency  asr_to_audio;  /* asr result sent until first audio of answer */
+  uint32_t rasr_sessions;
+  uint64_t rasr_packets;
+  uint64_t rasr_paused;   /* packets not sent while host offline */
+  uint32_t host_cmds;     /* other messages from host */
+  AudioBuffer audio;
+} SimStats;
+
+typedef struct {
+  uint32_t challenge_ms;
+  uint32_t asr_ms;
+  char     *words[SIM_WORDS_MAX];
+  uint32_t word_cnt;
+  uint32_t rasr_ms;
+  uint32_t rasr_len_ms;
+  double   rasr_speed;
+  uint32_t latency_ms;
+  uint32_t jitter_ms;
+  const char *link_path;
+  const char *listen_addr;
+  const char *pcm_file;
+  uint32_t run_sec;
+  uint32_t report_ms;
+} SimConfig;
+
+typedef struct {
+  CommCmd  cmd;
+  uint16_t len;
+  char     payload[sizeof(ChnIoTBaudVerify)];
+} Reply;
+
+static SimConfig       g_config;
+static SimStats        g_stats;
+static uni_mutex_t     g_mutex;
+static int             g_master_fd = -1;  /* pty master, or connected host in socket mode */
+static int             g_listen_fd = -1;
+static Link            g_to_host;
+static Link            g_from_host;
+static EventListHandle g_replies;
+static int64_t         g_challenge_us;  /* pending challenge pack, 0 none */
+static int64_t         g_asr_us;        /* asr result waiting for audio, 0 none */
+static short           *g_pcm;
+static uint32_t        g_pcm_samples;
+static volatile int    g_running = 1;
+
+static void _latency_add(Latency *latency, int64_t us) {
+  latency->cnt++;
+  latency->sum_us += us;
+  latency->max_us = uni_max(latency->max_us, (uint32_t)us);
+}
+
+static int64_t _now_us() {
+  return uni_get_clock_time_us();
+}
+
+static uint64_t _geometric_bits(Link *link) {
+  double u = (rand_r(&link->seed) + 1.0) / ((double)RAND_MAX + 2.0);
+  return (uint64_t)(-log(u) / link->ber) + 1;
+}
+
+/* flip bits at bit error rate, skip distance drawn once per error */
+static void _bit_errors(Link *link, unsigned char *buf, int len) {
+  uint64_t bits = (uint64_t)len * 8;
+  uint64_t pos = 0;
+  uint32_t flipped = 0;
+
+  if (link->ber <= 0) {
+    return;
+  }
+
+  if (0 == link->bits_to_error) {
+    link->bits_to_error = _geometric_bits(link);
+  }
+
+  while (pos + link->bits_to_error <= bits) {
+    pos += link->bits_to_error;
+    buf[(pos - 1) / 8] ^= (unsigned char)(1 << ((pos - 1) % 8));
+    link->bits_to_error = _geometric_bits(link);
+    flipped++;
+  }
+
+  link->bits_to_error -= bits - pos;
+  if (flipped) {
+    uni_mutex_lock(&g_mutex);
+    g_stats.bit_errors += flipped;
+    uni_mutex_unlock(&g_mutex);
+  }
+}
+
+static int _lost(Link *link) {
+  return link->loss > 0 && rand_r(&link->seed) < link->loss * RAND_MAX;
+}
+
+static int _link_direct(Link *link) {
+  return 0 == link->baud && 0 == g_config.latency_ms && 0 == g_config.jitter_ms;
+}
+
+static void _link_send(Link *link, unsigned char *buf, int len) {
+  int64_t now = _now_us();
+  Chunk *chunk;
+
+  if (_link_direct(link)) {
+    _bit_errors(link, buf, len);
+    link->deliver(buf, len);
+    return;
+  }
+
+  if (NULL == (chunk = uni_malloc(sizeof(Chunk) + len))) {
+    return;
+  }
+
+  memcpy(chunk->data, buf, len);
+  _bit_errors(link, chunk->data, len);
+  chunk->len    = len;
+  chunk->next   = NULL;
+  chunk->due_us = now + g_config.latency_ms * 1000LL;
+  if (g_config.jitter_ms) {
+    chunk->due_us += rand_r(&link->seed) % (g_config.jitter_ms * 1000);
+  }
+
+  uni_mutex_lock(&link->mutex);
+  /* a wire never reorders, nor sends faster than baud */
+  chunk->due_us = uni_max(chunk->due_us, link->wire_free_us);
+  if (link->baud) {
+    link->wire_free_us = chunk->due_us + (int64_t)len * 10 * 1000000 / link->baud;
+  } else {
+    link->wire_free_us = chunk->due_us;
+  }
+
+  if (NULL == link->tail) {
+    link->head = chunk;
+  } else {
+    link->tail->next = chunk;
+  }
+  link->tail = chunk;
+  uni_mutex_unlock(&link->mutex);
+  uni_sem_signal(&link->sem);
+}
+
+static void *_link_task(void *arg) {
+  Link *link = (Link *)arg;
+  Chunk *chunk;
+  int64_t wait;
+
+  while (g_running) {
+    uni_sem_wait(&link->sem, UNI_WAIT_FOREVER);
+    uni_mutex_lock(&link->mutex);
+    chunk = link->head;
+    uni_mutex_unlock(&link->mutex);
+    if (NULL == chunk) {
+      continue;
+    }
+
+    /* chunks queued later are never due earlier, head only needs waiting for */
+    if ((wait = chunk->due_us - _now_us()) > 0) {
+      usleep(wait);
+    }
+
+    uni_mutex_lock(&link->mutex);
+    link->head = chunk->next;
+    if (NULL == link->head) {
+      link->tail = NULL;
+    }
+    uni_mutex_unlock(&link->mutex);
+
+    link->deliver(chunk->data, chunk->len);
+    uni_free(chunk);
+  }
+
+  return NULL;
+}
+
+static int _link_init(Link *link, const char *name, void (*deliver)(unsigned char *, int),
+                      unsigned int seed) {
+  link->name    = name;
+  link->deliver = deliver;
+  link->seed    = seed;
+  uni_mutex_new(&link->mutex);
+  uni_sem_new(&link->sem, 0);
+  if (_link_direct(link)) {
+    return 0;
+  }
+
+  return uni_thread_new(name, _link_task, link, SIM_STACK_SIZE);
+}
+
+static void _wire_write(unsigned char *buf, int len) {
+  int done = 0;
+  int ret;
+
+  while (done < len) {
+    ret = write(__atomic_load_n(&g_master_fd, __ATOMIC_ACQUIRE), buf + done, len - done);
+    if (ret < 0) {
+      if (EINTR == errno || EAGAIN == errno) {
+        continue;
+      }
+      return;
+    }
+    done += ret;
+  }
+}
+
+/* protocol stack write hook, one whole frame per call */
+static int _comm_write(char *buf, unsigned int len) {
+  uni_mutex_lock(&g_mutex);
+  g_stats.tx_frames++;
+  g_stats.tx_bytes += len;
+  uni_mutex_unlock(&g_mutex);
+
+  if (_lost(&g_to_host)) {
+    uni_mutex_lock(&g_mutex);
+    g_stats.tx_lost++;
+    uni_mutex_unlock(&g_mutex);
+    return (int)len;
+  }
+
+  _link_send(&g_to_host, (unsigned char *)buf, (int)len);
+  return (int)len;
+}
+
+static void _host_data(unsigned char *buf, int len) {
+  CommProtocolReceiveUartData(buf, len);
+}
+
+static int _send(CommCmd cmd, char *payload, uint32_t len, int reliable) {
+  CommAttribute attr = {reliable};
+  int64_t begin = _now_us();
+  int ret = CommProtocolPacketAssembleAndSend(cmd, payload, len, &attr);
+
+  if (!reliable) {
+    return ret;
+  }
+
+  uni_mutex_lock(&g_mutex);
+  if (0 == ret) {
+    _latency_add(&g_stats.send, _now_us() - begin);
+  } else {
+    g_stats.send_failed++;
+  }
+  uni_mutex_unlock(&g_mutex);
+  return ret;
+}
+
+/* mutex held, play buffered audio out up to now */
+static void _audio_play(AudioBuffer *audio, int64_t now) {
+  uint64_t played = (uint64_t)(now - audio->played_us) * AUDIO_PCM_BYTES_PER_SEC / 1000000;
+
+  if (played >= audio->fill) {
+    audio->fill = 0;
+    audio->played_us = now;
+    return;
+  }
+
+  audio->fill -= (uint32_t)played;
+  audio->played_us += (int64_t)played * 1000000 / AUDIO_PCM_BYTES_PER_SEC;
+}
+
+static void _audio_push(uint32_t bytes) {
+  AudioBuffer *audio = &g_stats.audio;
+  int64_t now = _now_us();
+
+  uni_mutex_lock(&g_mutex);
+  _audio_play(audio, now);
+  if (now - audio->last_push_us > AUDIO_STREAM_GAP_MS * 1000LL) {
+    audio->streams++;
+  } else if (0 == audio->fill) {
+    audio->underruns++;
+  }
+
+  if (g_asr_us) {
+    _latency_add(&g_stats.asr_to_audio, now - g_asr_us);
+    g_asr_us = 0;
+  }
+
+  if (audio->fill + bytes > audio->capacity) {
+    audio->overflow_bytes += audio->fill + bytes - audio->capacity;
+    audio->fill = audio->capacity;
+  } else {
+    audio->fill += bytes;
+  }
+
+  audio->peak = uni_max(audio->peak, audio->fill);
+  audio->bytes += bytes;
+  audio->pushes++;
+  audio->last_push_us = now;
+  uni_mutex_unlock(&g_mutex);
+}
+
+static uint32_t _audio_remain() {
+  AudioBuffer *audio = &g_stats.audio;
+  uint32_t remain;
+
+  uni_mutex_lock(&g_mutex);
+  _audio_play(audio, _now_us());
+  audio->queries++;
+  remain = audio->capacity - audio->fill;
+  uni_mutex_unlock(&g_mutex);
+  return remain;
+}
+
+/* replies needing an ack are sent here, never on the receive path */
+static void _reply_handler(void *event) {
+  Reply *reply = (Reply *)event;
+  _send(reply->cmd, reply->payload, reply->len, 1);
+  uni_free(reply);
+}
+
+static void _reply(CommCmd cmd, void *payload, uint32_t len) {
+  Reply *reply = uni_malloc(sizeof(Reply));
+  if (NULL == reply) {
+    return;
+  }
+
+  reply->cmd = cmd;
+  reply->len = (uint16_t)uni_min(len, (uint32_t)sizeof(reply->payload));
+  memcpy(reply->payload, payload, reply->len);
+  EventListAdd(g_replies, reply, EVENT_LIST_PRIORITY_MEDIUM);
+}
+
+static void _net_state_set(uint32_t connected) {
+  uni_mutex_lock(&g_mutex);
+  g_stats.net_connected = connected;
+  uni_mutex_unlock(&g_mutex);
+}
+
+static void _on_challenge_ack(CommPacket *packet) {
+  ChnIoTChallengePackAck *ack = (ChnIoTChallengePackAck *)packet->payload;
+  if (packet->payload_len < sizeof(ChnIoTChallengePackAck)) {
+    return;
+  }
+
+  uni_mutex_lock(&g_mutex);
+  g_stats.challenge_acked++;
+  if (g_challenge_us) {
+    _latency_add(&g_stats.challenge, _now_us() - g_challenge_us);
+    g_challenge_us = 0;
+  }
+  uni_mutex_unlock(&g_mutex);
+  _net_state_set(ack->net_connected);
+}
+
+static void _on_baud_query() {
+  ChnIoTBaudCaps caps;
+  MZERO(&caps);
+  caps.current  = g_to_host.baud ? g_to_host.baud : 921600;
+  caps.count    = 1;
+  caps.rates[0] = caps.current;
+  _reply(CHNL_MSG_IOT_HBM_BAUD_QUERY_ACK, &caps, sizeof(caps));
+}
+
+/* protocol stack receive hook, runs on reader thread */
+static void _on_host_packet(CommPacket *packet) {
+  ChnIoTAudioLenAck len_ack;
+  ChnIoTAudioSourceEncoded *encoded;
+
+  uni_mutex_lock(&g_mutex);
+  g_stats.rx_frames++;
+  uni_mutex_unlock(&g_mutex);
+
+  switch (packet->cmd) {
+  case CHNL_MSG_ASR_CHALLENGE_PACK_ACK:
+    _on_challenge_ack(packet);
+    break;
+  case CHNL_MSG_IOT_NET_STATE:
+    if (packet->payload_len >= sizeof(ChnIoTNetState)) {
+      _net_state_set(((ChnIoTNetState *)packet->payload)->net_connected);
+    }
+    break;
+  case CHNL_MSG_IOT_HBM_AUDIO_SOURCE_BUF_REMAIN_LEN:
+    len_ack.remain_bytes = _audio_remain();
+    _reply(CHNL_MSG_IOT_HBM_AUDIO_SOURCE_BUF_REMAIN_LEN_ACK, &len_ack, sizeof(len_ack));
+    break;
+  case CHNL_MSG_IOT_HBM_AUDIO_SOURCE:
+    _audio_push(packet->payload_len);
+    break;
+  case CHNL_MSG_IOT_HBM_AUDIO_SOURCE_ENCODED:
+    encoded = (ChnIoTAudioSourceEncoded *)packet->payload;
+    if (packet->payload_len >= sizeof(ChnIoTAudioSourceEncoded)) {
+      _audio_push(encoded->samples * sizeof(short));
+    }
+    break;
+  case CHNL_MSG_IOT_HBM_BAUD_QUERY:
+    _on_baud_query();
+    break;
+  case CHNL_MSG_IOT_HBM_BAUD_VERIFY:
+    _reply(CHNL_MSG_IOT_HBM_BAUD_VERIFY_ACK, packet->payload, packet->payload_len);
+    break;
+  default:
+    uni_mutex_lock(&g_mutex);
+    g_stats.host_cmds++;
+    uni_mutex_unlock(&g_mutex);
+    break;
+  }
+}
+
+/* socket mode, wait for next host, frames to host are dropped meanwhile */
+static int _host_accept() {
+  int one = 1;
+  int fd = accept4(g_listen_fd, NULL, NULL, SOCK_CLOEXEC);
+  if (fd < 0) {
+    return -1;
+  }
+
+  setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+  __atomic_store_n(&g_master_fd, fd, __ATOMIC_RELEASE);
+  printf("host connected\n");
+  fflush(stdout);
+  return 0;
+}
+
+static void _host_close() {
+  int fd = __atomic_exchange_n(&g_master_fd, -1, __ATOMIC_ACQ_REL);
+  close(fd);
+  printf("host disconnected\n");
+  fflush(stdout);
+}
+
+static void *_reader_task(void *arg) {
+  static unsigned char buf[SIM_READ_BUF_SIZE];
+  int len;
+
+  while (g_running) {
+    if (g_listen_fd >= 0 && g_master_fd < 0) {
+      if (0 != _host_accept()) {
+        uni_msleep(10);
+      }
+      continue;
+    }
+
+    len = read(g_master_fd, buf, sizeof(buf));
+    if (0 == len && g_listen_fd >= 0) {
+      _host_close();
+      continue;
+    }
+
+    if (len <= 0) {
+      if (len < 0 && EINTR != errno && EAGAIN != errno && EIO != errno) {
+        fprintf(stderr, "read pty failed[%s]\n", strerror(errno));
+        break;
+      }
+      /* EIO while no process has the slave open */
+      uni_msleep(10);
+      continue;
+    }
+
+    uni_mutex_lock(&g_mutex);
+    g_stats.rx_reads++;
+    g_stats.rx_bytes += len;
+    uni_mutex_unlock(&g_mutex);
+
+    if (_lost(&g_from_host)) {
+      uni_mutex_lock(&g_mutex);
+      g_stats.rx_lost++;
+      uni_mutex_unlock(&g_mutex);
+      continue;
+    }
+
+    _link_send(&g_from_host, buf, len);
+  }
+
+  return NULL;
+}
+
+/* sleep until next period, false once stopped */
+static int _period_wait(int64_t *next_us, int64_t period_us) {
+  int64_t wait;
+  *next_us += period_us;
+  if ((wait = *next_us - _now_us()) > 0) {
+    usleep(wait);
+  } else {
+    *next_us = _now_us();
+  }
+
+  return g_running;
+}
+
+static void *_challenge_task(void *arg) {
+  int64_t next = _now_us();
+  ChnIoTChallengePackParam param;
+
+  MZERO(&param);
+  snprintf(param.init.appkey, sizeof(param.init.appkey), "%s", "hbm-sim-appkey");
+  snprintf(param.init.appsecret, sizeof(param.init.appsecret), "%s", "hbm-sim-appsecret");
+  while (_period_wait(&next, g_config.challenge_ms * 1000LL)) {
+    uni_mutex_lock(&g_mutex);
+    g_stats.challenge_sent++;
+    g_challenge_us = _now_us();
+    uni_mutex_unlock(&g_mutex);
+    _send(CHNL_MSG_ASR_CHALLENGE_PACK, (char *)&param, sizeof(param), 1);
+  }
+
+  return NULL;
+}
+
+static void *_asr_task(void *arg) {
+  int64_t next = _now_us();
+  uint32_t i = 0;
+  char *word;
+
+  while (_period_wait(&next, g_config.asr_ms * 1000LL)) {
+    word = g_config.words[i++ % g_config.word_cnt];
+    uni_mutex_lock(&g_mutex);
+    g_stats.asr_sent++;
+    g_asr_us = _now_us();
+    uni_mutex_unlock(&g_mutex);
+    /* payload without '\0', host routes by length */
+    _send(CHNL_MSG_HBM_IOT_ASR_RESULT, word, strlen(word), 1);
+  }
+
+  return NULL;
+}
+
+/* tone bursts with pauses, enough for host VAD to see speech and endpoints */
+static void _pcm_tone(short *pcm, uint32_t samples, uint64_t offset) {
+  uint32_t i;
+  uint64_t n;
+  for (i = 0; i < samples; i++) {
+    n = offset + i;
+    pcm[i] = ((n / 16000) % 4 == 3) ? 0 : (short)(8000 * sin(2 * M_PI * 440 * n / 16000.0));
+  }
+}
+
+static void _pcm_next(short *pcm, uint32_t samples, uint64_t offset) {
+  uint32_t i;
+  if (NULL == g_pcm) {
+    _pcm_tone(pcm, samples, offset);
+    return;
+  }
+
+  for (i = 0; i < samples; i++) {
+    pcm[i] = g_pcm[(offset + i) % g_pcm_samples];
+  }
+}
+
+static int _net_connected() {
+  int connected;
+  uni_mutex_lock(&g_mutex);
+  connected = g_stats.net_connected;
+  uni_mutex_unlock(&g_mutex);
+  return connected;
+}
+
+static void _rasr_session(uint32_t session_id) {
+  ChnIoTRasrStartParam start = {session_id};
+  ChnIoTRasrFeedDataParam feed;
+  short pcm[RASR_PACKET_SAMPLES];
+  int64_t period = (int64_t)(RASR_PACKET_US / g_config.rasr_speed);
+  int64_t end = _now_us() + g_config.rasr_len_ms * 1000LL;
+  int64_t next = _now_us();
+  uint64_t offset = 0;
+  AdpcmState state;
+
+  AdpcmStateReset(&state);
+  _send(CHNL_MSG_IOT_RASR_START, (char *)&start, sizeof(start), 1);
+  while (_now_us() < end && _period_wait(&next, period)) {
+    _pcm_next(pcm, RASR_PACKET_SAMPLES, offset);
+    offset += RASR_PACKET_SAMPLES;
+    AdpcmEncode(&state, pcm, RASR_PACKET_SAMPLES, (unsigned char *)feed.adpcm);
+    if (!_net_connected()) {
+      uni_mutex_lock(&g_mutex);
+      g_stats.rasr_paused++;
+      uni_mutex_unlock(&g_mutex);
+      continue;
+    }
+
+    _send(CHNL_MSG_IOT_RASR_DATA_FEED, (char *)&feed, sizeof(feed), 0);
+    uni_mutex_lock(&g_mutex);
+    g_stats.rasr_packets++;
+    uni_mutex_unlock(&g_mutex);
+  }
+
+  _send(CHNL_MSG_IOT_RASR_STOP, NULL, 0, 1);
+}
+
+static void *_rasr_task(void *arg) {
+  int64_t next = _now_us();
+  uint32_t session_id = 1;
+
+  while (_period_wait(&next, g_config.rasr_ms * 1000LL)) {
+    uni_mutex_lock(&g_mutex);
+    g_stats.rasr_sessions++;
+    uni_mutex_unlock(&g_mutex);
+    _rasr_session(session_id++);
+  }
+
+  return NULL;
+}
+
+static uint32_t _avg_ms(const Latency *latency) {
+  return latency->cnt ? (uint32_t)(latency->sum_us / latency->cnt / 1000) : 0;
+}
+
+static void _report(const char *tag) {
+  SimStats s;
+  uni_mutex_lock(&g_mutex);
+  _audio_play(&g_stats.audio, _now_us());
+  s = g_stats;
+  uni_mutex_unlock(&g_mutex);
+
+  printf("[%s] link to host frames=%llu bytes=%llu lost=%llu, from host reads=%llu "
+         "bytes=%llu lost=%llu frames=%llu, bit errors=%llu\n", tag,
+         (unsigned long long)s.tx_frames, (unsigned long long)s.tx_bytes,
+         (unsigned long long)s.tx_lost, (unsigned long long)s.rx_reads,
+         (unsigned long long)s.rx_bytes, (unsigned long long)s.rx_lost,
+         (unsigned long long)s.rx_frames, (unsigned long long)s.bit_errors);
+  printf("[%s] reliable send avg=%ums max=%ums failed=%u, challenge sent=%u acked=%u "
+         "avg=%ums max=%ums, net=%u\n", tag, _avg_ms(&s.send), s.send.max_us / 1000,
+         s.send_failed, s.challenge_sent, s.challenge_acked, _avg_ms(&s.challenge),
+         s.challenge.max_us / 1000, s.net_connected);
+  printf("[%s] asr results=%u answered=%u to audio avg=%ums max=%ums, rasr sessions=%u "
+         "packets=%llu paused=%llu, host cmds=%u\n", tag, s.asr_sent, s.asr_to_audio.cnt,
+         _avg_ms(&s.asr_to_audio), s.asr_to_audio.max_us / 1000, s.rasr_sessions,
+         (unsigned long long)s.rasr_packets, (unsigned long long)s.rasr_paused, s.host_cmds);
+  printf("[%s] audio streams=%u pushes=%u bytes=%llu queries=%u, fill=%u peak=%u/%u, "
+         "underruns=%u overflow=%llu\n", tag, s.audio.streams, s.audio.pushes,
+         (unsigned long long)s.audio.bytes, s.audio.queries, s.audio.fill, s.audio.peak,
+         s.audio.capacity, s.audio.underruns, (unsigned long long)s.audio.overflow_bytes);
+  fflush(stdout);
+}
+
+static int _pcm_load(const char *file) {
+  FILE *fp = fopen(file, "rb");
+  long size;
+
+  if (NULL == fp) {
+    fprintf(stderr, "open %s failed\n", file);
+    return -1;
+  }
+
+  fseek(fp, 0, SEEK_END);
+  size = ftell(fp);
+  fseek(fp, 0, SEEK_SET);
+  g_pcm_samples = (uint32_t)(size / sizeof(short));
+  g_pcm = g_pcm_samples ? uni_malloc(g_pcm_samples * sizeof(short)) : NULL;
+  if (NULL == g_pcm || g_pcm_samples != fread(g_pcm, sizeof(short), g_pcm_samples, fp)) {
+    fprintf(stderr, "read %s failed\n", file);
+    fclose(fp);
+    return -1;
+  }
+
+  fclose(fp);
+  return 0;
+}
+
+static int _pty_open() {
+  struct termios options;
+  const char *slave;
+
+  g_master_fd = posix_openpt(O_RDWR | O_NOCTTY);
+  if (g_master_fd < 0 || 0 != grantpt(g_master_fd) || 0 != unlockpt(g_master_fd) ||
+      NULL == (slave = ptsname(g_master_fd))) {
+    fprintf(stderr, "open pty failed[%s]\n", strerror(errno));
+    return -1;
+  }
+
+  tcgetattr(g_master_fd, &options);
+  cfmakeraw(&options);
+  tcsetattr(g_master_fd, TCSANOW, &options);
+
+  /* keep slave open, master reads EIO whenever APP is not running */
+  if (open(slave, O_RDWR | O_NOCTTY) < 0) {
+    fprintf(stderr, "open %s failed[%s]\n", slave, strerror(errno));
+    return -1;
+  }
+
+  if (NULL != g_config.link_path) {
+    unlink(g_config.link_path);
+    if (0 != symlink(slave, g_config.link_path)) {
+      fprintf(stderr, "link %s failed[%s]\n", g_config.link_path, strerror(errno));
+      return -1;
+    }
+  }
+
+  printf("hbm sim on %s%s%s\n", slave, g_config.link_path ? " -> " : "",
+         g_config.link_path ? g_config.link_path : "");
+  fflush(stdout);
+  return 0;
+}
+
+static int _listen_tcp(const char *address) {
+  struct addrinfo hints, *res;
+  const char *port = strrchr(address, ':');
+  char host[64] = "127.0.0.1";
+  int one = 1;
+  int fd, ret;
+
+  if (NULL != port) {
+    snprintf(host, sizeof(host), "%.*s", (int)(port - address), address);
+    address = port + 1;
+  }
+
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family   = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  hints.ai_flags    = AI_PASSIVE;
+  if (0 != (ret = getaddrinfo(host, address, &hints, &res))) {
+    fprintf(stderr, "resolve %s failed[%s]\n", host, gai_strerror(ret));
+    return -1;
+  }
+
+  fd = socket(res->ai_family, res->ai_socktype | SOCK_CLOEXEC, res->ai_protocol);
+  if (fd >= 0) {
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    if (0 != bind(fd, res->ai_addr, res->ai_addrlen)) {
+      close(fd);
+      fd = -1;
+    }
+  }
+
+  freeaddrinfo(res);
+  return fd;
+}
+
+static int _listen_unix(const char *path) {
+  struct sockaddr_un addr;
+  int fd;
+
+  if (strlen(path) >= sizeof(addr.sun_path)) {
+    errno = ENAMETOOLONG;
+    return -1;
+  }
+
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", path);
+  unlink(path);
+  fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (fd >= 0 && 0 != bind(fd, (struct sockaddr *)&addr, sizeof(addr))) {
+    close(fd);
+    fd = -1;
+  }
+
+  return fd;
+}
+
+static int _socket_open() {
+  const char *address = g_config.listen_addr;
+
+  if (0 == strncmp(address, "tcp:", 4)) {
+    g_listen_fd = _listen_tcp(address + 4);
+  } else if (0 == strncmp(address, "unix:", 5)) {
+    g_listen_fd = _listen_unix(address + 5);
+  } else {
+    fprintf(stderr, "invalid address %s, expect tcp:[host:]port or unix:path\n", address);
+    return -1;
+  }
+
+  if (g_listen_fd < 0 || 0 != listen(g_listen_fd, 1)) {
+    fprintf(stderr, "listen %s failed[%s]\n", address, strerror(errno));
+    return -1;
+  }
+
+  printf("hbm sim on %s\n", address);
+  fflush(stdout);
+  return 0;
+}
+
+static void _words_parse(char *list) {
+  char *save = NULL;
+  char *word;
+
+  g_config.word_cnt = 0;
+  for (word = strtok_r(list, ",", &save); NULL != word && g_config.word_cnt < SIM_WORDS_MAX;
+       word = strtok_r(NULL, ",", &save)) {
+    g_config.words[g_config.word_cnt++] = word;
+  }
+}
+
+static int _options_parse(int argc, char *argv[], unsigned int *seed) {
+  static char words[] = "wakeup_uni,ac_power_on,exitUni";
+  int opt;
+
+  g_config.challenge_ms = 1000;
+  g_config.asr_ms       = 5000;
+  g_config.rasr_ms      = 10000;
+  g_config.rasr_len_ms  = 3000;
+  g_config.rasr_speed   = 1.0;
+  g_config.report_ms    = 5000;
+  g_to_host.baud        = 921600;
+  g_stats.audio.capacity = 16 * 1024;
+  _words_parse(words);
+
+  while (-1 != (opt = getopt(argc, argv, "c:a:w:r:d:x:B:b:L:J:e:p:l:u:i:t:s:S:"))) {
+    switch (opt) {
+    case 'c': g_config.challenge_ms = atoi(optarg); break;
+    case 'a': g_config.asr_ms = atoi(optarg); break;
+    case 'w': _words_parse(optarg); break;
+    case 'r': g_config.rasr_ms = atoi(optarg); break;
+    case 'd': g_config.rasr_len_ms = atoi(optarg); break;
+    case 'x': g_config.rasr_speed = atof(optarg); break;
+    case 'B': g_stats.audio.capacity = atoi(optarg); break;
+    case 'b': g_to_host.baud = atoi(optarg); break;
+    case 'L': g_config.latency_ms = atoi(optarg); break;
+    case 'J': g_config.jitter_ms = atoi(optarg); break;
+    case 'e': g_to_host.ber = g_from_host.ber = atof(optarg); break;
+    case 'p': g_to_host.loss = g_from_host.loss = atof(optarg); break;
+    case 'l': g_config.link_path = optarg; break;
+    case 'u': g_config.listen_addr = optarg; break;
+    case 'i': g_config.pcm_file = optarg; break;
+    case 't': g_config.run_sec = atoi(optarg); break;
+    case 's': g_config.report_ms = atoi(optarg); break;
+    case 'S': *seed = (unsigned int)strtoul(optarg, NULL, 0); break;
+    default:
+      fprintf(stderr, "usage: %s [-c challenge_ms] [-a asr_ms] [-w word,...] [-r rasr_ms] "
+              "[-d rasr_len_ms] [-x speed] [-B audio_buf] [-b baud] [-L latency_ms] "
+              "[-J jitter_ms] [-e ber] [-p loss] [-l link] [-u addr] [-i pcm] [-t sec] [-s report_ms] "
+              "[-S seed]\n", argv[0]);
+      return -1;
+    }
+  }
+
+  if (0 == g_config.word_cnt || g_config.rasr_speed <= 0 || 0 == g_config.report_ms) {
+    fprintf(stderr, "invalid options\n");
+    return -1;
+  }
+
+  return 0;
+}
+
+static void* _sem_alloc() {
+  return uni_malloc(sizeof(uni_sem_t));
+}
+
+static int _sem_init(void *sem, unsigned int value) {
+  return uni_sem_new((uni_sem_t *)sem, value);
+}
+
+static void _sem_destroy(void *sem) {
+  uni_sem_free((uni_sem_t *)sem);
+  uni_free(sem);
+}
+
+static int _sem_post(void *sem) {
+  return uni_sem_signal((uni_sem_t *)sem);
+}
+
+static int _sem_wait(void *sem) {
+  return uni_sem_wait((uni_sem_t *)sem, UNI_WAIT_FOREVER);
+}
+
+static int _sem_timedwait(void *sem, unsigned int timeout_msecond) {
+  return uni_sem_wait((uni_sem_t *)sem, timeout_msecond);
+}
+
+static void _hooks_register() {
+  static CommProtocolHooks hooks;
+  hooks.malloc_fn        = uni_malloc;
+  hooks.free_fn          = uni_free;
+  hooks.realloc_fn       = uni_realloc;
+  hooks.msleep_fn        = uni_msleep;
+  hooks.sem_alloc_fn     = _sem_alloc;
+  hooks.sem_destroy_fn   = _sem_destroy;
+  hooks.sem_init_fn      = _sem_init;
+  hooks.sem_post_fn      = _sem_post;
+  hooks.sem_wait_fn      = _sem_wait;
+  hooks.sem_timedwait_fn = _sem_timedwait;
+  CommProtocolRegisterHooks(&hooks);
+}
+
+static void _on_signal(int sig) {
+  g_running = 0;
+}
+
+static int _start(const char *name, void *(*task)(void *), uint32_t period_ms) {
+  if (0 == period_ms) {
+    return 0;
+  }
+
+  return uni_thread_new(name, task, NULL, SIM_STACK_SIZE);
+}
+
+int main(int argc, char *argv[]) {
+  unsigned int seed = (unsigned int)time(NULL);
+  int64_t end_us, next_report;
+
+  if (0 != _options_parse(argc, argv, &seed)) {
+    return -1;
+  }
+
+  if (NULL != g_config.pcm_file && 0 != _pcm_load(g_config.pcm_file)) {
+    return -1;
+  }
+
+  LogLevelSet(N_LOG_ERROR);
+  signal(SIGINT, _on_signal);
+  signal(SIGTERM, _on_signal);
+  signal(SIGPIPE, SIG_IGN);
+  uni_mutex_new(&g_mutex);
+  g_stats.net_connected = 1;
+
+  if (0 != (NULL != g_config.listen_addr ? _socket_open() : _pty_open())) {
+    return -1;
+  }
+
+  _hooks_register();
+  if (0 != CommProtocolInit(_comm_write, _on_host_packet) ||
+      NULL == (g_replies = EventListCreate(_reply_handler, SIM_STACK_SIZE)) ||
+      0 != _link_init(&g_to_host, "sim_to_host", _wire_write, seed) ||
+      0 != _link_init(&g_from_host, "sim_from_host", _host_data, seed + 1) ||
+      0 != uni_thread_new("sim_reader", _reader_task, NULL, SIM_STACK_SIZE) ||
+      0 != _start("sim_challenge", _challenge_task, g_config.challenge_ms) ||
+      0 != _start("sim_asr", _asr_task, g_config.asr_ms) ||
+      0 != _start("sim_rasr", _rasr_task, g_config.rasr_ms)) {
+    fprintf(stderr, "start simulator failed\n");
+    return -1;
+  }
+
+  end_us = g_config.run_sec ? _now_us() + g_config.run_sec * 1000000LL : 0;
+  next_report = _now_us() + g_config.report_ms * 1000LL;
+  while (g_running && (0 == end_us || _now_us() < end_us)) {
+    uni_msleep(100);
+    if (_now_us() >= next_report) {
+      _report("sim");
+      next_report += g_config.report_ms * 1000LL;
+    }
+  }
+
+  g_running = 0;
+  _report("total");
+  if (NULL != g_config.link_path) {
+    unlink(g_config.link_path);
+  }
+  if (NULL != g_config.listen_addr && 0 == strncmp(g_config.listen_addr, "unix:", 5)) {
+    unlink(g_config.listen_addr + 5);
+  }
+  return 0;
+}
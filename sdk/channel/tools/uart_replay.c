@@ -0,0 +1,393 @@
+/**************************************************************************
+ * Copyright (C) 2020-2020  Unisound
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ **************************************************************************
+ *
+ * Description : uart_replay.c
+ * Author      : junlon2006@163.com
+ * Date        : 2020.08.29
+ *
+ **************************************************************************/
+
+/*
+ * usage: UART_REPLAY [options] capture_file
+ *
+ * feeds a capture recorded by UartCapture (APP option capture=file) into the
+ * protocol parser on one thread, no uart or module needed. frames are hashed,
+ * same capture gives same digest on every build, a digest change means parser
+ * or framing behaviour changed
+ *   -m mode    parse: frames only counted, measures framing and crc
+ *              dispatch: frames go through ChnlReceiveCommProtocolPacket to
+ *              counting handlers, measures packet pool and dispatcher too
+ *   -d dir     rx (default) replays what module sent, tx what host sent
+ *   -r         original speed, records fed at captured time, default max speed
+ *   -n loops   replay whole capture this many times
+ *   -c chunk   feed fixed size chunks instead of captured read sizes, max speed only
+ *   -B         dispatch mode, block parser on full packet pool instead of dropping
+ *   -e digest  expected digest, exit 1 when frames differ
+ */
+#include "uni_capture.h"
+#include "uni_communication.h"
+#include "uni_channel.h"
+#include "uni_channel_common.h"
+#include "uni_log.h"
+#include "porting.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/resource.h>
+
+#define REPLAY_DRAIN_TIMEOUT_MS  (10 * 1000)
+#define REPLAY_BLOCK_TIMEOUT_MS  (1000)
+#define FNV_OFFSET               (0xcbf29ce484222325ULL)
+#define FNV_PRIME                (0x100000001b3ULL)
+
+typedef struct {
+  uint64_t ts_us;
+  uint32_t offset;
+  uint32_t len;
+} Chunk;
+
+typedef struct {
+  const char *file;
+  int        dispatch;
+  CaptureDir dir;
+  int        realtime;
+  uint32_t   loops;
+  uint32_t   chunk;
+  int        block;
+  const char *expect;
+} ReplayConfig;
+
+static ReplayConfig  g_config;
+static unsigned char *g_data = NULL;  /* all bytes of one direction back to back */
+static uint32_t      g_data_len = 0;
+static Chunk         *g_chunks = NULL;
+static uint32_t      g_chunk_cnt = 0;
+static int           g_dispatch_on = 0;
+static uint64_t      g_frames = 0;
+static uint64_t      g_payload_bytes = 0;
+static uint64_t      g_digest = 0;
+static uint64_t      g_handled = 0;
+static uint8_t       g_cmd_seen[65536 / 8];
+
+static int _null_write(char *buf, unsigned int len) {
+  return (int)len;
+}
+
+/* sum of per frame hashes, same value whatever order dispatcher runs frames in */
+static uint64_t _frame_hash(CommPacket *packet) {
+  uint64_t hash = FNV_OFFSET;
+  uint32_t i;
+
+  hash = (hash ^ (packet->cmd & 0xff)) * FNV_PRIME;
+  hash = (hash ^ (packet->cmd >> 8)) * FNV_PRIME;
+  for (i = 0; i < packet->payload_len; i++) {
+    hash = (hash ^ (unsigned char)packet->payload[i]) * FNV_PRIME;
+  }
+
+  return hash;
+}
+
+static void _on_frame(CommPacket *packet) {
+  g_frames++;
+  g_payload_bytes += packet->payload_len;
+  g_digest += _frame_hash(packet);
+  g_cmd_seen[packet->cmd >> 3] |= (uint8_t)(1 << (packet->cmd & 7));
+  if (g_dispatch_on) {
+    ChnlReceiveCommProtocolPacket(packet);
+  }
+}
+
+static void _count_handler(uint32_t cmd, char *payload, uint32_t len, void *ctx) {
+  __atomic_add_fetch(&g_handled, 1, __ATOMIC_RELAXED);
+}
+
+static int _capture_load(const char *file) {
+  CaptureReaderHandle reader;
+  CaptureRecord record;
+  uint32_t data_cap = 0, chunk_cap = 0;
+  int ret;
+
+  if (NULL == (reader = CaptureReaderOpen(file, NULL))) {
+    fprintf(stderr, "open %s failed\n", file);
+    return -1;
+  }
+
+  while (1 == (ret = CaptureReaderNext(reader, &record))) {
+    if (record.dir != g_config.dir || 0 == record.len) {
+      continue;
+    }
+
+    if (g_data_len + record.len > data_cap) {
+      data_cap = uni_max(data_cap * 2, g_data_len + record.len);
+      g_data = (unsigned char *)uni_realloc(g_data, data_cap);
+    }
+
+    if (g_chunk_cnt == chunk_cap) {
+      chunk_cap = uni_max(chunk_cap * 2, 1024);
+      g_chunks = (Chunk *)uni_realloc(g_chunks, chunk_cap * sizeof(Chunk));
+    }
+
+    if (NULL == g_data || NULL == g_chunks) {
+      fprintf(stderr, "out of memory\n");
+      CaptureReaderClose(reader);
+      return -1;
+    }
+
+    memcpy(g_data + g_data_len, record.data, record.len);
+    g_chunks[g_chunk_cnt].ts_us = record.ts_us;
+    g_chunks[g_chunk_cnt].offset = g_data_len;
+    g_chunks[g_chunk_cnt].len = record.len;
+    g_chunk_cnt++;
+    g_data_len += record.len;
+  }
+
+  CaptureReaderClose(reader);
+  if (ret < 0) {
+    /* a capture cut by kill ends in a partial record, replay what is complete */
+    fprintf(stderr, "%s truncated after %u records\n", file, g_chunk_cnt);
+  }
+
+  return 0;
+}
+
+static void _feed_once(int realtime) {
+  int64_t start_us = uni_get_clock_time_us();
+  int64_t wait_us;
+  uint32_t i, len;
+
+  if (g_config.chunk > 0 && !realtime) {
+    for (i = 0; i < g_data_len; i += len) {
+      len = uni_min(g_config.chunk, g_data_len - i);
+      CommProtocolReceiveUartData(g_data + i, (int)len);
+    }
+    return;
+  }
+
+  for (i = 0; i < g_chunk_cnt; i++) {
+    if (realtime) {
+      wait_us = start_us + (int64_t)g_chunks[i].ts_us - uni_get_clock_time_us();
+      if (wait_us > 0) {
+        usleep((useconds_t)wait_us);
+      }
+    }
+
+    CommProtocolReceiveUartData(g_data + g_chunks[i].offset, (int)g_chunks[i].len);
+  }
+}
+
+static int _dispatch_init() {
+  uint32_t cmd;
+
+  if (0 != ChnlInit(NULL)) {
+    return -1;
+  }
+
+  /* builtin handlers reply to the module, counting handlers measure dispatch alone */
+  for (cmd = 1; cmd < 65536; cmd++) {
+    if (g_cmd_seen[cmd >> 3] & (1 << (cmd & 7))) {
+      ChnlRegisterHandler((CommCmd)cmd, _count_handler, NULL,
+                          cmd > CHNL_MSG_HBM_IOT_DEVICE_BASE ? CHNL_EXECUTOR_IOT :
+                                                               CHNL_EXECUTOR_NORMAL);
+    }
+  }
+
+  if (g_config.block) {
+    ChnlSetAdmissionPolicy(PACKET_POOL_POLICY_BLOCK, 0, REPLAY_BLOCK_TIMEOUT_MS);
+  }
+
+  g_dispatch_on = 1;
+  return 0;
+}
+
+static void _dispatch_drain() {
+  long deadline = uni_get_clock_time_ms() + REPLAY_DRAIN_TIMEOUT_MS;
+  while (ChnlPendingTasks() > 0 && uni_get_clock_time_ms() < deadline) {
+    uni_msleep(1);
+  }
+}
+
+static int64_t _cpu_us(const struct timeval *tv) {
+  return (int64_t)tv->tv_sec * 1000000 + tv->tv_usec;
+}
+
+static void _report(uint64_t frames, uint64_t bytes, int64_t elapsed_us,
+                    const struct rusage *begin, const struct rusage *end) {
+  PacketPoolStats pool;
+  double sec = elapsed_us > 0 ? elapsed_us / 1e6 : 1e-6;
+
+  printf("[replay] %s %s, loops=%u, %s%s, bytes=%llu frames=%llu\n",
+         g_config.dispatch ? "dispatch" : "parse", CAPTURE_DIR_RX == g_config.dir ? "rx" : "tx",
+         g_config.loops, g_config.realtime ? "original speed" : "max speed",
+         g_config.chunk && !g_config.realtime ? " fixed chunks" : "",
+         (unsigned long long)bytes, (unsigned long long)frames);
+  printf("[replay] elapsed=%.3fs, %.2fMB/s, %.0f frames/s, %.1fns/byte, "
+         "cpu user=%lldus sys=%lldus\n", sec, bytes / sec / 1e6, frames / sec,
+         bytes ? elapsed_us * 1000.0 / bytes : 0.0,
+         (long long)(_cpu_us(&end->ru_utime) - _cpu_us(&begin->ru_utime)),
+         (long long)(_cpu_us(&end->ru_stime) - _cpu_us(&begin->ru_stime)));
+
+  if (g_config.dispatch && 0 == ChnlGetPacketStats(&pool)) {
+    printf("[replay] handled=%llu pending=%u, pool admitted=%u drop budget=%u no slot=%u "
+           "too large=%u evicted=%u blocked=%u\n", (unsigned long long)g_handled,
+           ChnlPendingTasks(), pool.admitted, pool.drop_budget, pool.drop_no_slot,
+           pool.drop_too_large, pool.evicted, pool.blocked);
+  }
+}
+
+static int _options_parse(int argc, char *argv[]) {
+  int opt;
+
+  g_config.dir   = CAPTURE_DIR_RX;
+  g_config.loops = 1;
+
+  while (-1 != (opt = getopt(argc, argv, "m:d:rn:c:Be:"))) {
+    switch (opt) {
+    case 'm': g_config.dispatch = (0 == strcmp(optarg, "dispatch")); break;
+    case 'd': g_config.dir = (0 == strcmp(optarg, "tx") ? CAPTURE_DIR_TX : CAPTURE_DIR_RX); break;
+    case 'r': g_config.realtime = 1; break;
+    case 'n': g_config.loops = (uint32_t)atoi(optarg); break;
+    case 'c': g_config.chunk = (uint32_t)atoi(optarg); break;
+    case 'B': g_config.block = 1; break;
+    case 'e': g_config.expect = optarg; break;
+    default:
+      goto L_USAGE;
+    }
+  }
+
+  if (optind != argc - 1 || 0 == g_config.loops) {
+    goto L_USAGE;
+  }
+
+  g_config.file = argv[optind];
+  return 0;
+
+L_USAGE:
+  fprintf(stderr, "usage: %s [-m parse|dispatch] [-d rx|tx] [-r] [-n loops] [-c chunk] "
+          "[-B] [-e digest] capture_file\n", argv[0]);
+  return -1;
+}
+
+static void* _sem_alloc() {
+  return uni_malloc(sizeof(uni_sem_t));
+}
+
+static int _sem_init(void *sem, unsigned int value) {
+  return uni_sem_new((uni_sem_t *)sem, value);
+}
+
+static void _sem_destroy(void *sem) {
+  uni_sem_free((uni_sem_t *)sem);
+  uni_free(sem);
+}
+
+static int _sem_post(void *sem) {
+  return uni_sem_signal((uni_sem_t *)sem);
+}
+
+static int _sem_wait(void *sem) {
+  return uni_sem_wait((uni_sem_t *)sem, UNI_WAIT_FOREVER);
+}
+
+static int _sem_timedwait(void *sem, unsigned int timeout_msecond) {
+  return uni_sem_wait((uni_sem_t *)sem, timeout_msecond);
+}
+
+static void _hooks_register() {
+  static CommProtocolHooks hooks;
+  hooks.malloc_fn        = uni_malloc;
+  hooks.free_fn          = uni_free;
+  hooks.realloc_fn       = uni_realloc;
+  hooks.msleep_fn        = uni_msleep;
+  hooks.sem_alloc_fn     = _sem_alloc;
+  hooks.sem_destroy_fn   = _sem_destroy;
+  hooks.sem_init_fn      = _sem_init;
+  hooks.sem_post_fn      = _sem_post;
+  hooks.sem_wait_fn      = _sem_wait;
+  hooks.sem_timedwait_fn = _sem_timedwait;
+  CommProtocolRegisterHooks(&hooks);
+}
+
+int main(int argc, char *argv[]) {
+  struct rusage begin, end;
+  uint64_t pass_frames, pass_digest;
+  int64_t start_us, elapsed_us;
+  uint32_t i;
+
+  if (0 != _options_parse(argc, argv)) {
+    return 2;
+  }
+
+  LogLevelSet(N_LOG_ERROR);
+  if (0 != _capture_load(g_config.file)) {
+    return 2;
+  }
+
+  _hooks_register();
+  if (0 != CommProtocolInit(_null_write, _on_frame)) {
+    fprintf(stderr, "comm protocol init failed\n");
+    return 2;
+  }
+
+  /* first pass untimed: reference frame count and digest, cmds to register, warm caches */
+  _feed_once(0);
+  pass_frames = g_frames;
+  pass_digest = g_digest;
+  printf("[replay] %s, %u records, %u bytes, %.3fs captured, frames=%llu digest=%016llx\n",
+         g_config.file, g_chunk_cnt, g_data_len,
+         g_chunk_cnt ? g_chunks[g_chunk_cnt - 1].ts_us / 1e6 : 0.0,
+         (unsigned long long)pass_frames, (unsigned long long)pass_digest);
+
+  if (g_config.dispatch && 0 != _dispatch_init()) {
+    fprintf(stderr, "channel init failed\n");
+    return 2;
+  }
+
+  g_frames = 0;
+  g_digest = 0;
+  getrusage(RUSAGE_SELF, &begin);
+  start_us = uni_get_clock_time_us();
+  for (i = 0; i < g_config.loops; i++) {
+    _feed_once(g_config.realtime);
+  }
+
+  if (g_config.dispatch) {
+    _dispatch_drain();
+  }
+
+  elapsed_us = uni_get_clock_time_us() - start_us;
+  getrusage(RUSAGE_SELF, &end);
+  _report(g_frames, (uint64_t)g_data_len * g_config.loops, elapsed_us, &begin, &end);
+
+  /* every loop must frame exactly like the first one */
+  if (g_frames != pass_frames * g_config.loops || g_digest != pass_digest * g_config.loops) {
+    printf("[replay] loops not deterministic, frames=%llu digest=%016llx\n",
+           (unsigned long long)g_frames, (unsigned long long)g_digest);
+    return 1;
+  }
+
+  if (NULL != g_config.expect && strtoull(g_config.expect, NULL, 16) != pass_digest) {
+    printf("[replay] digest mismatch, expect=%s got=%016llx\n", g_config.expect,
+           (unsigned long long)pass_digest);
+    return 1;
+  }
+
+  return 0;
+}
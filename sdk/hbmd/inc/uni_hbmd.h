@@ -0,0 +1,83 @@
+/**************************************************************************
+ * Copyright (C) 2020-2020  Unisound
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ **************************************************************************
+ *
+ * Description : uni_hbmd.h
+ * Author      : junlon2006@163.com
+ * Date        : 2020.09.04
+ *
+ **************************************************************************/
+#ifndef SDK_HBMD_INC_UNI_HBMD_H_
+#define SDK_HBMD_INC_UNI_HBMD_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+/*
+ * 守护进程模式：持有蜂鸟M链路的进程在Unix socket上为本机其他进程（播报、
+ * IoT控制、遥测等）提供服务，消息格式见uni_hbmd_protocol.h，客户端见
+ * uni_hbmd_client.h
+ *   接收：客户端按cmd订阅IoT消息(>CHNL_MSG_HBM_IOT_DEVICE_BASE)，同一消息扇出给所有订阅者，
+ *         未被订阅的消息仍回调ChnlInit的cmd_callback
+ *   发送：客户端请求进入守护进程发送队列，控制消息与音频分两个队列，
+ *         长时间播报不阻塞控制消息，逐帧由协议栈发送锁合并到同一链路
+ *   音频：客户端以memfd共享内存传递PCM，守护进程直接从映射送入ChnlIotDeviceFeedAudioData；
+ *         或以ShmRing边写边播，协议帧头组装在环形缓冲预留空间内，PCM全程零拷贝
+ */
+
+typedef struct {
+  uint32_t clients;          /* 当前连接数 */
+  uint32_t accepted;
+  uint32_t rejected;         /* 连接数达到上限 */
+  uint64_t packets;          /* 扇出消息条数，每个订阅者计一次 */
+  uint64_t packet_drops;     /* 客户端接收过慢，发送缓冲满丢弃 */
+  uint32_t sends;
+  uint32_t send_failed;
+  uint32_t plays;
+  uint32_t streams;          /* ShmRing音频流，字节计入play_bytes */
+  uint64_t play_bytes;
+  uint32_t play_failed;
+} HbmdStats;
+
+/**
+ * @brief 启动守护进程服务，需在ChnlInit之后调用
+ * @param path Unix socket路径，已存在时先删除
+ * @return 0 成功，-1 失败
+ */
+int HbmdStart(const char *path);
+
+/**
+ * @brief 停止服务，断开所有客户端，排队未执行的发送请求丢弃
+ * @param void
+ * @return void
+ */
+void HbmdStop(void);
+
+/**
+ * @brief 获取连接、扇出及发送统计
+ * @param stats
+ * @return 0 成功，-1 未启动
+ */
+int HbmdGetStats(HbmdStats *stats);
+
+#ifdef __cplusplus
+}
+#endif
+#endif  // SDK_HBMD_INC_UNI_HBMD_H_
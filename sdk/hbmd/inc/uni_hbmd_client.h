@@ -0,0 +1,113 @@
+/**************************************************************************
+ * Copyright (C) 2020-2020  Unisound
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ **************************************************************************
+ *
+ * Description : uni_hbmd_client.h
+ * Author      : junlon2006@163.com
+ * Date        : 2020.09.04
+ *
+ **************************************************************************/
+#ifndef SDK_HBMD_INC_UNI_HBMD_CLIENT_H_
+#define SDK_HBMD_INC_UNI_HBMD_CLIENT_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include "uni_shm_ring.h"
+
+typedef void* HbmdClientHandle;
+
+/* 订阅消息回调，在客户端接收线程执行，不可调用本连接的请求接口 */
+typedef void (*HbmdPacketHandler)(uint32_t cmd, char *payload, uint32_t len, void *ctx);
+
+/**
+ * @brief 连接守护进程
+ * @param path 守护进程Unix socket路径
+ * @param handler 订阅消息回调，可为NULL
+ * @param ctx handler私有参数
+ * @return handle，失败返回NULL
+ */
+HbmdClientHandle HbmdClientConnect(const char *path, HbmdPacketHandler handler, void *ctx);
+
+/**
+ * @brief 断开连接，释放共享内存
+ * @param handle
+ * @return void
+ */
+void HbmdClientClose(HbmdClientHandle handle);
+
+/**
+ * @brief 订阅消息，仅支持IoT消息(>CHNL_MSG_HBM_IOT_DEVICE_BASE)
+ * Tips: 同一连接上的请求串行执行，以下请求接口相同
+ * @param handle
+ * @param cmd
+ * @return 0 成功，-1 失败
+ */
+int HbmdClientSubscribe(HbmdClientHandle handle, uint32_t cmd);
+
+/**
+ * @brief 取消订阅
+ * @param handle
+ * @param cmd
+ * @return 0 成功，-1 失败
+ */
+int HbmdClientUnsubscribe(HbmdClientHandle handle, uint32_t cmd);
+
+/**
+ * @brief 经守护进程可靠发送消息至蜂鸟M，阻塞至发送结束
+ * @param handle
+ * @param cmd
+ * @param payload
+ * @param len 不超过HBMD_PAYLOAD_MAX
+ * @return 0 成功，-1 失败
+ */
+int HbmdClientSend(HbmdClientHandle handle, uint32_t cmd, char *payload, uint32_t len);
+
+/**
+ * @brief 创建与守护进程共享的音频内存（memfd），重复调用替换之前的共享内存
+ * @param handle
+ * @param size 字节数
+ * @return 可写入PCM的映射地址，失败返回NULL
+ */
+char* HbmdClientAudioBuffer(HbmdClientHandle handle, uint32_t size);
+
+/**
+ * @brief 播放共享内存中的16KHz 16bit PCM，守护进程直接从共享内存发送，阻塞至播放数据发送完毕
+ * @param handle
+ * @param offset PCM在共享内存中的偏移
+ * @param len PCM字节数
+ * @return 0 成功，-1 失败
+ */
+int HbmdClientPlay(HbmdClientHandle handle, uint32_t offset, uint32_t len);
+
+/**
+ * @brief 创建共享内存环形缓冲并交给守护进程边收边播，16KHz 16bit PCM
+ * Tips: 生产者以ShmRingWriteBegin/ShmRingWriteEnd（或ShmRingWrite）直接写入，
+ *       写完调用ShmRingFinish，ShmRingDrain等待播放结束并获取结果，最后ShmRingClose；
+ *       守护进程在环形缓冲内原地组帧发送，PCM不经任何拷贝；超过5s未写入视为生产者退出
+ * @param handle
+ * @param size 环形缓冲字节数，按页对齐
+ * @return ring，失败返回NULL
+ */
+ShmRingHandle HbmdClientAudioRing(HbmdClientHandle handle, uint32_t size);
+
+#ifdef __cplusplus
+}
+#endif
+#endif  // SDK_HBMD_INC_UNI_HBMD_CLIENT_H_
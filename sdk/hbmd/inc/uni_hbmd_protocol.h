@@ -0,0 +1,81 @@
+/**************************************************************************
+ * Copyright (C) 2020-2020  Unisound
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ **************************************************************************
+ *
+ * Description : uni_hbmd_protocol.h
+ * Author      : junlon2006@163.com
+ * Date        : 2020.09.04
+ *
+ **************************************************************************/
+#ifndef SDK_HBMD_INC_UNI_HBMD_PROTOCOL_H_
+#define SDK_HBMD_INC_UNI_HBMD_PROTOCOL_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+/*
+ * 守护进程与客户端之间Unix stream socket上的消息格式，本机字节序
+ * 每条消息为HbmdMsgHeader + len字节payload
+ *
+ * 客户端 -> 守护进程，每条请求都会收到一条HBMD_MSG_RESULT，seq原样带回
+ *   HBMD_MSG_SUBSCRIBE     订阅cmd，收到的该消息以HBMD_MSG_PACKET转发
+ *   HBMD_MSG_UNSUBSCRIBE
+ *   HBMD_MSG_SEND          payload可靠发送至蜂鸟M，result为发送结果
+ *   HBMD_MSG_AUDIO_SHM     随消息以SCM_RIGHTS传递memfd，payload为uint32_t映射字节数
+ *   HBMD_MSG_AUDIO_PLAY    payload为HbmdAudioPlay，播放共享内存中的PCM，播完后回复result
+ *   HBMD_MSG_AUDIO_RING    随消息以SCM_RIGHTS传递ShmRing（uni_shm_ring.h）的memfd，无payload，
+ *                          接受后立即回复，守护进程边收边播，结束及结果经ShmRingDrain获取
+ * 守护进程 -> 客户端
+ *   HBMD_MSG_RESULT
+ *   HBMD_MSG_PACKET        订阅的消息，cmd及payload同蜂鸟M发送
+ */
+
+#define HBMD_PAYLOAD_MAX          (65535)
+/* ShmRing头部预留，守护进程在其中原地组装协议帧头，同COMM_PROTOCOL_HEADROOM */
+#define HBMD_AUDIO_RING_HEADROOM  (16)
+
+typedef enum {
+  HBMD_MSG_SUBSCRIBE = 1,
+  HBMD_MSG_UNSUBSCRIBE,
+  HBMD_MSG_SEND,
+  HBMD_MSG_AUDIO_SHM,
+  HBMD_MSG_AUDIO_PLAY,
+  HBMD_MSG_RESULT,
+  HBMD_MSG_PACKET,
+  HBMD_MSG_AUDIO_RING,
+} HbmdMsgType;
+
+typedef struct {
+  uint16_t type;
+  uint16_t cmd;
+  uint32_t len;     /* 其后payload字节数，不超过HBMD_PAYLOAD_MAX */
+  uint32_t seq;     /* 请求序号，HBMD_MSG_RESULT原样带回 */
+  int32_t  result;  /* HBMD_MSG_RESULT，0 成功，-1 失败 */
+} HbmdMsgHeader;
+
+typedef struct {
+  uint32_t offset;  /* PCM在共享内存中的偏移 */
+  uint32_t len;
+} HbmdAudioPlay;
+
+#ifdef __cplusplus
+}
+#endif
+#endif  // SDK_HBMD_INC_UNI_HBMD_PROTOCOL_H_
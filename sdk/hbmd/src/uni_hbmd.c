@@ -0,0 +1,875 @@
+/**************************************************************************
+ * Copyright (C) 2020-2020  Unisound
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ **************************************************************************
+ *
+ * Description : uni_hbmd.c
+ * Author      : junlon2006@163.com
+ * Date        : 2020.09.04
+ *
+ **************************************************************************/
+#define _GNU_SOURCE  /* MSG_CMSG_CLOEXEC, F_GET_SEALS */
+#include "uni_hbmd.h"
+#include "uni_hbmd_protocol.h"
+#include "uni_channel.h"
+#include "uni_channel_common.h"
+#include "uni_event_list.h"
+#include "uni_ringbuf.h"
+#include "uni_shm_ring.h"
+#include "uni_log.h"
+#include "porting.h"
+#include "errcode.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <signal.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+#define TAG "hbmd"
+
+#define HBMD_CLIENT_MAX        (16)
+#define HBMD_STACK_SIZE        (64 * 1024)
+#define HBMD_CMD_CNT           (65536)
+#define HBMD_MSG_MAX           (sizeof(HbmdMsgHeader) + HBMD_PAYLOAD_MAX)
+/* packets waiting for a slow client, beyond this they are dropped */
+#define HBMD_CLIENT_TX_SIZE    (256 * 1024)
+/* room kept for results, a client waiting for one must never lose it */
+#define HBMD_RESULT_RESERVE    (4 * 1024)
+#define HBMD_WRITE_CHUNK_SIZE  (4096)
+/* epoll data of listen and wake fds, clients use their slot index */
+#define HBMD_EV_LISTEN         (HBMD_CLIENT_MAX)
+#define HBMD_EV_WAKE           (HBMD_CLIENT_MAX + 1)
+/* producer of an audio ring silent this long is taken as gone */
+#define HBMD_RING_STALL_MS     (5 * 1000)
+/* ChnlIotDeviceFeedAudioData wants 512 multiples except at end of stream */
+#define HBMD_RING_FEED_ALIGN   (512)
+
+typedef struct {
+  unsigned char *map;
+  uint32_t      size;
+  int           refs;   /* client and audio jobs, mutex held */
+} HbmdShm;
+
+typedef struct {
+  int              fd;          /* -1 free slot */
+  uint32_t         id;          /* unique per connection, jobs reply by id */
+  unsigned char    *rx_buf;
+  uint32_t         rx_len;
+  int              pending_fd;  /* memfd received ahead of HBMD_MSG_AUDIO_SHM */
+  HbmdShm          *shm;
+  RingBufferHandle tx;
+  int              tx_armed;
+  uint8_t          subs[HBMD_CMD_CNT / 8];
+} HbmdClient;
+
+typedef struct {
+  uint32_t client_id;
+  uint32_t seq;
+  CommCmd  cmd;
+  HbmdShm  *shm;
+  ShmRingHandle ring;
+  uint32_t offset;
+  uint32_t len;
+  char     payload[0];
+} HbmdJob;
+
+typedef struct {
+  int             listen_fd;
+  int             epoll_fd;
+  int             wake_fd;
+  char            path[sizeof(((struct sockaddr_un *)0)->sun_path)];
+  HbmdClient      clients[HBMD_CLIENT_MAX];
+  uint32_t        next_id;
+  uint8_t         sub_cnt[HBMD_CMD_CNT];
+  EventListHandle send_queue;
+  EventListHandle audio_queue;
+  HbmdStats       stats;
+  uni_mutex_t     mutex;
+  uni_sem_t       sem_thread_exit_sync;
+  int             is_running;
+} Hbmd;
+
+static Hbmd g_hbmd = {.listen_fd = -1, .epoll_fd = -1, .wake_fd = -1};
+
+static void _wake() {
+  uint64_t one = 1;
+  if (sizeof(one) != write(g_hbmd.wake_fd, &one, sizeof(one))) {
+    LOGW(TAG, "wake server failed[%s]", strerror(errno));
+  }
+}
+
+static int _is_subscribed(HbmdClient *client, CommCmd cmd) {
+  return client->subs[cmd >> 3] & (1 << (cmd & 7));
+}
+
+static void _shm_unref_locked(HbmdShm *shm) {
+  if (NULL == shm || --shm->refs > 0) {
+    return;
+  }
+
+  munmap(shm->map, shm->size);
+  uni_free(shm);
+}
+
+static HbmdClient* _client_lookup_locked(uint32_t id) {
+  int i;
+  for (i = 0; i < HBMD_CLIENT_MAX; i++) {
+    if (g_hbmd.clients[i].fd >= 0 && g_hbmd.clients[i].id == id) {
+      return &g_hbmd.clients[i];
+    }
+  }
+
+  return NULL;
+}
+
+/* whole message or nothing, reserve keeps room for results, mutex held */
+static int _client_queue_locked(HbmdClient *client, HbmdMsgHeader *header, char *payload,
+                                int reserve) {
+  if (RingBufferGetFreeSize(client->tx) < (int)(sizeof(*header) + header->len) + reserve) {
+    return -1;
+  }
+
+  RingBufferWrite(client->tx, (char *)header, sizeof(*header));
+  if (header->len > 0) {
+    RingBufferWrite(client->tx, payload, header->len);
+  }
+
+  return 0;
+}
+
+static void _reply(uint32_t client_id, uint32_t seq, int result) {
+  HbmdMsgHeader header;
+  HbmdClient *client;
+
+  MZERO(&header);
+  header.type   = HBMD_MSG_RESULT;
+  header.seq    = seq;
+  header.result = result;
+
+  uni_mutex_lock(&g_hbmd.mutex);
+  if (NULL != (client = _client_lookup_locked(client_id))) {
+    _client_queue_locked(client, &header, NULL, 0);
+  }
+  uni_mutex_unlock(&g_hbmd.mutex);
+  _wake();
+}
+
+/* channel IOT executor, one subscribed message to every subscriber */
+static void _fanout(uint32_t cmd, char *payload, uint32_t len, void *ctx) {
+  HbmdMsgHeader header;
+  HbmdClient *client;
+  int i;
+
+  MZERO(&header);
+  header.type = HBMD_MSG_PACKET;
+  header.cmd  = (uint16_t)cmd;
+  header.len  = len;
+
+  uni_mutex_lock(&g_hbmd.mutex);
+  for (i = 0; i < HBMD_CLIENT_MAX; i++) {
+    client = &g_hbmd.clients[i];
+    if (client->fd < 0 || !_is_subscribed(client, (CommCmd)cmd)) {
+      continue;
+    }
+
+    if (0 == _client_queue_locked(client, &header, payload, HBMD_RESULT_RESERVE)) {
+      g_hbmd.stats.packets++;
+    } else {
+      g_hbmd.stats.packet_drops++;
+    }
+  }
+  uni_mutex_unlock(&g_hbmd.mutex);
+  _wake();
+}
+
+static void _send_job(void *event) {
+  HbmdJob *job = (HbmdJob *)event;
+  int ret = ChnlIotDevicePushCmd(job->cmd, job->payload, job->len);
+
+  uni_mutex_lock(&g_hbmd.mutex);
+  g_hbmd.stats.sends++;
+  if (0 != ret) {
+    g_hbmd.stats.send_failed++;
+  }
+  uni_mutex_unlock(&g_hbmd.mutex);
+
+  _reply(job->client_id, job->seq, ret);
+  uni_free(job);
+}
+
+/* pcm is fed straight from the client's memfd mapping, no copy in daemon */
+static void _audio_play_job(HbmdJob *job) {
+  int ret = ChnlIotDeviceFeedAudioData((char *)job->shm->map + job->offset, (int)job->len);
+
+  uni_mutex_lock(&g_hbmd.mutex);
+  g_hbmd.stats.plays++;
+  g_hbmd.stats.play_bytes += job->len;
+  if (0 != ret) {
+    g_hbmd.stats.play_failed++;
+  }
+  _shm_unref_locked(job->shm);
+  uni_mutex_unlock(&g_hbmd.mutex);
+
+  _reply(job->client_id, job->seq, ret);
+}
+
+/* frames are built in ring headroom, pcm leaves the producer's pages without a copy */
+static void _audio_ring_job(HbmdJob *job) {
+  uint32_t len, feed;
+  int finished, ret = 0;
+  char *pcm;
+
+  while (1) {
+    pcm = ShmRingReadBegin(job->ring, &len, HBMD_RING_FEED_ALIGN, HBMD_RING_STALL_MS);
+    if (NULL == pcm) {
+      if (!ShmRingIsFinished(job->ring)) {
+        LOGW(TAG, "client %u audio ring stalled", job->client_id);
+        ret = -1;
+      }
+      break;
+    }
+
+    /* finish seen after the snapshot, take the tail written before it too */
+    if ((finished = ShmRingIsFinished(job->ring))) {
+      pcm = ShmRingReadBegin(job->ring, &len, 0, 0);
+    }
+
+    feed = finished ? len : len & ~(HBMD_RING_FEED_ALIGN - 1);
+    ret  = ChnlIotDeviceFeedAudioDataInPlace(pcm, (int)feed);
+    ShmRingReadEnd(job->ring, feed);
+
+    uni_mutex_lock(&g_hbmd.mutex);
+    g_hbmd.stats.play_bytes += feed;
+    uni_mutex_unlock(&g_hbmd.mutex);
+    if (0 != ret) {
+      break;
+    }
+  }
+
+  uni_mutex_lock(&g_hbmd.mutex);
+  g_hbmd.stats.streams++;
+  if (0 != ret) {
+    g_hbmd.stats.play_failed++;
+  }
+  uni_mutex_unlock(&g_hbmd.mutex);
+
+  ShmRingDone(job->ring, ret);
+  ShmRingClose(job->ring);
+}
+
+static void _audio_job(void *event) {
+  HbmdJob *job = (HbmdJob *)event;
+  if (NULL != job->ring) {
+    _audio_ring_job(job);
+  } else {
+    _audio_play_job(job);
+  }
+
+  uni_free(job);
+}
+
+static HbmdJob* _job_alloc(HbmdClient *client, HbmdMsgHeader *header, uint32_t payload_len) {
+  HbmdJob *job = (HbmdJob *)uni_malloc(sizeof(HbmdJob) + payload_len);
+  if (NULL == job) {
+    LOGE(TAG, OUT_MEM_STRING);
+    return NULL;
+  }
+
+  job->client_id = client->id;
+  job->seq       = header->seq;
+  job->cmd       = header->cmd;
+  job->shm       = NULL;
+  job->ring      = NULL;
+  job->offset    = 0;
+  job->len       = payload_len;
+  return job;
+}
+
+/* only iot messages, lower ones are consumed by channel itself */
+static int _subscribe_locked(HbmdClient *client, CommCmd cmd, int subscribe) {
+  if (cmd <= CHNL_MSG_HBM_IOT_DEVICE_BASE) {
+    return -1;
+  }
+
+  if (!subscribe == !_is_subscribed(client, cmd)) {
+    return 0;
+  }
+
+  if (subscribe) {
+    client->subs[cmd >> 3] |= (uint8_t)(1 << (cmd & 7));
+    if (1 == ++g_hbmd.sub_cnt[cmd]) {
+      ChnlRegisterHandler(cmd, _fanout, NULL, CHNL_EXECUTOR_IOT);
+    }
+    return 0;
+  }
+
+  client->subs[cmd >> 3] &= (uint8_t)~(1 << (cmd & 7));
+  if (0 == --g_hbmd.sub_cnt[cmd]) {
+    /* back to cmd_callback of ChnlInit */
+    ChnlRegisterHandler(cmd, NULL, NULL, CHNL_EXECUTOR_IOT);
+  }
+  return 0;
+}
+
+static int _shm_sealed(int fd) {
+  int seals = fcntl(fd, F_GET_SEALS);
+  return seals >= 0 && (F_SEAL_SHRINK | F_SEAL_GROW) == (seals & (F_SEAL_SHRINK | F_SEAL_GROW));
+}
+
+static int _audio_shm_attach(HbmdClient *client, HbmdMsgHeader *header, unsigned char *payload) {
+  struct stat st;
+  HbmdShm *shm;
+  uint32_t size;
+  void *map;
+
+  if (client->pending_fd < 0 || header->len != sizeof(size)) {
+    return -1;
+  }
+
+  /* a client shrinking the memfd later would SIGBUS the daemon on every other client's link */
+  if (!_shm_sealed(client->pending_fd)) {
+    LOGW(TAG, "refuse unsealed audio shm");
+    return -1;
+  }
+
+  memcpy(&size, payload, sizeof(size));
+  if (0 == size || 0 != fstat(client->pending_fd, &st) || st.st_size < (off_t)size) {
+    return -1;
+  }
+
+  map = mmap(NULL, size, PROT_READ, MAP_SHARED, client->pending_fd, 0);
+  close(client->pending_fd);
+  client->pending_fd = -1;
+  if (MAP_FAILED == map) {
+    LOGE(TAG, "mmap audio shm failed[%s]", strerror(errno));
+    return -1;
+  }
+
+  if (NULL == (shm = (HbmdShm *)uni_malloc(sizeof(HbmdShm)))) {
+    munmap(map, size);
+    return -1;
+  }
+
+  shm->map  = (unsigned char *)map;
+  shm->size = size;
+  shm->refs = 1;
+  uni_mutex_lock(&g_hbmd.mutex);
+  _shm_unref_locked(client->shm);
+  client->shm = shm;
+  uni_mutex_unlock(&g_hbmd.mutex);
+  return 0;
+}
+
+static int _audio_play(HbmdClient *client, HbmdMsgHeader *header, unsigned char *payload) {
+  HbmdAudioPlay play;
+  HbmdJob *job;
+
+  if (NULL == client->shm || header->len != sizeof(play)) {
+    return -1;
+  }
+
+  memcpy(&play, payload, sizeof(play));
+  if (0 == play.len || play.offset > client->shm->size ||
+      play.len > client->shm->size - play.offset ||
+      NULL == (job = _job_alloc(client, header, 0))) {
+    return -1;
+  }
+
+  job->offset = play.offset;
+  job->len    = play.len;
+  uni_mutex_lock(&g_hbmd.mutex);
+  job->shm = client->shm;
+  job->shm->refs++;
+  uni_mutex_unlock(&g_hbmd.mutex);
+
+  if (0 != EventListAdd(g_hbmd.audio_queue, job, EVENT_LIST_PRIORITY_MEDIUM)) {
+    uni_mutex_lock(&g_hbmd.mutex);
+    _shm_unref_locked(job->shm);
+    uni_mutex_unlock(&g_hbmd.mutex);
+    uni_free(job);
+    return -1;
+  }
+
+  return 0;
+}
+
+static int _audio_ring(HbmdClient *client, HbmdMsgHeader *header) {
+  ShmRingHandle ring;
+  HbmdJob *job;
+
+  if (client->pending_fd < 0 || 0 != header->len) {
+    return -1;
+  }
+
+  ring = ShmRingOpen(client->pending_fd);
+  close(client->pending_fd);
+  client->pending_fd = -1;
+  if (NULL == ring) {
+    return -1;
+  }
+
+  if (ShmRingHeadroom(ring) < COMM_PROTOCOL_HEADROOM ||
+      NULL == (job = _job_alloc(client, header, 0))) {
+    LOGW(TAG, "client %u audio ring refused, headroom=%u", client->id, ShmRingHeadroom(ring));
+    ShmRingClose(ring);
+    return -1;
+  }
+
+  job->ring = ring;
+  if (0 != EventListAdd(g_hbmd.audio_queue, job, EVENT_LIST_PRIORITY_MEDIUM)) {
+    ShmRingClose(ring);
+    uni_free(job);
+    return -1;
+  }
+
+  return 0;
+}
+
+static int _send(HbmdClient *client, HbmdMsgHeader *header, unsigned char *payload) {
+  HbmdJob *job = _job_alloc(client, header, header->len);
+  if (NULL == job) {
+    return -1;
+  }
+
+  memcpy(job->payload, payload, header->len);
+  if (0 != EventListAdd(g_hbmd.send_queue, job, EVENT_LIST_PRIORITY_MEDIUM)) {
+    uni_free(job);
+    return -1;
+  }
+
+  return 0;
+}
+
+/* queued requests reply when done, others right away */
+static void _request_process(HbmdClient *client, HbmdMsgHeader *header, unsigned char *payload) {
+  int ret = -1;
+
+  switch (header->type) {
+  case HBMD_MSG_SUBSCRIBE:
+  case HBMD_MSG_UNSUBSCRIBE:
+    uni_mutex_lock(&g_hbmd.mutex);
+    ret = _subscribe_locked(client, header->cmd, HBMD_MSG_SUBSCRIBE == header->type);
+    uni_mutex_unlock(&g_hbmd.mutex);
+    break;
+  case HBMD_MSG_SEND:
+    if (0 == _send(client, header, payload)) {
+      return;
+    }
+    break;
+  case HBMD_MSG_AUDIO_SHM:
+    ret = _audio_shm_attach(client, header, payload);
+    break;
+  case HBMD_MSG_AUDIO_PLAY:
+    if (0 == _audio_play(client, header, payload)) {
+      return;
+    }
+    break;
+  case HBMD_MSG_AUDIO_RING:
+    /* accepted right away, producer writes while the daemon plays */
+    ret = _audio_ring(client, header);
+    break;
+  default:
+    LOGW(TAG, "unknown request type=%u", header->type);
+    break;
+  }
+
+  _reply(client->id, header->seq, ret);
+}
+
+static void _client_close(HbmdClient *client) {
+  uint32_t cmd;
+
+  epoll_ctl(g_hbmd.epoll_fd, EPOLL_CTL_DEL, client->fd, NULL);
+  close(client->fd);
+  if (client->pending_fd >= 0) {
+    close(client->pending_fd);
+  }
+
+  uni_mutex_lock(&g_hbmd.mutex);
+  for (cmd = CHNL_MSG_HBM_IOT_DEVICE_BASE + 1; cmd < HBMD_CMD_CNT; cmd++) {
+    _subscribe_locked(client, (CommCmd)cmd, 0);
+  }
+
+  /* audio jobs in flight keep the mapping until they finish */
+  _shm_unref_locked(client->shm);
+  client->shm = NULL;
+  client->fd  = -1;
+  RingBufferDestroy(client->tx);
+  client->tx = NULL;
+  g_hbmd.stats.clients--;
+  uni_mutex_unlock(&g_hbmd.mutex);
+
+  uni_free(client->rx_buf);
+  client->rx_buf = NULL;
+  LOGT(TAG, "client %u closed", client->id);
+}
+
+static void _client_arm(HbmdClient *client, int arm) {
+  struct epoll_event ev;
+  if (client->tx_armed == arm) {
+    return;
+  }
+
+  ev.events   = arm ? (EPOLLIN | EPOLLOUT) : EPOLLIN;
+  ev.data.u32 = (uint32_t)(client - g_hbmd.clients);
+  if (0 == epoll_ctl(g_hbmd.epoll_fd, EPOLL_CTL_MOD, client->fd, &ev)) {
+    client->tx_armed = arm;
+  }
+}
+
+/* write queued messages until empty or socket full, mutex held */
+static int _client_flush_locked(HbmdClient *client) {
+  static char chunk[HBMD_WRITE_CHUNK_SIZE];
+  int len, ret;
+
+  while ((len = RingBufferGetDataSize(client->tx)) > 0) {
+    len = RingBufferPeek(chunk, uni_min(len, (int)sizeof(chunk)), client->tx);
+    ret = write(client->fd, chunk, len);
+    if (ret <= 0) {
+      if (ret < 0 && EAGAIN != errno && EINTR != errno) {
+        return -1;
+      }
+      break;
+    }
+
+    RingBufferSkip(ret, client->tx);
+  }
+
+  _client_arm(client, RingBufferGetDataSize(client->tx) > 0);
+  return 0;
+}
+
+static void _flush_all() {
+  int i;
+
+  uni_mutex_lock(&g_hbmd.mutex);
+  for (i = 0; i < HBMD_CLIENT_MAX; i++) {
+    if (g_hbmd.clients[i].fd >= 0 && RingBufferGetDataSize(g_hbmd.clients[i].tx) > 0) {
+      _client_flush_locked(&g_hbmd.clients[i]);
+    }
+  }
+  uni_mutex_unlock(&g_hbmd.mutex);
+}
+
+/* memfd travels as SCM_RIGHTS with the bytes of its HBMD_MSG_AUDIO_SHM */
+static int _client_recv(HbmdClient *client) {
+  char control[CMSG_SPACE(sizeof(int))];
+  struct cmsghdr *cmsg;
+  struct msghdr msg;
+  struct iovec iov;
+  int ret;
+
+  iov.iov_base = client->rx_buf + client->rx_len;
+  iov.iov_len  = HBMD_MSG_MAX - client->rx_len;
+  MZERO(&msg);
+  msg.msg_iov        = &iov;
+  msg.msg_iovlen     = 1;
+  msg.msg_control    = control;
+  msg.msg_controllen = sizeof(control);
+  ret = (int)recvmsg(client->fd, &msg, MSG_CMSG_CLOEXEC);
+  if (ret <= 0) {
+    return ret;
+  }
+
+  for (cmsg = CMSG_FIRSTHDR(&msg); NULL != cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+    if (SOL_SOCKET == cmsg->cmsg_level && SCM_RIGHTS == cmsg->cmsg_type) {
+      if (client->pending_fd >= 0) {
+        close(client->pending_fd);
+      }
+      memcpy(&client->pending_fd, CMSG_DATA(cmsg), sizeof(int));
+    }
+  }
+
+  client->rx_len += (uint32_t)ret;
+  return ret;
+}
+
+static void _client_readable(HbmdClient *client) {
+  HbmdMsgHeader header;
+  uint32_t used, total;
+  int ret;
+
+  while (1) {
+    ret = _client_recv(client);
+    if (0 == ret || (ret < 0 && EAGAIN != errno && EINTR != errno)) {
+      _client_close(client);
+      return;
+    }
+
+    used = 0;
+    while (client->rx_len - used >= sizeof(header)) {
+      memcpy(&header, client->rx_buf + used, sizeof(header));
+      if (header.len > HBMD_PAYLOAD_MAX) {
+        LOGW(TAG, "client %u bad message len=%u", client->id, header.len);
+        _client_close(client);
+        return;
+      }
+
+      total = sizeof(header) + header.len;
+      if (client->rx_len - used < total) {
+        break;
+      }
+
+      _request_process(client, &header, client->rx_buf + used + sizeof(header));
+      used += total;
+    }
+
+    memmove(client->rx_buf, client->rx_buf + used, client->rx_len - used);
+    client->rx_len -= used;
+    if (ret < 0) {
+      return;
+    }
+  }
+}
+
+static void _client_accept() {
+  struct epoll_event ev;
+  HbmdClient *client = NULL;
+  int fd, i;
+
+  fd = accept4(g_hbmd.listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+  if (fd < 0) {
+    return;
+  }
+
+  for (i = 0; i < HBMD_CLIENT_MAX && NULL == client; i++) {
+    if (g_hbmd.clients[i].fd < 0) {
+      client = &g_hbmd.clients[i];
+    }
+  }
+
+  if (NULL == client) {
+    LOGW(TAG, "too many clients, reject");
+    g_hbmd.stats.rejected++;
+    close(fd);
+    return;
+  }
+
+  client->rx_buf = (unsigned char *)uni_malloc(HBMD_MSG_MAX);
+  client->tx     = RingBufferCreate(HBMD_CLIENT_TX_SIZE);
+  if (NULL == client->rx_buf || NULL == client->tx) {
+    LOGE(TAG, OUT_MEM_STRING);
+    goto L_ERROR;
+  }
+
+  ev.events   = EPOLLIN;
+  ev.data.u32 = (uint32_t)(client - g_hbmd.clients);
+  if (0 != epoll_ctl(g_hbmd.epoll_fd, EPOLL_CTL_ADD, fd, &ev)) {
+    goto L_ERROR;
+  }
+
+  memset(client->subs, 0, sizeof(client->subs));
+  client->rx_len     = 0;
+  client->pending_fd = -1;
+  client->shm        = NULL;
+  client->tx_armed   = 0;
+  uni_mutex_lock(&g_hbmd.mutex);
+  client->id = ++g_hbmd.next_id;
+  client->fd = fd;
+  g_hbmd.stats.clients++;
+  g_hbmd.stats.accepted++;
+  uni_mutex_unlock(&g_hbmd.mutex);
+  LOGT(TAG, "client %u connected", client->id);
+  return;
+
+L_ERROR:
+  uni_free(client->rx_buf);
+  client->rx_buf = NULL;
+  if (NULL != client->tx) {
+    RingBufferDestroy(client->tx);
+    client->tx = NULL;
+  }
+  close(fd);
+}
+
+static void* _server(void *args) {
+  struct epoll_event events[HBMD_CLIENT_MAX + 2];
+  HbmdClient *client;
+  uint64_t value;
+  int n, i;
+
+  while (g_hbmd.is_running) {
+    n = epoll_wait(g_hbmd.epoll_fd, events, sizeof(events) / sizeof(events[0]), -1);
+    for (i = 0; i < n && g_hbmd.is_running; i++) {
+      if (HBMD_EV_LISTEN == events[i].data.u32) {
+        _client_accept();
+      } else if (HBMD_EV_WAKE == events[i].data.u32) {
+        if (sizeof(value) != read(g_hbmd.wake_fd, &value, sizeof(value))) {
+          continue;
+        }
+      } else {
+        client = &g_hbmd.clients[events[i].data.u32];
+        if (client->fd >= 0 && (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR))) {
+          _client_readable(client);
+        }
+      }
+    }
+
+    /* results and fanned out packets, also remainder of EPOLLOUT */
+    _flush_all();
+  }
+
+  for (i = 0; i < HBMD_CLIENT_MAX; i++) {
+    if (g_hbmd.clients[i].fd >= 0) {
+      _client_close(&g_hbmd.clients[i]);
+    }
+  }
+
+  uni_sem_signal(&g_hbmd.sem_thread_exit_sync);
+  return NULL;
+}
+
+static int _listen(const char *path) {
+  struct sockaddr_un addr;
+
+  if (strlen(path) >= sizeof(addr.sun_path)) {
+    LOGE(TAG, "socket path too long %s", path);
+    return -1;
+  }
+
+  MZERO(&addr);
+  addr.sun_family = AF_UNIX;
+  snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", path);
+  snprintf(g_hbmd.path, sizeof(g_hbmd.path), "%s", path);
+  unlink(path);
+
+  g_hbmd.listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (g_hbmd.listen_fd < 0 ||
+      0 != bind(g_hbmd.listen_fd, (struct sockaddr *)&addr, sizeof(addr)) ||
+      0 != listen(g_hbmd.listen_fd, HBMD_CLIENT_MAX)) {
+    LOGE(TAG, "listen %s failed[%s]", path, strerror(errno));
+    return -1;
+  }
+
+  return 0;
+}
+
+static int _epoll_add(int fd, uint32_t data) {
+  struct epoll_event ev;
+  ev.events   = EPOLLIN;
+  ev.data.u32 = data;
+  return epoll_ctl(g_hbmd.epoll_fd, EPOLL_CTL_ADD, fd, &ev);
+}
+
+static void _free_all() {
+  if (NULL != g_hbmd.send_queue) {
+    EventListDestroy(g_hbmd.send_queue);
+    g_hbmd.send_queue = NULL;
+  }
+
+  if (NULL != g_hbmd.audio_queue) {
+    EventListDestroy(g_hbmd.audio_queue);
+    g_hbmd.audio_queue = NULL;
+  }
+
+  if (g_hbmd.listen_fd >= 0) {
+    close(g_hbmd.listen_fd);
+    g_hbmd.listen_fd = -1;
+    unlink(g_hbmd.path);
+  }
+
+  if (g_hbmd.epoll_fd >= 0) {
+    close(g_hbmd.epoll_fd);
+    g_hbmd.epoll_fd = -1;
+  }
+
+  if (g_hbmd.wake_fd >= 0) {
+    close(g_hbmd.wake_fd);
+    g_hbmd.wake_fd = -1;
+  }
+
+  uni_mutex_free(&g_hbmd.mutex);
+  uni_sem_free(&g_hbmd.sem_thread_exit_sync);
+}
+
+int HbmdStart(const char *path) {
+  int i;
+
+  if (g_hbmd.is_running) {
+    return -1;
+  }
+
+  uni_mutex_new(&g_hbmd.mutex);
+  uni_sem_new(&g_hbmd.sem_thread_exit_sync, 0);
+  MZERO(&g_hbmd.stats);
+  memset(g_hbmd.sub_cnt, 0, sizeof(g_hbmd.sub_cnt));
+  for (i = 0; i < HBMD_CLIENT_MAX; i++) {
+    g_hbmd.clients[i].fd = -1;
+  }
+
+  /* a client gone mid write must not kill the daemon */
+  signal(SIGPIPE, SIG_IGN);
+  g_hbmd.epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+  g_hbmd.wake_fd  = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+  if (g_hbmd.epoll_fd < 0 || g_hbmd.wake_fd < 0 || 0 != _listen(path) ||
+      0 != _epoll_add(g_hbmd.listen_fd, HBMD_EV_LISTEN) ||
+      0 != _epoll_add(g_hbmd.wake_fd, HBMD_EV_WAKE)) {
+    LOGE(TAG, "create server failed[%s]", strerror(errno));
+    goto L_ERROR;
+  }
+
+  /* control and audio apart, a playback lasting seconds never delays a command */
+  g_hbmd.send_queue  = EventListCreate(_send_job, HBMD_STACK_SIZE);
+  g_hbmd.audio_queue = EventListCreate(_audio_job, HBMD_STACK_SIZE);
+  if (NULL == g_hbmd.send_queue || NULL == g_hbmd.audio_queue) {
+    LOGE(TAG, "create send queue failed");
+    goto L_ERROR;
+  }
+
+  g_hbmd.is_running = 1;
+  if (OK != uni_thread_new(TAG, _server, NULL, HBMD_STACK_SIZE)) {
+    LOGE(TAG, "create server thread failed");
+    g_hbmd.is_running = 0;
+    goto L_ERROR;
+  }
+
+  LOGT(TAG, "hbmd on %s", path);
+  return 0;
+
+L_ERROR:
+  _free_all();
+  return -1;
+}
+
+void HbmdStop(void) {
+  if (!g_hbmd.is_running) {
+    return;
+  }
+
+  g_hbmd.is_running = 0;
+  _wake();
+  uni_sem_wait(&g_hbmd.sem_thread_exit_sync, UNI_WAIT_FOREVER);
+  _free_all();
+}
+
+int HbmdGetStats(HbmdStats *stats) {
+  if (!g_hbmd.is_running || NULL == stats) {
+    return -1;
+  }
+
+  uni_mutex_lock(&g_hbmd.mutex);
+  *stats = g_hbmd.stats;
+  uni_mutex_unlock(&g_hbmd.mutex);
+  return 0;
+}
@@ -0,0 +1,314 @@
+/**************************************************************************
+ * Copyright (C) 2020-2020  Unisound
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ **************************************************************************
+ *
+ * Description : uni_hbmd_client.c
+ * Author      : junlon2006@163.com
+ * Date        : 2020.09.04
+ *
+ **************************************************************************/
+#define _GNU_SOURCE  /* memfd_create, F_ADD_SEALS */
+#include "uni_hbmd_client.h"
+#include "uni_hbmd_protocol.h"
+#include "uni_log.h"
+#include "porting.h"
+#include "errcode.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#define TAG "hbmd_client"
+
+#define HBMD_CLIENT_STACK_SIZE  (32 * 1024)
+
+typedef struct {
+  int               fd;
+  HbmdPacketHandler handler;
+  void              *ctx;
+  char              *rx_payload;
+  char              *audio;       /* memfd mapping shared with daemon */
+  uint32_t          audio_size;
+  uni_mutex_t       request_mutex; /* one request outstanding */
+  uni_sem_t         sem_result;
+  uint32_t          seq;
+  int32_t           result;
+  int               closed;        /* reader gone, requests fail fast */
+  uni_sem_t         sem_thread_exit_sync;
+} HbmdClient;
+
+static int _read_full(int fd, void *buf, uint32_t len) {
+  uint32_t done = 0;
+  int ret;
+
+  while (done < len) {
+    ret = (int)read(fd, (char *)buf + done, len - done);
+    if (ret <= 0) {
+      if (ret < 0 && EINTR == errno) {
+        continue;
+      }
+      return -1;
+    }
+    done += (uint32_t)ret;
+  }
+
+  return 0;
+}
+
+static void* _reader(void *args) {
+  HbmdClient *client = (HbmdClient *)args;
+  HbmdMsgHeader header;
+
+  while (1) {
+    if (0 != _read_full(client->fd, &header, sizeof(header)) ||
+        header.len > HBMD_PAYLOAD_MAX ||
+        0 != _read_full(client->fd, client->rx_payload, header.len)) {
+      break;
+    }
+
+    if (HBMD_MSG_PACKET == header.type) {
+      if (NULL != client->handler) {
+        client->handler(header.cmd, client->rx_payload, header.len, client->ctx);
+      }
+    } else if (HBMD_MSG_RESULT == header.type && header.seq == client->seq) {
+      client->result = header.result;
+      uni_sem_signal(&client->sem_result);
+    }
+  }
+
+  __atomic_store_n(&client->closed, 1, __ATOMIC_RELEASE);
+  /* wake request waiting for a result which never comes */
+  uni_sem_signal(&client->sem_result);
+  uni_sem_signal(&client->sem_thread_exit_sync);
+  return NULL;
+}
+
+/* fd, if any, goes as SCM_RIGHTS with the message */
+static int _request(HbmdClient *client, HbmdMsgType type, uint32_t cmd,
+                    const void *payload, uint32_t len, int fd) {
+  char control[CMSG_SPACE(sizeof(int))];
+  struct cmsghdr *cmsg;
+  HbmdMsgHeader header;
+  struct msghdr msg;
+  struct iovec iov[2];
+  int ret = -1;
+
+  if (NULL == client || len > HBMD_PAYLOAD_MAX) {
+    return -1;
+  }
+
+  uni_mutex_lock(&client->request_mutex);
+  if (__atomic_load_n(&client->closed, __ATOMIC_ACQUIRE)) {
+    goto L_END;
+  }
+
+  MZERO(&header);
+  header.type = (uint16_t)type;
+  header.cmd  = (uint16_t)cmd;
+  header.len  = len;
+  header.seq  = ++client->seq;
+
+  iov[0].iov_base = &header;
+  iov[0].iov_len  = sizeof(header);
+  iov[1].iov_base = (void *)payload;
+  iov[1].iov_len  = len;
+  MZERO(&msg);
+  msg.msg_iov    = iov;
+  msg.msg_iovlen = len > 0 ? 2 : 1;
+  if (fd >= 0) {
+    memset(control, 0, sizeof(control));
+    msg.msg_control    = control;
+    msg.msg_controllen = sizeof(control);
+    cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type  = SCM_RIGHTS;
+    cmsg->cmsg_len   = CMSG_LEN(sizeof(int));
+    memcpy(CMSG_DATA(cmsg), &fd, sizeof(int));
+  }
+
+  /* blocking socket, a short send only on error */
+  if ((ssize_t)(sizeof(header) + len) != sendmsg(client->fd, &msg, MSG_NOSIGNAL)) {
+    LOGE(TAG, "send request failed[%s]", strerror(errno));
+    goto L_END;
+  }
+
+  uni_sem_wait(&client->sem_result, UNI_WAIT_FOREVER);
+  if (!__atomic_load_n(&client->closed, __ATOMIC_ACQUIRE)) {
+    ret = client->result;
+  }
+
+L_END:
+  uni_mutex_unlock(&client->request_mutex);
+  return ret;
+}
+
+static void _free_all(HbmdClient *client) {
+  if (client->fd >= 0) {
+    close(client->fd);
+  }
+
+  if (NULL != client->audio) {
+    munmap(client->audio, client->audio_size);
+  }
+
+  uni_free(client->rx_payload);
+  uni_mutex_free(&client->request_mutex);
+  uni_sem_free(&client->sem_result);
+  uni_sem_free(&client->sem_thread_exit_sync);
+  uni_free(client);
+}
+
+HbmdClientHandle HbmdClientConnect(const char *path, HbmdPacketHandler handler, void *ctx) {
+  struct sockaddr_un addr;
+  HbmdClient *client;
+
+  if (NULL == path || strlen(path) >= sizeof(addr.sun_path)) {
+    LOGE(TAG, "invalid socket path");
+    return NULL;
+  }
+
+  if (NULL == (client = (HbmdClient *)uni_calloc(1, sizeof(HbmdClient)))) {
+    LOGE(TAG, OUT_MEM_STRING);
+    return NULL;
+  }
+
+  client->handler = handler;
+  client->ctx     = ctx;
+  uni_mutex_new(&client->request_mutex);
+  uni_sem_new(&client->sem_result, 0);
+  uni_sem_new(&client->sem_thread_exit_sync, 0);
+
+  MZERO(&addr);
+  addr.sun_family = AF_UNIX;
+  snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", path);
+  client->fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (client->fd < 0 || 0 != connect(client->fd, (struct sockaddr *)&addr, sizeof(addr))) {
+    LOGE(TAG, "connect %s failed[%s]", path, strerror(errno));
+    goto L_ERROR;
+  }
+
+  if (NULL == (client->rx_payload = (char *)uni_malloc(HBMD_PAYLOAD_MAX))) {
+    LOGE(TAG, OUT_MEM_STRING);
+    goto L_ERROR;
+  }
+
+  if (OK != uni_thread_new(TAG, _reader, client, HBMD_CLIENT_STACK_SIZE)) {
+    LOGE(TAG, "create reader thread failed");
+    goto L_ERROR;
+  }
+
+  return client;
+
+L_ERROR:
+  _free_all(client);
+  return NULL;
+}
+
+void HbmdClientClose(HbmdClientHandle handle) {
+  HbmdClient *client = (HbmdClient *)handle;
+  if (NULL == client) {
+    return;
+  }
+
+  /* reader sees eof and exits */
+  shutdown(client->fd, SHUT_RDWR);
+  uni_sem_wait(&client->sem_thread_exit_sync, UNI_WAIT_FOREVER);
+  _free_all(client);
+}
+
+int HbmdClientSubscribe(HbmdClientHandle handle, uint32_t cmd) {
+  return _request((HbmdClient *)handle, HBMD_MSG_SUBSCRIBE, cmd, NULL, 0, -1);
+}
+
+int HbmdClientUnsubscribe(HbmdClientHandle handle, uint32_t cmd) {
+  return _request((HbmdClient *)handle, HBMD_MSG_UNSUBSCRIBE, cmd, NULL, 0, -1);
+}
+
+int HbmdClientSend(HbmdClientHandle handle, uint32_t cmd, char *payload, uint32_t len) {
+  return _request((HbmdClient *)handle, HBMD_MSG_SEND, cmd, payload, len, -1);
+}
+
+char* HbmdClientAudioBuffer(HbmdClientHandle handle, uint32_t size) {
+  HbmdClient *client = (HbmdClient *)handle;
+  void *map;
+  int fd;
+
+  if (NULL == client || 0 == size) {
+    return NULL;
+  }
+
+  /* size sealed, daemon refuses a memfd that could still be truncated under its mapping */
+  if ((fd = memfd_create("hbmd_audio", MFD_CLOEXEC | MFD_ALLOW_SEALING)) < 0 ||
+      0 != ftruncate(fd, size) || 0 != fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW)) {
+    LOGE(TAG, "create memfd failed[%s]", strerror(errno));
+    goto L_ERROR;
+  }
+
+  map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (MAP_FAILED == map) {
+    LOGE(TAG, "mmap memfd failed[%s]", strerror(errno));
+    goto L_ERROR;
+  }
+
+  /* daemon maps its own view, the fd is not needed once passed */
+  if (0 != _request(client, HBMD_MSG_AUDIO_SHM, 0, &size, sizeof(size), fd)) {
+    LOGE(TAG, "daemon refused audio shm");
+    munmap(map, size);
+    goto L_ERROR;
+  }
+
+  close(fd);
+  if (NULL != client->audio) {
+    munmap(client->audio, client->audio_size);
+  }
+
+  client->audio      = (char *)map;
+  client->audio_size = size;
+  return client->audio;
+
+L_ERROR:
+  if (fd >= 0) {
+    close(fd);
+  }
+  return NULL;
+}
+
+int HbmdClientPlay(HbmdClientHandle handle, uint32_t offset, uint32_t len) {
+  HbmdAudioPlay play = {offset, len};
+  return _request((HbmdClient *)handle, HBMD_MSG_AUDIO_PLAY, 0, &play, sizeof(play), -1);
+}
+
+ShmRingHandle HbmdClientAudioRing(HbmdClientHandle handle, uint32_t size) {
+  ShmRingHandle ring;
+
+  if (NULL == handle || NULL == (ring = ShmRingCreate(size, HBMD_AUDIO_RING_HEADROOM))) {
+    return NULL;
+  }
+
+  if (0 != _request((HbmdClient *)handle, HBMD_MSG_AUDIO_RING, 0, NULL, 0, ShmRingFd(ring))) {
+    LOGE(TAG, "daemon refused audio ring");
+    ShmRingClose(ring);
+    return NULL;
+  }
+
+  return ring;
+}
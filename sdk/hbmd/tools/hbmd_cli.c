@@ -0,0 +1,275 @@
+/**************************************************************************
+ * Copyright (C) 2020-2020  Unisound
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ **************************************************************************
+ *
+ * Description : hbmd_cli.c
+ * Author      : junlon2006@163.com
+ * Date        : 2020.09.02
+ *
+ **************************************************************************/
+/*
+ * usage: HBMD_CLI [options] socket
+ *
+ * client of the daemon started by APP option daemon=socket
+ *   -s cmd       subscribe cmd, repeatable, packets are printed until -t expires
+ *   -c cmd       send cmd with payload of -x
+ *   -x hex       payload of -c, e.g. 0102ff
+ *   -p pcm       play 16KHz 16bit pcm file through shared memory
+ *   -n loops     play pcm this many times from the same shared memory
+ *   -R kb        stream -p pcm through a shared memory ring of this size instead,
+ *                file is read straight into the ring, loops played back to back
+ *   -t seconds   stay connected this long after requests, default 0
+ */
+#include "uni_hbmd_client.h"
+#include "uni_log.h"
+#include "porting.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#define CLI_SUBSCRIBE_MAX       (32)
+#define CLI_RING_WRITE_TIMEOUT  (5 * 1000)
+#define CLI_RING_DRAIN_TIMEOUT  (60 * 1000)
+
+typedef struct {
+  const char *path;
+  uint32_t   subs[CLI_SUBSCRIBE_MAX];
+  uint32_t   sub_cnt;
+  int        send_cmd;
+  char       payload[256];
+  uint32_t   payload_len;
+  const char *pcm;
+  uint32_t   loops;
+  uint32_t   ring_kb;
+  uint32_t   seconds;
+} CliConfig;
+
+static CliConfig g_config = {NULL, {0}, 0, -1};
+static uint64_t  g_packets = 0;
+
+static void _on_packet(uint32_t cmd, char *payload, uint32_t len, void *ctx) {
+  uint32_t i;
+
+  __atomic_add_fetch(&g_packets, 1, __ATOMIC_RELAXED);
+  printf("[hbmd_cli] packet cmd=%u len=%u", cmd, len);
+  for (i = 0; i < uni_min(len, 16); i++) {
+    printf("%s%02x", 0 == i ? " " : "", (unsigned char)payload[i]);
+  }
+  printf("%s\n", len > 16 ? "..." : "");
+  fflush(stdout);
+}
+
+static int _hex_parse(const char *hex) {
+  unsigned int byte;
+  size_t len = strlen(hex);
+
+  if (len % 2 || len / 2 > sizeof(g_config.payload)) {
+    return -1;
+  }
+
+  for (g_config.payload_len = 0; g_config.payload_len < len / 2; g_config.payload_len++) {
+    if (1 != sscanf(hex + g_config.payload_len * 2, "%2x", &byte)) {
+      return -1;
+    }
+    g_config.payload[g_config.payload_len] = (char)byte;
+  }
+
+  return 0;
+}
+
+static int _options_parse(int argc, char *argv[]) {
+  int opt;
+
+  g_config.loops = 1;
+  while (-1 != (opt = getopt(argc, argv, "s:c:x:p:n:R:t:"))) {
+    switch (opt) {
+    case 's':
+      if (g_config.sub_cnt == CLI_SUBSCRIBE_MAX) {
+        goto L_USAGE;
+      }
+      g_config.subs[g_config.sub_cnt++] = (uint32_t)atoi(optarg);
+      break;
+    case 'c': g_config.send_cmd = atoi(optarg); break;
+    case 'x':
+      if (0 != _hex_parse(optarg)) {
+        goto L_USAGE;
+      }
+      break;
+    case 'p': g_config.pcm = optarg; break;
+    case 'n': g_config.loops = (uint32_t)atoi(optarg); break;
+    case 'R': g_config.ring_kb = (uint32_t)atoi(optarg); break;
+    case 't': g_config.seconds = (uint32_t)atoi(optarg); break;
+    default:
+      goto L_USAGE;
+    }
+  }
+
+  if (optind != argc - 1) {
+    goto L_USAGE;
+  }
+
+  g_config.path = argv[optind];
+  return 0;
+
+L_USAGE:
+  fprintf(stderr, "usage: %s [-s cmd]... [-c cmd [-x hex]] [-p pcm [-n loops]] "
+          "[-R kb] [-t seconds] socket\n", argv[0]);
+  return -1;
+}
+
+static int _play(HbmdClientHandle client) {
+  int64_t start_ms;
+  FILE *fp;
+  char *buf;
+  long size;
+  uint32_t i;
+  int ret = -1;
+
+  if (NULL == (fp = fopen(g_config.pcm, "rb"))) {
+    fprintf(stderr, "open %s failed\n", g_config.pcm);
+    return -1;
+  }
+
+  fseek(fp, 0, SEEK_END);
+  size = ftell(fp);
+  fseek(fp, 0, SEEK_SET);
+
+  /* pcm read once into shared memory, every loop is sent from there */
+  if (size <= 0 || NULL == (buf = HbmdClientAudioBuffer(client, (uint32_t)size)) ||
+      (size_t)size != fread(buf, 1, (size_t)size, fp)) {
+    fprintf(stderr, "load %s into shared memory failed\n", g_config.pcm);
+    goto L_END;
+  }
+
+  for (i = 0; i < g_config.loops; i++) {
+    start_ms = uni_get_clock_time_ms();
+    ret = HbmdClientPlay(client, 0, (uint32_t)size);
+    printf("[hbmd_cli] play %s %ld bytes ret=%d cost=%lldms\n", g_config.pcm, size, ret,
+           (long long)(uni_get_clock_time_ms() - start_ms));
+    if (0 != ret) {
+      break;
+    }
+  }
+
+L_END:
+  fclose(fp);
+  return ret;
+}
+
+/* file read straight into ring, daemon frames it in place */
+static int _stream(HbmdClientHandle client) {
+  ShmRingHandle ring;
+  ShmRingStats stats;
+  int64_t start_ms;
+  uint32_t room, i;
+  int fd, len = 0, ret;
+  char *p;
+
+  if ((fd = open(g_config.pcm, O_RDONLY)) < 0) {
+    fprintf(stderr, "open %s failed\n", g_config.pcm);
+    return -1;
+  }
+
+  if (NULL == (ring = HbmdClientAudioRing(client, g_config.ring_kb * 1024))) {
+    fprintf(stderr, "create audio ring failed\n");
+    close(fd);
+    return -1;
+  }
+
+  start_ms = uni_get_clock_time_ms();
+  for (i = 0; i < g_config.loops; i++) {
+    lseek(fd, 0, SEEK_SET);
+    do {
+      if (NULL == (p = ShmRingWriteBegin(ring, &room, CLI_RING_WRITE_TIMEOUT))) {
+        len = -1;
+        break;
+      }
+
+      if ((len = (int)read(fd, p, room)) > 0) {
+        ShmRingWriteEnd(ring, (uint32_t)len);
+      }
+    } while (len > 0);
+
+    if (len < 0) {
+      break;
+    }
+  }
+
+  ShmRingFinish(ring);
+  ret = (len < 0) ? -1 : ShmRingDrain(ring, CLI_RING_DRAIN_TIMEOUT);
+  ShmRingGetStats(ring, &stats);
+  printf("[hbmd_cli] stream %s x%u, bytes=%llu played=%llu ret=%d cost=%lldms, "
+         "waits producer=%u consumer=%u\n", g_config.pcm, g_config.loops,
+         (unsigned long long)stats.written, (unsigned long long)stats.read, ret,
+         (long long)(uni_get_clock_time_ms() - start_ms), stats.producer_waits,
+         stats.consumer_waits);
+
+  ShmRingClose(ring);
+  close(fd);
+  return ret;
+}
+
+int main(int argc, char *argv[]) {
+  HbmdClientHandle client;
+  uint32_t i;
+  int send_ret, ret = 0;
+
+  if (0 != _options_parse(argc, argv)) {
+    return 2;
+  }
+
+  LogLevelSet(N_LOG_ERROR);
+  if (NULL == (client = HbmdClientConnect(g_config.path, _on_packet, NULL))) {
+    fprintf(stderr, "connect %s failed\n", g_config.path);
+    return 2;
+  }
+
+  for (i = 0; i < g_config.sub_cnt; i++) {
+    if (0 != HbmdClientSubscribe(client, g_config.subs[i])) {
+      fprintf(stderr, "subscribe cmd=%u failed\n", g_config.subs[i]);
+      ret = 1;
+    }
+  }
+
+  if (g_config.send_cmd >= 0) {
+    send_ret = HbmdClientSend(client, (uint32_t)g_config.send_cmd, g_config.payload,
+                              g_config.payload_len);
+    printf("[hbmd_cli] send cmd=%d len=%u ret=%d\n", g_config.send_cmd, g_config.payload_len,
+           send_ret);
+    ret |= (0 != send_ret);
+  }
+
+  if (NULL != g_config.pcm &&
+      0 != (g_config.ring_kb > 0 ? _stream(client) : _play(client))) {
+    ret = 1;
+  }
+
+  if (g_config.seconds > 0) {
+    uni_msleep(g_config.seconds * 1000);
+  }
+
+  HbmdClientClose(client);
+  if (g_config.sub_cnt > 0) {
+    printf("[hbmd_cli] packets=%llu\n", (unsigned long long)g_packets);
+  }
+
+  return ret;
+}
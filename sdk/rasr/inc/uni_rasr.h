@@ -0,0 +1,203 @@
+/**************************************************************************
+ * Copyright (C) 2020-2020  Unisound
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ **************************************************************************
+ *
+ * Description : uni_rasr.h
+ * Author      : junlon2006@163.com
+ * Date        : 2020.08.05
+ *
+ **************************************************************************/
+#ifndef SDK_RASR_INC_UNI_RASR_H_
+#define SDK_RASR_INC_UNI_RASR_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+#define RASR_DEFAULT_CHUNK_BYTES  (3200) /* 16K 16bit PCM 100ms */
+#define RASR_SESSION_MAX          (4)    /* 同时打开的会话数，超出时淘汰最早打开的会话 */
+#define RASR_SESSION_HISTORY      (8)    /* 保留最近关闭的会话信息，迟到数据按id直接丢弃 */
+
+/**
+ * 上行音频sink，云端ASR对接由用户实现，SDK内置file、unix socket两种sink供调试
+ * open/close在会话起止时回调，write传入解码后的16bit PCM，每次长度为chunk_bytes（会话尾包除外）
+ */
+typedef struct {
+  void *ctx;
+  int  (*open)(void *ctx, uint32_t session_id);
+  int  (*write)(void *ctx, uint32_t session_id, const char *pcm, int len);
+  void (*close)(void *ctx, uint32_t session_id);
+} RasrSink;
+
+/**
+ * 可选的本地端点检测，对解码后的PCM按10ms帧计算能量与过零率：
+ * 语音之后的静音先缓存不转发，静音持续endpoint_ms即提前结束上行（关闭sink），不必等待蜂鸟M的stop；
+ * 会话结束时尾部静音只保留keep_tail_ms，其余裁掉
+ */
+typedef struct {
+  int      enable;
+  uint32_t endpoint_ms;   /* 尾部静音达到该时长判定说话结束，0使用默认600ms */
+  uint32_t min_speech_ms; /* 有效语音最短时长，更短的视为噪声，0使用默认200ms */
+  uint32_t keep_tail_ms;  /* 保留的尾部静音，0使用默认150ms */
+  uint32_t energy_floor;  /* 语音帧最低均方能量，0使用默认值（约-50dBFS） */
+} RasrVadConfig;
+
+typedef struct {
+  uint32_t      chunk_bytes; /* 网络发送粒度，PCM字节数，0使用默认值 */
+  RasrVadConfig vad;
+} RasrConfig;
+
+typedef enum {
+  RASR_SESSION_EVENT_OPENED = 0,
+  RASR_SESSION_EVENT_CLOSED,   /* RasrSessionStop正常关闭 */
+  RASR_SESSION_EVENT_EVICTED,  /* 会话表满被新会话淘汰，或RasrFinal/更换sink时强制关闭 */
+  RASR_SESSION_EVENT_ENDPOINT, /* 本地端点检测判定说话结束，上行已结束，会话仍需RasrSessionStop关闭 */
+} RasrSessionEvent;
+
+typedef struct {
+  uint32_t session_id;
+  long     start_ms;
+  uint32_t duration_ms;  /* 打开中的会话为截至当前的时长 */
+  uint32_t packets;
+  uint32_t adpcm_bytes;
+  uint32_t pcm_bytes;    /* 解码输出 */
+  uint32_t sink_bytes;   /* 成功写入sink */
+  uint32_t endpoint_ms;  /* 端点在会话音频中的位置，0表示未检测到 */
+  uint32_t saved_ms;     /* 端点检测到会话stop的时间差，即提前结束上行节省的时间 */
+  uint32_t trimmed_bytes;/* 裁掉未转发的静音及端点之后的音频 */
+} RasrSessionInfo;
+
+/* 在调用Rasr接口的线程回调，回调内可以调用Rasr接口 */
+typedef void (*RasrSessionEventHandler)(RasrSessionEvent event, const RasrSessionInfo *info,
+                                        void *ctx);
+
+typedef struct {
+  /* decode stage */
+  uint64_t decode_packets;
+  uint64_t decode_in_bytes;
+  uint64_t decode_out_bytes;
+  uint64_t decode_us;
+  /* aggregation stage, first packet in chunk -> chunk ready */
+  uint64_t chunks;
+  uint64_t aggregate_us;
+  /* sink stage */
+  uint64_t sink_writes;
+  uint64_t sink_bytes;
+  uint64_t sink_errors;
+  uint64_t sink_us;
+  uint64_t sink_max_us;
+  /* session table */
+  uint64_t sessions_opened;
+  uint64_t sessions_closed;
+  uint64_t sessions_evicted;
+  uint64_t late_packets;    /* 属于已关闭会话的数据 */
+  uint64_t unknown_packets; /* 会话id未知 */
+  /* endpoint detection */
+  uint64_t vad_endpoints;
+  uint64_t vad_saved_ms;
+  uint64_t vad_trimmed_bytes;
+} RasrStats;
+
+/**
+ * @brief RASR上行pipeline初始化，重复调用无效，需要自定义配置时在ChnlInit之前调用
+ * @param config NULL使用默认配置，端点检测默认关闭
+ * @return 0 成功，-1 失败
+ */
+int RasrInit(RasrConfig *config);
+
+/**
+ * @brief RASR上行pipeline释放
+ * @param void
+ * @return void
+ */
+void RasrFinal(void);
+
+/**
+ * @brief 注册上行sink，sink对象由调用者持有，NULL表示注销
+ * @param sink
+ * @return void
+ */
+void RasrRegisterSink(RasrSink *sink);
+
+/**
+ * @brief 注册会话生命周期事件回调，NULL表示注销
+ * @param handler
+ * @param ctx
+ * @return void
+ */
+void RasrRegisterEventHandler(RasrSessionEventHandler handler, void *ctx);
+
+/**
+ * @brief 会话开始，每个会话独立的解码状态与聚合buffer，会话id已打开时忽略
+ * @param session_id vui_session_id
+ * @return 0 成功，-1 失败
+ */
+int RasrSessionStart(uint32_t session_id);
+
+/**
+ * @brief 会话ADPCM数据输入
+ * @param session_id
+ * @param adpcm
+ * @param len
+ * @return 0 成功，-1 会话未打开（已关闭的迟到数据或未知会话，直接丢弃）
+ */
+int RasrSessionFeed(uint32_t session_id, const char *adpcm, int len);
+
+/**
+ * @brief 会话结束，flush剩余数据并关闭sink
+ * @param session_id
+ * @return 0 成功，-1 会话未打开
+ */
+int RasrSessionStop(uint32_t session_id);
+
+/**
+ * @brief 获取打开中或最近关闭的会话信息
+ * @param session_id
+ * @param info
+ * @return 0 成功，-1 未找到
+ */
+int RasrGetSessionInfo(uint32_t session_id, RasrSessionInfo *info);
+
+/**
+ * @brief 获取各stage统计
+ * @param stats
+ * @return void
+ */
+void RasrGetStats(RasrStats *stats);
+
+/**
+ * @brief 本地文件sink，每个会话写入<dir>/rasr_<session_id>.pcm，最多同时打开RASR_SESSION_MAX个会话
+ * @param dir
+ * @return sink，失败返回NULL
+ */
+RasrSink* RasrFileSinkCreate(const char *dir);
+void      RasrFileSinkDestroy(RasrSink *sink);
+
+/**
+ * @brief unix socket sink，每个会话建立一次连接，流式写入PCM
+ * @param path unix socket路径
+ * @return sink，失败返回NULL
+ */
+RasrSink* RasrSocketSinkCreate(const char *path);
+void      RasrSocketSinkDestroy(RasrSink *sink);
+
+#ifdef __cplusplus
+}
+#endif
+#endif  // SDK_RASR_INC_UNI_RASR_H_
@@ -0,0 +1,78 @@
+/**************************************************************************
+ * Copyright (C) 2020-2020  Unisound
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ **************************************************************************
+ *
+ * Description : uni_vad.h
+ * Author      : junlon2006@163.com
+ * Date        : 2020.08.14
+ *
+ **************************************************************************/
+#ifndef SDK_RASR_INC_UNI_VAD_H_
+#define SDK_RASR_INC_UNI_VAD_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+#define VAD_SAMPLE_RATE      (16000)
+#define VAD_FRAME_MS         (10)
+#define VAD_FRAME_SAMPLES    (VAD_SAMPLE_RATE / 1000 * VAD_FRAME_MS)
+#define VAD_BYTES_PER_MS     (VAD_SAMPLE_RATE / 1000 * sizeof(short))
+
+typedef struct {
+  uint32_t energy; /* mean square of samples */
+  uint32_t zcr;    /* zero crossings per VAD_FRAME_SAMPLES */
+} VadFeature;
+
+typedef struct {
+  uint32_t energy_floor; /* speech frame energy never below this */
+  uint32_t noise;        /* tracked noise energy */
+  uint32_t frames;
+} Vad;
+
+/**
+ * @brief energy and zero crossing rate of one frame, plain loops the compiler vectorizes
+ * @param pcm 16bit mono
+ * @param samples
+ * @param feature
+ * @return void
+ */
+void VadFrameFeature(const short *pcm, int samples, VadFeature *feature);
+
+/**
+ * @brief reset state
+ * @param vad
+ * @param energy_floor
+ * @return void
+ */
+void VadReset(Vad *vad, uint32_t energy_floor);
+
+/**
+ * @brief classify one frame, adapts noise level on non speech frames
+ * @param vad
+ * @param pcm
+ * @param samples not more than VAD_FRAME_SAMPLES
+ * @return 1 speech, 0 silence
+ */
+int VadFrameIsSpeech(Vad *vad, const short *pcm, int samples);
+
+#ifdef __cplusplus
+}
+#endif
+#endif  // SDK_RASR_INC_UNI_VAD_H_
@@ -0,0 +1,611 @@
+/**************************************************************************
+ * Copyright (C) 2020-2020  Unisound
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ **************************************************************************
+ *
+ * Description : uni_rasr.c
+ * Author      : junlon2006@163.com
+ * Date        : 2020.08.05
+ *
+ **************************************************************************/
+#include "uni_rasr.h"
+#include "uni_adpcm.h"
+#include "uni_vad.h"
+#include "uni_log.h"
+#include "porting.h"
+
+#define TAG "rasr"
+
+#define VAD_DEFAULT_ENDPOINT_MS    (600)
+#define VAD_DEFAULT_MIN_SPEECH_MS  (200)
+#define VAD_DEFAULT_KEEP_TAIL_MS   (150)
+#define VAD_DEFAULT_ENERGY_FLOOR   (10000) /* about -50dBFS */
+#define PENDING_EVENT_MAX          (RASR_SESSION_MAX * 2) /* closing all may raise endpoint and evicted per session */
+
+typedef struct {
+  int             active;
+  uint64_t        open_seq;      /* eviction order */
+  RasrSessionInfo info;
+  unsigned char   *adpcm;        /* aggregation buffer, chunk_bytes / 4 */
+  uint32_t        adpcm_len;
+  AdpcmState      state;
+  int             sink_opened;
+  int64_t         chunk_begin_us;
+  /* endpoint detection */
+  Vad             vad;
+  char            *held;         /* trailing silence not forwarded yet */
+  uint32_t        held_len;
+  int             speech_started;
+  uint32_t        speech_samples;
+  uint64_t        audio_samples;
+  int             endpointed;
+  long            endpoint_wall_ms;
+} RasrSession;
+
+typedef struct {
+  RasrSink                *sink;
+  RasrSessionEventHandler event_handler;
+  void                    *event_ctx;
+  uni_mutex_t             mutex;
+  uint32_t                chunk_bytes;
+  RasrVadConfig           vad;
+  short                   *pcm;  /* decode output of one chunk, shared by sessions */
+  RasrSession             sessions[RASR_SESSION_MAX];
+  uint64_t                open_seq;
+  RasrSessionInfo         history[RASR_SESSION_HISTORY];
+  uint32_t                history_cnt;
+  uint32_t                history_next;
+  RasrStats               stats;
+  int                     inited;
+} Rasr;
+
+/* session events are raised after mutex unlocked */
+typedef struct {
+  RasrSessionEventHandler handler;
+  void                    *ctx;
+  int                     cnt;
+  RasrSessionEvent        event[PENDING_EVENT_MAX];
+  RasrSessionInfo         info[PENDING_EVENT_MAX];
+} PendingEvents;
+
+static Rasr g_rasr = {0};
+
+static uint32_t _adpcm_chunk_bytes() {
+  return ADPCM_BYTES_PER_PCM_BYTES(g_rasr.chunk_bytes);
+}
+
+/* must be called with mutex locked */
+static void _event_push(PendingEvents *events, RasrSessionEvent event, const RasrSessionInfo *info) {
+  if (NULL == events || events->cnt >= PENDING_EVENT_MAX) {
+    return;
+  }
+
+  events->handler = g_rasr.event_handler;
+  events->ctx     = g_rasr.event_ctx;
+  events->event[events->cnt] = event;
+  events->info[events->cnt]  = *info;
+  events->cnt++;
+}
+
+static void _event_raise(PendingEvents *events) {
+  int i;
+  for (i = 0; i < events->cnt && NULL != events->handler; i++) {
+    events->handler(events->event[i], &events->info[i], events->ctx);
+  }
+}
+
+static RasrSession* _session_find(uint32_t session_id) {
+  int i;
+  for (i = 0; i < RASR_SESSION_MAX; i++) {
+    if (g_rasr.sessions[i].active && g_rasr.sessions[i].info.session_id == session_id) {
+      return &g_rasr.sessions[i];
+    }
+  }
+
+  return NULL;
+}
+
+static RasrSessionInfo* _history_find(uint32_t session_id) {
+  uint32_t i;
+  for (i = 0; i < g_rasr.history_cnt; i++) {
+    if (g_rasr.history[i].session_id == session_id) {
+      return &g_rasr.history[i];
+    }
+  }
+
+  return NULL;
+}
+
+static void _history_add(const RasrSessionInfo *info) {
+  g_rasr.history[g_rasr.history_next] = *info;
+  g_rasr.history_next = (g_rasr.history_next + 1) % RASR_SESSION_HISTORY;
+  g_rasr.history_cnt  = uni_min(g_rasr.history_cnt + 1, RASR_SESSION_HISTORY);
+}
+
+static void _sink_write(RasrSession *session, const char *pcm, int len) {
+  int64_t begin, cost;
+  int ret;
+
+  if (NULL == g_rasr.sink || !session->sink_opened || len <= 0) {
+    return;
+  }
+
+  begin = uni_get_clock_time_us();
+  ret   = g_rasr.sink->write(g_rasr.sink->ctx, session->info.session_id, pcm, len);
+  cost  = uni_get_clock_time_us() - begin;
+
+  g_rasr.stats.sink_writes++;
+  g_rasr.stats.sink_us += cost;
+  g_rasr.stats.sink_max_us = uni_max(g_rasr.stats.sink_max_us, (uint64_t)cost);
+  if (0 != ret) {
+    g_rasr.stats.sink_errors++;
+    return;
+  }
+
+  g_rasr.stats.sink_bytes += len;
+  session->info.sink_bytes += len;
+}
+
+static uint32_t _vad_bytes(uint32_t ms) {
+  return ms * VAD_BYTES_PER_MS;
+}
+
+static void _held_flush(RasrSession *session, uint32_t keep) {
+  keep = uni_min(keep, session->held_len);
+  _sink_write(session, session->held, keep);
+  session->info.trimmed_bytes += session->held_len - keep;
+  g_rasr.stats.vad_trimmed_bytes += session->held_len - keep;
+  session->held_len = 0;
+}
+
+/* finalize upstream early, audio after endpoint is not forwarded */
+static void _endpoint(RasrSession *session, PendingEvents *events) {
+  _held_flush(session, _vad_bytes(g_rasr.vad.keep_tail_ms));
+  if (session->sink_opened && NULL != g_rasr.sink) {
+    g_rasr.sink->close(g_rasr.sink->ctx, session->info.session_id);
+  }
+
+  session->sink_opened      = 0;
+  session->endpointed       = 1;
+  session->endpoint_wall_ms = uni_get_clock_time_ms();
+  session->info.endpoint_ms = (uint32_t)(session->audio_samples * 1000 / VAD_SAMPLE_RATE);
+  g_rasr.stats.vad_endpoints++;
+  LOGT(TAG, "session[%u] endpoint at %ums", session->info.session_id, session->info.endpoint_ms);
+  _event_push(events, RASR_SESSION_EVENT_ENDPOINT, &session->info);
+}
+
+/*
+ * forward leading silence and speech as is, hold silence after speech;
+ * speech resumes: forward held silence, held silence reaches endpoint_ms: endpoint
+ */
+static void _vad_route(RasrSession *session, const short *pcm, int samples, PendingEvents *events) {
+  int emit_begin = 0;
+  int i, n;
+
+  for (i = 0; i < samples; i += n) {
+    n = uni_min(VAD_FRAME_SAMPLES, samples - i);
+    session->audio_samples += n;
+
+    if (VadFrameIsSpeech(&session->vad, pcm + i, n)) {
+      if (session->held_len > 0) {
+        _sink_write(session, (const char *)(pcm + emit_begin), (i - emit_begin) * sizeof(short));
+        _held_flush(session, session->held_len);
+        emit_begin = i;
+      }
+
+      session->speech_started = 1;
+      session->speech_samples += n;
+      continue;
+    }
+
+    if (!session->speech_started) {
+      continue;
+    }
+
+    _sink_write(session, (const char *)(pcm + emit_begin), (i - emit_begin) * sizeof(short));
+    memcpy(session->held + session->held_len, pcm + i, n * sizeof(short));
+    session->held_len += n * sizeof(short);
+    emit_begin = i + n;
+
+    if (session->held_len < _vad_bytes(g_rasr.vad.endpoint_ms)) {
+      continue;
+    }
+
+    if (session->speech_samples * 1000 / VAD_SAMPLE_RATE >= g_rasr.vad.min_speech_ms) {
+      _endpoint(session, events);
+      session->info.trimmed_bytes += (samples - emit_begin) * sizeof(short);
+      g_rasr.stats.vad_trimmed_bytes += (samples - emit_begin) * sizeof(short);
+      return;
+    }
+
+    /* too short to be speech, it was noise */
+    _held_flush(session, session->held_len);
+    session->speech_started = 0;
+    session->speech_samples = 0;
+  }
+
+  _sink_write(session, (const char *)(pcm + emit_begin), (samples - emit_begin) * sizeof(short));
+}
+
+static void _route_pcm(RasrSession *session, const short *pcm, int samples, PendingEvents *events) {
+  if (session->endpointed) {
+    session->info.trimmed_bytes += samples * sizeof(short);
+    g_rasr.stats.vad_trimmed_bytes += samples * sizeof(short);
+    return;
+  }
+
+  if (!g_rasr.vad.enable) {
+    _sink_write(session, (const char *)pcm, samples * sizeof(short));
+    return;
+  }
+
+  _vad_route(session, pcm, samples, events);
+}
+
+/* decode the whole aggregated chunk in one pass, then hand it to sink */
+static void _flush_chunk(RasrSession *session, PendingEvents *events) {
+  int64_t begin;
+  int samples;
+
+  if (0 == session->adpcm_len) {
+    return;
+  }
+
+  begin = uni_get_clock_time_us();
+  g_rasr.stats.aggregate_us += begin - session->chunk_begin_us;
+  g_rasr.stats.chunks++;
+
+  samples = AdpcmDecode(&session->state, session->adpcm, session->adpcm_len, g_rasr.pcm);
+  g_rasr.stats.decode_us += uni_get_clock_time_us() - begin;
+  g_rasr.stats.decode_in_bytes  += session->adpcm_len;
+  g_rasr.stats.decode_out_bytes += samples * sizeof(short);
+  session->info.pcm_bytes += samples * sizeof(short);
+  session->adpcm_len = 0;
+
+  _route_pcm(session, g_rasr.pcm, samples, events);
+}
+
+static void _session_close(RasrSession *session, RasrSessionEvent event, PendingEvents *events) {
+  _flush_chunk(session, events);
+  /* trailing silence without endpoint, keep a short tail only */
+  _held_flush(session, _vad_bytes(g_rasr.vad.keep_tail_ms));
+  if (session->endpointed) {
+    session->info.saved_ms = (uint32_t)(uni_get_clock_time_ms() - session->endpoint_wall_ms);
+    g_rasr.stats.vad_saved_ms += session->info.saved_ms;
+  }
+
+  if (session->sink_opened && NULL != g_rasr.sink) {
+    g_rasr.sink->close(g_rasr.sink->ctx, session->info.session_id);
+  }
+
+  session->sink_opened = 0;
+  session->active      = 0;
+  session->info.duration_ms = (uint32_t)(uni_get_clock_time_ms() - session->info.start_ms);
+  _history_add(&session->info);
+
+  if (RASR_SESSION_EVENT_CLOSED == event) {
+    g_rasr.stats.sessions_closed++;
+  } else {
+    g_rasr.stats.sessions_evicted++;
+  }
+
+  LOGT(TAG, "session[%u] %s. duration=%ums, packets=%u, adpcm=%u, pcm=%u, sink=%u, "
+       "endpoint=%ums, saved=%ums, trimmed=%u",
+       session->info.session_id, RASR_SESSION_EVENT_CLOSED == event ? "closed" : "evicted",
+       session->info.duration_ms, session->info.packets, session->info.adpcm_bytes,
+       session->info.pcm_bytes, session->info.sink_bytes, session->info.endpoint_ms,
+       session->info.saved_ms, session->info.trimmed_bytes);
+
+  _event_push(events, event, &session->info);
+}
+
+static void _session_close_all(RasrSessionEvent event, PendingEvents *events) {
+  int i;
+  for (i = 0; i < RASR_SESSION_MAX; i++) {
+    if (g_rasr.sessions[i].active) {
+      _session_close(&g_rasr.sessions[i], event, events);
+    }
+  }
+}
+
+/* free slot, or the earliest opened session when table is full */
+static RasrSession* _session_slot_get(PendingEvents *events) {
+  RasrSession *oldest = NULL;
+  int i;
+
+  for (i = 0; i < RASR_SESSION_MAX; i++) {
+    if (!g_rasr.sessions[i].active) {
+      return &g_rasr.sessions[i];
+    }
+
+    if (NULL == oldest || g_rasr.sessions[i].open_seq < oldest->open_seq) {
+      oldest = &g_rasr.sessions[i];
+    }
+  }
+
+  LOGW(TAG, "session table full, evict session[%u]", oldest->info.session_id);
+  _session_close(oldest, RASR_SESSION_EVENT_EVICTED, events);
+  return oldest;
+}
+
+static void _buffer_free() {
+  int i;
+  for (i = 0; i < RASR_SESSION_MAX; i++) {
+    uni_free(g_rasr.sessions[i].adpcm);
+    uni_free(g_rasr.sessions[i].held);
+    g_rasr.sessions[i].adpcm = NULL;
+    g_rasr.sessions[i].held  = NULL;
+  }
+
+  uni_free(g_rasr.pcm);
+  g_rasr.pcm = NULL;
+}
+
+static int _buffer_alloc() {
+  int i;
+
+  g_rasr.pcm = (short *)uni_malloc(_adpcm_chunk_bytes() * ADPCM_SAMPLES_PER_BYTE * sizeof(short));
+  if (NULL == g_rasr.pcm) {
+    return -1;
+  }
+
+  for (i = 0; i < RASR_SESSION_MAX; i++) {
+    g_rasr.sessions[i].adpcm = (unsigned char *)uni_malloc(_adpcm_chunk_bytes());
+    if (NULL == g_rasr.sessions[i].adpcm) {
+      _buffer_free();
+      return -1;
+    }
+
+    if (!g_rasr.vad.enable) {
+      continue;
+    }
+
+    /* endpoint decided when held silence reaches endpoint_ms, one frame more at most */
+    g_rasr.sessions[i].held = (char *)uni_malloc(_vad_bytes(g_rasr.vad.endpoint_ms + VAD_FRAME_MS));
+    if (NULL == g_rasr.sessions[i].held) {
+      _buffer_free();
+      return -1;
+    }
+  }
+
+  return 0;
+}
+
+static void _vad_config_init(RasrConfig *config) {
+  RasrVadConfig *vad = &g_rasr.vad;
+
+  MZERO(vad);
+  if (NULL != config) {
+    *vad = config->vad;
+  }
+
+  vad->endpoint_ms   = vad->endpoint_ms   ? vad->endpoint_ms   : VAD_DEFAULT_ENDPOINT_MS;
+  vad->min_speech_ms = vad->min_speech_ms ? vad->min_speech_ms : VAD_DEFAULT_MIN_SPEECH_MS;
+  vad->keep_tail_ms  = vad->keep_tail_ms  ? vad->keep_tail_ms  : VAD_DEFAULT_KEEP_TAIL_MS;
+  vad->energy_floor  = vad->energy_floor  ? vad->energy_floor  : VAD_DEFAULT_ENERGY_FLOOR;
+  vad->keep_tail_ms  = uni_min(vad->keep_tail_ms, vad->endpoint_ms);
+}
+
+int RasrInit(RasrConfig *config) {
+  if (g_rasr.inited) {
+    return 0;
+  }
+
+  g_rasr.chunk_bytes = RASR_DEFAULT_CHUNK_BYTES;
+  if (NULL != config && 0 != config->chunk_bytes) {
+    g_rasr.chunk_bytes = config->chunk_bytes;
+  }
+
+  /* one adpcm byte carries 4 pcm bytes */
+  g_rasr.chunk_bytes = uni_max(4, g_rasr.chunk_bytes & ~3);
+  _vad_config_init(config);
+  if (0 != _buffer_alloc()) {
+    LOGE(TAG, OUT_MEM_STRING);
+    return -1;
+  }
+
+  uni_mutex_new(&g_rasr.mutex);
+  g_rasr.inited = 1;
+  LOGT(TAG, "rasr init success. chunk=%u, vad=%d", g_rasr.chunk_bytes, g_rasr.vad.enable);
+  return 0;
+}
+
+void RasrFinal(void) {
+  PendingEvents events = {0};
+  if (!g_rasr.inited) {
+    return;
+  }
+
+  uni_mutex_lock(&g_rasr.mutex);
+  _session_close_all(RASR_SESSION_EVENT_EVICTED, &events);
+  uni_mutex_unlock(&g_rasr.mutex);
+
+  uni_mutex_free(&g_rasr.mutex);
+  _buffer_free();
+  uni_memset(&g_rasr, 0, sizeof(g_rasr));
+
+  /* raised after teardown, handler calling back into rasr sees it uninited */
+  _event_raise(&events);
+}
+
+void RasrRegisterSink(RasrSink *sink) {
+  PendingEvents events = {0};
+  if (!g_rasr.inited) {
+    return;
+  }
+
+  uni_mutex_lock(&g_rasr.mutex);
+  _session_close_all(RASR_SESSION_EVENT_EVICTED, &events);
+  g_rasr.sink = sink;
+  uni_mutex_unlock(&g_rasr.mutex);
+
+  _event_raise(&events);
+}
+
+void RasrRegisterEventHandler(RasrSessionEventHandler handler, void *ctx) {
+  if (!g_rasr.inited) {
+    return;
+  }
+
+  uni_mutex_lock(&g_rasr.mutex);
+  g_rasr.event_handler = handler;
+  g_rasr.event_ctx     = ctx;
+  uni_mutex_unlock(&g_rasr.mutex);
+}
+
+int RasrSessionStart(uint32_t session_id) {
+  PendingEvents events = {0};
+  RasrSession *session;
+
+  if (!g_rasr.inited) {
+    return -1;
+  }
+
+  uni_mutex_lock(&g_rasr.mutex);
+  if (NULL != _session_find(session_id)) {
+    uni_mutex_unlock(&g_rasr.mutex);
+    LOGW(TAG, "session[%u] already started", session_id);
+    return 0;
+  }
+
+  session = _session_slot_get(&events);
+  session->active      = 1;
+  session->open_seq    = g_rasr.open_seq++;
+  session->adpcm_len   = 0;
+  session->sink_opened = 0;
+  session->held_len       = 0;
+  session->speech_started = 0;
+  session->speech_samples = 0;
+  session->audio_samples  = 0;
+  session->endpointed     = 0;
+  VadReset(&session->vad, g_rasr.vad.energy_floor);
+  MZERO(&session->info);
+  session->info.session_id = session_id;
+  session->info.start_ms   = uni_get_clock_time_ms();
+  AdpcmStateReset(&session->state);
+  g_rasr.stats.sessions_opened++;
+
+  if (NULL != g_rasr.sink) {
+    session->sink_opened = (0 == g_rasr.sink->open(g_rasr.sink->ctx, session_id));
+    if (!session->sink_opened) {
+      g_rasr.stats.sink_errors++;
+      LOGW(TAG, "sink open failed. session[%u]", session_id);
+    }
+  }
+
+  _event_push(&events, RASR_SESSION_EVENT_OPENED, &session->info);
+  uni_mutex_unlock(&g_rasr.mutex);
+
+  _event_raise(&events);
+  return 0;
+}
+
+int RasrSessionFeed(uint32_t session_id, const char *adpcm, int len) {
+  PendingEvents events = {0};
+  RasrSession *session;
+  uint32_t copy_len;
+
+  if (!g_rasr.inited || NULL == adpcm || len <= 0) {
+    return -1;
+  }
+
+  uni_mutex_lock(&g_rasr.mutex);
+  if (NULL == (session = _session_find(session_id))) {
+    if (NULL != _history_find(session_id)) {
+      g_rasr.stats.late_packets++;
+    } else {
+      g_rasr.stats.unknown_packets++;
+    }
+    uni_mutex_unlock(&g_rasr.mutex);
+    return -1;
+  }
+
+  g_rasr.stats.decode_packets++;
+  session->info.packets++;
+  session->info.adpcm_bytes += len;
+  while (len > 0) {
+    if (0 == session->adpcm_len) {
+      session->chunk_begin_us = uni_get_clock_time_us();
+    }
+
+    copy_len = uni_min((uint32_t)len, _adpcm_chunk_bytes() - session->adpcm_len);
+    memcpy(session->adpcm + session->adpcm_len, adpcm, copy_len);
+    session->adpcm_len += copy_len;
+    adpcm += copy_len;
+    len   -= copy_len;
+
+    if (session->adpcm_len == _adpcm_chunk_bytes()) {
+      _flush_chunk(session, &events);
+    }
+  }
+  uni_mutex_unlock(&g_rasr.mutex);
+
+  _event_raise(&events);
+  return 0;
+}
+
+int RasrSessionStop(uint32_t session_id) {
+  PendingEvents events = {0};
+  RasrSession *session;
+
+  if (!g_rasr.inited) {
+    return -1;
+  }
+
+  uni_mutex_lock(&g_rasr.mutex);
+  if (NULL == (session = _session_find(session_id))) {
+    uni_mutex_unlock(&g_rasr.mutex);
+    return -1;
+  }
+
+  _session_close(session, RASR_SESSION_EVENT_CLOSED, &events);
+  uni_mutex_unlock(&g_rasr.mutex);
+
+  _event_raise(&events);
+  return 0;
+}
+
+int RasrGetSessionInfo(uint32_t session_id, RasrSessionInfo *info) {
+  RasrSession *session;
+  RasrSessionInfo *closed;
+  int ret = 0;
+
+  if (!g_rasr.inited || NULL == info) {
+    return -1;
+  }
+
+  uni_mutex_lock(&g_rasr.mutex);
+  if (NULL != (session = _session_find(session_id))) {
+    *info = session->info;
+    info->duration_ms = (uint32_t)(uni_get_clock_time_ms() - session->info.start_ms);
+  } else if (NULL != (closed = _history_find(session_id))) {
+    *info = *closed;
+  } else {
+    ret = -1;
+  }
+  uni_mutex_unlock(&g_rasr.mutex);
+  return ret;
+}
+
+void RasrGetStats(RasrStats *stats) {
+  if (!g_rasr.inited || NULL == stats) {
+    return;
+  }
+
+  uni_mutex_lock(&g_rasr.mutex);
+  *stats = g_rasr.stats;
+  uni_mutex_unlock(&g_rasr.mutex);
+}
@@ -0,0 +1,215 @@
+/**************************************************************************
+ * Copyright (C) 2020-2020  Unisound
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ **************************************************************************
+ *
+ * Description : uni_rasr_sink.c
+ * Author      : junlon2006@163.com
+ * Date        : 2020.08.05
+ *
+ **************************************************************************/
+#include "uni_rasr.h"
+#include "uni_log.h"
+#include "porting.h"
+
+#include <stdio.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#define TAG           "rasr_sink"
+#define SINK_PATH_MAX (108)
+
+typedef struct {
+  uint32_t session_id;
+  int      fd;
+} SessionFd;
+
+/* one fd per open session, sessions may overlap */
+typedef struct {
+  RasrSink  sink;
+  char      path[SINK_PATH_MAX];
+  SessionFd fds[RASR_SESSION_MAX];
+} FdSink;
+
+static SessionFd* _session_fd(FdSink *sink, uint32_t session_id) {
+  int i;
+  for (i = 0; i < RASR_SESSION_MAX; i++) {
+    if (sink->fds[i].fd >= 0 && sink->fds[i].session_id == session_id) {
+      return &sink->fds[i];
+    }
+  }
+
+  return NULL;
+}
+
+static SessionFd* _session_fd_alloc(FdSink *sink, uint32_t session_id) {
+  int i;
+  for (i = 0; i < RASR_SESSION_MAX; i++) {
+    if (sink->fds[i].fd < 0) {
+      sink->fds[i].session_id = session_id;
+      return &sink->fds[i];
+    }
+  }
+
+  LOGE(TAG, "too many sessions");
+  return NULL;
+}
+
+/* socket peer may go away, use send with MSG_NOSIGNAL to avoid SIGPIPE */
+static int _write_all(int fd, const char *buf, int len, int is_socket) {
+  int ret;
+  while (len > 0) {
+    ret = is_socket ? send(fd, buf, len, MSG_NOSIGNAL) : write(fd, buf, len);
+    if (ret < 0) {
+      if (EINTR == errno) continue;
+      return -1;
+    }
+
+    buf += ret;
+    len -= ret;
+  }
+
+  return 0;
+}
+
+static int _file_sink_write(void *ctx, uint32_t session_id, const char *pcm, int len) {
+  SessionFd *session = _session_fd((FdSink *)ctx, session_id);
+  return (NULL == session) ? -1 : _write_all(session->fd, pcm, len, 0);
+}
+
+static int _socket_sink_write(void *ctx, uint32_t session_id, const char *pcm, int len) {
+  SessionFd *session = _session_fd((FdSink *)ctx, session_id);
+  return (NULL == session) ? -1 : _write_all(session->fd, pcm, len, 1);
+}
+
+static void _session_fd_close(SessionFd *session) {
+  if (NULL != session && session->fd >= 0) {
+    close(session->fd);
+    session->fd = -1;
+  }
+}
+
+static void _fd_sink_close(void *ctx, uint32_t session_id) {
+  _session_fd_close(_session_fd((FdSink *)ctx, session_id));
+}
+
+static int _file_sink_open(void *ctx, uint32_t session_id) {
+  FdSink *sink = (FdSink *)ctx;
+  SessionFd *session = _session_fd_alloc(sink, session_id);
+  char file_name[SINK_PATH_MAX + 32];
+
+  if (NULL == session) {
+    return -1;
+  }
+
+  snprintf(file_name, sizeof(file_name), "%s/rasr_%u.pcm", sink->path, session_id);
+  session->fd = open(file_name, O_WRONLY | O_CREAT | O_TRUNC, 0664);
+  if (session->fd < 0) {
+    LOGE(TAG, "open %s failed[%s]", file_name, strerror(errno));
+    return -1;
+  }
+
+  return 0;
+}
+
+static int _socket_sink_open(void *ctx, uint32_t session_id) {
+  FdSink *sink = (FdSink *)ctx;
+  SessionFd *session = _session_fd_alloc(sink, session_id);
+  struct sockaddr_un addr;
+
+  if (NULL == session) {
+    return -1;
+  }
+
+  session->fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (session->fd < 0) {
+    LOGE(TAG, "create socket failed[%s]", strerror(errno));
+    return -1;
+  }
+
+  MZERO(&addr);
+  addr.sun_family = AF_UNIX;
+  snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", sink->path);
+  if (0 != connect(session->fd, (struct sockaddr *)&addr, sizeof(addr))) {
+    LOGE(TAG, "connect %s failed[%s]", sink->path, strerror(errno));
+    _session_fd_close(session);
+    return -1;
+  }
+
+  return 0;
+}
+
+static RasrSink* _fd_sink_create(const char *path,
+                                 int (*open_fn)(void *ctx, uint32_t session_id),
+                                 int (*write_fn)(void *ctx, uint32_t session_id,
+                                                 const char *pcm, int len)) {
+  FdSink *sink;
+  int i;
+
+  if (NULL == path) {
+    return NULL;
+  }
+
+  if (NULL == (sink = (FdSink *)uni_malloc(sizeof(FdSink)))) {
+    LOGE(TAG, OUT_MEM_STRING);
+    return NULL;
+  }
+
+  snprintf(sink->path, sizeof(sink->path), "%s", path);
+  for (i = 0; i < RASR_SESSION_MAX; i++) {
+    sink->fds[i].fd = -1;
+  }
+
+  sink->sink.ctx   = sink;
+  sink->sink.open  = open_fn;
+  sink->sink.write = write_fn;
+  sink->sink.close = _fd_sink_close;
+  return &sink->sink;
+}
+
+static void _fd_sink_destroy(RasrSink *sink) {
+  FdSink *fd_sink;
+  int i;
+
+  if (NULL == sink) {
+    return;
+  }
+
+  fd_sink = (FdSink *)sink->ctx;
+  for (i = 0; i < RASR_SESSION_MAX; i++) {
+    _session_fd_close(&fd_sink->fds[i]);
+  }
+
+  uni_free(fd_sink);
+}
+
+RasrSink* RasrFileSinkCreate(const char *dir) {
+  return _fd_sink_create(dir, _file_sink_open, _file_sink_write);
+}
+
+void RasrFileSinkDestroy(RasrSink *sink) {
+  _fd_sink_destroy(sink);
+}
+
+RasrSink* RasrSocketSinkCreate(const char *path) {
+  return _fd_sink_create(path, _socket_sink_open, _socket_sink_write);
+}
+
+void RasrSocketSinkDestroy(RasrSink *sink) {
+  _fd_sink_destroy(sink);
+}
@@ -0,0 +1,91 @@
+/**************************************************************************
+ * Copyright (C) 2020-2020  Unisound
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ **************************************************************************
+ *
+ * Description : uni_vad.c
+ * Author      : junlon2006@163.com
+ * Date        : 2020.08.14
+ *
+ **************************************************************************/
+#include "uni_vad.h"
+
+/* speech energy at least this times of noise energy, about 6dB */
+#define VAD_SNR_RATIO          (4)
+/* unvoiced consonants, weak energy but many zero crossings */
+#define VAD_ZCR_UNVOICED       (50)
+
+void VadFrameFeature(const short *pcm, int samples, VadFeature *feature) {
+  int64_t energy = 0;
+  uint32_t zcr = 0;
+  int i;
+
+  if (samples <= 0) {
+    feature->energy = 0;
+    feature->zcr    = 0;
+    return;
+  }
+
+  /* keep both loops branch free so they vectorize */
+  for (i = 0; i < samples; i++) {
+    energy += (int32_t)pcm[i] * pcm[i];
+  }
+
+  for (i = 1; i < samples; i++) {
+    zcr += ((pcm[i - 1] ^ pcm[i]) < 0);
+  }
+
+  feature->energy = (uint32_t)(energy / samples);
+  feature->zcr    = zcr * VAD_FRAME_SAMPLES / samples;
+}
+
+void VadReset(Vad *vad, uint32_t energy_floor) {
+  vad->energy_floor = energy_floor;
+  vad->noise        = 0;
+  vad->frames       = 0;
+}
+
+static void _noise_update(Vad *vad, uint32_t energy) {
+  if (0 == vad->frames || energy < vad->noise) {
+    /* follow falling noise quickly */
+    vad->noise = (0 == vad->frames) ? energy :
+                 (uint32_t)(((uint64_t)vad->noise * 3 + energy) / 4);
+    return;
+  }
+
+  vad->noise = (uint32_t)(((uint64_t)vad->noise * 15 + energy) / 16);
+}
+
+int VadFrameIsSpeech(Vad *vad, const short *pcm, int samples) {
+  VadFeature feature;
+  uint64_t threshold;
+  int speech;
+
+  VadFrameFeature(pcm, samples, &feature);
+  threshold = (uint64_t)vad->noise * VAD_SNR_RATIO;
+  if (threshold < vad->energy_floor) {
+    threshold = vad->energy_floor;
+  }
+
+  speech = (feature.energy > threshold) ||
+           (feature.energy > threshold / 2 && feature.zcr >= VAD_ZCR_UNVOICED);
+  if (!speech) {
+    _noise_update(vad, feature.energy);
+  }
+
+  vad->frames++;
+  return speech;
+}
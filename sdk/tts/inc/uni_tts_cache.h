@@ -0,0 +1,151 @@
+/**************************************************************************
+ * Copyright (C) 2020-2020  Unisound
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ **************************************************************************
+ *
+ * Description : uni_tts_cache.h
+ * Author      : junlon2006@163.com
+ * Date        : 2020.08.15
+ *
+ **************************************************************************/
+#ifndef SDK_TTS_INC_UNI_TTS_CACHE_H_
+#define SDK_TTS_INC_UNI_TTS_CACHE_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+typedef void* TtsCacheHandle;
+
+/**
+ * TTS合成源，云端TTS对接由用户实现，SDK内置本地替身源供调试
+ * synthesize成功后pcm由release释放
+ */
+typedef struct {
+  void *ctx;
+  int  (*synthesize)(void *ctx, const char *text, const char *voice, const char *format,
+                     char **pcm, int *len);
+  void (*release)(void *ctx, char *pcm);
+} TtsSource;
+
+/* 播放接口，如ChnlIotDeviceFeedAudioData */
+typedef int (*TtsPlayHandler)(char *pcm, int len);
+
+typedef struct {
+  char     *data; /* 只读mmap映射，直接送入播放接口，不拷贝 */
+  uint32_t len;
+  uint64_t key;
+} TtsCacheEntry;
+
+typedef struct {
+  uint32_t entries;
+  uint64_t bytes;
+  uint64_t max_bytes;
+  uint32_t hits;
+  uint32_t misses;
+  uint32_t evictions;
+  uint32_t insert_failed;
+  uint64_t hit_lookup_us;  /* 命中时查找+mmap累计耗时 */
+  uint64_t hit_lookup_max_us;
+  uint64_t miss_synth_us;  /* 未命中时合成+落盘累计耗时 */
+  uint64_t miss_synth_max_us;
+} TtsCacheStats;
+
+/**
+ * @brief 创建磁盘缓存，目录中已有的缓存文件按修改时间恢复LRU顺序
+ * @param dir 缓存目录，需已存在
+ * @param max_bytes 缓存总字节数上限，超出按LRU淘汰
+ * @return handle，失败返回NULL
+ */
+TtsCacheHandle TtsCacheCreate(const char *dir, uint64_t max_bytes);
+
+/**
+ * @brief 释放缓存句柄，磁盘文件保留
+ * @param handle
+ * @return void
+ */
+void TtsCacheDestroy(TtsCacheHandle handle);
+
+/**
+ * @brief 缓存key，(text, voice, format)的64位FNV-1a哈希
+ * @param text
+ * @param voice 可为NULL
+ * @param format 可为NULL
+ * @return key
+ */
+uint64_t TtsCacheKey(const char *text, const char *voice, const char *format);
+
+/**
+ * @brief 查找并mmap缓存音频，命中后更新LRU
+ * @param handle
+ * @param key
+ * @param entry 成功时填充，使用完毕调用TtsCacheRelease
+ * @return 0 命中，-1 未命中
+ */
+int TtsCacheLookup(TtsCacheHandle handle, uint64_t key, TtsCacheEntry *entry);
+
+/**
+ * @brief 解除mmap映射，条目被淘汰后映射依然有效直到释放
+ * @param entry
+ * @return void
+ */
+void TtsCacheRelease(TtsCacheEntry *entry);
+
+/**
+ * @brief 写入缓存，不持锁写临时文件，持锁rename并淘汰最久未使用的条目，写入期间命中不受阻塞
+ * @param handle
+ * @param key
+ * @param pcm
+ * @param len
+ * @return 0 成功，-1 失败（含同一key正由其他线程写入）
+ */
+int TtsCacheInsert(TtsCacheHandle handle, uint64_t key, const char *pcm, uint32_t len);
+
+/**
+ * @brief 播放一条响应：命中则mmap直接送入播放接口，未命中则由source合成、写入缓存后播放
+ * @param handle
+ * @param source
+ * @param text
+ * @param voice
+ * @param format
+ * @param play
+ * @return 0 成功，-1 失败
+ */
+int TtsCachePlay(TtsCacheHandle handle, TtsSource *source, const char *text,
+                 const char *voice, const char *format, TtsPlayHandler play);
+
+/**
+ * @brief 获取命中率及延时统计
+ * @param handle
+ * @param stats
+ * @return void
+ */
+void TtsCacheGetStats(TtsCacheHandle handle, TtsCacheStats *stats);
+
+/**
+ * @brief 本地替身TTS源，按文本生成确定性的16K 16bit正弦音频，模拟云端合成延时
+ * @param latency_ms 每次合成的模拟延时
+ * @return source，失败返回NULL
+ */
+TtsSource* TtsToneSourceCreate(uint32_t latency_ms);
+void       TtsToneSourceDestroy(TtsSource *source);
+
+#ifdef __cplusplus
+}
+#endif
+#endif  // SDK_TTS_INC_UNI_TTS_CACHE_H_
@@ -0,0 +1,447 @@
+/**************************************************************************
+ * Copyright (C) 2020-2020  Unisound
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ **************************************************************************
+ *
+ * Description : uni_tts_cache.c
+ * Author      : junlon2006@163.com
+ * Date        : 2020.08.15
+ *
+ **************************************************************************/
+#include "uni_tts_cache.h"
+#include "list_head.h"
+#include "uni_log.h"
+#include "porting.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define TAG              "tts_cache"
+#define CACHE_PATH_MAX   (256)
+#define CACHE_BUCKET_CNT (256)
+#define FNV64_BASIS      (0xcbf29ce484222325ULL)
+#define FNV64_PRIME      (0x00000100000001b3ULL)
+
+typedef struct {
+  list_head lru;    /* head is most recently used */
+  list_head bucket;
+  uint64_t  key;
+  uint32_t  len;
+  long      mtime;
+} CacheNode;
+
+typedef struct {
+  char          dir[CACHE_PATH_MAX];
+  list_head     lru;
+  list_head     buckets[CACHE_BUCKET_CNT];
+  uni_mutex_t   mutex;
+  TtsCacheStats stats;
+} TtsCache;
+
+static uint64_t _fnv1a(uint64_t h, const char *s) {
+  for (; NULL != s && *s; s++) {
+    h ^= (unsigned char)*s;
+    h *= FNV64_PRIME;
+  }
+
+  /* field separator, ("ab", "c") and ("a", "bc") differ */
+  h ^= 0xff;
+  h *= FNV64_PRIME;
+  return h;
+}
+
+uint64_t TtsCacheKey(const char *text, const char *voice, const char *format) {
+  return _fnv1a(_fnv1a(_fnv1a(FNV64_BASIS, text), voice), format);
+}
+
+static void _file_path(TtsCache *cache, uint64_t key, const char *suffix, char *path, int size) {
+  snprintf(path, size, "%s/%016llx.%s", cache->dir, (unsigned long long)key, suffix);
+}
+
+static list_head* _bucket(TtsCache *cache, uint64_t key) {
+  return &cache->buckets[key % CACHE_BUCKET_CNT];
+}
+
+static CacheNode* _node_find(TtsCache *cache, uint64_t key) {
+  list_head *p;
+  CacheNode *node;
+  list_for_each(p, _bucket(cache, key)) {
+    node = list_entry(p, CacheNode, bucket);
+    if (node->key == key) {
+      return node;
+    }
+  }
+
+  return NULL;
+}
+
+/* keep lru ordered by mtime when restoring from disk, newest at head */
+static void _lru_insert_by_mtime(TtsCache *cache, CacheNode *node) {
+  list_head *p;
+  list_for_each(p, &cache->lru) {
+    if (list_entry(p, CacheNode, lru)->mtime <= node->mtime) {
+      break;
+    }
+  }
+
+  list_add_tail(&node->lru, p);
+}
+
+/* forget node, its file is left to the caller */
+static void _node_drop(TtsCache *cache, CacheNode *node) {
+  list_del(&node->lru);
+  list_del(&node->bucket);
+  cache->stats.entries--;
+  cache->stats.bytes -= node->len;
+  uni_free(node);
+}
+
+static void _node_remove(TtsCache *cache, CacheNode *node) {
+  char path[CACHE_PATH_MAX + 32];
+
+  _file_path(cache, node->key, "pcm", path, sizeof(path));
+  unlink(path);
+  _node_drop(cache, node);
+}
+
+static void _evict(TtsCache *cache, uint64_t need) {
+  CacheNode *node;
+  while (cache->stats.bytes + need > cache->stats.max_bytes &&
+         NULL != (node = list_get_tail_entry(&cache->lru, CacheNode, lru))) {
+    LOGD(TAG, "evict %016llx, len=%u", (unsigned long long)node->key, node->len);
+    _node_remove(cache, node);
+    cache->stats.evictions++;
+  }
+}
+
+static CacheNode* _node_add(TtsCache *cache, uint64_t key, uint32_t len, long mtime) {
+  CacheNode *node = (CacheNode *)uni_malloc(sizeof(CacheNode));
+  if (NULL == node) {
+    LOGE(TAG, OUT_MEM_STRING);
+    return NULL;
+  }
+
+  node->key   = key;
+  node->len   = len;
+  node->mtime = mtime;
+  list_add(&node->bucket, _bucket(cache, key));
+  _lru_insert_by_mtime(cache, node);
+  cache->stats.entries++;
+  cache->stats.bytes += len;
+  return node;
+}
+
+/* name is exactly "<16 hex><suffix>", as written by _file_path */
+static int _cache_name(const char *name, const char *suffix, unsigned long long *key) {
+  if (16 + strlen(suffix) != strlen(name) || 16 != strspn(name, "0123456789abcdef") ||
+      0 != strcmp(name + 16, suffix)) {
+    return -1;
+  }
+
+  *key = strtoull(name, NULL, 16);
+  return 0;
+}
+
+static void _restore(TtsCache *cache) {
+  char path[CACHE_PATH_MAX + NAME_MAX + 2];
+  unsigned long long key;
+  struct dirent *ent;
+  struct stat st;
+  DIR *dir;
+
+  if (NULL == (dir = opendir(cache->dir))) {
+    LOGW(TAG, "open %s failed[%s]", cache->dir, strerror(errno));
+    return;
+  }
+
+  while (NULL != (ent = readdir(dir))) {
+    /* dir is bounded by CACHE_PATH_MAX, name by NAME_MAX, skip anything longer anyway */
+    if (snprintf(path, sizeof(path), "%s/%s", cache->dir, ent->d_name) >= (int)sizeof(path)) {
+      continue;
+    }
+
+    /* leftover of interrupted insert */
+    if (0 == _cache_name(ent->d_name, ".tmp", &key)) {
+      unlink(path);
+      continue;
+    }
+
+    /* only "<16 hex>.pcm" belongs to cache, other files in dir are left alone */
+    if (0 != _cache_name(ent->d_name, ".pcm", &key)) continue;
+    if (0 != stat(path, &st) || !S_ISREG(st.st_mode) || 0 == st.st_size) continue;
+    if (NULL != _node_find(cache, key)) continue;
+    _node_add(cache, key, (uint32_t)st.st_size, (long)st.st_mtime);
+  }
+
+  closedir(dir);
+  _evict(cache, 0);
+  LOGT(TAG, "restore %u entries, %llu bytes", cache->stats.entries,
+       (unsigned long long)cache->stats.bytes);
+}
+
+TtsCacheHandle TtsCacheCreate(const char *dir, uint64_t max_bytes) {
+  TtsCache *cache;
+  int i;
+
+  if (NULL == dir || 0 == max_bytes) {
+    return NULL;
+  }
+
+  if (NULL == (cache = (TtsCache *)uni_calloc(1, sizeof(TtsCache)))) {
+    LOGE(TAG, OUT_MEM_STRING);
+    return NULL;
+  }
+
+  snprintf(cache->dir, sizeof(cache->dir), "%s", dir);
+  list_init(&cache->lru);
+  for (i = 0; i < CACHE_BUCKET_CNT; i++) {
+    list_init(&cache->buckets[i]);
+  }
+
+  cache->stats.max_bytes = max_bytes;
+  uni_mutex_new(&cache->mutex);
+  _restore(cache);
+  return cache;
+}
+
+void TtsCacheDestroy(TtsCacheHandle handle) {
+  TtsCache *cache = (TtsCache *)handle;
+  list_head *p, *n;
+
+  if (NULL == cache) {
+    return;
+  }
+
+  list_for_each_safe(p, n, &cache->lru) {
+    list_del(p);
+    uni_free(list_entry(p, CacheNode, lru));
+  }
+
+  uni_mutex_free(&cache->mutex);
+  uni_free(cache);
+}
+
+static int _map(TtsCache *cache, CacheNode *node, TtsCacheEntry *entry) {
+  char path[CACHE_PATH_MAX + 32];
+  void *addr;
+  int fd;
+
+  _file_path(cache, node->key, "pcm", path, sizeof(path));
+  if ((fd = open(path, O_RDONLY)) < 0) {
+    return -1;
+  }
+
+  /* private read only mapping, playback engine reads pages straight from page cache */
+  addr = mmap(NULL, node->len, PROT_READ, MAP_PRIVATE, fd, 0);
+  if (MAP_FAILED != addr) {
+    madvise(addr, node->len, MADV_SEQUENTIAL);
+    futimens(fd, NULL); /* persist recency for restore */
+  }
+
+  close(fd);
+  if (MAP_FAILED == addr) {
+    return -1;
+  }
+
+  entry->data = (char *)addr;
+  entry->len  = node->len;
+  entry->key  = node->key;
+  return 0;
+}
+
+int TtsCacheLookup(TtsCacheHandle handle, uint64_t key, TtsCacheEntry *entry) {
+  TtsCache *cache = (TtsCache *)handle;
+  int64_t begin = uni_get_clock_time_us();
+  CacheNode *node;
+  int ret = -1;
+
+  if (NULL == cache || NULL == entry) {
+    return -1;
+  }
+
+  uni_mutex_lock(&cache->mutex);
+  if (NULL != (node = _node_find(cache, key))) {
+    if (0 == (ret = _map(cache, node, entry))) {
+      list_del(&node->lru);
+      list_add(&node->lru, &cache->lru);
+    } else {
+      /* file removed behind our back */
+      _node_remove(cache, node);
+    }
+  }
+
+  if (0 == ret) {
+    int64_t cost = uni_get_clock_time_us() - begin;
+    cache->stats.hits++;
+    cache->stats.hit_lookup_us += cost;
+    cache->stats.hit_lookup_max_us = uni_max(cache->stats.hit_lookup_max_us, (uint64_t)cost);
+  } else {
+    cache->stats.misses++;
+  }
+  uni_mutex_unlock(&cache->mutex);
+  return ret;
+}
+
+void TtsCacheRelease(TtsCacheEntry *entry) {
+  if (NULL == entry || NULL == entry->data) {
+    return;
+  }
+
+  munmap(entry->data, entry->len);
+  entry->data = NULL;
+  entry->len  = 0;
+}
+
+static int _write_file(const char *path, const char *pcm, uint32_t len) {
+  int fd, ret;
+
+  /* exclusive, a concurrent insert of the same key already owns the tmp file */
+  if ((fd = open(path, O_WRONLY | O_CREAT | O_EXCL, 0664)) < 0) {
+    if (EEXIST != errno) {
+      LOGE(TAG, "open %s failed[%s]", path, strerror(errno));
+    }
+    return -1;
+  }
+
+  while (len > 0) {
+    ret = write(fd, pcm, len);
+    if (ret < 0) {
+      if (EINTR == errno) continue;
+      LOGE(TAG, "write %s failed[%s]", path, strerror(errno));
+      close(fd);
+      unlink(path);
+      return -1;
+    }
+
+    pcm += ret;
+    len -= ret;
+  }
+
+  close(fd);
+  return 0;
+}
+
+int TtsCacheInsert(TtsCacheHandle handle, uint64_t key, const char *pcm, uint32_t len) {
+  TtsCache *cache = (TtsCache *)handle;
+  char tmp[CACHE_PATH_MAX + 32], path[CACHE_PATH_MAX + 32];
+  CacheNode *node;
+
+  if (NULL == cache || NULL == pcm || 0 == len) {
+    return -1;
+  }
+
+  if (len > cache->stats.max_bytes) {
+    LOGW(TAG, "response too large to cache. len=%u", len);
+    return -1;
+  }
+
+  _file_path(cache, key, "tmp", tmp, sizeof(tmp));
+  _file_path(cache, key, "pcm", path, sizeof(path));
+
+  /* write outside the lock, a large miss must not stall concurrent hits */
+  if (0 != _write_file(tmp, pcm, len)) {
+    uni_mutex_lock(&cache->mutex);
+    cache->stats.insert_failed++;
+    uni_mutex_unlock(&cache->mutex);
+    return -1;
+  }
+
+  uni_mutex_lock(&cache->mutex);
+  /* rename replaces an older file of the same key atomically, nothing evicted if it fails */
+  if (0 != rename(tmp, path)) {
+    LOGE(TAG, "rename %s failed[%s]", tmp, strerror(errno));
+    unlink(tmp);
+    cache->stats.insert_failed++;
+    uni_mutex_unlock(&cache->mutex);
+    return -1;
+  }
+
+  if (NULL != (node = _node_find(cache, key))) {
+    _node_drop(cache, node);
+  }
+
+  _evict(cache, len);
+  if (NULL == (node = _node_add(cache, key, len, uni_get_utc_time_sec()))) {
+    unlink(path);
+  }
+  uni_mutex_unlock(&cache->mutex);
+  return (NULL == node) ? -1 : 0;
+}
+
+static int _play_miss(TtsCache *cache, TtsSource *source, uint64_t key, const char *text,
+                      const char *voice, const char *format, TtsPlayHandler play) {
+  int64_t begin = uni_get_clock_time_us();
+  int64_t cost;
+  char *pcm = NULL;
+  int len = 0, ret;
+
+  if (NULL == source || 0 != source->synthesize(source->ctx, text, voice, format, &pcm, &len)) {
+    LOGE(TAG, "synthesize failed");
+    return -1;
+  }
+
+  TtsCacheInsert(cache, key, pcm, len);
+  cost = uni_get_clock_time_us() - begin;
+
+  uni_mutex_lock(&cache->mutex);
+  cache->stats.miss_synth_us += cost;
+  cache->stats.miss_synth_max_us = uni_max(cache->stats.miss_synth_max_us, (uint64_t)cost);
+  uni_mutex_unlock(&cache->mutex);
+
+  ret = play(pcm, len);
+  source->release(source->ctx, pcm);
+  return ret;
+}
+
+int TtsCachePlay(TtsCacheHandle handle, TtsSource *source, const char *text,
+                 const char *voice, const char *format, TtsPlayHandler play) {
+  TtsCache *cache = (TtsCache *)handle;
+  TtsCacheEntry entry;
+  uint64_t key;
+  int ret;
+
+  if (NULL == cache || NULL == text || NULL == play) {
+    return -1;
+  }
+
+  key = TtsCacheKey(text, voice, format);
+  if (0 != TtsCacheLookup(cache, key, &entry)) {
+    return _play_miss(cache, source, key, text, voice, format, play);
+  }
+
+  ret = play(entry.data, entry.len);
+  TtsCacheRelease(&entry);
+  return ret;
+}
+
+void TtsCacheGetStats(TtsCacheHandle handle, TtsCacheStats *stats) {
+  TtsCache *cache = (TtsCache *)handle;
+  if (NULL == cache || NULL == stats) {
+    return;
+  }
+
+  uni_mutex_lock(&cache->mutex);
+  *stats = cache->stats;
+  uni_mutex_unlock(&cache->mutex);
+}
@@ -0,0 +1,93 @@
+/**************************************************************************
+ * Copyright (C) 2020-2020  Unisound
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ **************************************************************************
+ *
+ * Description : uni_tts_source.c
+ * Author      : junlon2006@163.com
+ * Date        : 2020.08.15
+ *
+ **************************************************************************/
+#include "uni_tts_cache.h"
+#include "uni_log.h"
+#include "porting.h"
+
+#include <math.h>
+#include <string.h>
+
+#define TAG                 "tts_source"
+#define TONE_SAMPLE_RATE    (16000)
+#define TONE_MS_PER_CHAR    (60)
+#define TONE_MIN_MS         (200)
+#define TONE_MAX_MS         (5000)
+#define TONE_AMPLITUDE      (8000)
+
+typedef struct {
+  TtsSource source;
+  uint32_t  latency_ms;
+} ToneSource;
+
+/* stand-in for cloud tts, same text always gives same audio */
+static int _tone_synthesize(void *ctx, const char *text, const char *voice, const char *format,
+                            char **pcm, int *len) {
+  ToneSource *tone = (ToneSource *)ctx;
+  uint64_t key = TtsCacheKey(text, voice, format);
+  uint32_t ms, samples, i;
+  double freq;
+  short *buf;
+
+  ms = uni_min(uni_max((uint32_t)strlen(text) * TONE_MS_PER_CHAR, TONE_MIN_MS), TONE_MAX_MS);
+  samples = TONE_SAMPLE_RATE / 1000 * ms;
+  freq = 300.0 + (double)(key % 600);
+
+  if (NULL == (buf = (short *)uni_malloc(samples * sizeof(short)))) {
+    LOGE(TAG, OUT_MEM_STRING);
+    return -1;
+  }
+
+  for (i = 0; i < samples; i++) {
+    buf[i] = (short)(TONE_AMPLITUDE * sin(2.0 * M_PI * freq * i / TONE_SAMPLE_RATE));
+  }
+
+  uni_msleep(tone->latency_ms);
+  *pcm = (char *)buf;
+  *len = (int)(samples * sizeof(short));
+  return 0;
+}
+
+static void _tone_release(void *ctx, char *pcm) {
+  uni_free(pcm);
+}
+
+TtsSource* TtsToneSourceCreate(uint32_t latency_ms) {
+  ToneSource *tone = (ToneSource *)uni_malloc(sizeof(ToneSource));
+  if (NULL == tone) {
+    LOGE(TAG, OUT_MEM_STRING);
+    return NULL;
+  }
+
+  tone->source.ctx        = tone;
+  tone->source.synthesize = _tone_synthesize;
+  tone->source.release    = _tone_release;
+  tone->latency_ms        = latency_ms;
+  return &tone->source;
+}
+
+void TtsToneSourceDestroy(TtsSource *source) {
+  if (NULL != source) {
+    uni_free(source->ctx);
+  }
+}
@@ -0,0 +1,239 @@
+/**************************************************************************
+ * Copyright (C) 2020-2020  Unisound
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ **************************************************************************
+ *
+ * Description : tts_cache_bench.c
+ * Author      : junlon2006@163.com
+ * Date        : 2020.09.10
+ *
+ **************************************************************************/
+/*
+ * usage: TTS_CACHE_BENCH [options]
+ *
+ * drives TtsCachePlay with the tone stand-in source through every path of
+ * the cache and prints TtsCacheGetStats after each step, play is a no-op so
+ * the numbers are cache cost only
+ *   miss:    first play of a response, synthesized and written to disk
+ *   hit:     same response again, served from mmap, repeated -n times
+ *   evict:   more responses than fit in -m, least recently used one dropped
+ *   restore: cache destroyed and created again on the same dir, the most
+ *            recent response must hit without synthesis
+ * exit 1 when any step does not behave as described
+ *   -d dir     cache dir, default a fresh one under /tmp removed at exit
+ *   -l ms      simulated synthesis latency of the source, default 200
+ *   -n hits    hit repetitions, default 200
+ *   -m kb      cache size, default 80, holds two of the 1s test responses
+ */
+#include "uni_tts_cache.h"
+#include "porting.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <dirent.h>
+
+#define BENCH_DIR_MAX  (256)
+
+typedef struct {
+  char     dir[BENCH_DIR_MAX];
+  int      own_dir;
+  uint32_t latency_ms;
+  uint32_t hits;
+  uint32_t max_kb;
+} BenchConfig;
+
+/* same length, so every response is the same size */
+static const char *g_texts[] = {
+  "turn on the light",
+  "turn off the fans",
+  "set heat to 26 c.",
+};
+
+static BenchConfig g_config;
+static uint64_t    g_played = 0;
+
+static int _play(char *pcm, int len) {
+  g_played += len;
+  return 0;
+}
+
+static int64_t _play_once(TtsCacheHandle cache, TtsSource *source, const char *text) {
+  int64_t begin = uni_get_clock_time_us();
+  if (0 != TtsCachePlay(cache, source, text, "xiaoyan", "pcm16k", _play)) {
+    return -1;
+  }
+
+  return uni_get_clock_time_us() - begin;
+}
+
+static void _report(const char *step, TtsCacheHandle cache) {
+  TtsCacheStats stats;
+  TtsCacheGetStats(cache, &stats);
+  printf("[bench] %-7s entries=%u bytes=%llu/%llu hits=%u misses=%u evictions=%u "
+         "insert_failed=%u, hit lookup avg=%lluus max=%lluus, miss synth avg=%lluus max=%lluus\n",
+         step, stats.entries, (unsigned long long)stats.bytes,
+         (unsigned long long)stats.max_bytes, stats.hits, stats.misses, stats.evictions,
+         stats.insert_failed,
+         (unsigned long long)(stats.hits ? stats.hit_lookup_us / stats.hits : 0),
+         (unsigned long long)stats.hit_lookup_max_us,
+         (unsigned long long)(stats.misses ? stats.miss_synth_us / stats.misses : 0),
+         (unsigned long long)stats.miss_synth_max_us);
+}
+
+static int _expect(int ok, const char *what) {
+  if (!ok) {
+    fprintf(stderr, "[bench] unexpected: %s\n", what);
+  }
+  return ok ? 0 : 1;
+}
+
+static int _bench(TtsSource *source) {
+  uint64_t max_bytes = (uint64_t)g_config.max_kb * 1024;
+  int64_t miss_us, hit_us, hit_max_us = 0, hit_total_us = 0, restore_us, cost;
+  TtsCacheHandle cache;
+  TtsCacheStats stats;
+  int fails = 0;
+  uint32_t i;
+
+  if (NULL == (cache = TtsCacheCreate(g_config.dir, max_bytes))) {
+    return -1;
+  }
+
+  miss_us = _play_once(cache, source, g_texts[0]);
+  TtsCacheGetStats(cache, &stats);
+  fails += _expect(miss_us >= 0 && 1 == stats.misses && 1 == stats.entries, "first play cached");
+  _report("miss", cache);
+
+  for (i = 0; i < g_config.hits; i++) {
+    cost          = _play_once(cache, source, g_texts[0]);
+    hit_total_us += cost;
+    hit_max_us    = uni_max(hit_max_us, cost);
+  }
+  hit_us = g_config.hits ? hit_total_us / g_config.hits : 0;
+  TtsCacheGetStats(cache, &stats);
+  fails += _expect(g_config.hits == stats.hits && 1 == stats.misses, "replays hit");
+  _report("hit", cache);
+
+  /* texts[0] is least recently used once texts[1] and texts[2] are in */
+  _play_once(cache, source, g_texts[1]);
+  _play_once(cache, source, g_texts[2]);
+  TtsCacheGetStats(cache, &stats);
+  fails += _expect(stats.evictions > 0 && stats.bytes <= max_bytes, "over size evicts");
+  _report("evict", cache);
+  TtsCacheDestroy(cache);
+
+  if (NULL == (cache = TtsCacheCreate(g_config.dir, max_bytes))) {
+    return -1;
+  }
+
+  TtsCacheGetStats(cache, &stats);
+  fails += _expect(stats.entries > 0, "entries restored from disk");
+  restore_us = _play_once(cache, source, g_texts[2]);
+  TtsCacheGetStats(cache, &stats);
+  fails += _expect(1 == stats.hits && 0 == stats.misses, "restored entry hits");
+  _report("restore", cache);
+  TtsCacheDestroy(cache);
+
+  printf("[bench] play latency, miss=%lldus (source %ums), hit avg=%lldus max=%lldus, "
+         "hit after restore=%lldus, %.0fx faster on hit\n", (long long)miss_us,
+         g_config.latency_ms, (long long)hit_us, (long long)hit_max_us, (long long)restore_us,
+         hit_us > 0 ? (double)miss_us / hit_us : 0.0);
+  return fails ? 1 : 0;
+}
+
+static void _dir_remove(const char *path) {
+  char file[BENCH_DIR_MAX * 2];
+  struct dirent *ent;
+  DIR *dir;
+
+  if (NULL == (dir = opendir(path))) {
+    return;
+  }
+
+  while (NULL != (ent = readdir(dir))) {
+    if ('.' == ent->d_name[0]) continue;
+    snprintf(file, sizeof(file), "%s/%s", path, ent->d_name);
+    unlink(file);
+  }
+
+  closedir(dir);
+  rmdir(path);
+}
+
+static int _options_parse(int argc, char *argv[]) {
+  int opt;
+
+  g_config.latency_ms = 200;
+  g_config.hits       = 200;
+  g_config.max_kb     = 80;
+  while (-1 != (opt = getopt(argc, argv, "d:l:n:m:"))) {
+    switch (opt) {
+    case 'd': snprintf(g_config.dir, sizeof(g_config.dir), "%s", optarg); break;
+    case 'l': g_config.latency_ms = (uint32_t)atoi(optarg); break;
+    case 'n': g_config.hits = (uint32_t)atoi(optarg); break;
+    case 'm': g_config.max_kb = (uint32_t)atoi(optarg); break;
+    default:
+      goto L_USAGE;
+    }
+  }
+
+  if (optind != argc || 0 == g_config.hits || 0 == g_config.max_kb) {
+    goto L_USAGE;
+  }
+
+  if ('\0' == g_config.dir[0]) {
+    snprintf(g_config.dir, sizeof(g_config.dir), "/tmp/tts_cache_XXXXXX");
+    if (NULL == mkdtemp(g_config.dir)) {
+      fprintf(stderr, "create cache dir failed\n");
+      return -1;
+    }
+    g_config.own_dir = 1;
+  }
+
+  return 0;
+
+L_USAGE:
+  fprintf(stderr, "usage: %s [-d dir] [-l latency_ms] [-n hits] [-m kb]\n", argv[0]);
+  return -1;
+}
+
+int main(int argc, char *argv[]) {
+  TtsSource *source;
+  int ret;
+
+  if (0 != _options_parse(argc, argv)) {
+    return 2;
+  }
+
+  if (NULL == (source = TtsToneSourceCreate(g_config.latency_ms))) {
+    return 2;
+  }
+
+  printf("[bench] cache dir %s, %ukb\n", g_config.dir, g_config.max_kb);
+  if (-1 == (ret = _bench(source))) {
+    fprintf(stderr, "create cache on %s failed\n", g_config.dir);
+    ret = 2;
+  }
+
+  TtsToneSourceDestroy(source);
+  if (g_config.own_dir) {
+    _dir_remove(g_config.dir);
+  }
+  return ret;
+}
@@ -0,0 +1,85 @@
+/**************************************************************************
+ * Copyright (C) 2020-2020  Junlon2006
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ **************************************************************************
+ *
+ * Description : uni_adpcm.h
+ * Author      : junlon2006@163.com
+ * Date        : 2020.08.03
+ *
+ **************************************************************************/
+#ifndef UTILS_ADPCM_INC_UNI_ADPCM_H_
+#define UTILS_ADPCM_INC_UNI_ADPCM_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* IMA-ADPCM, 4bit per sample, low nibble first, 16bit PCM 4:1 */
+#define ADPCM_BYTES_PER_PCM_BYTES(n)  ((n) >> 2)
+#define ADPCM_SAMPLES_PER_BYTE        (2)
+
+typedef struct {
+  short predictor;   /* last predicted sample */
+  char  step_index;  /* index of step table, [0, 88] */
+} AdpcmState;
+
+/**
+ * @brief reset codec state, predictor = 0, step_index = 0
+ * @param state
+ * @return void
+ */
+void AdpcmStateReset(AdpcmState *state);
+
+/**
+ * @brief encode 16bit PCM to IMA-ADPCM, state carried between calls
+ * @param state codec state
+ * @param pcm 16bit PCM samples
+ * @param samples sample count, should be even, the odd tail will be ignored
+ * @param adpcm output buffer, at least samples / 2 bytes
+ * @return encoded byte count
+ */
+int AdpcmEncode(AdpcmState *state, const short *pcm, int samples,
+                unsigned char *adpcm);
+
+/**
+ * @brief decode IMA-ADPCM to 16bit PCM, state carried between calls
+ * @param state codec state
+ * @param adpcm adpcm buffer
+ * @param len adpcm byte count
+ * @param pcm output buffer, at least len * 2 samples
+ * @return decoded sample count
+ */
+int AdpcmDecode(AdpcmState *state, const unsigned char *adpcm, int len,
+                short *pcm);
+
+/**
+ * @brief decode independent blocks together, lanes interleaved so that the
+ *        serial dependency inside one block doesn't stall the pipeline
+ * @param states codec state of each block, updated to the block end state
+ * @param adpcm adpcm buffer of each block
+ * @param pcm output buffer of each block, at least len * 2 samples
+ * @param blocks block count
+ * @param len adpcm byte count of every block
+ * @return decoded sample count of every block
+ */
+int AdpcmDecodeBlocks(AdpcmState *states, const unsigned char *const *adpcm,
+                      short *const *pcm, int blocks, int len);
+
+#ifdef __cplusplus
+}
+#endif
+#endif  // UTILS_ADPCM_INC_UNI_ADPCM_H_
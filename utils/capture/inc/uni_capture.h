@@ -0,0 +1,167 @@
+/**************************************************************************
+ * Copyright (C) 2020-2020  Junlon2006
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ **************************************************************************
+ *
+ * Description : uni_capture.h
+ * Author      : junlon2006@163.com
+ * Date        : 2020.08.29
+ *
+ **************************************************************************/
+#ifndef UTILS_CAPTURE_INC_UNI_CAPTURE_H_
+#define UTILS_CAPTURE_INC_UNI_CAPTURE_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+/*
+ * Capture of raw byte streams, e.g. uart rx and tx, for replay without a
+ * device. The capturing thread only copies the chunk into an in-memory
+ * buffer under a mutex, a writer thread swaps buffers and writes the full
+ * one out, a chunk which does not fit is dropped and counted, the caller
+ * never waits for the file.
+ *
+ * File layout, little endian:
+ *   CaptureFileHeader
+ *   CaptureRecordHeader, len bytes of data
+ *   CaptureRecordHeader, len bytes of data
+ *   ...
+ */
+
+#define CAPTURE_MAGIC    (0x50414355u)  /* "UCAP" */
+#define CAPTURE_VERSION  (1)
+
+typedef enum {
+  CAPTURE_DIR_RX = 0,
+  CAPTURE_DIR_TX,
+} CaptureDir;
+
+typedef struct {
+  uint32_t magic;
+  uint16_t version;
+  uint16_t header_size;  /* sizeof(CaptureFileHeader), records start here */
+  uint64_t start_us;     /* wall clock of capture start, record time is relative */
+} __attribute__ ((packed)) CaptureFileHeader;
+
+typedef struct {
+  uint64_t ts_us;        /* monotonic, since capture start */
+  uint32_t len;
+  uint8_t  dir;          /* CaptureDir */
+  uint8_t  reserved[3];
+} __attribute__ ((packed)) CaptureRecordHeader;
+
+typedef struct {
+  uint64_t records;
+  uint64_t bytes;          /* data bytes, headers not included */
+  uint64_t dropped;        /* records dropped, buffer full */
+  uint64_t dropped_bytes;
+  uint64_t flushes;        /* buffer swaps written out */
+} CaptureStats;
+
+typedef struct {
+  uint64_t      ts_us;
+  CaptureDir    dir;
+  uint32_t      len;
+  unsigned char *data;     /* valid until next CaptureReaderNext */
+} CaptureRecord;
+
+typedef void* CaptureHandle;
+typedef void* CaptureReaderHandle;
+
+/**
+ * @brief create idle capture, nothing recorded until CaptureStart
+ * @param buf_size bytes of each of the two buffers, 0 default 256KB
+ * @return handle, NULL if failed
+ */
+CaptureHandle CaptureCreate(uint32_t buf_size);
+
+/**
+ * @brief stop capture if running and free handle, no thread may append meanwhile
+ * @param handle
+ * @return void
+ */
+void CaptureDestroy(CaptureHandle handle);
+
+/**
+ * @brief create file, write header and start writer thread, statistics reset
+ * @param handle
+ * @param path
+ * @return 0 success, -1 failed or already running
+ */
+int CaptureStart(CaptureHandle handle, const char *path);
+
+/**
+ * @brief write out buffered records and close file, appends become no-ops
+ * @param handle
+ * @return 0 success, -1 not running
+ */
+int CaptureStop(CaptureHandle handle);
+
+/**
+ * @brief record one chunk with current time, never blocks on file io
+ * @param handle
+ * @param dir
+ * @param buf
+ * @param len
+ * @return void
+ */
+void CaptureAppend(CaptureHandle handle, CaptureDir dir, const void *buf, uint32_t len);
+
+/**
+ * @brief get record and drop counters of current or last capture
+ * @param handle
+ * @param stats
+ * @return void
+ */
+void CaptureGetStats(CaptureHandle handle, CaptureStats *stats);
+
+/**
+ * @brief open capture file and check header
+ * @param path
+ * @param header file header copied out, can be NULL
+ * @return handle, NULL if failed or not a capture file
+ */
+CaptureReaderHandle CaptureReaderOpen(const char *path, CaptureFileHeader *header);
+
+/**
+ * @brief read next record
+ * @param handle
+ * @param record
+ * @return 1 got one, 0 end of file, -1 truncated or corrupt record
+ */
+int CaptureReaderNext(CaptureReaderHandle handle, CaptureRecord *record);
+
+/**
+ * @brief restart from first record
+ * @param handle
+ * @return 0 success, -1 failed
+ */
+int CaptureReaderRewind(CaptureReaderHandle handle);
+
+/**
+ * @brief close capture file
+ * @param handle
+ * @return void
+ */
+void CaptureReaderClose(CaptureReaderHandle handle);
+
+#ifdef __cplusplus
+}
+#endif
+#endif  // UTILS_CAPTURE_INC_UNI_CAPTURE_H_
@@ -0,0 +1,390 @@
+/**************************************************************************
+ * Copyright (C) 2020-2020  Junlon2006
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ **************************************************************************
+ *
+ * Description : uni_capture.c
+ * Author      : junlon2006@163.com
+ * Date        : 2020.08.29
+ *
+ **************************************************************************/
+#include "uni_capture.h"
+#include "porting.h"
+#include "errcode.h"
+#include "uni_log.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/time.h>
+
+#define TAG "capture"
+
+#define CAPTURE_BUF_SIZE_DEFAULT   (256 * 1024)
+/* writer wakes up at least this often, a quiet link still reaches the file */
+#define CAPTURE_FLUSH_INTERVAL_MS  (100)
+/* a record longer than this is treated as corrupt file by reader */
+#define CAPTURE_RECORD_LEN_MAX     (64 * 1024 * 1024)
+#define CAPTURE_WRITER_STACK_SIZE  (64 * 1024)
+
+typedef struct {
+  uint32_t      buf_size;
+  unsigned char *bufs[2];     /* appends go to bufs[cur], writer owns the other */
+  int           cur;
+  uint32_t      used;
+  int           kicked;       /* writer signalled, active buffer over half full */
+  int           fd;
+  int64_t       start_us;
+  int           active;       /* read without lock by appenders, fast path when idle */
+  int           is_running;
+  CaptureStats  stats;
+  uni_mutex_t   mutex;
+  uni_sem_t     sem_flush;
+  uni_sem_t     sem_thread_exit_sync;
+} Capture;
+
+typedef struct {
+  FILE          *fp;
+  long          data_offset;
+  unsigned char *buf;
+  uint32_t      buf_size;
+} CaptureReader;
+
+static int _write_all(int fd, const unsigned char *buf, uint32_t len) {
+  ssize_t ret;
+
+  while (len > 0) {
+    ret = write(fd, buf, len);
+    if (ret < 0) {
+      if (EINTR == errno) {
+        continue;
+      }
+      return -1;
+    }
+
+    buf += ret;
+    len -= (uint32_t)ret;
+  }
+
+  return 0;
+}
+
+/* swap buffers and write the full one out, only writer thread calls it */
+static void _flush(Capture *capture) {
+  unsigned char *buf;
+  uint32_t len;
+
+  uni_mutex_lock(&capture->mutex);
+  buf = capture->bufs[capture->cur];
+  len = capture->used;
+  capture->cur ^= 1;
+  capture->used = 0;
+  capture->kicked = 0;
+  uni_mutex_unlock(&capture->mutex);
+
+  if (0 == len) {
+    return;
+  }
+
+  if (0 != _write_all(capture->fd, buf, len)) {
+    LOGE(TAG, "write capture failed, %s", strerror(errno));
+  }
+
+  uni_mutex_lock(&capture->mutex);
+  capture->stats.flushes++;
+  uni_mutex_unlock(&capture->mutex);
+}
+
+static void* _writer(void *args) {
+  Capture *capture = (Capture *)args;
+
+  while (capture->is_running) {
+    uni_sem_wait(&capture->sem_flush, CAPTURE_FLUSH_INTERVAL_MS);
+    _flush(capture);
+  }
+
+  /* last records appended before stop */
+  _flush(capture);
+  uni_sem_signal(&capture->sem_thread_exit_sync);
+  return NULL;
+}
+
+static void _buffers_free(Capture *capture) {
+  uni_free(capture->bufs[0]);
+  uni_free(capture->bufs[1]);
+  capture->bufs[0] = capture->bufs[1] = NULL;
+}
+
+CaptureHandle CaptureCreate(uint32_t buf_size) {
+  Capture *capture;
+
+  if (NULL == (capture = (Capture *)uni_calloc(1, sizeof(Capture)))) {
+    LOGE(TAG, OUT_MEM_STRING);
+    return NULL;
+  }
+
+  capture->buf_size = (0 == buf_size ? CAPTURE_BUF_SIZE_DEFAULT : buf_size);
+  capture->fd = -1;
+  uni_mutex_new(&capture->mutex);
+  uni_sem_new(&capture->sem_flush, 0);
+  uni_sem_new(&capture->sem_thread_exit_sync, 0);
+  return capture;
+}
+
+void CaptureDestroy(CaptureHandle handle) {
+  Capture *capture = (Capture *)handle;
+
+  if (NULL == capture) {
+    return;
+  }
+
+  CaptureStop(capture);
+  uni_mutex_free(&capture->mutex);
+  uni_sem_free(&capture->sem_flush);
+  uni_sem_free(&capture->sem_thread_exit_sync);
+  uni_free(capture);
+}
+
+int CaptureStart(CaptureHandle handle, const char *path) {
+  Capture *capture = (Capture *)handle;
+  CaptureFileHeader header;
+  struct timeval now;
+
+  if (NULL == capture || NULL == path || capture->is_running) {
+    return -1;
+  }
+
+  capture->bufs[0] = (unsigned char *)uni_malloc(capture->buf_size);
+  capture->bufs[1] = (unsigned char *)uni_malloc(capture->buf_size);
+  if (NULL == capture->bufs[0] || NULL == capture->bufs[1]) {
+    LOGE(TAG, OUT_MEM_STRING);
+    goto L_ERROR;
+  }
+
+  capture->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (capture->fd < 0) {
+    LOGE(TAG, "open %s failed, %s", path, strerror(errno));
+    goto L_ERROR;
+  }
+
+  gettimeofday(&now, NULL);
+  header.magic = CAPTURE_MAGIC;
+  header.version = CAPTURE_VERSION;
+  header.header_size = sizeof(CaptureFileHeader);
+  header.start_us = (uint64_t)now.tv_sec * 1000000 + now.tv_usec;
+  if (0 != _write_all(capture->fd, (const unsigned char *)&header, sizeof(header))) {
+    LOGE(TAG, "write %s failed, %s", path, strerror(errno));
+    goto L_ERROR;
+  }
+
+  capture->cur = 0;
+  capture->used = 0;
+  capture->kicked = 0;
+  MZERO(&capture->stats);
+  capture->start_us = uni_get_clock_time_us();
+  capture->is_running = 1;
+  if (OK != uni_thread_new(TAG, _writer, capture, CAPTURE_WRITER_STACK_SIZE)) {
+    LOGE(TAG, "create writer failed");
+    capture->is_running = 0;
+    goto L_ERROR;
+  }
+
+  __atomic_store_n(&capture->active, 1, __ATOMIC_RELEASE);
+  LOGT(TAG, "capture to %s", path);
+  return 0;
+
+L_ERROR:
+  if (capture->fd >= 0) {
+    close(capture->fd);
+    capture->fd = -1;
+  }
+  _buffers_free(capture);
+  return -1;
+}
+
+int CaptureStop(CaptureHandle handle) {
+  Capture *capture = (Capture *)handle;
+
+  if (NULL == capture || !capture->is_running) {
+    return -1;
+  }
+
+  /* appenders recheck active under mutex, none touches buffers after this */
+  uni_mutex_lock(&capture->mutex);
+  __atomic_store_n(&capture->active, 0, __ATOMIC_RELEASE);
+  uni_mutex_unlock(&capture->mutex);
+
+  capture->is_running = 0;
+  uni_sem_signal(&capture->sem_flush);
+  uni_sem_wait(&capture->sem_thread_exit_sync, UNI_WAIT_FOREVER);
+
+  close(capture->fd);
+  capture->fd = -1;
+  _buffers_free(capture);
+  LOGT(TAG, "capture stopped. records=%llu, bytes=%llu, dropped=%llu",
+       (unsigned long long)capture->stats.records,
+       (unsigned long long)capture->stats.bytes,
+       (unsigned long long)capture->stats.dropped);
+  return 0;
+}
+
+void CaptureAppend(CaptureHandle handle, CaptureDir dir, const void *buf, uint32_t len) {
+  Capture *capture = (Capture *)handle;
+  CaptureRecordHeader record;
+  unsigned char *p;
+  int kick = 0;
+
+  if (NULL == capture || !__atomic_load_n(&capture->active, __ATOMIC_ACQUIRE)) {
+    return;
+  }
+
+  MZERO(&record);
+  record.len = len;
+  record.dir = (uint8_t)dir;
+
+  uni_mutex_lock(&capture->mutex);
+  if (!capture->active) {
+    uni_mutex_unlock(&capture->mutex);
+    return;
+  }
+
+  /* stamped under lock, records in file are in time order */
+  record.ts_us = (uint64_t)(uni_get_clock_time_us() - capture->start_us);
+  if ((uint64_t)capture->used + sizeof(record) + len > capture->buf_size) {
+    capture->stats.dropped++;
+    capture->stats.dropped_bytes += len;
+    kick = !capture->kicked;
+    capture->kicked = 1;
+    uni_mutex_unlock(&capture->mutex);
+    goto L_KICK;
+  }
+
+  p = capture->bufs[capture->cur] + capture->used;
+  memcpy(p, &record, sizeof(record));
+  memcpy(p + sizeof(record), buf, len);
+  capture->used += sizeof(record) + len;
+  capture->stats.records++;
+  capture->stats.bytes += len;
+  if (!capture->kicked && capture->used >= capture->buf_size / 2) {
+    capture->kicked = kick = 1;
+  }
+  uni_mutex_unlock(&capture->mutex);
+
+L_KICK:
+  if (kick) {
+    uni_sem_signal(&capture->sem_flush);
+  }
+}
+
+void CaptureGetStats(CaptureHandle handle, CaptureStats *stats) {
+  Capture *capture = (Capture *)handle;
+
+  if (NULL == capture || NULL == stats) {
+    return;
+  }
+
+  uni_mutex_lock(&capture->mutex);
+  *stats = capture->stats;
+  uni_mutex_unlock(&capture->mutex);
+}
+
+CaptureReaderHandle CaptureReaderOpen(const char *path, CaptureFileHeader *header) {
+  CaptureReader *reader;
+  CaptureFileHeader h;
+  FILE *fp;
+
+  if (NULL == (fp = fopen(path, "rb"))) {
+    LOGE(TAG, "open %s failed, %s", path, strerror(errno));
+    return NULL;
+  }
+
+  if (1 != fread(&h, sizeof(h), 1, fp) || CAPTURE_MAGIC != h.magic ||
+      CAPTURE_VERSION != h.version || h.header_size < sizeof(h) ||
+      0 != fseek(fp, h.header_size, SEEK_SET)) {
+    LOGE(TAG, "%s is not a capture file", path);
+    fclose(fp);
+    return NULL;
+  }
+
+  if (NULL == (reader = (CaptureReader *)uni_calloc(1, sizeof(CaptureReader)))) {
+    LOGE(TAG, OUT_MEM_STRING);
+    fclose(fp);
+    return NULL;
+  }
+
+  reader->fp = fp;
+  reader->data_offset = h.header_size;
+  if (NULL != header) {
+    *header = h;
+  }
+
+  return reader;
+}
+
+int CaptureReaderNext(CaptureReaderHandle handle, CaptureRecord *record) {
+  CaptureReader *reader = (CaptureReader *)handle;
+  CaptureRecordHeader h;
+  unsigned char *buf;
+  size_t ret;
+
+  ret = fread(&h, 1, sizeof(h), reader->fp);
+  if (0 == ret && feof(reader->fp)) {
+    return 0;
+  }
+
+  if (ret != sizeof(h) || h.len > CAPTURE_RECORD_LEN_MAX || h.dir > CAPTURE_DIR_TX) {
+    return -1;
+  }
+
+  if (h.len > reader->buf_size) {
+    if (NULL == (buf = (unsigned char *)uni_realloc(reader->buf, h.len))) {
+      LOGE(TAG, OUT_MEM_STRING);
+      return -1;
+    }
+
+    reader->buf = buf;
+    reader->buf_size = h.len;
+  }
+
+  if (h.len > 0 && 1 != fread(reader->buf, h.len, 1, reader->fp)) {
+    return -1;
+  }
+
+  record->ts_us = h.ts_us;
+  record->dir = (CaptureDir)h.dir;
+  record->len = h.len;
+  record->data = reader->buf;
+  return 1;
+}
+
+int CaptureReaderRewind(CaptureReaderHandle handle) {
+  CaptureReader *reader = (CaptureReader *)handle;
+  return 0 == fseek(reader->fp, reader->data_offset, SEEK_SET) ? 0 : -1;
+}
+
+void CaptureReaderClose(CaptureReaderHandle handle) {
+  CaptureReader *reader = (CaptureReader *)handle;
+
+  if (NULL == reader) {
+    return;
+  }
+
+  fclose(reader->fp);
+  uni_free(reader->buf);
+  uni_free(reader);
+}
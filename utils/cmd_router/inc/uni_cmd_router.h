@@ -0,0 +1,98 @@
+/**************************************************************************
+ * Copyright (C) 2020-2020  Junlon2006
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ **************************************************************************
+ *
+ * Description : uni_cmd_router.h
+ * Author      : junlon2006@163.com
+ * Date        : 2020.08.12
+ *
+ **************************************************************************/
+#ifndef UTILS_CMD_ROUTER_INC_UNI_CMD_ROUTER_H_
+#define UTILS_CMD_ROUTER_INC_UNI_CMD_ROUTER_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+/*
+ * Route ASR command strings (or cmd_hash_code) to handlers in O(1).
+ * The tables are generated at build time by CMD_ROUTER_GEN from a command
+ * table file, see tools/cmd_router_gen.c for the file format. Lookup is a
+ * minimal perfect hash (hash and displace), one or two hashes of the key
+ * plus one memcmp, payload is never copied.
+ */
+
+typedef void (*CmdRouteHandler)(const char *cmd, uint32_t len, void *ctx);
+
+typedef struct {
+  const char      *name;
+  uint32_t        name_len;
+  uint32_t        hash_code; /* cmd_hash_code, 0 means not set */
+  CmdRouteHandler handler;
+} CmdRoute;
+
+typedef struct {
+  uint32_t       route_cnt;
+  const CmdRoute *routes;      /* ordered by perfect hash slot of name */
+  const int32_t  *name_g;      /* displacement of each bucket */
+  uint32_t       code_cnt;
+  const int32_t  *code_g;
+  const uint16_t *code_routes; /* code slot -> route index */
+} CmdRouteTable;
+
+/**
+ * @brief hash used by both generator and runtime, FNV based, seed 0 means default basis
+ * @param seed
+ * @param key
+ * @param len
+ * @return hash value
+ */
+uint32_t CmdRouterHash(uint32_t seed, const char *key, uint32_t len);
+
+/**
+ * @brief find route by command string, key need not be '\0' terminated
+ * @param table
+ * @param cmd
+ * @param len
+ * @return route, NULL if not found
+ */
+const CmdRoute* CmdRouterLookup(const CmdRouteTable *table, const char *cmd, uint32_t len);
+
+/**
+ * @brief find route by cmd_hash_code
+ * @param table
+ * @param hash_code
+ * @return route, NULL if not found
+ */
+const CmdRoute* CmdRouterLookupCode(const CmdRouteTable *table, uint32_t hash_code);
+
+/**
+ * @brief lookup and call the handler
+ * @param table
+ * @param cmd
+ * @param len
+ * @param ctx passed to handler
+ * @return 0 dispatched, -1 not found
+ */
+int CmdRouterDispatch(const CmdRouteTable *table, const char *cmd, uint32_t len, void *ctx);
+
+#ifdef __cplusplus
+}
+#endif
+#endif  // UTILS_CMD_ROUTER_INC_UNI_CMD_ROUTER_H_
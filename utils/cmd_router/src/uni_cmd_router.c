@@ -0,0 +1,88 @@
+/**************************************************************************
+ * Copyright (C) 2020-2020  Junlon2006
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ **************************************************************************
+ *
+ * Description : uni_cmd_router.c
+ * Author      : junlon2006@163.com
+ * Date        : 2020.08.12
+ *
+ **************************************************************************/
+#include "uni_cmd_router.h"
+
+#include <string.h>
+
+#define FNV_PRIME  (0x01000193)
+
+uint32_t CmdRouterHash(uint32_t seed, const char *key, uint32_t len) {
+  uint32_t h = (0 == seed) ? FNV_PRIME : seed;
+  uint32_t i;
+  for (i = 0; i < len; i++) {
+    h = (h * FNV_PRIME) ^ (unsigned char)key[i];
+  }
+
+  return h;
+}
+
+static uint32_t _slot(const int32_t *g, uint32_t cnt, const char *key, uint32_t len) {
+  int32_t d = g[CmdRouterHash(0, key, len) % cnt];
+  if (d < 0) {
+    return (uint32_t)(-d - 1);
+  }
+
+  return CmdRouterHash((uint32_t)d, key, len) % cnt;
+}
+
+const CmdRoute* CmdRouterLookup(const CmdRouteTable *table, const char *cmd, uint32_t len) {
+  const CmdRoute *route;
+  if (NULL == table || 0 == table->route_cnt || NULL == cmd) {
+    return NULL;
+  }
+
+  route = &table->routes[_slot(table->name_g, table->route_cnt, cmd, len)];
+  if (route->name_len != len || 0 != memcmp(route->name, cmd, len)) {
+    return NULL;
+  }
+
+  return route;
+}
+
+const CmdRoute* CmdRouterLookupCode(const CmdRouteTable *table, uint32_t hash_code) {
+  const CmdRoute *route;
+  unsigned char key[4];
+  if (NULL == table || 0 == table->code_cnt || 0 == hash_code) {
+    return NULL;
+  }
+
+  key[0] = (unsigned char)(hash_code);
+  key[1] = (unsigned char)(hash_code >> 8);
+  key[2] = (unsigned char)(hash_code >> 16);
+  key[3] = (unsigned char)(hash_code >> 24);
+
+  route = &table->routes[table->code_routes[_slot(table->code_g, table->code_cnt,
+                                                  (const char *)key, sizeof(key))]];
+  return (route->hash_code == hash_code) ? route : NULL;
+}
+
+int CmdRouterDispatch(const CmdRouteTable *table, const char *cmd, uint32_t len, void *ctx) {
+  const CmdRoute *route = CmdRouterLookup(table, cmd, len);
+  if (NULL == route || NULL == route->handler) {
+    return -1;
+  }
+
+  route->handler(cmd, len, ctx);
+  return 0;
+}
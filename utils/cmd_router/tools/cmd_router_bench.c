@@ -0,0 +1,183 @@
+/**************************************************************************
+ * Copyright (C) 2020-2020  Unisound
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ **************************************************************************
+ *
+ * Description : cmd_router_bench.c
+ * Author      : junlon2006@163.com
+ * Date        : 2020.09.08
+ *
+ **************************************************************************/
+
+/*
+ * usage: CMD_ROUTER_BENCH [-n rounds] [-m miss_percent]
+ *
+ * routes ASR results through bench_command_table, 500 commands generated by
+ * CMD_ROUTER_GEN at build time, against the strcmp chain the app used before:
+ * payload copied into a 16 byte '\0' terminated buffer, then compared with
+ * every command in turn. queries are all commands in random order plus
+ * unknown strings, payload not '\0' terminated as it comes from uart. both
+ * paths must resolve every query the same way, exit 1 otherwise
+ */
+#include "uni_cmd_router.h"
+#include "bench_command_table.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+
+#define CHAIN_PAYLOAD_LEN  (16)
+#define QUERY_LEN_MAX      (CHAIN_PAYLOAD_LEN - 1)
+
+typedef struct {
+  char     text[QUERY_LEN_MAX];
+  uint32_t len;
+  int      expect;  /* route index, -1 for unknown */
+} Query;
+
+static uint32_t g_hits = 0;
+
+void bench_on_cmd(const char *cmd, uint32_t len, void *ctx) {
+  g_hits++;
+}
+
+static int64_t _now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/* the former app path, copy then one strcmp per command until a match */
+static int _strcmp_chain(const char *payload, uint32_t len) {
+  char tmp[CHAIN_PAYLOAD_LEN] = {0};
+  uint32_t i;
+
+  strncpy(tmp, payload, ((len < CHAIN_PAYLOAD_LEN) ? len : (CHAIN_PAYLOAD_LEN - 1)));
+  for (i = 0; i < bench_command_table.route_cnt; i++) {
+    if (0 == strcmp(tmp, bench_command_table.routes[i].name)) {
+      bench_command_table.routes[i].handler(payload, len, NULL);
+      return (int)i;
+    }
+  }
+
+  return -1;
+}
+
+static int _router(const char *payload, uint32_t len) {
+  const CmdRoute *route = CmdRouterLookup(&bench_command_table, payload, len);
+  if (NULL == route) {
+    return -1;
+  }
+
+  route->handler(payload, len, NULL);
+  return (int)(route - bench_command_table.routes);
+}
+
+static Query* _queries_build(uint32_t miss_percent, uint32_t *cnt) {
+  uint32_t routes = bench_command_table.route_cnt;
+  uint32_t misses = routes * miss_percent / 100;
+  Query *queries, tmp;
+  uint32_t i, j;
+
+  *cnt = routes + misses;
+  if (NULL == (queries = (Query *)malloc(*cnt * sizeof(Query)))) {
+    return NULL;
+  }
+
+  for (i = 0; i < routes; i++) {
+    queries[i].len    = bench_command_table.routes[i].name_len;
+    queries[i].expect = (int)i;
+    memcpy(queries[i].text, bench_command_table.routes[i].name, queries[i].len);
+  }
+
+  /* same shape as real commands, so misses are not rejected at the first byte */
+  for (i = routes; i < *cnt; i++) {
+    queries[i].len    = (uint32_t)snprintf(tmp.text, sizeof(tmp.text), "ac_mode_x%u", i);
+    queries[i].expect = -1;
+    memcpy(queries[i].text, tmp.text, queries[i].len);
+  }
+
+  srand(1);
+  for (i = *cnt - 1; i > 0; i--) {
+    j          = (uint32_t)rand() % (i + 1);
+    tmp        = queries[i];
+    queries[i] = queries[j];
+    queries[j] = tmp;
+  }
+
+  return queries;
+}
+
+static int64_t _run(const char *mode, int (*route)(const char *, uint32_t),
+                    const Query *queries, uint32_t cnt, uint32_t rounds) {
+  int64_t start, cost;
+  uint32_t r, i;
+
+  for (i = 0; i < cnt; i++) {
+    if (route(queries[i].text, queries[i].len) != queries[i].expect) {
+      fprintf(stderr, "%s resolved %.*s wrong\n", mode, (int)queries[i].len, queries[i].text);
+      return -1;
+    }
+  }
+
+  g_hits = 0;
+  start  = _now_ns();
+  for (r = 0; r < rounds; r++) {
+    for (i = 0; i < cnt; i++) {
+      route(queries[i].text, queries[i].len);
+    }
+  }
+  cost = _now_ns() - start;
+
+  printf("[bench] %-6s %u lookups, hits=%u, %.1fns per lookup\n", mode, cnt * rounds,
+         g_hits, (double)cost / ((uint64_t)cnt * rounds));
+  return cost;
+}
+
+int main(int argc, char *argv[]) {
+  uint32_t rounds = 2000, miss_percent = 10, cnt;
+  int64_t chain, router;
+  Query *queries;
+  int opt;
+
+  while (-1 != (opt = getopt(argc, argv, "n:m:"))) {
+    switch (opt) {
+    case 'n': rounds = (uint32_t)atoi(optarg); break;
+    case 'm': miss_percent = (uint32_t)atoi(optarg); break;
+    default:
+      fprintf(stderr, "usage: %s [-n rounds] [-m miss_percent]\n", argv[0]);
+      return 2;
+    }
+  }
+
+  if (0 == rounds || NULL == (queries = _queries_build(miss_percent, &cnt))) {
+    return 2;
+  }
+
+  printf("[bench] %u commands, %u queries per round, %u%% unknown\n",
+         bench_command_table.route_cnt, cnt, miss_percent);
+  chain  = _run("strcmp", _strcmp_chain, queries, cnt, rounds);
+  router = _run("router", _router, queries, cnt, rounds);
+  free(queries);
+  if (chain < 0 || router < 0) {
+    return 1;
+  }
+
+  printf("[bench] router %.1fx faster than strcmp chain\n", router ? (double)chain / router : 0.0);
+  return 0;
+}
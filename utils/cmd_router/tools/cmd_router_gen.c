@@ -0,0 +1,388 @@
+/**************************************************************************
+ * Copyright (C) 2020-2020  Junlon2006
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ **************************************************************************
+ *
+ * Description : cmd_router_gen.c
+ * Author      : junlon2006@163.com
+ * Date        : 2020.08.12
+ *
+ **************************************************************************/
+
+/*
+ * usage: CMD_ROUTER_GEN <command table> <output dir> <table name>
+ * generate <table name>.c and <table name>.h into output dir.
+ *
+ * command table format, one command per line, '#' starts a comment:
+ *   <command string>  <handler function>  [cmd_hash_code]
+ * handler function is declared as CmdRouteHandler in the generated header,
+ * '-' means no handler. cmd_hash_code can be decimal or 0x hex.
+ */
+#include "uni_cmd_router.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#define LINE_MAX_LEN      (1024)
+#define DISPLACE_TRY_MAX  (10000000)
+
+typedef struct {
+  char     *name;
+  char     *handler;
+  uint32_t hash_code;
+  uint32_t slot;
+} Entry;
+
+typedef struct {
+  Entry    *entries;
+  uint32_t cnt;
+  uint32_t capacity;
+} EntryList;
+
+static char* _strdup(const char *s) {
+  char *p = (char *)malloc(strlen(s) + 1);
+  strcpy(p, s);
+  return p;
+}
+
+static int _entry_add(EntryList *list, const char *name, const char *handler,
+                      uint32_t hash_code) {
+  if (list->cnt == list->capacity) {
+    list->capacity = list->capacity ? list->capacity * 2 : 64;
+    list->entries  = (Entry *)realloc(list->entries, list->capacity * sizeof(Entry));
+    if (NULL == list->entries) return -1;
+  }
+
+  list->entries[list->cnt].name      = _strdup(name);
+  list->entries[list->cnt].handler   = _strdup(handler);
+  list->entries[list->cnt].hash_code = hash_code;
+  list->cnt++;
+  return 0;
+}
+
+static int _parse(const char *file, EntryList *list) {
+  char line[LINE_MAX_LEN], name[LINE_MAX_LEN], handler[LINE_MAX_LEN], code[LINE_MAX_LEN];
+  int line_no = 0, fields;
+  char *comment;
+  uint32_t i;
+  FILE *fp;
+
+  if (NULL == (fp = fopen(file, "r"))) {
+    fprintf(stderr, "open %s failed\n", file);
+    return -1;
+  }
+
+  while (NULL != fgets(line, sizeof(line), fp)) {
+    line_no++;
+    if (NULL != (comment = strchr(line, '#'))) *comment = '\0';
+    fields = sscanf(line, "%s %s %s", name, handler, code);
+    if (fields <= 0) continue;
+    if (fields < 2) {
+      fprintf(stderr, "%s:%d: expect <command> <handler> [hash_code]\n", file, line_no);
+      fclose(fp);
+      return -1;
+    }
+
+    for (i = 0; i < list->cnt; i++) {
+      if (0 == strcmp(list->entries[i].name, name)) {
+        fprintf(stderr, "%s:%d: duplicate command %s\n", file, line_no, name);
+        fclose(fp);
+        return -1;
+      }
+    }
+
+    if (0 != _entry_add(list, name, handler,
+                        fields == 3 ? (uint32_t)strtoul(code, NULL, 0) : 0)) {
+      fclose(fp);
+      return -1;
+    }
+  }
+
+  fclose(fp);
+  return 0;
+}
+
+typedef struct {
+  uint32_t bucket;
+  uint32_t size;
+} BucketOrder;
+
+static int _bucket_order_cmp(const void *a, const void *b) {
+  const BucketOrder *x = (const BucketOrder *)a;
+  const BucketOrder *y = (const BucketOrder *)b;
+  if (x->size != y->size) return (x->size < y->size) ? 1 : -1;
+  return (x->bucket < y->bucket) ? -1 : 1;
+}
+
+/*
+ * hash and displace: keys are hashed into n buckets with seed 0, the biggest
+ * buckets are placed first by searching a seed which maps all of its keys to
+ * free slots, single key buckets take the remaining slots directly (g < 0).
+ */
+static int _build_mph(const char **keys, const uint32_t *lens, uint32_t n,
+                      int32_t *g, uint32_t *slots) {
+  BucketOrder *order  = (BucketOrder *)calloc(n, sizeof(BucketOrder));
+  uint32_t *bucket_of = (uint32_t *)malloc(n * sizeof(uint32_t));
+  char *used          = (char *)calloc(n, 1);
+  uint32_t *members   = (uint32_t *)malloc(n * sizeof(uint32_t));
+  uint32_t *tried     = (uint32_t *)malloc(n * sizeof(uint32_t));
+  uint32_t i, j, k, m, d, free_slot = 0;
+  int ret = 0;
+
+  for (i = 0; i < n; i++) {
+    order[i].bucket = i;
+    g[i] = 0;
+  }
+
+  for (i = 0; i < n; i++) {
+    bucket_of[i] = CmdRouterHash(0, keys[i], lens[i]) % n;
+    order[bucket_of[i]].size++;
+  }
+
+  qsort(order, n, sizeof(BucketOrder), _bucket_order_cmp);
+
+  for (i = 0; i < n && order[i].size > 1; i++) {
+    for (m = 0, j = 0; j < n; j++) {
+      if (bucket_of[j] == order[i].bucket) members[m++] = j;
+    }
+
+    for (d = 1; d < DISPLACE_TRY_MAX; d++) {
+      for (k = 0; k < m; k++) {
+        tried[k] = CmdRouterHash(d, keys[members[k]], lens[members[k]]) % n;
+        if (used[tried[k]]) break;
+        for (j = 0; j < k && tried[j] != tried[k]; j++);
+        if (j < k) break;
+      }
+      if (k == m) break;
+    }
+
+    if (d == DISPLACE_TRY_MAX) {
+      fprintf(stderr, "perfect hash not found\n");
+      ret = -1;
+      goto L_END;
+    }
+
+    g[order[i].bucket] = (int32_t)d;
+    for (k = 0; k < m; k++) {
+      used[tried[k]] = 1;
+      slots[members[k]] = tried[k];
+    }
+  }
+
+  for (; i < n && order[i].size == 1; i++) {
+    while (used[free_slot]) free_slot++;
+    for (j = 0; bucket_of[j] != order[i].bucket; j++);
+    used[free_slot] = 1;
+    slots[j] = free_slot;
+    g[order[i].bucket] = -(int32_t)free_slot - 1;
+  }
+
+L_END:
+  free(order);
+  free(bucket_of);
+  free(used);
+  free(members);
+  free(tried);
+  return ret;
+}
+
+static void _emit_g(FILE *fp, const char *name, const char *suffix, const int32_t *g, uint32_t n) {
+  uint32_t i;
+  fprintf(fp, "static const int32_t %s_%s[%u] = {", name, suffix, n);
+  for (i = 0; i < n; i++) {
+    fprintf(fp, "%s%d,", (i % 10) ? " " : "\n  ", g[i]);
+  }
+  fprintf(fp, "\n};\n\n");
+}
+
+static void _emit_string(FILE *fp, const char *s) {
+  fputc('"', fp);
+  for (; *s; s++) {
+    if ('"' == *s || '\\' == *s) fputc('\\', fp);
+    fputc(*s, fp);
+  }
+  fputc('"', fp);
+}
+
+static int _is_handler_set(const Entry *entry) {
+  return 0 != strcmp(entry->handler, "-");
+}
+
+static int _emit_header(const char *dir, const char *name, EntryList *list) {
+  char path[LINE_MAX_LEN];
+  uint32_t i, j;
+  FILE *fp;
+
+  snprintf(path, sizeof(path), "%s/%s.h", dir, name);
+  if (NULL == (fp = fopen(path, "w"))) {
+    fprintf(stderr, "open %s failed\n", path);
+    return -1;
+  }
+
+  fprintf(fp, "/* generated by CMD_ROUTER_GEN, do not edit */\n");
+  fprintf(fp, "#ifndef CMD_ROUTER_GEN_%s_H_\n#define CMD_ROUTER_GEN_%s_H_\n\n", name, name);
+  fprintf(fp, "#ifdef __cplusplus\nextern \"C\" {\n#endif\n\n");
+  fprintf(fp, "#include \"uni_cmd_router.h\"\n\n");
+  for (i = 0; i < list->cnt; i++) {
+    if (!_is_handler_set(&list->entries[i])) continue;
+    for (j = 0; j < i && strcmp(list->entries[j].handler, list->entries[i].handler); j++);
+    if (j < i) continue;
+    fprintf(fp, "void %s(const char *cmd, uint32_t len, void *ctx);\n", list->entries[i].handler);
+  }
+  fprintf(fp, "\nextern const CmdRouteTable %s;\n\n", name);
+  fprintf(fp, "#ifdef __cplusplus\n}\n#endif\n#endif\n");
+  fclose(fp);
+  return 0;
+}
+
+static int _emit_source(const char *dir, const char *name, EntryList *list,
+                        const int32_t *name_g, const int32_t *code_g,
+                        const uint16_t *code_routes, uint32_t code_cnt) {
+  char path[LINE_MAX_LEN];
+  Entry **by_slot;
+  uint32_t i;
+  FILE *fp;
+
+  snprintf(path, sizeof(path), "%s/%s.c", dir, name);
+  if (NULL == (fp = fopen(path, "w"))) {
+    fprintf(stderr, "open %s failed\n", path);
+    return -1;
+  }
+
+  by_slot = (Entry **)malloc(list->cnt * sizeof(Entry *));
+  for (i = 0; i < list->cnt; i++) {
+    by_slot[list->entries[i].slot] = &list->entries[i];
+  }
+
+  fprintf(fp, "/* generated by CMD_ROUTER_GEN, do not edit */\n");
+  fprintf(fp, "#include \"%s.h\"\n#include <stddef.h>\n\n", name);
+  fprintf(fp, "static const CmdRoute %s_routes[%u] = {\n", name, list->cnt);
+  for (i = 0; i < list->cnt; i++) {
+    fprintf(fp, "  {");
+    _emit_string(fp, by_slot[i]->name);
+    fprintf(fp, ", %u, 0x%08xu, %s},\n", (uint32_t)strlen(by_slot[i]->name),
+            by_slot[i]->hash_code,
+            _is_handler_set(by_slot[i]) ? by_slot[i]->handler : "NULL");
+  }
+  fprintf(fp, "};\n\n");
+
+  _emit_g(fp, name, "name_g", name_g, list->cnt);
+  if (code_cnt > 0) {
+    _emit_g(fp, name, "code_g", code_g, code_cnt);
+    fprintf(fp, "static const uint16_t %s_code_routes[%u] = {", name, code_cnt);
+    for (i = 0; i < code_cnt; i++) {
+      fprintf(fp, "%s%u,", (i % 10) ? " " : "\n  ", code_routes[i]);
+    }
+    fprintf(fp, "\n};\n\n");
+  }
+
+  fprintf(fp, "const CmdRouteTable %s = {\n", name);
+  fprintf(fp, "  %u, %s_routes, %s_name_g,\n", list->cnt, name, name);
+  if (code_cnt > 0) {
+    fprintf(fp, "  %u, %s_code_g, %s_code_routes,\n", code_cnt, name, name);
+  } else {
+    fprintf(fp, "  0, NULL, NULL,\n");
+  }
+  fprintf(fp, "};\n");
+
+  free(by_slot);
+  fclose(fp);
+  return 0;
+}
+
+static void _code_key(uint32_t code, char *key) {
+  key[0] = (char)(code);
+  key[1] = (char)(code >> 8);
+  key[2] = (char)(code >> 16);
+  key[3] = (char)(code >> 24);
+}
+
+int main(int argc, char *argv[]) {
+  EntryList list = {0};
+  const char **keys;
+  uint32_t *lens, *slots, *code_entry;
+  int32_t *name_g, *code_g = NULL;
+  uint16_t *code_routes = NULL;
+  char (*code_keys)[4];
+  uint32_t i, j, code_cnt = 0;
+  int ret;
+
+  if (argc != 4) {
+    fprintf(stderr, "usage: %s <command table> <output dir> <table name>\n", argv[0]);
+    return -1;
+  }
+
+  if (0 != _parse(argv[1], &list) || 0 == list.cnt || list.cnt > 0xFFFF) {
+    fprintf(stderr, "invalid command table %s\n", argv[1]);
+    return -1;
+  }
+
+  keys       = (const char **)malloc(list.cnt * sizeof(char *));
+  lens       = (uint32_t *)malloc(list.cnt * sizeof(uint32_t));
+  slots      = (uint32_t *)malloc(list.cnt * sizeof(uint32_t));
+  name_g     = (int32_t *)malloc(list.cnt * sizeof(int32_t));
+  code_entry = (uint32_t *)malloc(list.cnt * sizeof(uint32_t));
+  code_keys  = (char (*)[4])malloc(list.cnt * 4);
+
+  for (i = 0; i < list.cnt; i++) {
+    keys[i] = list.entries[i].name;
+    lens[i] = strlen(list.entries[i].name);
+  }
+
+  if (0 != _build_mph(keys, lens, list.cnt, name_g, slots)) {
+    return -1;
+  }
+
+  for (i = 0; i < list.cnt; i++) {
+    list.entries[i].slot = slots[i];
+    if (0 != list.entries[i].hash_code) {
+      _code_key(list.entries[i].hash_code, code_keys[code_cnt]);
+      keys[code_cnt] = code_keys[code_cnt];
+      lens[code_cnt] = 4;
+      code_entry[code_cnt++] = i;
+    }
+  }
+
+  if (code_cnt > 0) {
+    code_g      = (int32_t *)malloc(code_cnt * sizeof(int32_t));
+    code_routes = (uint16_t *)malloc(code_cnt * sizeof(uint16_t));
+    for (i = 0; i < code_cnt; i++) {
+      for (j = i + 1; j < code_cnt; j++) {
+        if (0 == memcmp(code_keys[i], code_keys[j], 4)) {
+          fprintf(stderr, "duplicate hash_code of %s\n", list.entries[code_entry[j]].name);
+          return -1;
+        }
+      }
+    }
+
+    if (0 != _build_mph(keys, lens, code_cnt, code_g, slots)) {
+      return -1;
+    }
+
+    for (i = 0; i < code_cnt; i++) {
+      code_routes[slots[i]] = (uint16_t)list.entries[code_entry[i]].slot;
+    }
+  }
+
+  ret = _emit_header(argv[2], argv[3], &list);
+  if (0 == ret) {
+    ret = _emit_source(argv[2], argv[3], &list, name_g, code_g, code_routes, code_cnt);
+  }
+
+  return ret;
+}
@@ -0,0 +1,148 @@
+/**************************************************************************
+ * Copyright (C) 2020-2020  Junlon2006
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ **************************************************************************
+ *
+ * Description : uni_dispatcher.h
+ * Author      : junlon2006@163.com
+ * Date        : 2020.08.13
+ *
+ **************************************************************************/
+#ifndef UTILS_DISPATCHER_INC_UNI_DISPATCHER_H_
+#define UTILS_DISPATCHER_INC_UNI_DISPATCHER_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+/*
+ * One task dispatcher shared by several task classes. Every class has its
+ * own FIFO queue and a concurrency limit, a pool of worker threads serves
+ * all classes. Among the classes under their limit the oldest head task
+ * runs first, so arrival order across classes is kept as far as the limits
+ * allow, and a class which is slow or busy can only occupy up to its limit.
+ * Tasks submitted with the same key in one class run one after another in
+ * submit order, tasks with different keys may run in parallel. A watchdog
+ * reports tasks which run longer than the latency budget of their class.
+ * With worker_cnt 0 no thread is created at all, the owner runs queued
+ * tasks from its own loop by DispatcherRunOnce, one task at a time, and
+ * budget overruns are reported when the task finishes.
+ */
+
+#define DISPATCHER_CLASS_MAX  (8)
+#define DISPATCHER_NO_KEY     (0xFFFFFFFFu)
+
+typedef void* DispatcherHandle;
+
+typedef void (*DispatchHandler)(void *task);
+
+typedef struct {
+  const char *name;
+  uint32_t   max_concurrency;   /* 0 means no limit except worker count */
+  uint32_t   latency_budget_ms; /* 0 means watchdog disabled */
+} DispatcherClass;
+
+typedef struct {
+  uint32_t        worker_cnt;       /* 0 means cooperative, see DispatcherRunOnce */
+  uint32_t        stack_size;
+  uint32_t        class_cnt;
+  DispatcherClass classes[DISPATCHER_CLASS_MAX];
+} DispatcherConfig;
+
+typedef struct {
+  uint32_t worker_cnt;
+  uint32_t class_cnt;
+  uint32_t queued[DISPATCHER_CLASS_MAX];
+  uint32_t queued_max[DISPATCHER_CLASS_MAX];
+  uint32_t running[DISPATCHER_CLASS_MAX];
+  uint32_t dispatched[DISPATCHER_CLASS_MAX];
+  uint32_t throttled[DISPATCHER_CLASS_MAX]; /* queued tasks waited for class limit or key */
+  uint32_t overrun[DISPATCHER_CLASS_MAX];   /* tasks over latency budget */
+  uint32_t latency_max_ms[DISPATCHER_CLASS_MAX];
+} DispatcherStats;
+
+/**
+ * @brief create dispatcher and start its workers
+ * @param config
+ * @param handler called on a worker thread for every task
+ * @return handle, NULL if failed
+ */
+DispatcherHandle DispatcherCreate(const DispatcherConfig *config, DispatchHandler handler);
+
+/**
+ * @brief stop workers and free dispatcher, queued tasks are dropped without handler
+ * @param handle
+ * @return void
+ */
+void DispatcherDestroy(DispatcherHandle handle);
+
+/**
+ * @brief queue task into class without ordering key
+ * @param handle
+ * @param class_id index of config classes
+ * @param task
+ * @return 0 success, -1 failed
+ */
+int DispatcherSubmit(DispatcherHandle handle, uint32_t class_id, void *task);
+
+/**
+ * @brief queue task into class, tasks with same key in one class never run concurrently
+ * @param handle
+ * @param class_id index of config classes
+ * @param key ordering key, DISPATCHER_NO_KEY same as DispatcherSubmit
+ * @param task
+ * @return 0 success, -1 failed
+ */
+int DispatcherSubmitKeyed(DispatcherHandle handle, uint32_t class_id, uint32_t key, void *task);
+
+/**
+ * @brief change latency budget of class at runtime
+ * @param handle
+ * @param class_id
+ * @param budget_ms 0 disable watchdog of class
+ * @return 0 success, -1 failed
+ */
+int DispatcherSetLatencyBudget(DispatcherHandle handle, uint32_t class_id, uint32_t budget_ms);
+
+/**
+ * @brief run queued tasks on caller thread, cooperative dispatcher only
+ * @param handle
+ * @param max_tasks 0 means until no runnable task left
+ * @return number of tasks run, -1 if not cooperative; 0 when called from a running task
+ */
+int DispatcherRunOnce(DispatcherHandle handle, uint32_t max_tasks);
+
+/**
+ * @brief total queued tasks of all classes
+ * @param handle
+ * @return queued task count
+ */
+uint32_t DispatcherQueued(DispatcherHandle handle);
+
+/**
+ * @brief get queue depth and dispatch statistics
+ * @param handle
+ * @param stats
+ * @return void
+ */
+void DispatcherGetStats(DispatcherHandle handle, DispatcherStats *stats);
+
+#ifdef __cplusplus
+}
+#endif
+#endif  // UTILS_DISPATCHER_INC_UNI_DISPATCHER_H_
@@ -0,0 +1,571 @@
+/**************************************************************************
+ * Copyright (C) 2020-2020  Junlon2006
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ **************************************************************************
+ *
+ * Description : uni_dispatcher.c
+ * Author      : junlon2006@163.com
+ * Date        : 2020.08.13
+ *
+ **************************************************************************/
+#include "uni_dispatcher.h"
+#include "list_head.h"
+#include "porting.h"
+#include "errcode.h"
+#include "uni_log.h"
+
+#define TAG "dispatcher"
+
+/* DispatchItem recycled instead of malloc per task, keep at most this many */
+#define DISPATCH_ITEM_CACHE_MAX  (64)
+/* keyed tasks behind a running key are skipped, look this deep for a runnable one */
+#define DISPATCH_KEY_SCAN_MAX    (16)
+/* watchdog checks running tasks every budget / WATCHDOG_CHECK_DIV */
+#define WATCHDOG_CHECK_DIV       (2)
+#define WATCHDOG_CHECK_MIN_MS    (10)
+
+typedef struct {
+  list_head link;
+  uint64_t  seq;
+  uint32_t  key;
+  int       throttled; /* already counted in class throttled */
+  void      *task;
+} DispatchItem;
+
+typedef struct {
+  list_head  queue;
+  const char *name;
+  uint32_t   limit;
+  uint32_t   budget_ms;
+  uint32_t   queued;
+  uint32_t   queued_max;
+  uint32_t   running;
+  uint32_t   dispatched;
+  uint32_t   throttled;
+  uint32_t   overrun;
+  uint32_t   latency_max_ms;
+} DispatchClass;
+
+struct Dispatcher;
+
+typedef struct {
+  struct Dispatcher *dispatcher;
+  DispatchClass     *busy;      /* NULL when idle */
+  uint32_t          key;
+  int64_t           start_us;
+  int               reported;
+} DispatchWorker;
+
+typedef struct Dispatcher {
+  DispatchClass   classes[DISPATCHER_CLASS_MAX];
+  uint32_t        class_cnt;
+  DispatchWorker  *workers;
+  uint32_t        worker_cnt;
+  DispatchHandler handler;
+  uint64_t        seq;
+  list_head       free_items;
+  uint32_t        free_cnt;
+  uni_mutex_t     mutex;
+  uni_sem_t       sem_new_task;
+  uni_sem_t       sem_watchdog;
+  uni_sem_t       sem_thread_exit_sync;
+  int             watchdog_started;
+  int             is_running;
+  int             cooperative; /* no thread, tasks run by DispatcherRunOnce on caller thread */
+} Dispatcher;
+
+/* must be called with mutex locked */
+static DispatchItem* _item_alloc(Dispatcher *dispatcher) {
+  list_head *p = list_get_head(&dispatcher->free_items);
+  if (NULL == p) {
+    return (DispatchItem *)uni_malloc(sizeof(DispatchItem));
+  }
+
+  list_del(p);
+  dispatcher->free_cnt--;
+  return list_entry(p, DispatchItem, link);
+}
+
+/* must be called with mutex locked */
+static void _item_free(Dispatcher *dispatcher, DispatchItem *item) {
+  if (dispatcher->free_cnt >= DISPATCH_ITEM_CACHE_MAX) {
+    uni_free(item);
+    return;
+  }
+
+  list_add_tail(&item->link, &dispatcher->free_items);
+  dispatcher->free_cnt++;
+}
+
+static void _item_list_destroy(list_head *header) {
+  list_head *p, *n;
+  list_for_each_safe(p, n, header) {
+    list_del(p);
+    uni_free(list_entry(p, DispatchItem, link));
+  }
+}
+
+/* must be called with mutex locked */
+static int _key_running(Dispatcher *dispatcher, DispatchClass *c, uint32_t key) {
+  uint32_t i;
+  for (i = 0; i < dispatcher->worker_cnt; i++) {
+    if (dispatcher->workers[i].busy == c && dispatcher->workers[i].key == key) {
+      return 1;
+    }
+  }
+
+  return 0;
+}
+
+/* must be called with mutex locked, a task is counted once however often it is passed over */
+static void _throttle_mark(DispatchClass *c, DispatchItem *item) {
+  if (!item->throttled) {
+    item->throttled = 1;
+    c->throttled++;
+  }
+}
+
+/* must be called with mutex locked, first queued task whose key is not running */
+static DispatchItem* _runnable_item(Dispatcher *dispatcher, DispatchClass *c) {
+  DispatchItem *item;
+  list_head *p;
+  uint32_t scanned = 0;
+
+  list_for_each(p, &c->queue) {
+    item = list_entry(p, DispatchItem, link);
+    if (DISPATCHER_NO_KEY == item->key || !_key_running(dispatcher, c, item->key)) {
+      return item;
+    }
+
+    _throttle_mark(c, item);
+
+    if (++scanned >= DISPATCH_KEY_SCAN_MAX) break;
+  }
+
+  return NULL;
+}
+
+/* must be called with mutex locked, oldest runnable task among classes under limit */
+static DispatchItem* _pick_item(Dispatcher *dispatcher, DispatchClass **picked_class) {
+  DispatchItem *picked = NULL;
+  DispatchItem *item;
+  DispatchClass *c;
+  uint32_t i;
+
+  for (i = 0; i < dispatcher->class_cnt; i++) {
+    c = &dispatcher->classes[i];
+    if (0 == c->queued) continue;
+    /* at class limit the head task is the one kept waiting */
+    if (c->running >= c->limit) {
+      _throttle_mark(c, list_get_head_entry(&c->queue, DispatchItem, link));
+      continue;
+    }
+
+    if (NULL == (item = _runnable_item(dispatcher, c))) continue;
+
+    if (NULL == picked || item->seq < picked->seq) {
+      picked        = item;
+      *picked_class = c;
+    }
+  }
+
+  return picked;
+}
+
+/* must be called with mutex locked */
+static void _latency_check(DispatchWorker *worker, int64_t now_us, int done) {
+  DispatchClass *c = worker->busy;
+  uint32_t elapsed_ms = (uint32_t)((now_us - worker->start_us) / 1000);
+
+  if (done) {
+    c->latency_max_ms = uni_max(c->latency_max_ms, elapsed_ms);
+  }
+
+  if (0 == c->budget_ms || elapsed_ms <= c->budget_ms || worker->reported) {
+    return;
+  }
+
+  worker->reported = 1;
+  c->overrun++;
+  if (DISPATCHER_NO_KEY == worker->key) {
+    LOGW(TAG, "[%s] task %s over budget. elapsed=%ums, budget=%ums",
+         c->name, done ? "finished" : "still running", elapsed_ms, c->budget_ms);
+  } else {
+    LOGW(TAG, "[%s] task key=%u %s over budget. elapsed=%ums, budget=%ums",
+         c->name, worker->key, done ? "finished" : "still running", elapsed_ms, c->budget_ms);
+  }
+}
+
+static void _run_one_task(DispatchWorker *worker, DispatchClass *c, DispatchItem *item) {
+  Dispatcher *dispatcher = worker->dispatcher;
+  void *task = item->task;
+
+  list_del(&item->link);
+  c->queued--;
+  c->running++;
+  worker->busy     = c;
+  worker->key      = item->key;
+  worker->start_us = uni_get_clock_time_us();
+  worker->reported = 0;
+  _item_free(dispatcher, item);
+  uni_mutex_unlock(&dispatcher->mutex);
+
+  dispatcher->handler(task);
+
+  uni_mutex_lock(&dispatcher->mutex);
+  _latency_check(worker, uni_get_clock_time_us(), 1);
+  worker->busy = NULL;
+  c->running--;
+  c->dispatched++;
+}
+
+static void* _worker(void *args) {
+  DispatchWorker *worker = (DispatchWorker *)args;
+  Dispatcher *dispatcher = worker->dispatcher;
+  DispatchClass *c;
+  DispatchItem *item;
+
+  while (dispatcher->is_running) {
+    uni_mutex_lock(&dispatcher->mutex);
+    while (dispatcher->is_running && NULL != (item = _pick_item(dispatcher, &c))) {
+      _run_one_task(worker, c, item);
+    }
+    uni_mutex_unlock(&dispatcher->mutex);
+
+    /* task blocked by class limit or key is picked up by the worker which unblocks it */
+    uni_sem_wait(&dispatcher->sem_new_task, UNI_WAIT_FOREVER);
+  }
+
+  uni_sem_signal(&dispatcher->sem_thread_exit_sync);
+  return NULL;
+}
+
+/* must be called with mutex locked, UNI_WAIT_FOREVER when no budget set */
+static unsigned int _watchdog_interval(Dispatcher *dispatcher) {
+  unsigned int interval = UNI_WAIT_FOREVER;
+  uint32_t i, budget;
+
+  for (i = 0; i < dispatcher->class_cnt; i++) {
+    budget = dispatcher->classes[i].budget_ms;
+    if (0 == budget) continue;
+    interval = uni_min(interval, uni_max(budget / WATCHDOG_CHECK_DIV, WATCHDOG_CHECK_MIN_MS));
+  }
+
+  return interval;
+}
+
+static void* _watchdog(void *args) {
+  Dispatcher *dispatcher = (Dispatcher *)args;
+  unsigned int interval;
+  int64_t now_us;
+  uint32_t i;
+
+  while (dispatcher->is_running) {
+    uni_mutex_lock(&dispatcher->mutex);
+    now_us = uni_get_clock_time_us();
+    for (i = 0; i < dispatcher->worker_cnt; i++) {
+      if (NULL != dispatcher->workers[i].busy) {
+        _latency_check(&dispatcher->workers[i], now_us, 0);
+      }
+    }
+    interval = _watchdog_interval(dispatcher);
+    uni_mutex_unlock(&dispatcher->mutex);
+
+    /* woken up early when budget changed or dispatcher destroyed */
+    uni_sem_wait(&dispatcher->sem_watchdog, interval);
+  }
+
+  uni_sem_signal(&dispatcher->sem_thread_exit_sync);
+  return NULL;
+}
+
+static int _config_check(const DispatcherConfig *config) {
+  if (NULL == config ||
+      0 == config->class_cnt || config->class_cnt > DISPATCHER_CLASS_MAX) {
+    LOGE(TAG, "invalid config");
+    return -1;
+  }
+
+  return 0;
+}
+
+static void _classes_init(Dispatcher *dispatcher, const DispatcherConfig *config) {
+  DispatchClass *c;
+  uint32_t i;
+
+  dispatcher->class_cnt = config->class_cnt;
+  for (i = 0; i < config->class_cnt; i++) {
+    c = &dispatcher->classes[i];
+    list_init(&c->queue);
+    c->name      = config->classes[i].name ? config->classes[i].name : "";
+    c->budget_ms = config->classes[i].latency_budget_ms;
+    c->limit     = config->classes[i].max_concurrency;
+    if (0 == c->limit || c->limit > uni_max(config->worker_cnt, 1)) {
+      c->limit = uni_max(config->worker_cnt, 1);
+    }
+  }
+}
+
+/* single slot for the caller thread, overrun is reported when the task finishes */
+static int _cooperative_create(Dispatcher *dispatcher) {
+  dispatcher->workers = (DispatchWorker *)uni_calloc(1, sizeof(DispatchWorker));
+  if (NULL == dispatcher->workers) {
+    LOGE(TAG, OUT_MEM_STRING);
+    return -1;
+  }
+
+  dispatcher->workers[0].dispatcher = dispatcher;
+  dispatcher->worker_cnt  = 1;
+  dispatcher->cooperative = 1;
+  dispatcher->is_running  = 1;
+  return 0;
+}
+
+static int _workers_create(Dispatcher *dispatcher, const DispatcherConfig *config) {
+  uint32_t i;
+
+  if (0 == config->worker_cnt) {
+    return _cooperative_create(dispatcher);
+  }
+
+  dispatcher->workers = (DispatchWorker *)uni_calloc(config->worker_cnt, sizeof(DispatchWorker));
+  if (NULL == dispatcher->workers) {
+    LOGE(TAG, OUT_MEM_STRING);
+    return -1;
+  }
+
+  dispatcher->is_running = 1;
+  for (i = 0; i < config->worker_cnt; i++) {
+    dispatcher->workers[i].dispatcher = dispatcher;
+    if (OK != uni_thread_new(TAG, _worker, &dispatcher->workers[i], config->stack_size)) {
+      LOGE(TAG, "create worker failed");
+      break;
+    }
+  }
+
+  uni_mutex_lock(&dispatcher->mutex);
+  dispatcher->worker_cnt = i;
+  uni_mutex_unlock(&dispatcher->mutex);
+  if (0 == i) {
+    return -1;
+  }
+
+  if (OK != uni_thread_new(TAG, _watchdog, dispatcher, config->stack_size)) {
+    LOGW(TAG, "create watchdog failed, latency budget not checked");
+    return 0;
+  }
+
+  dispatcher->watchdog_started = 1;
+  return 0;
+}
+
+static void _workers_exit(Dispatcher *dispatcher) {
+  uint32_t i;
+
+  dispatcher->is_running = 0;
+  if (dispatcher->cooperative) {
+    return;
+  }
+
+  for (i = 0; i < dispatcher->worker_cnt; i++) {
+    uni_sem_signal(&dispatcher->sem_new_task);
+  }
+
+  for (i = 0; i < dispatcher->worker_cnt; i++) {
+    uni_sem_wait(&dispatcher->sem_thread_exit_sync, UNI_WAIT_FOREVER);
+  }
+
+  if (dispatcher->watchdog_started) {
+    uni_sem_signal(&dispatcher->sem_watchdog);
+    uni_sem_wait(&dispatcher->sem_thread_exit_sync, UNI_WAIT_FOREVER);
+  }
+}
+
+static void _destroy_all(Dispatcher *dispatcher) {
+  uint32_t i;
+
+  for (i = 0; i < dispatcher->class_cnt; i++) {
+    _item_list_destroy(&dispatcher->classes[i].queue);
+  }
+
+  _item_list_destroy(&dispatcher->free_items);
+  uni_mutex_free(&dispatcher->mutex);
+  uni_sem_free(&dispatcher->sem_new_task);
+  uni_sem_free(&dispatcher->sem_watchdog);
+  uni_sem_free(&dispatcher->sem_thread_exit_sync);
+  uni_free(dispatcher->workers);
+  uni_free(dispatcher);
+}
+
+DispatcherHandle DispatcherCreate(const DispatcherConfig *config, DispatchHandler handler) {
+  Dispatcher *dispatcher;
+
+  if (0 != _config_check(config) || NULL == handler) {
+    return NULL;
+  }
+
+  if (NULL == (dispatcher = (Dispatcher *)uni_calloc(1, sizeof(Dispatcher)))) {
+    LOGE(TAG, OUT_MEM_STRING);
+    return NULL;
+  }
+
+  list_init(&dispatcher->free_items);
+  _classes_init(dispatcher, config);
+  dispatcher->handler = handler;
+  uni_mutex_new(&dispatcher->mutex);
+  uni_sem_new(&dispatcher->sem_new_task, 0);
+  uni_sem_new(&dispatcher->sem_watchdog, 0);
+  uni_sem_new(&dispatcher->sem_thread_exit_sync, 0);
+
+  if (0 != _workers_create(dispatcher, config)) {
+    _destroy_all(dispatcher);
+    return NULL;
+  }
+
+  LOGT(TAG, "dispatcher created. workers=%u, classes=%u",
+       dispatcher->worker_cnt, dispatcher->class_cnt);
+  return dispatcher;
+}
+
+void DispatcherDestroy(DispatcherHandle handle) {
+  Dispatcher *dispatcher = (Dispatcher *)handle;
+  if (NULL == dispatcher) {
+    return;
+  }
+
+  _workers_exit(dispatcher);
+  _destroy_all(dispatcher);
+}
+
+int DispatcherSubmitKeyed(DispatcherHandle handle, uint32_t class_id, uint32_t key, void *task) {
+  Dispatcher *dispatcher = (Dispatcher *)handle;
+  DispatchItem *item;
+  DispatchClass *c;
+
+  if (NULL == dispatcher || class_id >= dispatcher->class_cnt) {
+    LOGE(TAG, "invalid param. class=%u", class_id);
+    return -1;
+  }
+
+  c = &dispatcher->classes[class_id];
+  uni_mutex_lock(&dispatcher->mutex);
+  if (NULL == (item = _item_alloc(dispatcher))) {
+    uni_mutex_unlock(&dispatcher->mutex);
+    LOGE(TAG, OUT_MEM_STRING);
+    return -1;
+  }
+
+  item->task      = task;
+  item->key       = key;
+  item->throttled = 0;
+  item->seq       = dispatcher->seq++;
+  list_add_tail(&item->link, &c->queue);
+  c->queued++;
+  c->queued_max = uni_max(c->queued_max, c->queued);
+  uni_mutex_unlock(&dispatcher->mutex);
+
+  if (!dispatcher->cooperative) {
+    uni_sem_signal(&dispatcher->sem_new_task);
+  }
+  return 0;
+}
+
+int DispatcherSubmit(DispatcherHandle handle, uint32_t class_id, void *task) {
+  return DispatcherSubmitKeyed(handle, class_id, DISPATCHER_NO_KEY, task);
+}
+
+int DispatcherSetLatencyBudget(DispatcherHandle handle, uint32_t class_id, uint32_t budget_ms) {
+  Dispatcher *dispatcher = (Dispatcher *)handle;
+
+  if (NULL == dispatcher || class_id >= dispatcher->class_cnt) {
+    LOGE(TAG, "invalid param. class=%u", class_id);
+    return -1;
+  }
+
+  uni_mutex_lock(&dispatcher->mutex);
+  dispatcher->classes[class_id].budget_ms = budget_ms;
+  uni_mutex_unlock(&dispatcher->mutex);
+
+  if (dispatcher->watchdog_started) {
+    uni_sem_signal(&dispatcher->sem_watchdog);
+  }
+  return 0;
+}
+
+int DispatcherRunOnce(DispatcherHandle handle, uint32_t max_tasks) {
+  Dispatcher *dispatcher = (Dispatcher *)handle;
+  DispatchWorker *worker;
+  DispatchClass *c;
+  DispatchItem *item;
+  int cnt = 0;
+
+  if (NULL == dispatcher || !dispatcher->cooperative) {
+    return -1;
+  }
+
+  worker = &dispatcher->workers[0];
+  uni_mutex_lock(&dispatcher->mutex);
+  /* nested call from a running task does nothing, tasks never interleave */
+  while (NULL == worker->busy && (0 == max_tasks || (uint32_t)cnt < max_tasks) &&
+         NULL != (item = _pick_item(dispatcher, &c))) {
+    _run_one_task(worker, c, item);
+    cnt++;
+  }
+  uni_mutex_unlock(&dispatcher->mutex);
+  return cnt;
+}
+
+uint32_t DispatcherQueued(DispatcherHandle handle) {
+  Dispatcher *dispatcher = (Dispatcher *)handle;
+  uint32_t i, queued = 0;
+
+  if (NULL == dispatcher) {
+    return 0;
+  }
+
+  uni_mutex_lock(&dispatcher->mutex);
+  for (i = 0; i < dispatcher->class_cnt; i++) {
+    queued += dispatcher->classes[i].queued;
+  }
+  uni_mutex_unlock(&dispatcher->mutex);
+  return queued;
+}
+
+void DispatcherGetStats(DispatcherHandle handle, DispatcherStats *stats) {
+  Dispatcher *dispatcher = (Dispatcher *)handle;
+  DispatchClass *c;
+  uint32_t i;
+
+  if (NULL == dispatcher || NULL == stats) {
+    return;
+  }
+
+  uni_memset(stats, 0, sizeof(DispatcherStats));
+  uni_mutex_lock(&dispatcher->mutex);
+  stats->worker_cnt = dispatcher->cooperative ? 0 : dispatcher->worker_cnt;
+  stats->class_cnt  = dispatcher->class_cnt;
+  for (i = 0; i < dispatcher->class_cnt; i++) {
+    c = &dispatcher->classes[i];
+    stats->queued[i]         = c->queued;
+    stats->queued_max[i]     = c->queued_max;
+    stats->running[i]        = c->running;
+    stats->dispatched[i]     = c->dispatched;
+    stats->throttled[i]      = c->throttled;
+    stats->overrun[i]        = c->overrun;
+    stats->latency_max_ms[i] = c->latency_max_ms;
+  }
+  uni_mutex_unlock(&dispatcher->mutex);
+}
@@ -34,6 +34,9 @@
 
 #define TAG "event_list"
 
+/* EventListItem recycled instead of malloc per event, keep at most this many */
+#define EVENT_ITEM_CACHE_MAX               (64)
+
 typedef int (*_interruptable_handler)(void *args);
 
 typedef struct {
@@ -53,13 +56,48 @@ typedef struct {
   _interruptable_handler highest_interrupt_handler;
   _interruptable_handler medium_interrupt_handler;
   _interruptable_handler lowest_interrupt_handler;
+  list_head              free_items;
+  int                    free_cnt;
   uni_mutex_t            mutex;
   uni_sem_t              sem_new_event;
   uni_sem_t              sem_thread_exit_sync;
   int                    is_running;
 } EventList;
 
-static inline void _consume_one_list(list_head *header,
+/* must be called with mutex locked */
+static EventListItem* _item_alloc(EventList *event_list) {
+  list_head *p = list_get_head(&event_list->free_items);
+  if (NULL == p) {
+    return (EventListItem *)uni_malloc(sizeof(EventListItem));
+  }
+
+  list_del(p);
+  event_list->free_cnt--;
+  return list_entry(p, EventListItem, link);
+}
+
+/* must be called with mutex locked */
+static void _item_free(EventList *event_list, EventListItem *item) {
+  if (event_list->free_cnt >= EVENT_ITEM_CACHE_MAX) {
+    uni_free(item);
+    return;
+  }
+
+  list_add_tail(&item->link, &event_list->free_items);
+  event_list->free_cnt++;
+}
+
+static void _item_cache_destroy(EventList *event_list) {
+  list_head *p, *n;
+  list_for_each_safe(p, n, &event_list->free_items) {
+    list_del(p);
+    uni_free(list_entry(p, EventListItem, link));
+  }
+  event_list->free_cnt = 0;
+}
+
+static inline void _consume_one_list(EventList *event_list,
+                                     list_head *header,
                                      EventHandler event_handler,
                                      _interruptable_handler interrupt,
                                      void *interrupt_args,
@@ -68,6 +106,7 @@ static inline void _consume_one_list(list_head *header,
                                      int *is_running) {
   list_head *p;
   EventListItem *item;
+  void *event;
   do {
     uni_mutex_lock(mutex);
     if (NULL != interrupt && interrupt(interrupt_args)) {
@@ -81,11 +120,12 @@ static inline void _consume_one_list(list_head *header,
     item = list_entry(p, EventListItem, link);
     list_del(&item->link);
     *total_cnt = *total_cnt - 1;
+    event = item->event;
+    _item_free(event_list, item);
     uni_mutex_unlock(mutex);
     if (NULL != event_handler && *is_running) {
-      event_handler(item->event);
+      event_handler(event);
     }
-    uni_free(item);
   } while (p != NULL);
 }
 
@@ -104,15 +144,18 @@ static int _lowest_interruptable_handler(void *args) {
 }
 
 static void _consume_event_list(EventList *event_list) {
-  _consume_highest_list(&event_list->highest_list, event_list->event_handler,
+  _consume_highest_list(event_list, &event_list->highest_list,
+                        event_list->event_handler,
                         event_list->highest_interrupt_handler, event_list,
                         &event_list->mutex,
                         &event_list->highest_cnt, &event_list->is_running);
-  _consume_medium_list(&event_list->medium_list, event_list->event_handler,
+  _consume_medium_list(event_list, &event_list->medium_list,
+                       event_list->event_handler,
                        event_list->medium_interrupt_handler, event_list,
                        &event_list->mutex,
                        &event_list->medium_cnt, &event_list->is_running);
-  _consume_lowest_list(&event_list->lowest_list, event_list->event_handler,
+  _consume_lowest_list(event_list, &event_list->lowest_list,
+                       event_list->event_handler,
                        event_list->lowest_interrupt_handler, event_list,
                        &event_list->mutex,
                        &event_list->lowest_cnt, &event_list->is_running);
@@ -132,6 +175,7 @@ static void _destroy_all(EventList *event_list) {
   _reset_event_handler(event_list);
   _reset_interrupt_handler(event_list);
   _consume_event_list(event_list);
+  _item_cache_destroy(event_list);
   uni_mutex_free(&event_list->mutex);
   uni_sem_free(&event_list->sem_new_event);
   uni_sem_free(&event_list->sem_thread_exit_sync);
@@ -177,6 +221,7 @@ static void _list_init(EventList *event_list) {
   list_init(&event_list->highest_list);
   list_init(&event_list->medium_list);
   list_init(&event_list->lowest_list);
+  list_init(&event_list->free_items);
 }
 
 static void _register_event_handler(EventList *event_list,
@@ -230,14 +275,15 @@ int EventListDestroy(EventListHandle handle) {
 int EventListAdd(EventListHandle handle, void *event, int priority) {
   EventListItem *item = NULL;
   EventList *event_list = (EventList *)handle;
-  if (NULL == (item = (EventListItem *)uni_malloc(sizeof(EventListItem)))) {
+  uni_mutex_lock(&event_list->mutex);
+  if (NULL == (item = _item_alloc(event_list))) {
+    uni_mutex_unlock(&event_list->mutex);
     LOGE(TAG, "alloc memory failed");
     return -1;
   }
 
   item->priority = priority;
   item->event    = event;
-  uni_mutex_lock(&event_list->mutex);
   if (EVENT_LIST_PRIORITY_HIGHEST == priority) {
     list_add_tail(&item->link, &event_list->highest_list);
     event_list->highest_cnt++;
@@ -255,13 +301,13 @@ int EventListAdd(EventListHandle handle, void *event, int priority) {
 
 int EventListClear(EventListHandle handle) {
   EventList *event_list = (EventList *)handle;
-  _consume_highest_list(&event_list->highest_list, NULL, NULL, NULL,
+  _consume_highest_list(event_list, &event_list->highest_list, NULL, NULL, NULL,
                         &event_list->mutex, &event_list->highest_cnt,
                         &event_list->is_running);
-  _consume_medium_list(&event_list->medium_list, NULL, NULL, NULL,
+  _consume_medium_list(event_list, &event_list->medium_list, NULL, NULL, NULL,
                        &event_list->mutex, &event_list->medium_cnt,
                        &event_list->is_running);
-  _consume_lowest_list(&event_list->lowest_list, NULL, NULL, NULL,
+  _consume_lowest_list(event_list, &event_list->lowest_list, NULL, NULL, NULL,
                        &event_list->mutex, &event_list->lowest_cnt,
                        &event_list->is_running);
   return 0;
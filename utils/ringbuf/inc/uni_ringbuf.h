@@ -38,6 +38,7 @@ int RingBufferGetFreeSize(RingBufferHandle handle);
 int RingBufferGetDataSize(RingBufferHandle handle);
 int RingBufferWrite(RingBufferHandle handle, char *src, int writelen);
 int RingBufferRead(char *dst, int readlen, RingBufferHandle handle);
+int RingBufferSkip(int skiplen, RingBufferHandle handle);
 
 #ifdef __cplusplus
 }
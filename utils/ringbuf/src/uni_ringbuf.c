@@ -182,4 +182,8 @@ int RingBufferWrite(RingBufferHandle handle, char *src, int writelen) {
 int RingBufferRead(char *dst, int readlen, RingBufferHandle handle) {
   return _ring_buffer_read(dst, readlen, handle,
                            RINGBBUF_ATTR_READ | RINGBBUF_ATTR_SYNC);
+}
+
+int RingBufferSkip(int skiplen, RingBufferHandle handle) {
+  return _ring_buffer_read(NULL, skiplen, handle, RINGBBUF_ATTR_SYNC);
 }
\ No newline at end of file
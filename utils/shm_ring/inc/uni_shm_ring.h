@@ -0,0 +1,183 @@
+/**************************************************************************
+ * Copyright (C) 2020-2020  Junlon2006
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ **************************************************************************
+ *
+ * Description : uni_shm_ring.h
+ * Author      : junlon2006@163.com
+ * Date        : 2020.09.05
+ *
+ **************************************************************************/
+#ifndef UTILS_SHM_RING_INC_UNI_SHM_RING_H_
+#define UTILS_SHM_RING_INC_UNI_SHM_RING_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+/*
+ * Single producer single consumer byte ring in a memfd, shared between two
+ * processes. The producer creates it and passes the fd, e.g. by SCM_RIGHTS,
+ * the consumer opens it. Data pages are mapped twice back to back, so free
+ * space and pending data are always one contiguous span, both sides read and
+ * write the ring in place.
+ *
+ * The headroom bytes right before the consumer's read pointer belong to the
+ * consumer, the producer never writes there. A consumer sending data framed
+ * in place, e.g. by CommProtocolPacketSendInPlace, builds the frame header
+ * there without copying the payload.
+ *
+ * Waiting is by futex on the shared mapping, no syscall while the other side
+ * is not waiting.
+ */
+
+typedef void* ShmRingHandle;
+
+typedef struct {
+  uint64_t written;         /* bytes committed by producer */
+  uint64_t read;            /* bytes released by consumer */
+  uint32_t producer_waits;  /* producer slept, ring full */
+  uint32_t consumer_waits;  /* consumer slept, ring empty */
+} ShmRingStats;
+
+/**
+ * @brief producer side, create memfd backed ring
+ * @param size data bytes, rounded up to page size
+ * @param headroom bytes reserved for consumer before read pointer, less than size
+ * @return handle, NULL if failed
+ */
+ShmRingHandle ShmRingCreate(uint32_t size, uint32_t headroom);
+
+/**
+ * @brief consumer side, map ring created by ShmRingCreate in another process
+ * @param fd memfd of ring, not closed, can be closed after return
+ * @return handle, NULL if failed, not a ring, or size not sealed by ShmRingCreate
+ */
+ShmRingHandle ShmRingOpen(int fd);
+
+/**
+ * @brief unmap ring, memfd of creator closed, memory freed when both sides closed
+ * @param handle
+ * @return void
+ */
+void ShmRingClose(ShmRingHandle handle);
+
+/**
+ * @brief memfd to pass to consumer, -1 for opened rings
+ * @param handle
+ * @return fd
+ */
+int ShmRingFd(ShmRingHandle handle);
+
+/**
+ * @brief consumer headroom the ring was created with
+ * @param handle
+ * @return bytes
+ */
+uint32_t ShmRingHeadroom(ShmRingHandle handle);
+
+/**
+ * @brief producer, get contiguous free space, waits until some is free
+ * @param handle
+ * @param len free bytes at returned pointer
+ * @param timeout_msec 0 never wait
+ * @return write pointer, NULL timeout or consumer done
+ */
+char* ShmRingWriteBegin(ShmRingHandle handle, uint32_t *len, uint32_t timeout_msec);
+
+/**
+ * @brief producer, publish len bytes written at pointer of ShmRingWriteBegin
+ * @param handle
+ * @param len
+ * @return void
+ */
+void ShmRingWriteEnd(ShmRingHandle handle, uint32_t len);
+
+/**
+ * @brief producer, copy buf into ring, waits for free space
+ * @param handle
+ * @param buf
+ * @param len
+ * @param timeout_msec max time waiting for free space each time
+ * @return bytes written, less than len on timeout or consumer done
+ */
+uint32_t ShmRingWrite(ShmRingHandle handle, const void *buf, uint32_t len,
+                      uint32_t timeout_msec);
+
+/**
+ * @brief producer, end of stream, consumer drains what is left
+ * @param handle
+ * @return void
+ */
+void ShmRingFinish(ShmRingHandle handle);
+
+/**
+ * @brief producer, wait until consumer called ShmRingDone
+ * @param handle
+ * @param timeout_msec
+ * @return result passed to ShmRingDone, -1 timeout
+ */
+int ShmRingDrain(ShmRingHandle handle, uint32_t timeout_msec);
+
+/**
+ * @brief consumer, get all pending data as one span, waits until there is enough
+ * @param handle
+ * @param len pending bytes at returned pointer
+ * @param min_len wait until this many bytes pending or stream finished, 0 taken as 1
+ * @param timeout_msec 0 never wait
+ * @return read pointer, headroom bytes before it writable. NULL timeout, or end of
+ *         stream when ShmRingIsFinished and nothing pending
+ */
+char* ShmRingReadBegin(ShmRingHandle handle, uint32_t *len, uint32_t min_len,
+                       uint32_t timeout_msec);
+
+/**
+ * @brief consumer, release len bytes from read pointer back to producer
+ * @param handle
+ * @param len
+ * @return void
+ */
+void ShmRingReadEnd(ShmRingHandle handle, uint32_t len);
+
+/**
+ * @brief consumer, stream consumed or abandoned, wakes ShmRingDrain, producer writes fail
+ * @param handle
+ * @param result passed to ShmRingDrain, 0 success
+ * @return void
+ */
+void ShmRingDone(ShmRingHandle handle, int result);
+
+/**
+ * @brief producer finished, pending data still readable
+ * @param handle
+ * @return 1 finished
+ */
+int ShmRingIsFinished(ShmRingHandle handle);
+
+/**
+ * @brief get byte and wait counters, shared by both sides
+ * @param handle
+ * @param stats
+ * @return void
+ */
+void ShmRingGetStats(ShmRingHandle handle, ShmRingStats *stats);
+
+#ifdef __cplusplus
+}
+#endif
+#endif  // UTILS_SHM_RING_INC_UNI_SHM_RING_H_
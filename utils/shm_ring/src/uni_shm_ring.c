@@ -0,0 +1,422 @@
+/**************************************************************************
+ * Copyright (C) 2020-2020  Junlon2006
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ **************************************************************************
+ *
+ * Description : uni_shm_ring.c
+ * Author      : junlon2006@163.com
+ * Date        : 2020.09.05
+ *
+ **************************************************************************/
+#define _GNU_SOURCE  /* memfd_create, F_ADD_SEALS */
+#include "uni_shm_ring.h"
+#include "porting.h"
+#include "uni_log.h"
+
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <unistd.h>
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+
+#define TAG "shm_ring"
+
+#define SHM_RING_MAGIC     (0x474e5253u)  /* "SRNG" */
+#define SHM_RING_VERSION   (1)
+#define SHM_RING_FINISHED  (1 << 0)
+#define SHM_RING_DONE      (1 << 1)
+#define SHM_RING_CACHELINE (64)
+#define SHM_RING_SEALS     (F_SEAL_SHRINK | F_SEAL_GROW)
+
+/*
+ * first page of memfd, data pages follow. head and tail run free and wrap at
+ * 2^32, ring position is modulo size. each side waits on its own seq word,
+ * the other side bumps it after every change and wakes only if waiting set
+ */
+typedef struct {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t size;
+  uint32_t headroom;
+  uint32_t state;
+  int32_t  result;
+  uint32_t producer_waits;
+  uint32_t consumer_waits;
+  uint64_t written;
+  uint64_t read;
+  uint32_t head __attribute__ ((aligned(SHM_RING_CACHELINE)));
+  uint32_t consumer_seq;
+  uint32_t consumer_waiting;
+  uint32_t tail __attribute__ ((aligned(SHM_RING_CACHELINE)));
+  uint32_t producer_seq;
+  uint32_t producer_waiting;
+} ShmRingCtrl;
+
+typedef struct {
+  ShmRingCtrl *ctrl;
+  char        *data;      /* size bytes mapped twice back to back */
+  uint32_t    size;       /* local copies, never trust the peer's page */
+  uint32_t    headroom;
+  uint32_t    page;
+  uint32_t    min_len;    /* consumer waits for this many bytes */
+  int         fd;         /* creator only */
+} ShmRing;
+
+typedef int (*ShmRingReady)(ShmRing *ring);
+
+static void _futex_wait(uint32_t *addr, uint32_t value, int64_t timeout_msec) {
+  struct timespec ts;
+  ts.tv_sec  = timeout_msec / 1000;
+  ts.tv_nsec = (timeout_msec % 1000) * 1000000;
+  syscall(SYS_futex, addr, FUTEX_WAIT, value, &ts, NULL, 0);
+}
+
+static void _futex_wake(uint32_t *addr) {
+  syscall(SYS_futex, addr, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+}
+
+static void _notify(uint32_t *seq, uint32_t *waiting) {
+  __atomic_add_fetch(seq, 1, __ATOMIC_SEQ_CST);
+  if (__atomic_load_n(waiting, __ATOMIC_SEQ_CST)) {
+    _futex_wake(seq);
+  }
+}
+
+/* seq loaded after waiting set and before ready checked, a later change wakes us */
+static int _wait_ready(ShmRing *ring, uint32_t *seq, uint32_t *waiting, uint32_t *waits,
+                       ShmRingReady ready, uint32_t timeout_msec) {
+  int64_t deadline = uni_get_clock_time_ms() + timeout_msec;
+  int64_t left;
+  uint32_t value;
+
+  while (!ready(ring)) {
+    if ((left = deadline - uni_get_clock_time_ms()) <= 0) {
+      return 0;
+    }
+
+    __atomic_store_n(waiting, 1, __ATOMIC_SEQ_CST);
+    value = __atomic_load_n(seq, __ATOMIC_SEQ_CST);
+    if (!ready(ring)) {
+      __atomic_add_fetch(waits, 1, __ATOMIC_RELAXED);
+      _futex_wait(seq, value, left);
+    }
+    __atomic_store_n(waiting, 0, __ATOMIC_SEQ_CST);
+  }
+
+  return 1;
+}
+
+static uint32_t _state(ShmRing *ring) {
+  return __atomic_load_n(&ring->ctrl->state, __ATOMIC_ACQUIRE);
+}
+
+static uint32_t _pending(ShmRing *ring) {
+  return __atomic_load_n(&ring->ctrl->head, __ATOMIC_ACQUIRE) -
+         __atomic_load_n(&ring->ctrl->tail, __ATOMIC_ACQUIRE);
+}
+
+/* headroom before tail is the consumer's, producer stops short of it */
+static uint32_t _free(ShmRing *ring) {
+  uint32_t pending = _pending(ring);
+  return pending >= ring->size - ring->headroom ? 0 : ring->size - ring->headroom - pending;
+}
+
+static int _writable(ShmRing *ring) {
+  return _free(ring) > 0 || (_state(ring) & SHM_RING_DONE);
+}
+
+static int _readable(ShmRing *ring) {
+  return _pending(ring) >= ring->min_len || (_state(ring) & SHM_RING_FINISHED);
+}
+
+static int _done(ShmRing *ring) {
+  return _state(ring) & SHM_RING_DONE;
+}
+
+static int _data_map(ShmRing *ring) {
+  char *base = (char *)mmap(NULL, (size_t)ring->size * 2, PROT_NONE,
+                            MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (MAP_FAILED == base) {
+    return -1;
+  }
+
+  if (MAP_FAILED == mmap(base, ring->size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED,
+                         ring->fd, ring->page) ||
+      MAP_FAILED == mmap(base + ring->size, ring->size, PROT_READ | PROT_WRITE,
+                         MAP_SHARED | MAP_FIXED, ring->fd, ring->page)) {
+    munmap(base, (size_t)ring->size * 2);
+    return -1;
+  }
+
+  ring->data = base;
+  return 0;
+}
+
+static ShmRing* _ring_alloc() {
+  ShmRing *ring = (ShmRing *)uni_calloc(1, sizeof(ShmRing));
+  if (NULL == ring) {
+    LOGE(TAG, OUT_MEM_STRING);
+    return NULL;
+  }
+
+  ring->fd   = -1;
+  ring->page = (uint32_t)sysconf(_SC_PAGESIZE);
+  ring->ctrl = (ShmRingCtrl *)MAP_FAILED;
+  return ring;
+}
+
+static void _ring_free(ShmRing *ring, int owns_fd) {
+  if (NULL != ring->data) {
+    munmap(ring->data, (size_t)ring->size * 2);
+  }
+
+  if (MAP_FAILED != (void *)ring->ctrl) {
+    munmap(ring->ctrl, ring->page);
+  }
+
+  if (owns_fd && ring->fd >= 0) {
+    close(ring->fd);
+  }
+
+  uni_free(ring);
+}
+
+ShmRingHandle ShmRingCreate(uint32_t size, uint32_t headroom) {
+  ShmRing *ring = _ring_alloc();
+  if (NULL == ring) {
+    return NULL;
+  }
+
+  ring->size     = (size + ring->page - 1) / ring->page * ring->page;
+  ring->headroom = headroom;
+  if (0 == ring->size || ring->size > (1u << 30) || headroom >= ring->size) {
+    LOGE(TAG, "invalid size=%u headroom=%u", size, headroom);
+    goto L_ERROR;
+  }
+
+  /* size sealed, a peer shrinking the memfd would SIGBUS the other side's mapping */
+  ring->fd = memfd_create("shm_ring", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+  if (ring->fd < 0 || 0 != ftruncate(ring->fd, (off_t)ring->page + ring->size) ||
+      0 != fcntl(ring->fd, F_ADD_SEALS, SHM_RING_SEALS)) {
+    LOGE(TAG, "create memfd failed[%s]", strerror(errno));
+    goto L_ERROR;
+  }
+
+  ring->ctrl = (ShmRingCtrl *)mmap(NULL, ring->page, PROT_READ | PROT_WRITE, MAP_SHARED,
+                                   ring->fd, 0);
+  if (MAP_FAILED == (void *)ring->ctrl || 0 != _data_map(ring)) {
+    LOGE(TAG, "mmap ring failed[%s]", strerror(errno));
+    goto L_ERROR;
+  }
+
+  /* memfd comes zero filled, positions and state start at 0 */
+  ring->ctrl->version  = SHM_RING_VERSION;
+  ring->ctrl->size     = ring->size;
+  ring->ctrl->headroom = headroom;
+  __atomic_store_n(&ring->ctrl->magic, SHM_RING_MAGIC, __ATOMIC_RELEASE);
+  return ring;
+
+L_ERROR:
+  _ring_free(ring, 1);
+  return NULL;
+}
+
+ShmRingHandle ShmRingOpen(int fd) {
+  ShmRing *ring = _ring_alloc();
+  struct stat st;
+  int seals;
+
+  if (NULL == ring) {
+    return NULL;
+  }
+
+  ring->fd = fd;
+  seals = fcntl(fd, F_GET_SEALS);
+  if (seals < 0 || SHM_RING_SEALS != (seals & SHM_RING_SEALS)) {
+    LOGE(TAG, "refuse unsealed ring fd=%d", fd);
+    goto L_ERROR;
+  }
+
+  if (0 != fstat(fd, &st) || st.st_size < (off_t)ring->page) {
+    LOGE(TAG, "not a ring fd=%d", fd);
+    goto L_ERROR;
+  }
+
+  ring->ctrl = (ShmRingCtrl *)mmap(NULL, ring->page, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (MAP_FAILED == (void *)ring->ctrl) {
+    LOGE(TAG, "mmap ring failed[%s]", strerror(errno));
+    goto L_ERROR;
+  }
+
+  ring->size     = ring->ctrl->size;
+  ring->headroom = ring->ctrl->headroom;
+  if (SHM_RING_MAGIC != __atomic_load_n(&ring->ctrl->magic, __ATOMIC_ACQUIRE) ||
+      SHM_RING_VERSION != ring->ctrl->version || 0 == ring->size ||
+      0 != ring->size % ring->page || ring->size > (1u << 30) ||
+      ring->headroom >= ring->size || st.st_size < (off_t)ring->page + ring->size) {
+    LOGE(TAG, "invalid ring size=%u headroom=%u", ring->size, ring->headroom);
+    goto L_ERROR;
+  }
+
+  if (0 != _data_map(ring)) {
+    LOGE(TAG, "mmap ring failed[%s]", strerror(errno));
+    goto L_ERROR;
+  }
+
+  ring->fd = -1;
+  return ring;
+
+L_ERROR:
+  _ring_free(ring, 0);
+  return NULL;
+}
+
+void ShmRingClose(ShmRingHandle handle) {
+  if (NULL != handle) {
+    _ring_free((ShmRing *)handle, 1);
+  }
+}
+
+int ShmRingFd(ShmRingHandle handle) {
+  return ((ShmRing *)handle)->fd;
+}
+
+uint32_t ShmRingHeadroom(ShmRingHandle handle) {
+  return ((ShmRing *)handle)->headroom;
+}
+
+char* ShmRingWriteBegin(ShmRingHandle handle, uint32_t *len, uint32_t timeout_msec) {
+  ShmRing *ring = (ShmRing *)handle;
+  ShmRingCtrl *ctrl = ring->ctrl;
+
+  *len = 0;
+  if (!_wait_ready(ring, &ctrl->producer_seq, &ctrl->producer_waiting, &ctrl->producer_waits,
+                   _writable, timeout_msec) || _done(ring)) {
+    return NULL;
+  }
+
+  /* mirror mapping, free space never wraps */
+  *len = _free(ring);
+  return ring->data + ctrl->head % ring->size;
+}
+
+void ShmRingWriteEnd(ShmRingHandle handle, uint32_t len) {
+  ShmRing *ring = (ShmRing *)handle;
+  ShmRingCtrl *ctrl = ring->ctrl;
+
+  __atomic_store_n(&ctrl->head, ctrl->head + len, __ATOMIC_RELEASE);
+  __atomic_add_fetch(&ctrl->written, len, __ATOMIC_RELAXED);
+  _notify(&ctrl->consumer_seq, &ctrl->consumer_waiting);
+}
+
+uint32_t ShmRingWrite(ShmRingHandle handle, const void *buf, uint32_t len,
+                      uint32_t timeout_msec) {
+  uint32_t done = 0, room;
+  char *p;
+
+  while (done < len) {
+    if (NULL == (p = ShmRingWriteBegin(handle, &room, timeout_msec))) {
+      break;
+    }
+
+    room = uni_min(room, len - done);
+    memcpy(p, (const char *)buf + done, room);
+    ShmRingWriteEnd(handle, room);
+    done += room;
+  }
+
+  return done;
+}
+
+void ShmRingFinish(ShmRingHandle handle) {
+  ShmRingCtrl *ctrl = ((ShmRing *)handle)->ctrl;
+  __atomic_or_fetch(&ctrl->state, SHM_RING_FINISHED, __ATOMIC_RELEASE);
+  _notify(&ctrl->consumer_seq, &ctrl->consumer_waiting);
+}
+
+int ShmRingDrain(ShmRingHandle handle, uint32_t timeout_msec) {
+  ShmRing *ring = (ShmRing *)handle;
+  ShmRingCtrl *ctrl = ring->ctrl;
+
+  if (!_wait_ready(ring, &ctrl->producer_seq, &ctrl->producer_waiting, &ctrl->producer_waits,
+                   _done, timeout_msec)) {
+    return -1;
+  }
+
+  return ctrl->result;
+}
+
+char* ShmRingReadBegin(ShmRingHandle handle, uint32_t *len, uint32_t min_len,
+                       uint32_t timeout_msec) {
+  ShmRing *ring = (ShmRing *)handle;
+  ShmRingCtrl *ctrl = ring->ctrl;
+  uint32_t tail, pending;
+
+  *len = 0;
+  ring->min_len = uni_max(uni_min(min_len, ring->size - ring->headroom), 1);
+  if (!_wait_ready(ring, &ctrl->consumer_seq, &ctrl->consumer_waiting, &ctrl->consumer_waits,
+                   _readable, timeout_msec)) {
+    return NULL;
+  }
+
+  tail    = ctrl->tail;
+  pending = __atomic_load_n(&ctrl->head, __ATOMIC_ACQUIRE) - tail;
+  if (pending > ring->size - ring->headroom) {
+    LOGE(TAG, "corrupt ring, pending=%u size=%u", pending, ring->size);
+    return NULL;
+  }
+
+  if (0 == pending) {
+    return NULL;
+  }
+
+  /* read pointer in second view when headroom would start before the first */
+  tail %= ring->size;
+  *len = pending;
+  return ring->data + tail + (tail < ring->headroom ? ring->size : 0);
+}
+
+void ShmRingReadEnd(ShmRingHandle handle, uint32_t len) {
+  ShmRing *ring = (ShmRing *)handle;
+  ShmRingCtrl *ctrl = ring->ctrl;
+
+  __atomic_store_n(&ctrl->tail, ctrl->tail + len, __ATOMIC_RELEASE);
+  __atomic_add_fetch(&ctrl->read, len, __ATOMIC_RELAXED);
+  _notify(&ctrl->producer_seq, &ctrl->producer_waiting);
+}
+
+void ShmRingDone(ShmRingHandle handle, int result) {
+  ShmRingCtrl *ctrl = ((ShmRing *)handle)->ctrl;
+  ctrl->result = result;
+  __atomic_or_fetch(&ctrl->state, SHM_RING_DONE, __ATOMIC_RELEASE);
+  _notify(&ctrl->producer_seq, &ctrl->producer_waiting);
+}
+
+int ShmRingIsFinished(ShmRingHandle handle) {
+  return 0 != (_state((ShmRing *)handle) & SHM_RING_FINISHED);
+}
+
+void ShmRingGetStats(ShmRingHandle handle, ShmRingStats *stats) {
+  ShmRingCtrl *ctrl = ((ShmRing *)handle)->ctrl;
+  stats->written        = __atomic_load_n(&ctrl->written, __ATOMIC_RELAXED);
+  stats->read           = __atomic_load_n(&ctrl->read, __ATOMIC_RELAXED);
+  stats->producer_waits = __atomic_load_n(&ctrl->producer_waits, __ATOMIC_RELAXED);
+  stats->consumer_waits = __atomic_load_n(&ctrl->consumer_waits, __ATOMIC_RELAXED);
+}